@@ -7,6 +7,7 @@
 
 #include <iostream>             // for debugging
 #include "code_generator.h"
+#include "peephole_optimizer.h"
 #include <unordered_set>
 
 using namespace std;
@@ -22,12 +23,149 @@ void replace_all(string& s, const string& old_str, const string& new_str)
 }
 
 
+// helper function to name a data type (e.g., "array int") for the VM
+static string type_name(const DataType& type)
+{
+  return (type.is_array ? "array " : "") + type.type_name;
+}
+
+
 CodeGenerator::CodeGenerator(VM& vm)
   : vm(vm)
 {
 }
 
 
+CodeGenerator::CodeGenerator(VM& vm, const OperandTypes& operand_types)
+  : vm(vm), operand_types(&operand_types)
+{
+}
+
+
+void CodeGenerator::set_optimization_level(int level)
+{
+  optimization_level = level;
+}
+
+
+void CodeGenerator::pop_unused_value(const shared_ptr<Stmt>& stmt)
+{
+  // a call used as a statement leaves its result on the operand stack
+  // (void functions return null), except for print
+  CallExpr* call = dynamic_cast<CallExpr*>(stmt.get());
+  if (call and call->fun_name.lexeme() != "print")
+    curr_frame.instructions.push_back(VMInstr::POP());
+}
+
+
+VMInstr CodeGenerator::binary_instr(Expr& e) const
+{
+  string op = e.op.value().lexeme();
+  // operand type suffix: 'I' (int), 'D' (double), 'S' (string or char,
+  // which are both strings at runtime), or none if unknown
+  char t = ' ';
+  if (operand_types) {
+    auto entry = operand_types->find(&e);
+    if (entry != operand_types->end() and !entry->second.is_array) {
+      string type_name = entry->second.type_name;
+      if (type_name == "int")
+        t = 'I';
+      else if (type_name == "double")
+        t = 'D';
+      else if (type_name == "string" or type_name == "char")
+        t = 'S';
+    }
+  }
+  if (op == "+")
+    return t == 'I' ? VMInstr::ADDI() : t == 'D' ? VMInstr::ADDD() :
+      VMInstr::ADD();
+  else if (op == "-")
+    return t == 'I' ? VMInstr::SUBI() : t == 'D' ? VMInstr::SUBD() :
+      VMInstr::SUB();
+  else if (op == "*")
+    return t == 'I' ? VMInstr::MULI() : t == 'D' ? VMInstr::MULD() :
+      VMInstr::MUL();
+  else if (op == "/")
+    return t == 'I' ? VMInstr::DIVI() : t == 'D' ? VMInstr::DIVD() :
+      VMInstr::DIV();
+  else if (op == "==")
+    return t == 'I' ? VMInstr::CMPEQI() : t == 'D' ? VMInstr::CMPEQD() :
+      t == 'S' ? VMInstr::CMPEQS() : VMInstr::CMPEQ();
+  else if (op == "!=")
+    return t == 'I' ? VMInstr::CMPNEI() : t == 'D' ? VMInstr::CMPNED() :
+      t == 'S' ? VMInstr::CMPNES() : VMInstr::CMPNE();
+  else if (op == "<")
+    return t == 'I' ? VMInstr::CMPLTI() : t == 'D' ? VMInstr::CMPLTD() :
+      t == 'S' ? VMInstr::CMPLTS() : VMInstr::CMPLT();
+  else if (op == "<=")
+    return t == 'I' ? VMInstr::CMPLEI() : t == 'D' ? VMInstr::CMPLED() :
+      t == 'S' ? VMInstr::CMPLES() : VMInstr::CMPLE();
+  else if (op == ">")
+    return t == 'I' ? VMInstr::CMPGTI() : t == 'D' ? VMInstr::CMPGTD() :
+      t == 'S' ? VMInstr::CMPGTS() : VMInstr::CMPGT();
+  else if (op == ">=")
+    return t == 'I' ? VMInstr::CMPGEI() : t == 'D' ? VMInstr::CMPGED() :
+      t == 'S' ? VMInstr::CMPGES() : VMInstr::CMPGE();
+  else if (op == "and")
+    return VMInstr::AND();
+  else
+    return VMInstr::OR();
+}
+
+
+string CodeGenerator::field_operand(const DataType& type,
+                                    const Token& field) const
+{
+  return type.type_name + "." + field.lexeme();
+}
+
+
+DataType CodeGenerator::field_type(const DataType& type,
+                                   const Token& field) const
+{
+  if (struct_defs.contains(type.type_name))
+    for (const VarDef& field_def : struct_defs.at(type.type_name).fields)
+      if (field_def.var_name.lexeme() == field.lexeme())
+        return field_def.data_type;
+  return DataType {false, "void"};
+}
+
+
+VMInstr CodeGenerator::get_instr(const DataType& type) const
+{
+  if (type.is_array and type.type_name == "int")
+    return VMInstr::GETII();
+  else if (type.is_array and type.type_name == "double")
+    return VMInstr::GETID();
+  else if (type.is_array and type.type_name == "bool")
+    return VMInstr::GETIB();
+  else if (type.is_array and type.type_name == "char")
+    return VMInstr::GETIC();
+  return VMInstr::GETI();
+}
+
+
+VMInstr CodeGenerator::set_instr(const DataType& type) const
+{
+  if (type.is_array and type.type_name == "int")
+    return VMInstr::SETII();
+  else if (type.is_array and type.type_name == "double")
+    return VMInstr::SETID();
+  else if (type.is_array and type.type_name == "bool")
+    return VMInstr::SETIB();
+  else if (type.is_array and type.type_name == "char")
+    return VMInstr::SETIC();
+  return VMInstr::SETI();
+}
+
+
+void CodeGenerator::add_var(const VarDef& var_def)
+{
+  var_table.add(var_def.var_name.lexeme());
+  var_types[var_table.get(var_def.var_name.lexeme())] = var_def.data_type;
+}
+
+
 void CodeGenerator::visit(Program& p)
 {
   for (auto& struct_def : p.struct_defs)
@@ -40,34 +178,33 @@ void CodeGenerator::visit(Program& p)
 void CodeGenerator::visit(FunDef& f)
 {
   curr_frame = {f.fun_name.lexeme(), (int) f.params.size()};
+  curr_frame.return_type = type_name(f.return_type);
   var_table.push_environment();
 
+  // the caller leaves the arguments in the first variable slots, so
+  // the parameters just need names (no prologue code)
   for (int i = 0; i < f.params.size(); i++)
   {
-    this->var_table.add(f.params[i].var_name.lexeme());
-    curr_frame.instructions.push_back(VMInstr::STORE(i));
+    add_var(f.params[i]);
+    curr_frame.arg_types.push_back(type_name(f.params[i].data_type));
   }
 
-  if (f.stmts.size() == 0)
-    {
-      curr_frame.instructions.push_back(VMInstr::PUSH(nullptr));
-      curr_frame.instructions.push_back(VMInstr::RET());
-    } else {
-      for (int i = 0; i < f.stmts.size(); i++)
-      {
-        f.stmts.at(i)->accept(*this);
-
-        if (i == (f.stmts.size()))
-        {
-          if (curr_frame.instructions.at(i).opcode() != OpCode::RET) 
-          {
-            curr_frame.instructions.push_back(VMInstr::PUSH(nullptr));
-            curr_frame.instructions.push_back(VMInstr::RET());
-          }
-        }
-      }
-    }
-  
+  for (int i = 0; i < f.stmts.size(); i++)
+  {
+    f.stmts.at(i)->accept(*this);
+    pop_unused_value(f.stmts.at(i));
+  }
+
+  // return null if the function can reach its end without returning
+  if (curr_frame.instructions.size() == 0 ||
+      curr_frame.instructions.back().opcode() != OpCode::RET)
+  {
+    curr_frame.instructions.push_back(VMInstr::PUSH(nullptr));
+    curr_frame.instructions.push_back(VMInstr::RET());
+  }
+
+  if (optimization_level >= 1)
+    PeepholeOptimizer(vm).optimize(curr_frame);
   vm.add(curr_frame);
   var_table.pop_environment();
 }
@@ -76,6 +213,12 @@ void CodeGenerator::visit(FunDef& f)
 void CodeGenerator::visit(StructDef& s)
 {
   struct_defs[s.struct_name.lexeme()] = s;
+  VMStructInfo struct_type {s.struct_name.lexeme()};
+  for (const VarDef& field : s.fields) {
+    struct_type.field_names.push_back(field.var_name.lexeme());
+    struct_type.field_types.push_back(type_name(field.data_type));
+  }
+  vm.add(struct_type);
 }
 
 
@@ -100,6 +243,7 @@ void CodeGenerator::visit(WhileStmt& s)
 
   for (int i = 0; i < s.stmts.size(); i++) {
     s.stmts[i]->accept(*this);
+    pop_unused_value(s.stmts[i]);
   }
 
   this->var_table.pop_environment();
@@ -129,6 +273,7 @@ void CodeGenerator::visit(ForStmt& s)
 
   for (int i = 0; i < s.stmts.size(); i++) {
     s.stmts[i]->accept(*this);
+    pop_unused_value(s.stmts[i]);
   }
 
   this->var_table.pop_environment();
@@ -162,6 +307,7 @@ void CodeGenerator::visit(IfStmt& s)
   for (int i = 0; i < s.if_part.stmts.size(); i++)
   {
     s.if_part.stmts[i]->accept(*this);
+    pop_unused_value(s.if_part.stmts[i]);
   }
 
   this->var_table.pop_environment();
@@ -187,22 +333,25 @@ void CodeGenerator::visit(IfStmt& s)
     for (int j = 0; j < s.else_ifs[i].stmts.size(); j++)
     {
       s.else_ifs[i].stmts[j]->accept(*this);
+      pop_unused_value(s.else_ifs[i].stmts[j]);
     }
 
     this->var_table.pop_environment();
 
-    curr_frame.instructions.at(jmpf) = VMInstr::JMPF(curr_frame.instructions.size() + 1);
-  }
+    // (each else-if body skips the rest, like the if part's)
+    jmp_indices.push_back(curr_frame.instructions.size());
 
-  jmp_indices.push_back(curr_frame.instructions.size());
+    curr_frame.instructions.push_back(VMInstr::JMP(-1));
 
-  curr_frame.instructions.push_back(VMInstr::JMP(-1));
+    curr_frame.instructions.at(jmpf) = VMInstr::JMPF(curr_frame.instructions.size());
+  }
 
   //else stmts
 
   for (int i = 0; i < s.else_stmts.size(); i++)
   {
     s.else_stmts[i]->accept(*this);
+    pop_unused_value(s.else_stmts[i]);
   }
 
   for (int i = 0; i < jmp_indices.size(); i++)
@@ -215,17 +364,20 @@ void CodeGenerator::visit(IfStmt& s)
 void CodeGenerator::visit(VarDeclStmt& s)
 {
   s.expr.accept(*this);
-  this->var_table.add(s.var_def.var_name.lexeme());
+  add_var(s.var_def);
   curr_frame.instructions.push_back(VMInstr::STORE(this->var_table.get(s.var_def.var_name.lexeme())));
 }
 
 
 void CodeGenerator::visit(AssignStmt& s)
 { 
+  // the type of the object (or variable) the current path element is in
+  DataType type = var_types[var_table.get(s.lvalue[0].var_name.lexeme())];
   for (int i = 0; i < s.lvalue.size() - 1; i++)
   {
     if (i > 0) {
-      curr_frame.instructions.push_back(VMInstr::GETF(s.lvalue[i].var_name.lexeme()));
+      curr_frame.instructions.push_back(VMInstr::GETF(field_operand(type, s.lvalue[i].var_name)));
+      type = field_type(type, s.lvalue[i].var_name);
     } else {
       curr_frame.instructions.push_back(VMInstr::LOAD(var_table.get(s.lvalue[i].var_name.lexeme())));
     }
@@ -233,7 +385,7 @@ void CodeGenerator::visit(AssignStmt& s)
     if (s.lvalue[i].array_expr.has_value()) //any field could be an array access
     {
       s.lvalue[i].array_expr->accept(*this);
-      curr_frame.instructions.push_back(VMInstr::GETI());
+      curr_frame.instructions.push_back(get_instr(type));
     }
   }
 
@@ -242,14 +394,15 @@ void CodeGenerator::visit(AssignStmt& s)
     if (s.lvalue.size() == 1) {
       curr_frame.instructions.push_back(VMInstr::LOAD(this->var_table.get(s.lvalue[s.lvalue.size() - 1].var_name.lexeme())));
     } else {
-      curr_frame.instructions.push_back(VMInstr::GETF(s.lvalue[s.lvalue.size() - 1].var_name.lexeme()));
+      curr_frame.instructions.push_back(VMInstr::GETF(field_operand(type, s.lvalue[s.lvalue.size() - 1].var_name)));
+      type = field_type(type, s.lvalue[s.lvalue.size() - 1].var_name);
     }
     s.lvalue[s.lvalue.size() - 1].array_expr->accept(*this);
     s.expr.accept(*this);
-    curr_frame.instructions.push_back(VMInstr::SETI());
+    curr_frame.instructions.push_back(set_instr(type));
   } else if (s.lvalue.size() > 1) { //last field could be a simple variable
     s.expr.accept(*this);
-    curr_frame.instructions.push_back(VMInstr::SETF(s.lvalue[s.lvalue.size() - 1].var_name.lexeme()));
+    curr_frame.instructions.push_back(VMInstr::SETF(field_operand(type, s.lvalue[s.lvalue.size() - 1].var_name)));
   } else {
     s.expr.accept(*this);
     curr_frame.instructions.push_back(VMInstr::STORE(this->var_table.get(s.lvalue[s.lvalue.size() - 1].var_name.lexeme())));
@@ -311,31 +464,7 @@ void CodeGenerator::visit(Expr& e)
   
   if (e.op.has_value()) {
     e.rest->accept(*this);
-    if(e.op.value().lexeme() == "+") {
-      curr_frame.instructions.push_back(VMInstr::ADD());
-    } else if (e.op.value().lexeme() == "-") {
-      curr_frame.instructions.push_back(VMInstr::SUB());
-    } else if (e.op.value().lexeme() == "*") {
-      curr_frame.instructions.push_back(VMInstr::MUL());
-    } else if (e.op.value().lexeme() == "/") {
-      curr_frame.instructions.push_back(VMInstr::DIV());
-    } else if (e.op.value().lexeme() == "==") {
-      curr_frame.instructions.push_back(VMInstr::CMPEQ());
-    } else if (e.op.value().lexeme() == "!=") {
-      curr_frame.instructions.push_back(VMInstr::CMPNE());
-    } else if (e.op.value().lexeme() == "<") {
-      curr_frame.instructions.push_back(VMInstr::CMPLT());
-    } else if (e.op.value().lexeme() == "<=") {
-      curr_frame.instructions.push_back(VMInstr::CMPLE());
-    } else if (e.op.value().lexeme() == ">") {
-      curr_frame.instructions.push_back(VMInstr::CMPGT());
-    } else if (e.op.value().lexeme() == ">=") {
-      curr_frame.instructions.push_back(VMInstr::CMPGE());
-    } else if (e.op.value().lexeme() == "and") {
-      curr_frame.instructions.push_back(VMInstr::AND());
-    } else if (e.op.value().lexeme() == "or") {
-      curr_frame.instructions.push_back(VMInstr::OR());
-    }
+    curr_frame.instructions.push_back(binary_instr(e));
   }
 }
 
@@ -387,18 +516,24 @@ void CodeGenerator::visit(NewRValue& v)
   if (v.array_expr.has_value())
   {
     v.array_expr->accept(*this);
-    curr_frame.instructions.push_back(VMInstr::PUSH(nullptr));
-    curr_frame.instructions.push_back(VMInstr::ALLOCA());
-  } else {
-    curr_frame.instructions.push_back(VMInstr::ALLOCS());
-    for (VarDef field : struct_defs[v.type.lexeme()].fields)
-    {
-      curr_frame.instructions.push_back(VMInstr::DUP());
-      curr_frame.instructions.push_back(VMInstr::ADDF(field.var_name.lexeme()));
-      curr_frame.instructions.push_back(VMInstr::DUP());
+    // arrays of ints, doubles, bools, and chars store their elements
+    // unboxed (the elements all start out null)
+    string element_type = v.type.lexeme();
+    if (element_type == "int")
+      curr_frame.instructions.push_back(VMInstr::ALLOCAI());
+    else if (element_type == "double")
+      curr_frame.instructions.push_back(VMInstr::ALLOCAD());
+    else if (element_type == "bool")
+      curr_frame.instructions.push_back(VMInstr::ALLOCAB());
+    else if (element_type == "char")
+      curr_frame.instructions.push_back(VMInstr::ALLOCAC());
+    else {
       curr_frame.instructions.push_back(VMInstr::PUSH(nullptr));
-      curr_frame.instructions.push_back(VMInstr::SETF(field.var_name.lexeme()));
+      curr_frame.instructions.push_back(VMInstr::ALLOCA());
     }
+  } else {
+    // the new object's field slots all start out null
+    curr_frame.instructions.push_back(VMInstr::ALLOCS(v.type.lexeme()));
   }
 }
 
@@ -407,19 +542,21 @@ void CodeGenerator::visit(VarRValue& v)
 {
   curr_frame.instructions.push_back(VMInstr::LOAD(this->var_table.get(v.path[0].var_name.lexeme())));
   //could be an array: x[0], etc.
+  DataType type = var_types[var_table.get(v.path[0].var_name.lexeme())];
   if (v.path[0].array_expr.has_value())
   {
     v.path[0].array_expr->accept(*this);
-    curr_frame.instructions.push_back(VMInstr::GETI());
+    curr_frame.instructions.push_back(get_instr(type));
   }
   
   for (int i = 1; i < v.path.size(); i++)
   {
-    curr_frame.instructions.push_back(VMInstr::GETF(v.path[i].var_name.lexeme()));
+    curr_frame.instructions.push_back(VMInstr::GETF(field_operand(type, v.path[i].var_name)));
+    type = field_type(type, v.path[i].var_name);
     if (v.path[i].array_expr.has_value())
     {
       v.path[i].array_expr->accept(*this);
-      curr_frame.instructions.push_back(VMInstr::GETI());
+      curr_frame.instructions.push_back(get_instr(type));
     }
   }
   
@@ -14,11 +14,18 @@
 #include "ast.h"
 #include "var_table.h"
 #include "vm.h"
+#include "semantic_checker.h"
 
 
 class CodeGenerator : public Visitor {
 public:
   CodeGenerator(VM& vm);
+  CodeGenerator(VM& vm, const OperandTypes& operand_types);
+
+  // optimization level for the generated code (0 = none, 1 = run the
+  // peephole optimizer over each function before adding it to the vm)
+  void set_optimization_level(int level);
+
   void visit(Program& p);
   void visit(FunDef& f);
   void visit(StructDef& s);
@@ -44,6 +51,35 @@ private:
   VarTable var_table;
   std::unordered_map<std::string,StructDef> struct_defs;
 
+  // declared type of the variable currently held in each variable slot
+  std::unordered_map<int,DataType> var_types;
+
+  // expression operand types from the semantic checker (if given)
+  const OperandTypes* operand_types = nullptr;
+
+  int optimization_level = 0;
+
+  // helper to discard the unused result of a call statement
+  void pop_unused_value(const std::shared_ptr<Stmt>& stmt);
+
+  // helper to pick the typed form of a binary operator instruction
+  VMInstr binary_instr(Expr& e) const;
+
+  // helper to name a field of the given struct type ("T.f"), which the
+  // vm resolves to the field's slot
+  std::string field_operand(const DataType& type, const Token& field) const;
+
+  // helper to get the type of a field of the given struct type
+  DataType field_type(const DataType& type, const Token& field) const;
+
+  // helpers to pick the typed form of an element get or set of an array
+  // of the given type
+  VMInstr get_instr(const DataType& type) const;
+  VMInstr set_instr(const DataType& type) const;
+
+  // helper to add a variable (and its type) to the var table
+  void add_var(const VarDef& var_def);
+
 };
 
 #endif
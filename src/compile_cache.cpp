@@ -0,0 +1,207 @@
+//----------------------------------------------------------------------
+// FILE: compile_cache.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Cache of compiled MyPL programs, keyed by their source
+//----------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+#include "compile_cache.h"
+#include "mypl_exception.h"
+
+
+using namespace std;
+namespace fs = std::filesystem;
+
+
+// each build of the compiler gets its own entries (its code generator
+// may differ from the one that compiled an entry, even when the
+// bytecode format does not)
+static const string COMPILER_BUILD = "MyPL bytecode " +
+  to_string(BYTECODE_VERSION) + " built " + __DATE__ + " " + __TIME__;
+
+static const string ENTRY_EXTENSION = ".myplc";
+
+// hits and misses are appended to the log one byte each (appends that
+// small are atomic, so concurrent runs never lose counts)
+static const string STATS_LOG = "stats";
+
+
+string to_string(const CompileCacheStats& stats)
+{
+  long lookups = stats.hits + stats.misses;
+  string s = "Compile cache:\n";
+  s += "  hits: " + to_string(stats.hits) + "\n";
+  s += "  misses: " + to_string(stats.misses) + "\n";
+  if (lookups > 0)
+    s += "  hit rate: " + to_string(100 * stats.hits / lookups) + "%\n";
+  s += "  entries: " + to_string(stats.entries) + "\n";
+  s += "  bytes: " + to_string(stats.bytes) + "\n";
+  return s;
+}
+
+
+string CompileCache::default_directory()
+{
+  if (const char* dir = getenv("MYPL_CACHE_DIR"))
+    return dir;
+  if (const char* dir = getenv("XDG_CACHE_HOME"))
+    return string(dir) + "/mypl";
+  if (const char* home = getenv("HOME"))
+    return string(home) + "/.cache/mypl";
+  return "";
+}
+
+
+CompileCache::CompileCache(const string& directory, size_t max_bytes)
+  : directory(directory), max_bytes(max_bytes)
+{
+}
+
+
+string CompileCache::key(const string& source, int optimization_level)
+{
+  // 64-bit FNV-1a over the build, level, and source (the source's
+  // length is part of the key as well)
+  uint64_t hash = 14695981039346656037ull;
+  auto add = [&](const string& s) {
+    for (char ch : s) {
+      hash ^= uint8_t(ch);
+      hash *= 1099511628211ull;
+    }
+    hash ^= 0xff;
+    hash *= 1099511628211ull;
+  };
+  add(COMPILER_BUILD);
+  add(to_string(optimization_level));
+  add(source);
+  char digits[17];
+  snprintf(digits, sizeof(digits), "%016llx", (unsigned long long) hash);
+  return string(digits) + "-" + to_string(source.size());
+}
+
+
+shared_ptr<const VMImage> CompileCache::find(const string& key)
+{
+  if (directory == "")
+    return nullptr;
+  fs::path path = fs::path(directory) / (key + ENTRY_EXTENSION);
+  error_code ec;
+  if (fs::exists(path, ec)) {
+    try {
+      shared_ptr<const VMImage> image = VMImage::open(path.string());
+      // (the entry's time is its last use, for eviction)
+      fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+      record('h');
+      return image;
+    } catch (MyPLException&) {
+      // a damaged entry is replaced
+      fs::remove(path, ec);
+    }
+  }
+  record('m');
+  return nullptr;
+}
+
+
+void CompileCache::store(const string& key, const VM& vm)
+{
+  if (directory == "")
+    return;
+  error_code ec;
+  fs::create_directories(directory, ec);
+  if (ec)
+    return;
+  // write under a name no other process uses, then rename into place
+  // (so no run ever maps a partly written entry)
+  fs::path path = fs::path(directory) / (key + ENTRY_EXTENSION);
+  fs::path temp = path;
+  temp += ".tmp" + to_string(random_device()());
+  {
+    ofstream out(temp, ios::binary);
+    write_bytecode(vm, out);
+    if (!out) {
+      fs::remove(temp, ec);
+      return;
+    }
+  }
+  fs::rename(temp, path, ec);
+  if (ec) {
+    fs::remove(temp, ec);
+    return;
+  }
+  evict();
+}
+
+
+CompileCacheStats CompileCache::statistics() const
+{
+  CompileCacheStats stats;
+  if (directory == "")
+    return stats;
+  ifstream log(fs::path(directory) / STATS_LOG, ios::binary);
+  for (char event; log.get(event); ) {
+    if (event == 'h')
+      ++stats.hits;
+    else if (event == 'm')
+      ++stats.misses;
+  }
+  error_code ec;
+  for (const auto& entry : fs::directory_iterator(directory, ec)) {
+    if (entry.path().extension() == ENTRY_EXTENSION) {
+      ++stats.entries;
+      stats.bytes += entry.file_size(ec);
+    }
+  }
+  return stats;
+}
+
+
+void CompileCache::record(char event) const
+{
+  error_code ec;
+  fs::create_directories(directory, ec);
+  ofstream log(fs::path(directory) / STATS_LOG, ios::binary | ios::app);
+  log.put(event);
+}
+
+
+void CompileCache::evict() const
+{
+  struct Entry {
+    fs::path path;
+    fs::file_time_type used;
+    size_t size;
+  };
+  vector<Entry> entries;
+  size_t total = 0;
+  error_code ec;
+  for (const auto& entry : fs::directory_iterator(directory, ec)) {
+    if (entry.path().extension() != ENTRY_EXTENSION)
+      continue;
+    Entry e {entry.path(), entry.last_write_time(ec), entry.file_size(ec)};
+    if (ec)
+      continue;
+    entries.push_back(e);
+    total += e.size;
+  }
+  if (total <= max_bytes)
+    return;
+  // least recently used first
+  sort(entries.begin(), entries.end(),
+       [](const Entry& x, const Entry& y) {return x.used < y.used;});
+  for (const Entry& e : entries) {
+    if (total <= max_bytes)
+      break;
+    // (another run may have removed it already)
+    if (fs::remove(e.path, ec))
+      total -= e.size;
+  }
+}
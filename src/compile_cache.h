@@ -0,0 +1,81 @@
+//----------------------------------------------------------------------
+// FILE: compile_cache.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Cache of compiled MyPL programs, keyed by their source
+//----------------------------------------------------------------------
+
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "vm.h"
+#include "vm_bytecode.h"
+
+
+// cache statistics: lookups that found (hits) or did not find (misses)
+// a script's bytecode, and the entries currently cached
+struct CompileCacheStats {
+  long hits = 0;
+  long misses = 0;
+  long entries = 0;
+  std::size_t bytes = 0;
+};
+
+std::string to_string(const CompileCacheStats& stats);
+
+
+// A directory of .myplc files, one per script contents, compiler
+// build, and optimization level, so running an unchanged script again
+// skips the lexer through the code generator. Entries are written
+// whole (under a temporary name, then renamed) and found by mapping
+// them, so any number of mypl processes can share the cache. Once the
+// entries exceed the cache's size, the least recently used are removed.
+// The cache is only an optimization: if its directory cannot be used,
+// lookups miss and stores do nothing.
+class CompileCache
+{
+public:
+
+  // $MYPL_CACHE_DIR, else $XDG_CACHE_HOME/mypl, else ~/.cache/mypl
+  static std::string default_directory();
+
+  // the default size bound (64 MiB)
+  static const std::size_t DEFAULT_SIZE = std::size_t(64) << 20;
+
+  // a cache in the directory (created when first stored to) holding
+  // at most max_bytes of bytecode
+  CompileCache(const std::string& directory,
+               std::size_t max_bytes = DEFAULT_SIZE);
+
+  // the key of the bytecode for a script's source (a hash of the
+  // source, the compiler build, and the optimization level)
+  static std::string key(const std::string& source, int optimization_level);
+
+  // the cached bytecode for the key, if any (counted as a hit or miss)
+  std::shared_ptr<const VMImage> find(const std::string& key);
+
+  // cache the vm's program under the key, then evict the least
+  // recently used entries until the cache fits its size
+  void store(const std::string& key, const VM& vm);
+
+  // the hits and misses so far and the current entries
+  CompileCacheStats statistics() const;
+
+private:
+
+  std::string directory;
+  std::size_t max_bytes;
+
+  // helper to record a hit ('h') or a miss ('m') in the statistics log
+  void record(char event) const;
+
+  // helper to remove the least recently used entries beyond max_bytes
+  void evict() const;
+
+};
+
+
+#endif
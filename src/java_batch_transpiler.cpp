@@ -0,0 +1,125 @@
+//----------------------------------------------------------------------
+// FILE: java_batch_transpiler.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Transpiles a directory of MyPL files to Java on a thread pool
+//----------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+#include "java_batch_transpiler.h"
+#include "java_lexer.h"
+#include "java_ast_parser.h"
+#include "mypl_exception.h"
+#include "mypl_to_java_transpiler.h"
+
+
+using namespace std;
+namespace fs = std::filesystem;
+
+
+string to_string(const JavaBatchStats& stats)
+{
+  double seconds = max(stats.seconds, 1e-9);
+  ostringstream s;
+  s << "Transpiled " << stats.files - stats.failed << " of " << stats.files
+    << " files (" << stats.bytes << " bytes) in " << stats.seconds * 1000
+    << " ms on " << stats.threads << " threads: " << stats.files / seconds
+    << " files/s, " << stats.bytes / seconds / (1 << 20) << " MiB/s\n";
+  return s.str();
+}
+
+
+JavaBatchTranspiler::JavaBatchTranspiler(const string& directory,
+                                         const string& output, int jobs)
+  : directory(directory), output(output), jobs(jobs)
+{
+}
+
+
+JavaBatchStats JavaBatchTranspiler::run() const
+{
+  vector<fs::path> files;
+  error_code ec;
+  for (auto it = fs::recursive_directory_iterator(directory, ec);
+       !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+    if (it->is_regular_file() && it->path().extension() == ".mypl")
+      files.push_back(it->path());
+  if (ec)
+    throw MyPLException("Unable to read directory '" + directory + "': " +
+                        ec.message());
+  // (in order, so the errors are reported the same way on each run)
+  sort(files.begin(), files.end());
+
+  // each file's error (empty if it was transpiled), and bytes read
+  vector<string> errors(files.size());
+  vector<size_t> sizes(files.size(), 0);
+  atomic<size_t> next = 0;
+  auto worker = [&]() {
+    for (size_t i = next++; i < files.size(); i = next++) {
+      ifstream in(files[i], ios::binary);
+      if (!in) {
+        errors[i] = "Unable to open file";
+        continue;
+      }
+      string source {istreambuf_iterator<char>(in), istreambuf_iterator<char>()};
+      sizes[i] = source.size();
+      fs::path path = fs::path(output) / files[i].lexically_relative(directory);
+      path.replace_extension(".java");
+      try {
+        istringstream source_in(source);
+        JavaLexer lexer(source_in);
+        JavaASTParser parser(lexer);
+        Program p = parser.parse();
+        // (the file is only written once the program is transpiled)
+        ostringstream java;
+        MyPLtoJavaTranspiler j(java);
+        p.accept(j);
+        java << '\n';
+        // (each worker has its own error code)
+        error_code mkdir_error;
+        fs::create_directories(path.parent_path(), mkdir_error);
+        if (mkdir_error) {
+          errors[i] = "Unable to create directory '" +
+            path.parent_path().string() + "': " + mkdir_error.message();
+          continue;
+        }
+        ofstream out(path, ios::binary);
+        out << java.str();
+        if (!out)
+          errors[i] = "Unable to write file '" + path.string() + "'";
+      } catch (MyPLException& ex) {
+        errors[i] = ex.what();
+      }
+    }
+  };
+
+  JavaBatchStats stats;
+  stats.threads = jobs > 0 ? jobs : max(1u, thread::hardware_concurrency());
+  stats.threads = min<size_t>(stats.threads, max<size_t>(files.size(), 1));
+  auto start = chrono::steady_clock::now();
+  vector<thread> threads;
+  for (int t = 1; t < stats.threads; ++t)
+    threads.emplace_back(worker);
+  worker();
+  for (thread& t : threads)
+    t.join();
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  stats.seconds = elapsed.count();
+
+  stats.files = files.size();
+  for (size_t i = 0; i < files.size(); ++i) {
+    stats.bytes += sizes[i];
+    if (errors[i] != "") {
+      stats.errors.push_back({files[i].string(), errors[i]});
+      ++stats.failed;
+    }
+  }
+  return stats;
+}
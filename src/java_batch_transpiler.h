@@ -0,0 +1,60 @@
+//----------------------------------------------------------------------
+// FILE: java_batch_transpiler.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Transpiles a directory of MyPL files to Java on a thread pool
+//----------------------------------------------------------------------
+
+#ifndef JAVA_BATCH_TRANSPILER_H
+#define JAVA_BATCH_TRANSPILER_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// batch statistics: the files found and those that failed (each with
+// its error, in path order), the bytes of MyPL read, and the threads
+// and time taken
+struct JavaBatchStats {
+  long files = 0;
+  long failed = 0;
+  std::size_t bytes = 0;
+  int threads = 0;
+  double seconds = 0;
+  std::vector<std::pair<std::string,std::string>> errors;
+};
+
+// the batch's throughput (in files and bytes per second)
+std::string to_string(const JavaBatchStats& stats);
+
+
+// Transpiles each .mypl file under a directory to a .java file at the
+// same relative path under an output directory. The files are shared
+// among a pool of threads, each file with its own JavaLexer,
+// JavaASTParser, and MyPLtoJavaTranspiler, and a file that fails is
+// recorded without stopping the rest. A .java file is only written
+// once its program is completely transpiled.
+class JavaBatchTranspiler
+{
+public:
+
+  // a batch on the given number of threads (one per core if 0)
+  JavaBatchTranspiler(const std::string& directory, const std::string& output,
+                      int jobs = 0);
+
+  // transpile the files (throws a MyPLException if the directory
+  // cannot be read)
+  JavaBatchStats run() const;
+
+private:
+
+  std::string directory;
+  std::string output;
+  int jobs;
+
+};
+
+
+#endif
@@ -0,0 +1,766 @@
+//----------------------------------------------------------------------
+// FILE: jvm_class_file.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Writer for JVM class files (constant pool, code, stack maps)
+//----------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "mypl_exception.h"
+#include "jvm_class_file.h"
+
+using namespace std;
+
+
+namespace {
+
+  // class files are big-endian
+  void put_u1(std::string& out, int value)
+  {
+    out += char(value & 0xff);
+  }
+
+  void put_u2(std::string& out, int value)
+  {
+    put_u1(out, value >> 8);
+    put_u1(out, value);
+  }
+
+  void put_u4(std::string& out, uint32_t value)
+  {
+    put_u2(out, value >> 16);
+    put_u2(out, value);
+  }
+
+  // the modified UTF-8 encoding of a string (NUL is two bytes, and
+  // characters outside the BMP are surrogate pairs); bytes that are
+  // not valid UTF-8 are taken as Latin-1 characters
+  std::string modified_utf8(const std::string& s)
+  {
+    std::string out;
+    auto encode = [&](uint32_t c) {
+      if (c != 0 and c < 0x80)
+        out += char(c);
+      else if (c < 0x800) {
+        out += char(0xc0 | (c >> 6));
+        out += char(0x80 | (c & 0x3f));
+      }
+      else {
+        out += char(0xe0 | (c >> 12));
+        out += char(0x80 | ((c >> 6) & 0x3f));
+        out += char(0x80 | (c & 0x3f));
+      }
+    };
+    for (size_t i = 0; i < s.size(); ) {
+      unsigned char b = s[i];
+      int n = b >= 0xf0 and b < 0xf5 ? 3 : b >= 0xe0 ? 2 : b >= 0xc2 ? 1 : 0;
+      if (b >= 0x80 and n > 0 and i + n < s.size()) {
+        uint32_t c = b & (0x3f >> n);
+        bool valid = true;
+        for (int j = 1; j <= n; ++j) {
+          unsigned char next = i + j < s.size() ? s[i + j] : 0;
+          valid = valid and (next & 0xc0) == 0x80;
+          c = (c << 6) | (next & 0x3f);
+        }
+        if (valid) {
+          if (c >= 0x10000) {
+            encode(0xd800 + ((c - 0x10000) >> 10));
+            encode(0xdc00 + ((c - 0x10000) & 0x3ff));
+          }
+          else
+            encode(c);
+          i += n + 1;
+          continue;
+        }
+      }
+      encode(b);
+      ++i;
+    }
+    return out;
+  }
+
+  // the field descriptors of a method descriptor's parameters
+  vector<std::string> parameters(const std::string& descriptor)
+  {
+    vector<std::string> params;
+    size_t i = 1;
+    while (descriptor[i] != ')') {
+      size_t start = i;
+      while (descriptor[i] == '[')
+        ++i;
+      if (descriptor[i] == 'L')
+        i = descriptor.find(';', i);
+      ++i;
+      params.push_back(descriptor.substr(start, i - start));
+    }
+    return params;
+  }
+
+  // the return type's descriptor (after the parameters)
+  std::string return_descriptor(const std::string& descriptor)
+  {
+    return descriptor.substr(descriptor.find(')') + 1);
+  }
+
+  // the class constant naming an object type (arrays are named by
+  // their descriptors)
+  std::string class_name(const std::string& descriptor)
+  {
+    if (descriptor[0] == 'L')
+      return descriptor.substr(1, descriptor.size() - 2);
+    return descriptor;
+  }
+
+}
+
+
+JVMType JVMType::of(const std::string& descriptor)
+{
+  if (descriptor == "D")
+    return {DOUBLE};
+  if (descriptor[0] == 'L' or descriptor[0] == '[')
+    return {OBJECT, class_name(descriptor)};
+  return {INTEGER};
+}
+
+
+//----------------------------------------------------------------------
+// Constant pool
+//----------------------------------------------------------------------
+
+int JVMConstantPool::add(const std::string& constant, int entries)
+{
+  auto it = indexes.find(constant);
+  if (it != indexes.end())
+    return it->second;
+  if (count + entries > 0xffff)
+    throw MyPLException::StaticError("too many constants for a class file");
+  int index = count;
+  indexes[constant] = index;
+  constants += constant;
+  count += entries;
+  return index;
+}
+
+int JVMConstantPool::utf8(const std::string& s)
+{
+  std::string encoded = modified_utf8(s);
+  if (encoded.size() > 0xffff)
+    throw MyPLException::StaticError("string too long for a class file");
+  std::string constant;
+  put_u1(constant, 1);
+  put_u2(constant, encoded.size());
+  return add(constant + encoded);
+}
+
+int JVMConstantPool::integer(int32_t value)
+{
+  std::string constant;
+  put_u1(constant, 3);
+  put_u4(constant, value);
+  return add(constant);
+}
+
+int JVMConstantPool::number(double value)
+{
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  std::string constant;
+  put_u1(constant, 6);
+  put_u4(constant, bits >> 32);
+  put_u4(constant, bits);
+  return add(constant, 2);
+}
+
+int JVMConstantPool::string(const std::string& s)
+{
+  std::string constant;
+  put_u1(constant, 8);
+  put_u2(constant, utf8(s));
+  return add(constant);
+}
+
+int JVMConstantPool::class_ref(const std::string& name)
+{
+  std::string constant;
+  put_u1(constant, 7);
+  put_u2(constant, utf8(name));
+  return add(constant);
+}
+
+int JVMConstantPool::field_ref(const std::string& owner,
+                               const std::string& name,
+                               const std::string& descriptor)
+{
+  std::string name_and_type;
+  put_u1(name_and_type, 12);
+  put_u2(name_and_type, utf8(name));
+  put_u2(name_and_type, utf8(descriptor));
+  std::string constant;
+  put_u1(constant, 9);
+  put_u2(constant, class_ref(owner));
+  put_u2(constant, add(name_and_type));
+  return add(constant);
+}
+
+int JVMConstantPool::method_ref(const std::string& owner,
+                                const std::string& name,
+                                const std::string& descriptor)
+{
+  std::string name_and_type;
+  put_u1(name_and_type, 12);
+  put_u2(name_and_type, utf8(name));
+  put_u2(name_and_type, utf8(descriptor));
+  std::string constant;
+  put_u1(constant, 10);
+  put_u2(constant, class_ref(owner));
+  put_u2(constant, add(name_and_type));
+  return add(constant);
+}
+
+std::string JVMConstantPool::bytes() const
+{
+  std::string out;
+  put_u2(out, count);
+  return out + constants;
+}
+
+
+//----------------------------------------------------------------------
+// Code
+//----------------------------------------------------------------------
+
+JVMCode::JVMCode(JVMConstantPool& pool, const vector<JVMType>& params)
+  : pool(pool)
+{
+  for (const JVMType& type : params)
+    add_local(type);
+}
+
+JVMLabel JVMCode::new_label()
+{
+  offsets.push_back(-1);
+  frames.push_back(Frame());
+  targets.push_back(false);
+  return {int(offsets.size()) - 1};
+}
+
+void JVMCode::bind(JVMLabel label)
+{
+  offsets[label.id] = code.size();
+  Frame& frame = frames[label.id];
+  if (!frame.known) {
+    if (live)
+      record(label.id);
+    return;
+  }
+  // the code after the label sees only what the frame says
+  int size = locals.size();
+  locals = frame.locals;
+  locals.resize(size);
+  stack = frame.stack;
+  live = true;
+}
+
+int JVMCode::add_local(const JVMType& type)
+{
+  int local = locals.size();
+  locals.push_back(type);
+  if (type.size() == 2)
+    locals.push_back({JVMType::TOP});
+  max_locals = max(max_locals, int(locals.size()));
+  return local;
+}
+
+void JVMCode::end_scope(int start)
+{
+  locals.resize(start);
+}
+
+void JVMCode::emit(JVMOp opcode)
+{
+  u1(int(opcode));
+}
+
+void JVMCode::u1(int value)
+{
+  put_u1(code, value);
+}
+
+void JVMCode::u2(int value)
+{
+  put_u2(code, value);
+}
+
+void JVMCode::push(const JVMType& type)
+{
+  stack.push_back(type);
+  int depth = 0;
+  for (const JVMType& t : stack)
+    depth += t.size();
+  max_stack = max(max_stack, depth);
+}
+
+JVMType JVMCode::pop()
+{
+  JVMType type = stack.back();
+  stack.pop_back();
+  return type;
+}
+
+void JVMCode::record(int label)
+{
+  frames[label] = {true, locals, stack};
+}
+
+void JVMCode::op(JVMOp opcode)
+{
+  if (!live)
+    return;
+  emit(opcode);
+  JVMType integer {JVMType::INTEGER};
+  JVMType dbl {JVMType::DOUBLE};
+  switch (opcode) {
+  case JVMOp::ACONST_NULL:
+    push({JVMType::NULL_REF});
+    break;
+  case JVMOp::ICONST_0:
+    push(integer);
+    break;
+  case JVMOp::DCONST_0:
+  case JVMOp::DCONST_1:
+    push(dbl);
+    break;
+  case JVMOp::IALOAD:
+  case JVMOp::BALOAD:
+  case JVMOp::CALOAD:
+    pop();
+    pop();
+    push(integer);
+    break;
+  case JVMOp::DALOAD:
+    pop();
+    pop();
+    push(dbl);
+    break;
+  case JVMOp::AALOAD: {
+    pop();
+    JVMType array = pop();
+    if (array.tag == JVMType::OBJECT)
+      push(JVMType::of(array.name.substr(1)));
+    else
+      push({JVMType::NULL_REF});
+    break;
+  }
+  case JVMOp::IASTORE:
+  case JVMOp::DASTORE:
+  case JVMOp::AASTORE:
+  case JVMOp::BASTORE:
+  case JVMOp::CASTORE:
+    pop();
+    pop();
+    pop();
+    break;
+  case JVMOp::POP:
+  case JVMOp::POP2:
+    pop();
+    break;
+  case JVMOp::DUP:
+    push(stack.back());
+    break;
+  case JVMOp::SWAP:
+    swap(stack[stack.size() - 1], stack[stack.size() - 2]);
+    break;
+  case JVMOp::IADD:
+  case JVMOp::ISUB:
+  case JVMOp::IMUL:
+  case JVMOp::IDIV:
+  case JVMOp::IAND:
+  case JVMOp::IOR:
+  case JVMOp::IXOR:
+  case JVMOp::DCMPL:
+  case JVMOp::DCMPG:
+    pop();
+    pop();
+    push(integer);
+    break;
+  case JVMOp::DADD:
+  case JVMOp::DSUB:
+  case JVMOp::DMUL:
+  case JVMOp::DDIV:
+    pop();
+    pop();
+    push(dbl);
+    break;
+  case JVMOp::I2D:
+    pop();
+    push(dbl);
+    break;
+  case JVMOp::D2I:
+  case JVMOp::ARRAYLENGTH:
+    pop();
+    push(integer);
+    break;
+  case JVMOp::IRETURN:
+  case JVMOp::DRETURN:
+  case JVMOp::ARETURN:
+    pop();
+    live = false;
+    break;
+  case JVMOp::RETURN:
+    live = false;
+    break;
+  default:
+    throw MyPLException::StaticError("instruction takes operands");
+  }
+}
+
+void JVMCode::push_int(int32_t value)
+{
+  if (!live)
+    return;
+  if (value >= -1 and value <= 5)
+    u1(int(JVMOp::ICONST_0) + value);
+  else if (value >= -128 and value <= 127) {
+    emit(JVMOp::BIPUSH);
+    u1(value);
+  }
+  else if (value >= -32768 and value <= 32767) {
+    emit(JVMOp::SIPUSH);
+    u2(value);
+  }
+  else {
+    int index = pool.integer(value);
+    if (index < 256) {
+      emit(JVMOp::LDC);
+      u1(index);
+    }
+    else {
+      emit(JVMOp::LDC_W);
+      u2(index);
+    }
+  }
+  push({JVMType::INTEGER});
+}
+
+void JVMCode::push_double(double value)
+{
+  if (!live)
+    return;
+  if (value == 0.0 and !signbit(value))
+    emit(JVMOp::DCONST_0);
+  else if (value == 1.0)
+    emit(JVMOp::DCONST_1);
+  else {
+    emit(JVMOp::LDC2_W);
+    u2(pool.number(value));
+  }
+  push({JVMType::DOUBLE});
+}
+
+void JVMCode::push_string(const std::string& s)
+{
+  if (!live)
+    return;
+  int index = pool.string(s);
+  if (index < 256) {
+    emit(JVMOp::LDC);
+    u1(index);
+  }
+  else {
+    emit(JVMOp::LDC_W);
+    u2(index);
+  }
+  push({JVMType::OBJECT, "java/lang/String"});
+}
+
+void JVMCode::load(int local)
+{
+  if (!live)
+    return;
+  JVMType type = locals[local];
+  JVMOp opcode = type.tag == JVMType::INTEGER ? JVMOp::ILOAD :
+    type.tag == JVMType::DOUBLE ? JVMOp::DLOAD : JVMOp::ALOAD;
+  // iload_<n>, dload_<n>, and aload_<n> follow their order in the table
+  int base = type.tag == JVMType::INTEGER ? 0x1a :
+    type.tag == JVMType::DOUBLE ? 0x26 : 0x2a;
+  if (local <= 3)
+    u1(base + local);
+  else if (local <= 255) {
+    emit(opcode);
+    u1(local);
+  }
+  else {
+    u1(0xc4);   // wide
+    emit(opcode);
+    u2(local);
+  }
+  push(type);
+}
+
+void JVMCode::store(int local)
+{
+  if (!live)
+    return;
+  pop();
+  JVMType type = locals[local];
+  JVMOp opcode = type.tag == JVMType::INTEGER ? JVMOp::ISTORE :
+    type.tag == JVMType::DOUBLE ? JVMOp::DSTORE : JVMOp::ASTORE;
+  int base = type.tag == JVMType::INTEGER ? 0x3b :
+    type.tag == JVMType::DOUBLE ? 0x47 : 0x4b;
+  if (local <= 3)
+    u1(base + local);
+  else if (local <= 255) {
+    emit(opcode);
+    u1(local);
+  }
+  else {
+    u1(0xc4);   // wide
+    emit(opcode);
+    u2(local);
+  }
+}
+
+void JVMCode::branch(JVMOp opcode, JVMLabel target)
+{
+  if (!live)
+    return;
+  if (opcode >= JVMOp::IF_ICMPEQ and opcode <= JVMOp::IF_ACMPNE) {
+    pop();
+    pop();
+  }
+  else if (opcode != JVMOp::GOTO)
+    pop();
+  jumps.push_back({int(code.size()), target.id});
+  emit(opcode);
+  u2(0);
+  targets[target.id] = true;
+  if (!frames[target.id].known)
+    record(target.id);
+  if (opcode == JVMOp::GOTO)
+    live = false;
+}
+
+void JVMCode::field(JVMOp opcode, const std::string& owner,
+                    const std::string& name, const std::string& descriptor)
+{
+  if (!live)
+    return;
+  emit(opcode);
+  u2(pool.field_ref(owner, name, descriptor));
+  if (opcode == JVMOp::PUTFIELD or opcode == JVMOp::PUTSTATIC)
+    pop();
+  if (opcode == JVMOp::GETFIELD or opcode == JVMOp::PUTFIELD)
+    pop();
+  if (opcode == JVMOp::GETFIELD or opcode == JVMOp::GETSTATIC)
+    push(JVMType::of(descriptor));
+}
+
+void JVMCode::invoke(JVMOp opcode, const std::string& owner,
+                     const std::string& name, const std::string& descriptor)
+{
+  if (!live)
+    return;
+  emit(opcode);
+  u2(pool.method_ref(owner, name, descriptor));
+  for (size_t i = 0; i < parameters(descriptor).size(); ++i)
+    pop();
+  if (opcode != JVMOp::INVOKESTATIC) {
+    JVMType receiver = pop();
+    // a constructor initializes each copy of the new object's reference
+    if (name == "<init>" and receiver.tag == JVMType::UNINITIALIZED)
+      for (JVMType& type : stack)
+        if (type == receiver)
+          type = {JVMType::OBJECT, receiver.name};
+  }
+  std::string result = return_descriptor(descriptor);
+  if (result != "V")
+    push(JVMType::of(result));
+}
+
+void JVMCode::new_object(const std::string& name)
+{
+  if (!live)
+    return;
+  JVMType type {JVMType::UNINITIALIZED, name, int(code.size())};
+  emit(JVMOp::NEW);
+  u2(pool.class_ref(name));
+  push(type);
+  emit(JVMOp::DUP);
+  push(type);
+}
+
+void JVMCode::new_array(const std::string& element_descriptor)
+{
+  if (!live)
+    return;
+  pop();
+  // the newarray codes of boolean, char, double, and int arrays
+  const std::unordered_map<char,int> codes {
+    {'Z', 4}, {'C', 5}, {'D', 7}, {'I', 10}
+  };
+  auto it = codes.find(element_descriptor[0]);
+  if (it != codes.end()) {
+    emit(JVMOp::NEWARRAY);
+    u1(it->second);
+  }
+  else {
+    emit(JVMOp::ANEWARRAY);
+    u2(pool.class_ref(class_name(element_descriptor)));
+  }
+  push({JVMType::OBJECT, "[" + element_descriptor});
+}
+
+std::string JVMCode::attribute() const
+{
+  if (code.size() > 0xffff)
+    throw MyPLException::StaticError("function too large for the JVM");
+  std::string patched = code;
+  for (auto [at, label] : jumps) {
+    int offset = offsets[label] - at;
+    if (offset < -32768 or offset > 32767)
+      throw MyPLException::StaticError("function too large for the JVM");
+    patched[at + 1] = char((offset >> 8) & 0xff);
+    patched[at + 2] = char(offset & 0xff);
+  }
+
+  // a full frame at each (distinct) jump target, in order
+  auto put_type = [&](std::string& out, const JVMType& type) {
+    put_u1(out, type.tag);
+    if (type.tag == JVMType::OBJECT)
+      put_u2(out, pool.class_ref(type.name));
+    else if (type.tag == JVMType::UNINITIALIZED)
+      put_u2(out, type.offset);
+  };
+  std::vector<std::pair<int,int>> at;
+  for (size_t label = 0; label < offsets.size(); ++label)
+    if (targets[label])
+      at.push_back({offsets[label], label});
+  sort(at.begin(), at.end());
+  std::string table;
+  int frame_count = 0;
+  int previous = -1;
+  for (auto [offset, label] : at) {
+    if (offset == previous)
+      continue;
+    const Frame& frame = frames[label];
+    std::vector<JVMType> frame_locals;
+    for (size_t i = 0; i < frame.locals.size(); i += frame.locals[i].size())
+      frame_locals.push_back(frame.locals[i]);
+    while (!frame_locals.empty() and frame_locals.back().tag == JVMType::TOP)
+      frame_locals.pop_back();
+    put_u1(table, 255);
+    put_u2(table, previous < 0 ? offset : offset - previous - 1);
+    put_u2(table, frame_locals.size());
+    for (const JVMType& type : frame_locals)
+      put_type(table, type);
+    put_u2(table, frame.stack.size());
+    for (const JVMType& type : frame.stack)
+      put_type(table, type);
+    previous = offset;
+    ++frame_count;
+  }
+
+  std::string body;
+  put_u2(body, max_stack);
+  put_u2(body, max_locals);
+  put_u4(body, patched.size());
+  body += patched;
+  put_u2(body, 0);   // no exception handlers
+  if (frame_count == 0)
+    put_u2(body, 0);
+  else {
+    put_u2(body, 1);
+    put_u2(body, pool.utf8("StackMapTable"));
+    put_u4(body, 2 + table.size());
+    put_u2(body, frame_count);
+    body += table;
+  }
+  std::string attr;
+  put_u2(attr, pool.utf8("Code"));
+  put_u4(attr, body.size());
+  return attr + body;
+}
+
+
+//----------------------------------------------------------------------
+// Class file
+//----------------------------------------------------------------------
+
+JVMClassFile::JVMClassFile(const std::string& name, int access)
+  : class_name(name), access(access)
+{
+}
+
+void JVMClassFile::add_field(int access, const std::string& name,
+                             const std::string& descriptor)
+{
+  fields.push_back({access, name, descriptor, nullptr});
+}
+
+JVMCode& JVMClassFile::add_method(int access, const std::string& name,
+                                  const std::string& descriptor)
+{
+  std::vector<JVMType> params;
+  if (!(access & ACC_STATIC))
+    params.push_back({JVMType::OBJECT, class_name});
+  for (const std::string& param : parameters(descriptor))
+    params.push_back(JVMType::of(param));
+  methods.push_back({access, name, descriptor,
+                     make_unique<JVMCode>(pool, params)});
+  return *methods.back().code;
+}
+
+void JVMClassFile::add_inner_class(const std::string& inner,
+                                   const std::string& outer,
+                                   const std::string& simple_name, int access)
+{
+  inner_classes.push_back({inner, outer, simple_name, access});
+}
+
+std::string JVMClassFile::bytes()
+{
+  // the rest of the class file is written first, adding the constants
+  // it uses to the pool
+  std::string body;
+  put_u2(body, access);
+  put_u2(body, pool.class_ref(class_name));
+  put_u2(body, pool.class_ref("java/lang/Object"));
+  put_u2(body, 0);   // no interfaces
+  put_u2(body, fields.size());
+  for (const Member& f : fields) {
+    put_u2(body, f.access);
+    put_u2(body, pool.utf8(f.name));
+    put_u2(body, pool.utf8(f.descriptor));
+    put_u2(body, 0);
+  }
+  put_u2(body, methods.size());
+  for (const Member& m : methods) {
+    put_u2(body, m.access);
+    put_u2(body, pool.utf8(m.name));
+    put_u2(body, pool.utf8(m.descriptor));
+    put_u2(body, 1);
+    body += m.code->attribute();
+  }
+  if (inner_classes.empty())
+    put_u2(body, 0);
+  else {
+    put_u2(body, 1);
+    put_u2(body, pool.utf8("InnerClasses"));
+    put_u4(body, 2 + 8 * inner_classes.size());
+    put_u2(body, inner_classes.size());
+    for (const InnerClass& c : inner_classes) {
+      put_u2(body, pool.class_ref(c.inner));
+      put_u2(body, pool.class_ref(c.outer));
+      put_u2(body, pool.utf8(c.simple_name));
+      put_u2(body, c.access);
+    }
+  }
+  std::string out;
+  put_u4(out, 0xcafebabe);
+  put_u2(out, 0);    // minor version
+  put_u2(out, 52);   // major version (Java 8)
+  return out + pool.bytes() + body;
+}
@@ -0,0 +1,240 @@
+//----------------------------------------------------------------------
+// FILE: jvm_class_file.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Writer for JVM class files (constant pool, code, stack maps)
+//----------------------------------------------------------------------
+
+#ifndef JVM_CLASS_FILE_H
+#define JVM_CLASS_FILE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// the JVM instructions the class file writer emits
+enum class JVMOp : std::uint8_t {
+  ACONST_NULL = 0x01, ICONST_0 = 0x03, DCONST_0 = 0x0e, DCONST_1 = 0x0f,
+  BIPUSH = 0x10, SIPUSH = 0x11, LDC = 0x12, LDC_W = 0x13, LDC2_W = 0x14,
+  ILOAD = 0x15, DLOAD = 0x18, ALOAD = 0x19, IALOAD = 0x2e, DALOAD = 0x31,
+  AALOAD = 0x32, BALOAD = 0x33, CALOAD = 0x34, ISTORE = 0x36, DSTORE = 0x39,
+  ASTORE = 0x3a, IASTORE = 0x4f, DASTORE = 0x52, AASTORE = 0x53,
+  BASTORE = 0x54, CASTORE = 0x55, POP = 0x57, POP2 = 0x58, DUP = 0x59,
+  SWAP = 0x5f, IADD = 0x60, DADD = 0x63, ISUB = 0x64, DSUB = 0x67,
+  IMUL = 0x68, DMUL = 0x6b, IDIV = 0x6c, DDIV = 0x6f, IAND = 0x7e,
+  IOR = 0x80, IXOR = 0x82, I2D = 0x87, D2I = 0x8e, DCMPL = 0x97,
+  DCMPG = 0x98, IFEQ = 0x99, IFNE = 0x9a, IFLT = 0x9b, IFGE = 0x9c,
+  IFGT = 0x9d, IFLE = 0x9e, IF_ICMPEQ = 0x9f, IF_ICMPNE = 0xa0,
+  IF_ICMPLT = 0xa1, IF_ICMPGE = 0xa2, IF_ICMPGT = 0xa3, IF_ICMPLE = 0xa4,
+  IF_ACMPEQ = 0xa5, IF_ACMPNE = 0xa6, GOTO = 0xa7, IRETURN = 0xac,
+  DRETURN = 0xaf, ARETURN = 0xb0, RETURN = 0xb1, GETSTATIC = 0xb2,
+  PUTSTATIC = 0xb3, GETFIELD = 0xb4, PUTFIELD = 0xb5, INVOKEVIRTUAL = 0xb6,
+  INVOKESPECIAL = 0xb7, INVOKESTATIC = 0xb8, NEW = 0xbb, NEWARRAY = 0xbc,
+  ANEWARRAY = 0xbd, ARRAYLENGTH = 0xbe, IFNULL = 0xc6, IFNONNULL = 0xc7
+};
+
+
+// the verification type of a local variable or operand stack entry
+// (ints, bools, and chars are all INTEGER)
+struct JVMType {
+  enum Tag : std::uint8_t {TOP = 0, INTEGER = 1, DOUBLE = 3, NULL_REF = 5,
+                           OBJECT = 7, UNINITIALIZED = 8};
+  Tag tag = TOP;
+  // the class (or array descriptor, e.g., "[I") of an object, or of an
+  // object not yet initialized
+  std::string name = "";
+  // where an uninitialized object was created
+  int offset = 0;
+
+  // the number of local variable slots (or stack words) the type takes
+  int size() const {return tag == DOUBLE ? 2 : 1;}
+
+  bool operator==(const JVMType& other) const = default;
+
+  // the type of values with the field descriptor (e.g., "I", "D",
+  // "Ljava/lang/String;", or "[I")
+  static JVMType of(const std::string& descriptor);
+};
+
+
+// The constant pool of a class file. Each constant is added once, and
+// its index returned each time it is asked for.
+class JVMConstantPool
+{
+public:
+  int utf8(const std::string& s);
+  int integer(std::int32_t value);
+  int number(double value);
+  int string(const std::string& s);
+  int class_ref(const std::string& name);
+  int field_ref(const std::string& owner, const std::string& name,
+                const std::string& descriptor);
+  int method_ref(const std::string& owner, const std::string& name,
+                 const std::string& descriptor);
+
+  // the constant pool count followed by the constants
+  std::string bytes() const;
+
+private:
+  std::string constants;
+  int count = 1;
+  std::unordered_map<std::string,int> indexes;
+
+  // helper to add an encoded constant taking the given number of
+  // entries (doubles take two)
+  int add(const std::string& constant, int entries = 1);
+};
+
+
+// a position in a method's code (bound once, jumped to any number of
+// times before or after)
+struct JVMLabel {
+  int id;
+};
+
+
+// Assembles a method's code. The assembler follows the types on the
+// operand stack (and of the locals in scope) instruction by
+// instruction, so it can work out the method's stack and local sizes
+// and write the stack map frame each jump target needs. Code following
+// a return or goto is not emitted until a label it can be reached from
+// is bound (the verifier rejects unreachable code without a frame).
+class JVMCode
+{
+public:
+
+  // the code for a method whose parameters (after its receiver, if it
+  // is not static) are the first locals
+  JVMCode(JVMConstantPool& pool, const std::vector<JVMType>& params);
+
+  JVMLabel new_label();
+  void bind(JVMLabel label);
+
+  // true if the next instruction can be reached
+  bool reachable() const {return live;}
+
+  // a new local of the type, in scope until the scope it was added in
+  // ends (scope() marks a scope's start)
+  int add_local(const JVMType& type);
+  int scope() const {return locals.size();}
+  void end_scope(int start);
+
+  // the instructions (an op takes no operands)
+  void op(JVMOp opcode);
+  void push_int(std::int32_t value);
+  void push_double(double value);
+  void push_string(const std::string& s);
+  void load(int local);
+  void store(int local);
+  void branch(JVMOp opcode, JVMLabel target);
+  void field(JVMOp opcode, const std::string& owner, const std::string& name,
+             const std::string& descriptor);
+  void invoke(JVMOp opcode, const std::string& owner, const std::string& name,
+              const std::string& descriptor);
+  // new (followed by dup, for the invokespecial of a constructor)
+  void new_object(const std::string& name);
+  void new_array(const std::string& element_descriptor);
+
+  // the method's Code attribute (with its StackMapTable)
+  std::string attribute() const;
+
+private:
+
+  JVMConstantPool& pool;
+  std::string code;
+  bool live = true;
+
+  // the types on the operand stack, and of each local slot (TOP if out
+  // of scope, and the second slot of a double is TOP)
+  std::vector<JVMType> stack;
+  std::vector<JVMType> locals;
+  int max_stack = 0;
+  int max_locals = 0;
+
+  // each label's offset (-1 until bound), and the frame (locals then
+  // stack) at it, from the first jump to it or the code falling into it
+  struct Frame {
+    bool known = false;
+    std::vector<JVMType> locals;
+    std::vector<JVMType> stack;
+  };
+  std::vector<int> offsets;
+  std::vector<Frame> frames;
+  std::vector<bool> targets;
+
+  // where each jump's offset is to be filled in, and its label
+  std::vector<std::pair<int,int>> jumps;
+
+  // helpers to emit code, and to follow the operand stack
+  void emit(JVMOp opcode);
+  void u1(int value);
+  void u2(int value);
+  void push(const JVMType& type);
+  JVMType pop();
+  void record(int label);
+
+};
+
+
+// A class file (version 52, Java 8) with its fields, methods, and
+// nested classes.
+class JVMClassFile
+{
+public:
+
+  static const int ACC_PUBLIC = 0x0001;
+  static const int ACC_PRIVATE = 0x0002;
+  static const int ACC_STATIC = 0x0008;
+  static const int ACC_SUPER = 0x0020;
+
+  JVMClassFile(const std::string& name, int access);
+  JVMClassFile(const JVMClassFile&) = delete;
+  JVMClassFile& operator=(const JVMClassFile&) = delete;
+
+  const std::string& name() const {return class_name;}
+  JVMConstantPool& constants() {return pool;}
+
+  void add_field(int access, const std::string& name,
+                 const std::string& descriptor);
+
+  // a method of the class, whose code is then assembled
+  JVMCode& add_method(int access, const std::string& name,
+                      const std::string& descriptor);
+
+  // record a nested class (in the InnerClasses attribute)
+  void add_inner_class(const std::string& inner, const std::string& outer,
+                       const std::string& simple_name, int access);
+
+  // the class file's contents
+  std::string bytes();
+
+private:
+
+  std::string class_name;
+  int access;
+  JVMConstantPool pool;
+
+  struct Member {
+    int access;
+    std::string name;
+    std::string descriptor;
+    std::unique_ptr<JVMCode> code;
+  };
+  std::vector<Member> fields;
+  std::vector<Member> methods;
+
+  struct InnerClass {
+    std::string inner;
+    std::string outer;
+    std::string simple_name;
+    int access;
+  };
+  std::vector<InnerClass> inner_classes;
+
+};
+
+
+#endif
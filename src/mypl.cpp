@@ -8,6 +8,10 @@
 
 #include <iostream>
 #include <fstream>
+#include <climits>
+#include <filesystem>
+#include <iterator>
+#include <sstream>
 #include <lexer.h>
 #include <java_lexer.h>
 #include <token.h>
@@ -18,64 +22,182 @@
 #include <print_visitor.h>
 #include <semantic_checker.h>
 #include <mypl_to_java_transpiler.h>
+#include <java_batch_transpiler.h>
+#include <mypl_to_cpp_transpiler.h>
+#include <mypl_to_jvm_compiler.h>
 #include <optional>
 #include <code_generator.h>
+#include <vm_bytecode.h>
+#include <compile_cache.h>
 
 using namespace std;
 
+// settings collected from the command-line flags (as opposed to the
+// mode, which selects what to do with the program)
+struct Settings {
+  bool legacy_dispatch = false;
+  int max_call_depth = 0;
+  bool profile = false;
+  bool superinstructions = true;
+  bool verify = true;
+  bool jit = true;
+  int optimization_level = 0;
+  bool gc_stats = false;
+  bool gc_stress = false;
+  long gc_threshold = 0;
+  long gc_nursery = 0;
+  // where --compile writes the bytecode (cout if empty), where
+  // --native writes the executable, or the directory --class writes
+  // the class files to
+  string output = "";
+  // whether normal mode caches scripts' bytecode, and the cache's size
+  // in bytes (the default if 0)
+  bool cache = true;
+  long cache_size = 0;
+  // the number of threads --java transpiles a directory's files with
+  // (one per core if 0)
+  int jobs = 0;
+};
+
 void usage(const string& command);
-void selector(const string& command, istream* input);
+void selector(const string& command, istream* input, const Settings& settings);
+void run_vm(VM& vm, const Settings& settings);
+void run_bytecode(const string& file, istream* input, const Settings& settings);
+void run_cached(istream* input, const Settings& settings);
+void compile(istream* input, VM& vm, const Settings& settings);
+void transpile_directory(const string& directory, const Settings& settings);
 void help_options();
+optional<long> flag_value(const string& value, long max = LONG_MAX);
 
 int main(int argc, char* argv[])
 {
   istream* input = &cin;
-  string response, args[argc];
-  char ch1, ch2 = ' ';
-  for (int i = 0; i < argc; i++)
+  Settings settings;
+  string mode = "", file = "";
+  for (int i = 1; i < argc; i++)
   {
-    args[i] = string(argv[i]);//convert from array of char* to array of string
-  }
-  
-  switch (argc) {
-    case 1: //no mode or file specified, open in "normal" mode for console input
-    usage("");
-    selector("", input);
-    break;
-
-    case 2: //mode specified but no file, open console input 
-    //OR file with no mode, open file in "normal" mode
-      ch1 = args[1][0];
-      ch2 = args[1][1];
-      if (ch1 == '-' && ch2 == '-')//checking for "--" to distinguish between mode or file path
-      {
-        //usage(args[1]);
-        selector(args[1], input);
-      } else {
-        input = new ifstream(args[1]); //file name is only argument
-        if (input->fail()) {
-          cout << "Unable to open file '" << args[1] << "'" << endl;
-          return 1;
-        }
-        //usage("");
-        selector("", input);
+    string arg = string(argv[i]);//convert from char* to string
+    if (arg == "-O0" || arg == "-O1") {
+      settings.optimization_level = arg[2] - '0';
+    } else if (arg == "--legacy-dispatch") {
+      settings.legacy_dispatch = true;
+    } else if (arg.starts_with("--max-call-depth=")) {
+      optional<long> n = flag_value(arg.substr(arg.find('=') + 1), INT_MAX);
+      if (!n)
+        return 1;
+      settings.max_call_depth = *n;
+    } else if (arg == "--no-superinstructions") {
+      settings.superinstructions = false;
+    } else if (arg == "--no-verify") {
+      settings.verify = false;
+    } else if (arg == "--no-jit") {
+      settings.jit = false;
+    } else if (arg == "--gc-stats") {
+      settings.gc_stats = true;
+    } else if (arg == "--gc-stress") {
+      settings.gc_stress = true;
+    } else if (arg.starts_with("--gc-threshold=")) {
+      optional<long> n = flag_value(arg.substr(arg.find('=') + 1));
+      if (!n)
+        return 1;
+      settings.gc_threshold = *n;
+    } else if (arg.starts_with("--gc-nursery=")) {
+      optional<long> n = flag_value(arg.substr(arg.find('=') + 1));
+      if (!n)
+        return 1;
+      settings.gc_nursery = *n;
+    } else if (arg == "--profile") {
+      settings.profile = true;
+    } else if (arg == "--no-cache") {
+      settings.cache = false;
+    } else if (arg.starts_with("--cache-size=")) {
+      optional<long> n = flag_value(arg.substr(arg.find('=') + 1));
+      if (!n)
+        return 1;
+      settings.cache_size = *n;
+    } else if (arg == "-o" && i + 1 < argc) {
+      settings.output = argv[++i];
+    } else if (arg == "-j" && i + 1 < argc) {
+      optional<long> n = flag_value(argv[++i], INT_MAX);
+      if (!n)
+        return 1;
+      settings.jobs = *n;
+    } else if (arg.starts_with("-j") && arg.size() > 2) {
+      optional<long> n = flag_value(arg.substr(2), INT_MAX);
+      if (!n)
+        return 1;
+      settings.jobs = *n;
+    } else if (arg.size() > 1 && arg[0] == '-' && arg[1] == '-') {
+      //checking for "--" to distinguish between mode or file path
+      if (mode != "") { //only one mode at a time
+        help_options();
+        return 1;
       }
-    break;
-
-    case 3: //file and mode specified
-      input = new ifstream(args[2]); //file name is second argument
-      usage(args[1]);
-      if (input->fail()) {
-        cout << "Unable to open file '" << args[2] << "'" << endl;
+      mode = arg;
+    } else {
+      if (file != "") { //only one file at a time
+        help_options();
         return 1;
       }
-      selector(args[1], input);
-    break;
+      file = arg;
+    }
+  }
+
+  // compile prog.mypl to prog.myplc unless told otherwise
+  if (mode == "--compile" && settings.output == "" && file != "") {
+    settings.output = file + (file.ends_with(".mypl") ? "c" : ".myplc");
+  }
+
+  // build prog.mypl into prog unless told otherwise
+  if (mode == "--native" && settings.output == "") {
+    if (file.ends_with(".mypl"))
+      settings.output = file.substr(0, file.size() - 5);
+    else
+      settings.output = file == "" ? "a.out" : file + ".out";
+  }
+
+  // write Program.class (and its structs' classes) here unless told
+  // otherwise
+  if (mode == "--class" && settings.output == "") {
+    settings.output = ".";
+  }
 
-    default: //invalid option
-      help_options();
+  if (mode == "--cache-stats") {
+    cout << to_string(CompileCache(CompileCache::default_directory()).statistics());
     return 1;
   }
+
+  // transpile each script in the directory (to the same place in the
+  // output directory, or next to the script unless told otherwise)
+  if (mode == "--java" && file != "" && filesystem::is_directory(file)) {
+    if (settings.output == "")
+      settings.output = file;
+    transpile_directory(file, settings);
+    return 1;
+  }
+
+  if (file == "") {
+    //no file specified, open console input (in "normal" mode if no mode given)
+    if (mode == "")
+      usage("");
+    selector(mode, input, settings);
+  } else if (mode == "--run-bytecode") {
+    // (the file is mapped rather than read through a stream)
+    run_bytecode(file, nullptr, settings);
+  } else {
+    input = new ifstream(file);
+    if (mode != "")
+      usage(mode);
+    if (input->fail()) {
+      cout << "Unable to open file '" << file << "'" << endl;
+      delete input;
+      return 1;
+    }
+    if (mode == "" && settings.cache)
+      run_cached(input, settings);
+    else
+      selector(mode, input, settings);
+  }
   //input->clear();
   if (input != &cin)
   {
@@ -109,13 +231,17 @@ void usage(const string& command) {
     cout << "[Normal Mode]" << endl;
   } else if (command == "--java") {
     // cout << "[Java Mode]" << endl;
+  } else if (command == "--compile" || command == "--run-bytecode" ||
+             command == "--cpp" || command == "--native" ||
+             command == "--class") {
+    // (no banner, the output is code or the program's own)
   } else {
     help_options();
   }
 }
 
 //implements behavior for each mode, accepts command and input stream
-void selector(const string& command, istream* input) {
+void selector(const string& command, istream* input, const Settings& settings) {
   char ch = ' ';
   Lexer lexer = Lexer(*input);
   JavaLexer jlexer = JavaLexer(*input);
@@ -161,6 +287,42 @@ void selector(const string& command, istream* input) {
         cerr << ex.what() << endl;
       }
     cout << endl;
+  } else if (command == "--cpp" || command == "--native") {
+    try {
+      ASTParser parser(lexer);
+      Program p = parser.parse();
+      SemanticChecker v;
+      p.accept(v);
+      if (command == "--cpp") {
+        MyPLtoCppTranspiler t(cout);
+        p.accept(t);
+      } else {
+        ostringstream source;
+        MyPLtoCppTranspiler t(source);
+        p.accept(t);
+        MyPLtoCppTranspiler::build(source.str(), settings.output);
+      }
+    } catch (MyPLException& ex) {
+      cerr << ex.what() << endl;
+    }
+  } else if (command == "--class") {
+    try {
+      ASTParser parser(lexer);
+      Program p = parser.parse();
+      SemanticChecker v;
+      p.accept(v);
+      MyPLtoJVMCompiler c;
+      p.accept(c);
+      for (auto& [name, bytes] : c.class_files()) {
+        string path = settings.output + "/" + name;
+        ofstream out(path, ios::binary);
+        out << bytes;
+        if (!out)
+          cerr << "Unable to write file '" << path << "'" << endl;
+      }
+    } catch (MyPLException& ex) {
+      cerr << ex.what() << endl;
+    }
   } else if (command == "--check") {
     try {
       ASTParser parser(lexer); 
@@ -177,28 +339,154 @@ void selector(const string& command, istream* input) {
         SemanticChecker v; 
         p.accept(v);
         VM vm;
-        CodeGenerator g(vm);
+        CodeGenerator g(vm, v.operand_types());
         p.accept(g);
-        cout << to_string(vm) << endl;
+        if (settings.optimization_level > 0) {
+          // show the code both before and after optimizing
+          VM optimized_vm;
+          CodeGenerator optimizer(optimized_vm, v.operand_types());
+          optimizer.set_optimization_level(settings.optimization_level);
+          p.accept(optimizer);
+          cout << "Before -O" << settings.optimization_level << ":" << endl;
+          cout << to_string(vm) << endl;
+          cout << "After -O" << settings.optimization_level << ":" << endl;
+          cout << to_string(optimized_vm) << endl;
+        } else
+          cout << to_string(vm) << endl;
       } catch (MyPLException& ex) { 
         cerr << ex.what() << endl;
       }
   } else if (command == "") {
     try {
-        ASTParser parser(lexer); 
-        Program p = parser.parse(); 
-        SemanticChecker v; 
-        p.accept(v);
         VM vm;
-        CodeGenerator g(vm);
-        p.accept(g);
-        vm.run();
+        compile(input, vm, settings);
+        run_vm(vm, settings);
       } catch (MyPLException& ex) { 
         cerr << ex.what() << endl;
       }
+  } else if (command == "--compile") {
+    try {
+      VM vm;
+      compile(input, vm, settings);
+      if (settings.output == "")
+        write_bytecode(vm, cout);
+      else {
+        ofstream out(settings.output, ios::binary);
+        write_bytecode(vm, out);
+        if (!out)
+          cerr << "Unable to write file '" << settings.output << "'" << endl;
+      }
+    } catch (MyPLException& ex) {
+      cerr << ex.what() << endl;
+    }
+  } else if (command == "--run-bytecode") {
+    run_bytecode("", input, settings);
+  }
+}
+
+//runs code compiled by --compile (skipping the lexer through the code
+//generator) from the file, or from the input if there is no file
+void run_bytecode(const string& file, istream* input, const Settings& settings) {
+  try {
+    VM vm;
+    if (file == "")
+      vm.load(VMImage::read(*input));
+    else
+      vm.load(VMImage::open(file));
+    run_vm(vm, settings);
+  } catch (MyPLException& ex) {
+    cerr << ex.what() << endl;
   }
 }
 
+//runs a script in normal mode, from its cached bytecode if it has not
+//changed since it was last compiled (caching it otherwise)
+void run_cached(istream* input, const Settings& settings) {
+  string source {istreambuf_iterator<char>(*input), istreambuf_iterator<char>()};
+  CompileCache cache(CompileCache::default_directory(),
+                     settings.cache_size > 0 ? settings.cache_size
+                                             : CompileCache::DEFAULT_SIZE);
+  string key = CompileCache::key(source, settings.optimization_level);
+  try {
+    VM vm;
+    if (shared_ptr<const VMImage> image = cache.find(key))
+      vm.load(image);
+    else {
+      istringstream in(source);
+      compile(&in, vm, settings);
+      cache.store(key, vm);
+    }
+    run_vm(vm, settings);
+  } catch (MyPLException& ex) {
+    cerr << ex.what() << endl;
+  }
+}
+
+//compiles the program on the input (lexer through code generator)
+void compile(istream* input, VM& vm, const Settings& settings) {
+  Lexer lexer(*input);
+  ASTParser parser(lexer);
+  Program p = parser.parse();
+  SemanticChecker v;
+  p.accept(v);
+  CodeGenerator g(vm, v.operand_types());
+  g.set_optimization_level(settings.optimization_level);
+  p.accept(g);
+}
+
+//transpiles each .mypl file under the directory to a .java file (see
+//JavaBatchTranspiler), reporting each file's errors and then the
+//throughput
+void transpile_directory(const string& directory, const Settings& settings) {
+  try {
+    JavaBatchStats stats =
+      JavaBatchTranspiler(directory, settings.output, settings.jobs).run();
+    for (auto& [file, error] : stats.errors)
+      cerr << file << ": " << error << endl;
+    cout << to_string(stats);
+  } catch (MyPLException& ex) {
+    cerr << ex.what() << endl;
+  }
+}
+
+//configures the vm from the flags, then runs its program
+void run_vm(VM& vm, const Settings& settings) {
+  if (settings.legacy_dispatch)
+    vm.set_dispatch(Dispatch::LEGACY);
+  if (settings.max_call_depth > 0)
+    vm.set_max_call_depth(settings.max_call_depth);
+  vm.set_superinstructions(settings.superinstructions);
+  vm.set_verification(settings.verify);
+  vm.set_jit(settings.jit);
+  vm.set_profile(settings.profile);
+  vm.set_gc_stress(settings.gc_stress);
+  if (settings.gc_threshold > 0)
+    vm.set_gc_threshold(settings.gc_threshold);
+  if (settings.gc_nursery > 0)
+    vm.set_gc_nursery_size(settings.gc_nursery);
+  vm.run();
+  if (settings.profile)
+    cerr << vm.profile_report();
+  if (settings.gc_stats)
+    cerr << to_string(vm.gc_statistics());
+}
+
+//the value of a numeric flag (e.g., the N of --max-call-depth=N), or
+//nullopt (after printing the usage) if it is not a number from 0 to max
+optional<long> flag_value(const string& value, long max) {
+  try {
+    size_t end = 0;
+    long n = stol(value, &end);
+    if (end == value.size() && n >= 0 && n <= max)
+      return n;
+  } catch (invalid_argument&) {
+  } catch (out_of_range&) {
+  }
+  cout << "Invalid number '" << value << "'" << endl;
+  help_options();
+  return nullopt;
+}
+
 //simple helper function to output help message, avoids repeating code
 void help_options() {
   cout << "Usage: ./mypl [option] [script-file]" << endl;
@@ -210,5 +498,29 @@ void help_options() {
   cout << "   --check   statically checks program" << endl;
   cout << "   --ir     print intermediate (code) representation" << endl;
   cout << "   --java     Transpiles program to Java" << endl;
+  cout << "   --compile   compiles program to bytecode (prog.mypl to prog.myplc)" << endl;
+  cout << "   --run-bytecode   runs a program compiled with --compile" << endl;
+  cout << "   --cache-stats   reports compile cache hits, misses, and size" << endl;
+  cout << "   --cpp     Transpiles program to C++" << endl;
+  cout << "   --native   builds program into a native executable (prog.mypl to prog)" << endl;
+  cout << "   --class   compiles program to JVM class files (Program.class)" << endl;
+  cout << "Flags:" << endl;
+  cout << "   -O0 / -O1           disable / enable bytecode optimization (--ir shows both)" << endl;
+  cout << "   -o FILE             write --compile bytecode (or the --native executable) to FILE" << endl;
+  cout << "                       (or --class files to the directory FILE)" << endl;
+  cout << "                       (or, given --java and a directory, the .java files to FILE)" << endl;
+  cout << "   -j N                transpile a directory's files on N threads (--java, default one per core)" << endl;
+  cout << "   --no-cache          compile scripts even if their bytecode is cached" << endl;
+  cout << "   --cache-size=N      evict cached bytecode beyond N bytes (default 64 MiB)" << endl;
+  cout << "   --legacy-dispatch   run the VM with the original if/else dispatch" << endl;
+  cout << "   --max-call-depth=N  limit VM calls to N active frames" << endl;
+  cout << "   --no-superinstructions  run the VM without fused instructions" << endl;
+  cout << "   --no-verify         run the VM with every check (no bytecode verifier)" << endl;
+  cout << "   --no-jit            run the VM without compiling hot functions to machine code" << endl;
+  cout << "   --gc-stats          report garbage collection statistics" << endl;
+  cout << "   --gc-stress         collect garbage before every allocation" << endl;
+  cout << "   --gc-threshold=N    first fully collect when the old space reaches N bytes" << endl;
+  cout << "   --gc-nursery=N      allocate new objects in an N byte nursery" << endl;
+  cout << "   --profile           report the most frequent VM opcode pairs" << endl;
 
-}
\ No newline at end of file
+}
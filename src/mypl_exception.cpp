@@ -32,6 +32,11 @@ MyPLException MyPLException::VMError(const std::string& msg)
 {
   return MyPLException("VM Error: " + msg);    
 }
+
+MyPLException MyPLException::NativeError(const std::string& msg)
+{
+  return MyPLException("Native Error: " + msg);
+}
   
 const char* MyPLException::what() const noexcept 
 {
@@ -24,6 +24,7 @@ public:
   static MyPLException ParserError(const std::string& msg);
   static MyPLException StaticError(const std::string& msg);
   static MyPLException VMError(const std::string& msg);
+  static MyPLException NativeError(const std::string& msg);
   
   // return a string representation for printing
   const char* what() const noexcept;
@@ -0,0 +1,991 @@
+//----------------------------------------------------------------------
+// FILE: mypl_to_cpp_transpiler.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: MyPL to C++ (native code) transpiler
+//----------------------------------------------------------------------
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <unordered_set>
+#include "mypl_to_cpp_transpiler.h"
+#include "mypl_exception.h"
+
+using namespace std;
+
+
+static const unordered_set<string> BUILT_INS {"print", "input", "to_string",
+  "to_int", "to_double", "length", "get", "concat"};
+
+
+// The run-time library written at the top of each generated program.
+// Ints, doubles, bools, and chars are Maybe values (null if not set),
+// strings and objects are (possibly null) counted references, and
+// errors end the program the way the vm's errors end a run.
+static const string RUNTIME = R"(//----------------------------------------------------------------------
+// MyPL run-time library
+//----------------------------------------------------------------------
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mypl {
+
+[[noreturn]] inline void error(const char* msg)
+{
+  std::fflush(stdout);
+  std::fprintf(stderr, "Runtime Error: %s\n", msg);
+  std::exit(1);
+}
+
+// the null literal (converts to a null value of any type)
+struct Null {};
+
+template <class T>
+struct Maybe {
+  T v;
+  bool set;
+  Maybe() : v(), set(false) {}
+  Maybe(Null) : v(), set(false) {}
+  Maybe(T v) : v(v), set(true) {}
+};
+
+using Int = Maybe<int>;
+using Double = Maybe<double>;
+using Bool = Maybe<bool>;
+using Char = Maybe<char>;
+
+template <class T>
+inline T val(const Maybe<T>& x)
+{
+  if (!x.set)
+    error("null reference");
+  return x.v;
+}
+
+struct Obj {
+  int refs = 0;
+  virtual ~Obj() {}
+};
+
+// objects whose last reference is dropped while another object is
+// being deleted are deleted after it (not recursively, so dropping a
+// long list cannot overflow the stack)
+inline std::vector<Obj*> dying;
+inline bool deleting = false;
+
+inline void release(Obj* o)
+{
+  if (--o->refs > 0)
+    return;
+  if (deleting) {
+    dying.push_back(o);
+    return;
+  }
+  deleting = true;
+  delete o;
+  while (!dying.empty()) {
+    Obj* next = dying.back();
+    dying.pop_back();
+    delete next;
+  }
+  deleting = false;
+}
+
+template <class T>
+class Ref {
+public:
+  Ref() : p(nullptr) {}
+  Ref(Null) : p(nullptr) {}
+  explicit Ref(T* p) : p(p) {if (p) ++p->refs;}
+  Ref(const Ref& r) : p(r.p) {if (p) ++p->refs;}
+  Ref(Ref&& r) noexcept : p(r.p) {r.p = nullptr;}
+  ~Ref() {if (p) release(p);}
+  Ref& operator=(Ref r) noexcept {std::swap(p, r.p); return *this;}
+  T* get() const {return p;}
+  T* operator->() const
+  {
+    if (!p)
+      error("null reference");
+    return p;
+  }
+private:
+  T* p;
+};
+
+template <class T>
+inline Ref<T> make() {return Ref<T>(new T());}
+
+struct Text : Obj {
+  std::string s;
+  explicit Text(std::string s) : s(std::move(s)) {}
+};
+
+using Str = Ref<Text>;
+
+inline Str str(std::string s) {return Str(new Text(std::move(s)));}
+
+inline const std::string& chars(const Str& x) {return x->s;}
+
+template <class T>
+struct Array : Obj {
+  std::vector<T> elems;
+  explicit Array(int n) : elems(n) {}
+};
+
+template <class T>
+inline Ref<Array<T>> new_array(const Int& n)
+{
+  int size = val(n);
+  if (size < 0)
+    error("negative array size");
+  return Ref<Array<T>>(new Array<T>(size));
+}
+
+template <class T>
+inline T& elem(const Ref<Array<T>>& a, const Int& i)
+{
+  std::vector<T>& elems = a->elems;
+  int index = val(i);
+  if (index < 0 || index >= (int) elems.size())
+    error("out-of-bounds array index");
+  return elems[index];
+}
+
+template <class T>
+struct Id {using type = T;};
+
+// stores into array elements (null cannot be stored in int, double,
+// bool, or char arrays)
+template <class T>
+inline void store(Maybe<T>& slot, const typename Id<Maybe<T>>::type& x)
+{
+  val(x);
+  slot = x;
+}
+
+template <class T>
+inline void store(T& slot, typename Id<T>::type x) {slot = std::move(x);}
+
+// variables cannot be assigned null
+template <class T>
+inline Maybe<T> nonnull(const Maybe<T>& x)
+{
+  val(x);
+  return x;
+}
+
+template <class T>
+inline Ref<T> nonnull(Ref<T> x)
+{
+  if (!x.get())
+    error("null reference");
+  return x;
+}
+
+[[noreturn]] inline Null nonnull(Null) {error("null reference");}
+
+//----------------------------------------------------------------------
+// Operators (ints wrap around, as in the vm)
+//----------------------------------------------------------------------
+
+inline Int add(const Int& x, const Int& y)
+{
+  return int(unsigned(val(x)) + unsigned(val(y)));
+}
+
+inline Int sub(const Int& x, const Int& y)
+{
+  return int(unsigned(val(x)) - unsigned(val(y)));
+}
+
+inline Int mul(const Int& x, const Int& y)
+{
+  return int(unsigned(val(x)) * unsigned(val(y)));
+}
+
+inline Int div(const Int& x, const Int& y)
+{
+  int a = val(x), b = val(y);
+  if (b == 0)
+    error("division by zero");
+  if (b == -1)
+    return int(0u - unsigned(a));
+  return a / b;
+}
+
+inline Double add(const Double& x, const Double& y) {return val(x) + val(y);}
+inline Double sub(const Double& x, const Double& y) {return val(x) - val(y);}
+inline Double mul(const Double& x, const Double& y) {return val(x) * val(y);}
+inline Double div(const Double& x, const Double& y) {return val(x) / val(y);}
+
+template <class T>
+inline Bool eq(const Maybe<T>& x, const Maybe<T>& y)
+{
+  if (!x.set || !y.set)
+    return x.set == y.set;
+  return x.v == y.v;
+}
+
+inline Bool eq(const Str& x, const Str& y)
+{
+  if (!x.get() || !y.get() || x.get() == y.get())
+    return x.get() == y.get();
+  return x.get()->s == y.get()->s;
+}
+
+template <class T>
+inline Bool eq(const Ref<T>& x, const Ref<T>& y) {return x.get() == y.get();}
+
+inline Bool eq(Null, Null) {return true;}
+
+template <class X, class Y>
+inline Bool ne(const X& x, const Y& y) {return !val(eq(x, y));}
+
+template <class T>
+inline Bool lt(const Maybe<T>& x, const Maybe<T>& y) {return val(x) < val(y);}
+template <class T>
+inline Bool le(const Maybe<T>& x, const Maybe<T>& y) {return val(x) <= val(y);}
+template <class T>
+inline Bool gt(const Maybe<T>& x, const Maybe<T>& y) {return val(x) > val(y);}
+template <class T>
+inline Bool ge(const Maybe<T>& x, const Maybe<T>& y) {return val(x) >= val(y);}
+
+// (chars compare as the one character strings they are in the vm)
+inline unsigned char code(const Char& x) {return val(x);}
+inline Bool lt(const Char& x, const Char& y) {return code(x) < code(y);}
+inline Bool le(const Char& x, const Char& y) {return code(x) <= code(y);}
+inline Bool gt(const Char& x, const Char& y) {return code(x) > code(y);}
+inline Bool ge(const Char& x, const Char& y) {return code(x) >= code(y);}
+
+inline Bool lt(const Str& x, const Str& y) {return chars(x) < chars(y);}
+inline Bool le(const Str& x, const Str& y) {return chars(x) <= chars(y);}
+inline Bool gt(const Str& x, const Str& y) {return chars(x) > chars(y);}
+inline Bool ge(const Str& x, const Str& y) {return chars(x) >= chars(y);}
+
+// (both operands are evaluated, as in the vm)
+inline Bool and_(const Bool& x, const Bool& y)
+{
+  bool a = val(x), b = val(y);
+  return a && b;
+}
+
+inline Bool or_(const Bool& x, const Bool& y)
+{
+  bool a = val(x), b = val(y);
+  return a || b;
+}
+
+inline Bool not_(const Bool& x) {return !val(x);}
+
+inline bool test(const Bool& x) {return val(x);}
+
+//----------------------------------------------------------------------
+// Built-in functions
+//----------------------------------------------------------------------
+
+inline void print(const Int& x)
+{
+  if (x.set)
+    std::printf("%d", x.v);
+  else
+    std::fputs("null", stdout);
+}
+
+inline void print(const Double& x)
+{
+  if (x.set)
+    std::printf("%f", x.v);
+  else
+    std::fputs("null", stdout);
+}
+
+inline void print(const Bool& x)
+{
+  std::fputs(!x.set ? "null" : x.v ? "true" : "false", stdout);
+}
+
+inline void print(const Char& x)
+{
+  if (x.set)
+    std::putchar(x.v);
+  else
+    std::fputs("null", stdout);
+}
+
+inline void print(const Str& x)
+{
+  if (x.get())
+    std::fwrite(x.get()->s.data(), 1, x.get()->s.size(), stdout);
+  else
+    std::fputs("null", stdout);
+}
+
+inline Str input()
+{
+  std::fflush(stdout);
+  std::string line;
+  std::getline(std::cin, line);
+  return str(std::move(line));
+}
+
+inline Int length(const Str& x) {return int(chars(x).size());}
+
+template <class T>
+inline Int length(const Ref<Array<T>>& a) {return int(a->elems.size());}
+
+inline Char get(const Int& i, const Str& x)
+{
+  int index = val(i);
+  const std::string& s = chars(x);
+  if (index < 0 || index >= (int) s.size())
+    error("out-of-bounds string index");
+  return s[index];
+}
+
+inline Str concat(const Str& x, const Str& y) {return str(chars(x) + chars(y));}
+
+// x = concat(x, y), appending in place if x holds the only reference
+// to its string (building a string up in a loop takes linear time)
+inline void append(Str& x, const Str& y)
+{
+  const std::string& tail = chars(y);
+  if (x->refs == 1)
+    x.get()->s += tail;
+  else
+    x = str(chars(x) + tail);
+}
+
+inline Str to_string(const Int& x) {return str(std::to_string(val(x)));}
+inline Str to_string(const Double& x) {return str(std::to_string(val(x)));}
+inline Str to_string(const Bool& x) {return str(val(x) ? "true" : "false");}
+inline Str to_string(const Char& x) {return str(std::string(1, val(x)));}
+
+inline Str to_string(const Str& x)
+{
+  chars(x);
+  return x;
+}
+
+inline Int parse_int(const std::string& s)
+{
+  try {
+    return std::stoi(s);
+  } catch (std::exception&) {
+    error("cannot convert string to int");
+  }
+}
+
+inline Double parse_double(const std::string& s)
+{
+  try {
+    return std::stod(s);
+  } catch (std::exception&) {
+    error("cannot convert string to double");
+  }
+}
+
+inline Int to_int(const Double& x) {return int(val(x));}
+inline Int to_int(const Str& x) {return parse_int(chars(x));}
+inline Int to_int(const Char& x) {return parse_int(std::string(1, val(x)));}
+
+inline Double to_double(const Int& x) {return double(val(x));}
+inline Double to_double(const Str& x) {return parse_double(chars(x));}
+inline Double to_double(const Char& x) {return parse_double(std::string(1, val(x)));}
+
+}
+
+)";
+
+
+// helper function to write a string as a C++ string literal
+static string cpp_literal(const string& s)
+{
+  string result = "\"";
+  for (char ch : s) {
+    if (ch == '"' or ch == '\\')
+      result += string("\\") + ch;
+    else if (ch == '\n')
+      result += "\\n";
+    else if (ch == '\t')
+      result += "\\t";
+    else if (static_cast<unsigned char>(ch) < ' ' or ch == 127) {
+      // (an octal escape always has three digits, so cannot run into
+      // the following characters)
+      char digits[8];
+      snprintf(digits, sizeof(digits), "\\%03o", static_cast<unsigned char>(ch));
+      result += digits;
+    } else
+      result += ch;
+  }
+  return result + "\"";
+}
+
+
+// helper function to quote a path for the shell
+static string shell_quote(const string& s)
+{
+  string result = "'";
+  for (char ch : s)
+    result += ch == '\'' ? string("'\\''") : string(1, ch);
+  return result + "'";
+}
+
+
+MyPLtoCppTranspiler::MyPLtoCppTranspiler(ostream& output)
+  : out(output)
+{
+}
+
+
+void MyPLtoCppTranspiler::build(const string& source, const string& executable)
+{
+  namespace fs = std::filesystem;
+  fs::path file = fs::temp_directory_path() /
+    ("mypl-" + to_string(random_device()()) + ".cpp");
+  {
+    ofstream cpp(file);
+    cpp << source;
+    if (!cpp)
+      throw MyPLException::NativeError("unable to write '" + file.string() + "'");
+  }
+  const char* compiler = getenv("CXX");
+  string command = string(compiler ? compiler : "c++") + " -std=c++17 -O2 -o " +
+    shell_quote(executable) + " " + shell_quote(file.string());
+  int status = system(command.c_str());
+  error_code ec;
+  fs::remove(file, ec);
+  if (status != 0)
+    throw MyPLException::NativeError("'" + command + "' failed");
+}
+
+
+void MyPLtoCppTranspiler::inc_indent()
+{
+  indent += INDENT_AMT;
+}
+
+
+void MyPLtoCppTranspiler::dec_indent()
+{
+  indent -= INDENT_AMT;
+}
+
+
+void MyPLtoCppTranspiler::line(const string& s)
+{
+  *code << string(indent, ' ') << s << '\n';
+}
+
+
+string MyPLtoCppTranspiler::cpp_type(const DataType& type) const
+{
+  string name = type.type_name;
+  string base;
+  if (name == "int")
+    base = "mypl::Int";
+  else if (name == "double")
+    base = "mypl::Double";
+  else if (name == "bool")
+    base = "mypl::Bool";
+  else if (name == "char")
+    base = "mypl::Char";
+  else if (name == "string")
+    base = "mypl::Str";
+  else if (name == "void")
+    base = "void";
+  else
+    base = "mypl::Ref<s_" + name + ">";
+  if (type.is_array)
+    return "mypl::Ref<mypl::Array<" + base + ">>";
+  return base;
+}
+
+
+string MyPLtoCppTranspiler::signature(const FunDef& f) const
+{
+  string s = "static " + cpp_type(f.return_type) + " f_" +
+    f.fun_name.lexeme() + "(";
+  for (int i = 0; i < f.params.size(); i++) {
+    if (i > 0)
+      s += ", ";
+    s += cpp_type(f.params[i].data_type) + " v_" +
+      f.params[i].var_name.lexeme();
+  }
+  return s + ")";
+}
+
+
+DataType MyPLtoCppTranspiler::var_type(const string& name) const
+{
+  for (auto scope = var_types.rbegin(); scope != var_types.rend(); ++scope)
+    if (scope->contains(name))
+      return scope->at(name);
+  return DataType {false, "void"};
+}
+
+
+DataType MyPLtoCppTranspiler::field_type(const DataType& type,
+                                         const Token& field) const
+{
+  if (struct_defs.contains(type.type_name))
+    for (const VarDef& field_def : struct_defs.at(type.type_name).fields)
+      if (field_def.var_name.lexeme() == field.lexeme())
+        return field_def.data_type;
+  return DataType {false, "void"};
+}
+
+
+string MyPLtoCppTranspiler::coerce(const DataType& type) const
+{
+  // (only the null literal and void calls have type void)
+  if (curr_type.type_name == "void" and !curr_type.is_array and
+      (type.type_name != "void" or type.is_array))
+    return cpp_type(type) + "()";
+  return curr_code;
+}
+
+
+void MyPLtoCppTranspiler::statement(const shared_ptr<Stmt>& stmt)
+{
+  // a call used as a statement is made directly (its result unused)
+  if (CallExpr* e = dynamic_cast<CallExpr*>(stmt.get())) {
+    call(*e);
+    line(curr_code + ";");
+  } else
+    stmt->accept(*this);
+}
+
+
+void MyPLtoCppTranspiler::block(const vector<shared_ptr<Stmt>>& stmts)
+{
+  var_types.push_back({});
+  inc_indent();
+  for (auto& stmt : stmts)
+    statement(stmt);
+  dec_indent();
+  var_types.pop_back();
+}
+
+
+string MyPLtoCppTranspiler::condition(Expr& e)
+{
+  // the calls are made at the start of the block the condition is
+  // tested in
+  ostringstream calls;
+  ostream* saved = code;
+  code = &calls;
+  inc_indent();
+  e.accept(*this);
+  dec_indent();
+  code = saved;
+  return calls.str();
+}
+
+
+void MyPLtoCppTranspiler::visit(Program& p)
+{
+  for (auto& struct_def : p.struct_defs)
+    struct_def.accept(*this);
+  for (auto& fun_def : p.fun_defs)
+    return_types[fun_def.fun_name.lexeme()] = fun_def.return_type;
+  for (auto& fun_def : p.fun_defs)
+    fun_def.accept(*this);
+
+  // the program is written in one piece once it is complete
+  ostringstream program;
+  program << RUNTIME;
+  for (auto& struct_def : p.struct_defs)
+    program << "struct s_" << struct_def.struct_name.lexeme() << ";\n";
+  for (auto& struct_def : p.struct_defs) {
+    program << "\nstruct s_" << struct_def.struct_name.lexeme()
+            << " : mypl::Obj {\n";
+    for (const VarDef& field : struct_def.fields)
+      program << string(INDENT_AMT, ' ') << cpp_type(field.data_type)
+              << " m_" << field.var_name.lexeme() << ";\n";
+    program << "};\n";
+  }
+  program << "\n";
+  for (int i = 0; i < literals.size(); i++)
+    program << "static const mypl::Str lit_" << i << " = mypl::str("
+            << cpp_literal(literals[i]) << ");\n";
+  program << "\n";
+  for (auto& fun_def : p.fun_defs)
+    program << signature(fun_def) << ";\n";
+  program << "\n" << functions.str();
+  program << "int main()\n{\n"
+          << string(INDENT_AMT, ' ') << "f_main();\n"
+          << string(INDENT_AMT, ' ') << "return 0;\n}\n";
+  out << program.str();
+}
+
+
+void MyPLtoCppTranspiler::visit(FunDef& f)
+{
+  return_type = f.return_type;
+  next_temp = 0;
+  var_types.push_back({});
+  for (const VarDef& param : f.params)
+    var_types.back()[param.var_name.lexeme()] = param.data_type;
+  line(signature(f));
+  line("{");
+  inc_indent();
+  for (auto& stmt : f.stmts)
+    statement(stmt);
+  // (a function that ends without returning returns null)
+  if (f.return_type.type_name != "void" or f.return_type.is_array)
+    line("return {};");
+  dec_indent();
+  line("}");
+  line("");
+  var_types.pop_back();
+}
+
+
+void MyPLtoCppTranspiler::visit(StructDef& s)
+{
+  struct_defs[s.struct_name.lexeme()] = s;
+}
+
+
+void MyPLtoCppTranspiler::visit(ReturnStmt& s)
+{
+  s.expr.accept(*this);
+  if (return_type.type_name == "void" and !return_type.is_array)
+    line("return;");
+  else
+    line("return " + coerce(return_type) + ";");
+}
+
+
+void MyPLtoCppTranspiler::visit(WhileStmt& s)
+{
+  string calls = condition(s.condition);
+  if (calls.empty())
+    line("while (mypl::test(" + curr_code + ")) {");
+  else {
+    line("while (true) {");
+    *code << calls;
+    inc_indent();
+    line("if (!mypl::test(" + curr_code + "))");
+    line(string(INDENT_AMT, ' ') + "break;");
+    dec_indent();
+  }
+  block(s.stmts);
+  line("}");
+}
+
+
+void MyPLtoCppTranspiler::visit(ForStmt& s)
+{
+  line("{");
+  inc_indent();
+  var_types.push_back({});
+  s.var_decl.accept(*this);
+  string calls = condition(s.condition);
+  if (calls.empty())
+    line("while (mypl::test(" + curr_code + ")) {");
+  else {
+    line("while (true) {");
+    *code << calls;
+    inc_indent();
+    line("if (!mypl::test(" + curr_code + "))");
+    line(string(INDENT_AMT, ' ') + "break;");
+    dec_indent();
+  }
+  // (the body's variables are out of scope in the update)
+  inc_indent();
+  line("{");
+  block(s.stmts);
+  line("}");
+  s.assign_stmt.accept(*this);
+  dec_indent();
+  line("}");
+  var_types.pop_back();
+  dec_indent();
+  line("}");
+}
+
+
+void MyPLtoCppTranspiler::visit(IfStmt& s)
+{
+  s.if_part.condition.accept(*this);
+  line("if (mypl::test(" + curr_code + ")) {");
+  block(s.if_part.stmts);
+  // an else if whose condition makes calls is an if in an else (the
+  // calls are only made if the earlier conditions are false)
+  int nested = 0;
+  for (BasicIf& else_if : s.else_ifs) {
+    string calls = condition(else_if.condition);
+    if (calls.empty())
+      line("} else if (mypl::test(" + curr_code + ")) {");
+    else {
+      line("} else {");
+      *code << calls;
+      inc_indent();
+      ++nested;
+      line("if (mypl::test(" + curr_code + ")) {");
+    }
+    block(else_if.stmts);
+  }
+  if (s.else_stmts.size() > 0) {
+    line("} else {");
+    block(s.else_stmts);
+  }
+  line("}");
+  for (; nested > 0; --nested) {
+    dec_indent();
+    line("}");
+  }
+}
+
+
+void MyPLtoCppTranspiler::visit(VarDeclStmt& s)
+{
+  s.expr.accept(*this);
+  string value = coerce(s.var_def.data_type);
+  var_types.back()[s.var_def.var_name.lexeme()] = s.var_def.data_type;
+  line(cpp_type(s.var_def.data_type) + " v_" + s.var_def.var_name.lexeme() +
+       " = mypl::nonnull(" + value + ");");
+}
+
+
+void MyPLtoCppTranspiler::visit(AssignStmt& s)
+{
+  // x = concat(x, e) appends e to x's string when no other reference
+  // can see it change
+  if (SimpleTerm* term = dynamic_cast<SimpleTerm*>(s.expr.first.get());
+      term and s.lvalue.size() == 1 and !s.lvalue[0].array_expr and
+      !s.expr.negated and !s.expr.op) {
+    CallExpr* e = dynamic_cast<CallExpr*>(term->rvalue.get());
+    if (e and e->fun_name.lexeme() == "concat" and e->args.size() == 2) {
+      Expr& lhs = e->args[0];
+      SimpleTerm* arg = dynamic_cast<SimpleTerm*>(lhs.first.get());
+      VarRValue* var = arg ? dynamic_cast<VarRValue*>(arg->rvalue.get()) : nullptr;
+      if (var and !lhs.negated and !lhs.op and var->path.size() == 1 and
+          !var->path[0].array_expr and
+          var->path[0].var_name.lexeme() == s.lvalue[0].var_name.lexeme()) {
+        e->args[1].accept(*this);
+        line("mypl::append(v_" + s.lvalue[0].var_name.lexeme() + ", " +
+             curr_code + ");");
+        return;
+      }
+    }
+  }
+  // the variable, field, or element assigned (and its type)
+  DataType type = var_type(s.lvalue[0].var_name.lexeme());
+  string target = "v_" + s.lvalue[0].var_name.lexeme();
+  for (int i = 0; i < s.lvalue.size(); i++) {
+    if (i > 0) {
+      target += "->m_" + s.lvalue[i].var_name.lexeme();
+      type = field_type(type, s.lvalue[i].var_name);
+    }
+    if (s.lvalue[i].array_expr.has_value()) {
+      s.lvalue[i].array_expr->accept(*this);
+      target = "mypl::elem(" + target + ", " + curr_code + ")";
+      type.is_array = false;
+    }
+  }
+  s.expr.accept(*this);
+  string value = coerce(type);
+  if (s.lvalue.back().array_expr.has_value())
+    line("mypl::store(" + target + ", " + value + ");");
+  else if (s.lvalue.size() > 1)
+    line(target + " = " + value + ";");
+  else
+    line(target + " = mypl::nonnull(" + value + ");");
+}
+
+
+void MyPLtoCppTranspiler::call(CallExpr& e)
+{
+  string name = e.fun_name.lexeme();
+  vector<string> args;
+  for (Expr& arg : e.args) {
+    arg.accept(*this);
+    args.push_back(curr_code);
+  }
+  if (BUILT_INS.contains(name)) {
+    if (name == "print")
+      curr_type = DataType {false, "void"};
+    else if (name == "input" or name == "to_string" or name == "concat")
+      curr_type = DataType {false, "string"};
+    else if (name == "to_int" or name == "length")
+      curr_type = DataType {false, "int"};
+    else if (name == "to_double")
+      curr_type = DataType {false, "double"};
+    else if (name == "get")
+      curr_type = DataType {false, "char"};
+    name = "mypl::" + name;
+  } else {
+    curr_type = return_types[name];
+    name = "f_" + name;
+  }
+  curr_code = name + "(";
+  for (int i = 0; i < args.size(); i++)
+    curr_code += (i > 0 ? ", " : "") + args[i];
+  curr_code += ")";
+}
+
+
+void MyPLtoCppTranspiler::visit(CallExpr& e)
+{
+  call(e);
+  string name = e.fun_name.lexeme();
+  if (BUILT_INS.contains(name) and name != "print" and name != "input")
+    return;
+  // calls are made before the rest of the expression is evaluated, so
+  // they happen in the vm's order (C++ leaves the order of a call's
+  // arguments unspecified)
+  if (curr_type.type_name == "void" and !curr_type.is_array) {
+    line(curr_code + ";");
+    curr_code = "mypl::Null()";
+  } else {
+    string temp = "t" + to_string(next_temp++);
+    line("auto " + temp + " = " + curr_code + ";");
+    curr_code = temp;
+  }
+}
+
+
+void MyPLtoCppTranspiler::visit(Expr& e)
+{
+  e.first->accept(*this);
+  if (e.negated) {
+    curr_code = "mypl::not_(" + curr_code + ")";
+    curr_type = DataType {false, "bool"};
+  }
+  if (!e.op.has_value())
+    return;
+  string lhs = curr_code;
+  DataType lhs_type = curr_type;
+  e.rest->accept(*this);
+  string rhs = curr_code;
+  DataType rhs_type = curr_type;
+  string op = e.op.value().lexeme();
+  if (op == "==" or op == "!=") {
+    // null is compared as a null value of the other operand's type
+    curr_code = lhs;
+    curr_type = lhs_type;
+    lhs = coerce(rhs_type);
+    curr_code = rhs;
+    curr_type = rhs_type;
+    rhs = coerce(lhs_type);
+    curr_code = string(op == "==" ? "mypl::eq(" : "mypl::ne(") + lhs + ", " +
+      rhs + ")";
+    curr_type = DataType {false, "bool"};
+    return;
+  }
+  string fun;
+  if (op == "+")
+    fun = "add";
+  else if (op == "-")
+    fun = "sub";
+  else if (op == "*")
+    fun = "mul";
+  else if (op == "/")
+    fun = "div";
+  else if (op == "<")
+    fun = "lt";
+  else if (op == "<=")
+    fun = "le";
+  else if (op == ">")
+    fun = "gt";
+  else if (op == ">=")
+    fun = "ge";
+  else if (op == "and")
+    fun = "and_";
+  else
+    fun = "or_";
+  curr_code = "mypl::" + fun + "(" + lhs + ", " + rhs + ")";
+  if (fun == "add" or fun == "sub" or fun == "mul" or fun == "div")
+    curr_type = DataType {false, lhs_type.type_name};
+  else
+    curr_type = DataType {false, "bool"};
+}
+
+
+void MyPLtoCppTranspiler::visit(SimpleTerm& t)
+{
+  t.rvalue->accept(*this);
+}
+
+
+void MyPLtoCppTranspiler::visit(ComplexTerm& t)
+{
+  t.expr.accept(*this);
+}
+
+
+void MyPLtoCppTranspiler::visit(SimpleRValue& v)
+{
+  string s = v.value.lexeme();
+  TokenType type = v.value.type();
+  if (type == TokenType::INT_VAL) {
+    curr_code = "mypl::Int(" + s + ")";
+    curr_type = DataType {false, "int"};
+  } else if (type == TokenType::DOUBLE_VAL) {
+    curr_code = "mypl::Double(" + s + ")";
+    curr_type = DataType {false, "double"};
+  } else if (type == TokenType::BOOL_VAL) {
+    curr_code = "mypl::Bool(" + s + ")";
+    curr_type = DataType {false, "bool"};
+  } else if (type == TokenType::CHAR_VAL) {
+    char ch = s == "\\n" ? '\n' : s == "\\t" ? '\t' : s[0];
+    curr_code = "mypl::Char(char(" + to_string(int(ch)) + "))";
+    curr_type = DataType {false, "char"};
+  } else if (type == TokenType::STRING_VAL) {
+    // (the same escapes as the code generator)
+    for (auto [escape, ch] : {pair {"\\n", "\n"}, pair {"\\t", "\t"}})
+      for (size_t i = s.find(escape); i != string::npos; i = s.find(escape, i))
+        s.replace(i, 2, ch);
+    if (!literal_index.contains(s)) {
+      literal_index[s] = literals.size();
+      literals.push_back(s);
+    }
+    curr_code = "lit_" + to_string(literal_index[s]);
+    curr_type = DataType {false, "string"};
+  } else {
+    curr_code = "mypl::Null()";
+    curr_type = DataType {false, "void"};
+  }
+}
+
+
+void MyPLtoCppTranspiler::visit(NewRValue& v)
+{
+  DataType type {false, v.type.lexeme()};
+  if (v.array_expr.has_value()) {
+    v.array_expr->accept(*this);
+    curr_code = "mypl::new_array<" + cpp_type(type) + ">(" + curr_code + ")";
+    type.is_array = true;
+  } else
+    curr_code = "mypl::make<s_" + type.type_name + ">()";
+  curr_type = type;
+}
+
+
+void MyPLtoCppTranspiler::visit(VarRValue& v)
+{
+  DataType type = var_type(v.path[0].var_name.lexeme());
+  string value = "v_" + v.path[0].var_name.lexeme();
+  for (int i = 0; i < v.path.size(); i++) {
+    if (i > 0) {
+      value += "->m_" + v.path[i].var_name.lexeme();
+      type = field_type(type, v.path[i].var_name);
+    }
+    if (v.path[i].array_expr.has_value()) {
+      v.path[i].array_expr->accept(*this);
+      value = "mypl::elem(" + value + ", " + curr_code + ")";
+      type.is_array = false;
+    }
+  }
+  curr_code = value;
+  curr_type = type;
+}
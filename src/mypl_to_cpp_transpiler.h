@@ -0,0 +1,115 @@
+//----------------------------------------------------------------------
+// FILE: mypl_to_cpp_transpiler.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Interface for the MyPL to C++ (native code) transpiler
+//----------------------------------------------------------------------
+
+
+#ifndef MYPL_TO_CPP_TRANSPILER_H
+#define MYPL_TO_CPP_TRANSPILER_H
+
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast.h"
+
+
+// Translates a checked program into a single self-contained C++
+// source file (the small run-time library for strings, structs,
+// arrays, and the built-in functions is written at its top), which any
+// C++17 compiler can build into a native executable. The generated
+// code keeps the vm's semantics: ints, doubles, bools, and chars may
+// be null, using a null value (or storing null in a variable or typed
+// array) is an error, calls are made in the order the vm makes them,
+// and objects are reference counted (so, unlike the vm's heap, cycles
+// of objects are never freed).
+class MyPLtoCppTranspiler : public Visitor {
+public:
+  MyPLtoCppTranspiler(std::ostream& output);
+  void visit(Program& p);
+  void visit(FunDef& f);
+  void visit(StructDef& s);
+  void visit(ReturnStmt& s);
+  void visit(WhileStmt& s);
+  void visit(ForStmt& s);
+  void visit(IfStmt& s);
+  void visit(VarDeclStmt& s);
+  void visit(AssignStmt& s);
+  void visit(CallExpr& e);
+  void visit(Expr& e);
+  void visit(SimpleTerm& t);
+  void visit(ComplexTerm& t);
+  void visit(SimpleRValue& v);
+  void visit(NewRValue& v);
+  void visit(VarRValue& v);
+
+  // build the C++ source into an executable with the system compiler
+  // ($CXX, else c++), throwing a MyPLException if it fails
+  static void build(const std::string& source, const std::string& executable);
+
+private:
+  std::ostream& out;
+
+  // the function definitions (written after the declarations they use)
+  std::ostringstream functions;
+
+  // where statements are currently written (the function definitions,
+  // or a buffer holding the code that computes a loop condition)
+  std::ostream* code = &functions;
+  int indent = 0;
+  const int INDENT_AMT = 2;
+
+  // the C++ code and the type of the expression last visited
+  std::string curr_code;
+  DataType curr_type;
+
+  std::unordered_map<std::string, StructDef> struct_defs;
+  std::unordered_map<std::string, DataType> return_types;
+
+  // the declared type of each variable in scope (innermost last)
+  std::vector<std::unordered_map<std::string, DataType>> var_types;
+
+  // the return type of the function being translated
+  DataType return_type;
+
+  // string literals (each is created once, when the program starts)
+  std::vector<std::string> literals;
+  std::unordered_map<std::string, int> literal_index;
+
+  // the next temporary holding a call's result
+  int next_temp = 0;
+
+  void inc_indent();
+  void dec_indent();
+
+  // helper to write a line of code at the current indentation
+  void line(const std::string& s);
+
+  // helpers to translate a statement (calls used as statements are
+  // not hoisted into temporaries), and a block of them in a new scope
+  void statement(const std::shared_ptr<Stmt>& stmt);
+  void block(const std::vector<std::shared_ptr<Stmt>>& stmts);
+
+  // helper to translate an expression, returning the code computing
+  // any calls in it (its value is then in curr_code)
+  std::string condition(Expr& e);
+
+  // helper to translate a call, leaving the call itself in curr_code
+  void call(CallExpr& e);
+
+  // helper to convert the expression last visited (which may be the
+  // null literal) to the given type
+  std::string coerce(const DataType& type) const;
+
+  // helpers for types and declarations
+  std::string cpp_type(const DataType& type) const;
+  std::string signature(const FunDef& f) const;
+  DataType var_type(const std::string& name) const;
+  DataType field_type(const DataType& type, const Token& field) const;
+
+};
+
+#endif
@@ -6,7 +6,6 @@
 //----------------------------------------------------------------------
 
 #include "mypl_to_java_transpiler.h"
-#include <iostream>
 
 using namespace std;
 
@@ -32,19 +31,19 @@ void MyPLtoJavaTranspiler::dec_indent()
 
 void MyPLtoJavaTranspiler::print_indent()
 {
-  out << string(indent, ' ');
+  buffer << string(indent, ' ');
 }
 
 
 void MyPLtoJavaTranspiler::visit(Program& p)
 {
-  cout << "import java.util.*;" << endl;
-  cout << "import java.util.Scanner;" << endl;
-  cout << endl;
-  cout << "class Program {" << endl;
+  buffer << "import java.util.*;" << '\n';
+  buffer << "import java.util.Scanner;" << '\n';
+  buffer << '\n';
+  buffer << "class Program {" << '\n';
   // inc_indent();
   // cout << "public static void main(String args[]) {" << endl;
-  cout << "Scanner input = new Scanner(System.in);"<< endl; //FIXME, temporary solution for input(), should be placed closer to call
+  buffer << "Scanner input = new Scanner(System.in);"<< '\n'; //FIXME, temporary solution for input(), should be placed closer to call
   for (auto struct_def : p.struct_defs) {
     struct_def.accept(*this);
   }
@@ -54,129 +53,136 @@ void MyPLtoJavaTranspiler::visit(Program& p)
   }
   // cout << "}" << endl;
   // dec_indent();
-  cout << "}";
+  buffer << "}";
+
+  // the whole program is written at once (and not flushed)
+  string program = buffer.str();
+  out.write(program.data(), program.size());
+  // (so the transpiler can be used again for another program)
+  buffer.str("");
+  buffer.clear();
 }
 
 void MyPLtoJavaTranspiler::visit(FunDef& f) {
-  cout << endl;
+  buffer << '\n';
 
-  cout << "public ";
+  buffer << "public ";
 
   if (f.fun_name.lexeme() == "main") {
-    cout << "static ";
+    buffer << "static ";
   }
 
-  cout << f.return_type.type_name << " " << f.fun_name.lexeme() << "(";
+  buffer << f.return_type.type_name << " " << f.fun_name.lexeme() << "(";
   if (f.fun_name.lexeme() == "main") {
-    cout << "String[] args";
+    buffer << "String[] args";
   } else {
     for (int i = 0; i < f.params.size(); i++)
     {
-      cout << f.params.at(i).data_type.type_name << " " << f.params.at(i).var_name.lexeme();
+      buffer << f.params.at(i).data_type.type_name << " " << f.params.at(i).var_name.lexeme();
       if (i < (f.params.size() - 1))
       {
-        cout << ", ";
+        buffer << ", ";
       }
     }
   }
-  cout << ") {" << endl;
+  buffer << ") {" << '\n';
   inc_indent();
   if (f.fun_name.lexeme() == "main")
   {
-    cout << "Program p = new Program();" << endl;
+    buffer << "Program p = new Program();" << '\n';
   }
   
   for (auto statement : f.stmts)
   {
     print_indent();
     statement->accept(*this);
-    cout << ";";
-    cout << endl;
+    buffer << ";";
+    buffer << '\n';
   }
   dec_indent();
-  cout << "}" << endl;
+  buffer << "}" << '\n';
 }
 
 void MyPLtoJavaTranspiler::visit(StructDef& s) {
-  cout << "class " << s.struct_name.lexeme() << " {" << endl;
+  buffer << "class " << s.struct_name.lexeme() << " {" << '\n';
   inc_indent();
   for (int i = 0; i < s.fields.size(); i++)
   {
     print_indent();
 
-    cout << "public " << s.fields.at(i).data_type.type_name;
-    cout << " " << s.fields.at(i).var_name.lexeme();
+    buffer << "public " << s.fields.at(i).data_type.type_name;
+    buffer << " " << s.fields.at(i).var_name.lexeme();
     if (i <= (s.fields.size() - 1))
     {
-      cout << ";";
+      buffer << ";";
     } 
-    cout << endl;
+    buffer << '\n';
   }
   dec_indent();
-  cout << "}" << endl;
+  buffer << "}" << '\n';
 }
 
 void MyPLtoJavaTranspiler::visit(ReturnStmt& s) {
-  cout << "return ";
+  buffer << "return ";
   s.expr.accept(*this);
-  cout << ";";
+  buffer << ";";
 }
 
 void MyPLtoJavaTranspiler::visit(WhileStmt& s) {
-  cout << "while" << " (";
+  buffer << "while" << " (";
   s.condition.accept(*this);
-  cout << ")" << " {" << endl;
+  buffer << ")" << " {" << '\n';
   inc_indent();
   for (auto stmt : s.stmts)
   {
     print_indent();
     stmt->accept(*this);
-    cout << ";";
-    cout << endl;
+    buffer << ";";
+    buffer << '\n';
   }
   dec_indent();
   print_indent();
-  cout << "}";
+  buffer << "}";
 }
 void MyPLtoJavaTranspiler::visit(ForStmt& s) {
-  cout << "for (";
+  buffer << "for (";
   s.var_decl.accept(*this);
   // cout << "; ";
   s.condition.accept(*this);
-  cout << "; ";
+  buffer << "; ";
   s.assign_stmt.accept(*this);
-  cout << ") {" << endl;
+  buffer << ") {" << '\n';
   inc_indent();
   print_indent();
   for (auto stmt : s.stmts)
   {
     stmt->accept(*this);
-    cout << ";";
+    buffer << ";";
   }
   dec_indent();
-  cout << endl;
+  buffer << '\n';
   print_indent();
-  cout << "}";
+  buffer << "}";
 }
 
 void MyPLtoJavaTranspiler::visit(IfStmt& s) {
-  cout << "if (";
+  buffer << "if (";
   s.if_part.condition.accept(*this);
-  cout << ") {" << endl;
+  buffer << ") {" << '\n';
   inc_indent();
   for (auto stmt : s.if_part.stmts)
   {
     print_indent();
     stmt->accept(*this);
-    cout << ";";
-    cout << endl;
+    buffer << ";";
+    buffer << '\n';
   }
   dec_indent();
   print_indent();
-  cout << "}";
+  buffer << "}";
   if (s.else_ifs.size() > 0 || s.else_stmts.size() > 0)
   {
-    cout << endl;
+    buffer << '\n';
   }
   
   if (s.else_ifs.size() > 0)
@@ -184,74 +190,74 @@ void MyPLtoJavaTranspiler::visit(IfStmt& s) {
     for (auto elseif : s.else_ifs)
     {
     print_indent();
-    cout << "else if (";
+    buffer << "else if (";
     elseif.condition.accept(*this);
-    cout << ") {" << endl;
+    buffer << ") {" << '\n';
     inc_indent();
     for (auto stmt : elseif.stmts)
     {
       print_indent();
       stmt->accept(*this);
-      cout << ";";
-      cout << endl;
+      buffer << ";";
+      buffer << '\n';
     }
     dec_indent();
     print_indent();
-    cout << "}";
-    cout << endl;
+    buffer << "}";
+    buffer << '\n';
     }
   }
   if (s.else_stmts.size() > 0)
   {
     print_indent();
-    cout << "else {" << endl;
+    buffer << "else {" << '\n';
     inc_indent();
     for (auto stmt : s.else_stmts)
     {
       print_indent();
       stmt->accept(*this);
-      cout << ";";
-      cout << endl;
+      buffer << ";";
+      buffer << '\n';
     }
     dec_indent();
     print_indent();
-    cout << "}";
+    buffer << "}";
   }
 }
 
 void MyPLtoJavaTranspiler::visit(VarDeclStmt& s) {
-  cout << s.var_def.data_type.type_name;
+  buffer << s.var_def.data_type.type_name;
   if ((s.expr.first_token().type() == TokenType::STRING_TYPE) ||
   (s.expr.first_token().type() == TokenType::INT_TYPE) ||
   (s.expr.first_token().type() == TokenType::DOUBLE_TYPE) ||
   (s.expr.first_token().type() == TokenType::BOOL_TYPE) ||
   (s.expr.first_token().type() == TokenType::CHAR_TYPE)) {
     //Java arrays require datatype to have "[]", as in String[] strings = new String[];
-    cout << "[]";
+    buffer << "[]";
   }
 
-  cout<< " " << s.var_def.var_name.lexeme();
-  cout << " = ";
+  buffer << " " << s.var_def.var_name.lexeme();
+  buffer << " = ";
   s.expr.accept(*this);
-  cout << ";";
+  buffer << ";";
 }
 
 void MyPLtoJavaTranspiler::visit(AssignStmt& s) {
   for (int i = 0; i < s.lvalue.size(); i++)
   {
-    cout << s.lvalue.at(i).var_name.lexeme();
+    buffer << s.lvalue.at(i).var_name.lexeme();
     if (s.lvalue.at(i).array_expr.has_value())
     {
-      cout << "[";
+      buffer << "[";
       s.lvalue.at(i).array_expr.value().accept(*this);
-      cout << "]";
+      buffer << "]";
     }
     if (i < (s.lvalue.size() - 1))
     {
-      cout << ".";
+      buffer << ".";
     }
   }
-  cout << " = ";
+  buffer << " = ";
   s.expr.accept(*this);
   //cout << ";";
 }
@@ -260,60 +266,60 @@ void MyPLtoJavaTranspiler::visit(CallExpr& e) {
   if (e.fun_name.lexeme() == "get")
   {
     e.args.at(1).accept(*this);
-    cout << "." << "charAt" << "(";
+    buffer << "." << "charAt" << "(";
     e.args.at(0).accept(*this);
-    cout << ")";
+    buffer << ")";
   } else if (e.fun_name.lexeme() == "length") {
     e.args.at(0).accept(*this);
-    cout << "." << "length";
+    buffer << "." << "length";
     if (e.args.at(0).first_token().type() == TokenType::STRING_VAL)
     {
-      cout << "()";
+      buffer << "()";
     }
   } else if (e.fun_name.lexeme() == "input") {
-      cout << "input.nextLine();" << endl;
+      buffer << "input.nextLine();" << '\n';
   } else if (e.fun_name.lexeme() == "concat") {
     e.args.at(0).accept(*this);
-    cout << ".concat(" ;
+    buffer << ".concat(" ;
     e.args.at(1).accept(*this);
-    cout << ")";
+    buffer << ")";
   } else {
     if (e.fun_name.lexeme() == "print") {
-      cout << "System.out.println" << "(";
+      buffer << "System.out.println" << "(";
     } else if (e.fun_name.lexeme() == "to_string") {
-      cout << "toString" << "(";
+      buffer << "toString" << "(";
     } else if (e.fun_name.lexeme() == "to_double") {
-      cout << "toDouble" << "(";
+      buffer << "toDouble" << "(";
     } else if (e.fun_name.lexeme() == "to_int") {
-      cout << "toInt" << "(";
+      buffer << "toInt" << "(";
     } else {
-      cout << e.fun_name.lexeme() << "(";
+      buffer << e.fun_name.lexeme() << "(";
     }
     for (int i = 0; i < e.args.size(); i++)
     {
       e.args.at(i).accept(*this);
       if (i < (e.args.size() - 1))
       {
-        cout << ", ";
+        buffer << ", ";
       }
     }
-    cout << ")";
+    buffer << ")";
   }
 }
 
 void MyPLtoJavaTranspiler::visit(Expr& e) {
   if(e.negated) {
-    cout << "!";
-    cout << "(";
+    buffer << "!";
+    buffer << "(";
   }
   e.first->accept(*this);
   if (e.op.has_value())
   {
-    cout << " " << e.op.value().lexeme() << " ";
+    buffer << " " << e.op.value().lexeme() << " ";
     e.rest->accept(*this);
   }
   if(e.negated) {
-    cout << ")";
+    buffer << ")";
   }
 }
 
@@ -322,37 +328,37 @@ void MyPLtoJavaTranspiler::visit(SimpleTerm& t) {
 }
 
 void MyPLtoJavaTranspiler::visit(ComplexTerm& t) {
-  cout << "(";
+  buffer << "(";
   t.expr.accept(*this);
-  cout << ")";
+  buffer << ")";
 }
 
 void MyPLtoJavaTranspiler::visit(SimpleRValue& v) {
   if (v.value.type() == TokenType::CHAR_VAL)
   {
-    cout << "'" << v.value.lexeme() << "'";
+    buffer << "'" << v.value.lexeme() << "'";
   } else if (v.value.type() == TokenType::STRING_VAL) {
-    cout << "\"" << v.value.lexeme() << "\"";
+    buffer << "\"" << v.value.lexeme() << "\"";
   } else {
-    cout << v.value.lexeme();
+    buffer << v.value.lexeme();
   }
 }
 
 void MyPLtoJavaTranspiler::visit(NewRValue& v) {
-  cout << "new " << v.type.lexeme();
+  buffer << "new " << v.type.lexeme();
 
   if ((v.type.lexeme() != "String") && (v.type.lexeme() != "double")
   && (v.type.lexeme() != "bool") && (v.type.lexeme() != "char") 
   && (v.type.lexeme() != "int")) //then it must be a struct, (or a class in Java), which needs '()'
   {
-    cout << "()";
+    buffer << "()";
   }
   
   if (v.array_expr.has_value())
   {
-    cout << "[";
+    buffer << "[";
     v.array_expr->accept(*this);
-    cout << "]";
+    buffer << "]";
   }
   
 }
@@ -360,16 +366,16 @@ void MyPLtoJavaTranspiler::visit(NewRValue& v) {
 void MyPLtoJavaTranspiler::visit(VarRValue& v) {
   for (int i = 0; i < v.path.size(); i++)
   {
-    cout << v.path.at(i).var_name.lexeme();
+    buffer << v.path.at(i).var_name.lexeme();
     if (v.path.at(i).array_expr.has_value())
     {
-      cout << "[";
+      buffer << "[";
       v.path.at(i).array_expr->accept(*this);
-      cout << "]";
+      buffer << "]";
     }
     if (i < (v.path.size() - 1))
     {
-      cout << ".";
+      buffer << ".";
     }
   }
 }
\ No newline at end of file
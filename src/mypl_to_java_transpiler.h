@@ -10,6 +10,7 @@
 #define MYPL_TO_JAVA_TRANSPILER
 
 #include <ostream>
+#include <sstream>
 #include "ast.h"
 
 
@@ -34,6 +35,10 @@ public:
   void visit(VarRValue& v);    
 private:
   std::ostream& out;  
+
+  // the program as it is translated (written to out in one piece once
+  // it is complete)
+  std::ostringstream buffer;
   int indent = 0;
   const int INDENT_AMT = 2;
 
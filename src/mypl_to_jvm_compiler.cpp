@@ -0,0 +1,744 @@
+//----------------------------------------------------------------------
+// FILE: mypl_to_jvm_compiler.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: MyPL to JVM class file compiler
+//----------------------------------------------------------------------
+
+#include <unordered_set>
+#include "mypl_to_jvm_compiler.h"
+
+using namespace std;
+
+
+static const unordered_set<string> BUILT_INS {"print", "input", "to_string",
+  "to_int", "to_double", "length", "get", "concat"};
+
+static const string PROGRAM = "Program";
+static const string STRING = "Ljava/lang/String;";
+static const string OBJECT = "Ljava/lang/Object;";
+
+// the run-time support methods (named so they cannot clash with a
+// MyPL function)
+static const string FORMAT = "mypl$format";
+static const string INPUT = "mypl$input";
+static const string READER = "mypl$in";
+
+
+// helper functions for MyPL's primitive (non-array) types
+static bool is_void_type(const DataType& type)
+{
+  return type.type_name == "void" and !type.is_array;
+}
+
+static bool is_primitive_type(const DataType& type)
+{
+  const string& name = type.type_name;
+  return !type.is_array and (name == "int" or name == "double" or
+                             name == "bool" or name == "char");
+}
+
+static bool is_double_type(const DataType& type)
+{
+  return type.type_name == "double" and !type.is_array;
+}
+
+
+MyPLtoJVMCompiler::MyPLtoJVMCompiler()
+  : program(make_unique<JVMClassFile>(PROGRAM, JVMClassFile::ACC_PUBLIC |
+                                      JVMClassFile::ACC_SUPER))
+{
+}
+
+
+vector<pair<string, string>> MyPLtoJVMCompiler::class_files()
+{
+  vector<pair<string, string>> files;
+  files.push_back({program->name() + ".class", program->bytes()});
+  for (auto& s : structs)
+    files.push_back({s->name() + ".class", s->bytes()});
+  return files;
+}
+
+
+string MyPLtoJVMCompiler::descriptor(const DataType& type) const
+{
+  string name = type.type_name;
+  string base;
+  if (name == "int")
+    base = "I";
+  else if (name == "double")
+    base = "D";
+  else if (name == "bool")
+    base = "Z";
+  else if (name == "char")
+    base = "C";
+  else if (name == "string")
+    base = STRING;
+  else if (name == "void")
+    base = "V";
+  else
+    base = "L" + PROGRAM + "$" + name + ";";
+  if (type.is_array)
+    return "[" + base;
+  return base;
+}
+
+
+string MyPLtoJVMCompiler::descriptor(const FunDef& f) const
+{
+  // (main is the JVM's entry point)
+  if (f.fun_name.lexeme() == "main")
+    return "([" + STRING + ")V";
+  string s = "(";
+  for (const VarDef& param : f.params)
+    s += descriptor(param.data_type);
+  return s + ")" + descriptor(f.return_type);
+}
+
+
+string MyPLtoJVMCompiler::class_name(const DataType& type) const
+{
+  return PROGRAM + "$" + type.type_name;
+}
+
+
+MyPLtoJVMCompiler::Var MyPLtoJVMCompiler::var(const string& name) const
+{
+  for (auto scope = vars.rbegin(); scope != vars.rend(); ++scope)
+    if (scope->contains(name))
+      return scope->at(name);
+  return Var {0, DataType {false, "void"}};
+}
+
+
+DataType MyPLtoJVMCompiler::field_type(const DataType& type,
+                                       const Token& field) const
+{
+  if (struct_defs.contains(type.type_name))
+    for (const VarDef& field_def : struct_defs.at(type.type_name).fields)
+      if (field_def.var_name.lexeme() == field.lexeme())
+        return field_def.data_type;
+  return DataType {false, "void"};
+}
+
+
+void MyPLtoJVMCompiler::push_default(const DataType& type)
+{
+  if (is_double_type(type))
+    code->push_double(0.0);
+  else if (is_primitive_type(type))
+    code->push_int(0);
+  else
+    code->op(JVMOp::ACONST_NULL);
+}
+
+
+void MyPLtoJVMCompiler::pop_value(const DataType& type)
+{
+  code->op(is_double_type(type) ? JVMOp::POP2 : JVMOp::POP);
+}
+
+
+void MyPLtoJVMCompiler::load_element(const DataType& type)
+{
+  string name = type.type_name;
+  if (name == "int")
+    code->op(JVMOp::IALOAD);
+  else if (name == "double")
+    code->op(JVMOp::DALOAD);
+  else if (name == "bool")
+    code->op(JVMOp::BALOAD);
+  else if (name == "char")
+    code->op(JVMOp::CALOAD);
+  else
+    code->op(JVMOp::AALOAD);
+}
+
+
+void MyPLtoJVMCompiler::store_element(const DataType& type)
+{
+  string name = type.type_name;
+  if (name == "int")
+    code->op(JVMOp::IASTORE);
+  else if (name == "double")
+    code->op(JVMOp::DASTORE);
+  else if (name == "bool")
+    code->op(JVMOp::BASTORE);
+  else if (name == "char")
+    code->op(JVMOp::CASTORE);
+  else
+    code->op(JVMOp::AASTORE);
+}
+
+
+void MyPLtoJVMCompiler::return_value(const DataType& type)
+{
+  if (is_void_type(type))
+    code->op(JVMOp::RETURN);
+  else if (is_double_type(type))
+    code->op(JVMOp::DRETURN);
+  else if (is_primitive_type(type))
+    code->op(JVMOp::IRETURN);
+  else
+    code->op(JVMOp::ARETURN);
+}
+
+
+void MyPLtoJVMCompiler::coerce(const DataType& type)
+{
+  // (only the null literal and void calls have type void, and the
+  // primitives cannot be null)
+  if (is_void_type(curr_type) and is_primitive_type(type)) {
+    code->op(JVMOp::POP);
+    push_default(type);
+  }
+}
+
+
+void MyPLtoJVMCompiler::write_format()
+{
+  // doubles are written the way the vm writes them (C's %f)
+  JVMCode& f = program->add_method(JVMClassFile::ACC_PRIVATE |
+                                   JVMClassFile::ACC_STATIC, FORMAT,
+                                   "(D)" + STRING);
+  f.field(JVMOp::GETSTATIC, "java/util/Locale", "ROOT", "Ljava/util/Locale;");
+  f.push_string("%f");
+  f.push_int(1);
+  f.new_array(OBJECT);
+  f.op(JVMOp::DUP);
+  f.push_int(0);
+  f.load(0);
+  f.invoke(JVMOp::INVOKESTATIC, "java/lang/Double", "valueOf",
+           "(D)Ljava/lang/Double;");
+  f.op(JVMOp::AASTORE);
+  f.invoke(JVMOp::INVOKESTATIC, "java/lang/String", "format",
+           "(Ljava/util/Locale;" + STRING + "[" + OBJECT + ")" + STRING);
+  f.op(JVMOp::ARETURN);
+}
+
+
+void MyPLtoJVMCompiler::write_input()
+{
+  // a line of input (the empty string at the end of the input), read
+  // from one buffered reader created when the class is loaded
+  const string reader = "java/io/BufferedReader";
+  program->add_field(JVMClassFile::ACC_PRIVATE | JVMClassFile::ACC_STATIC,
+                     READER, "L" + reader + ";");
+  JVMCode& init = program->add_method(JVMClassFile::ACC_STATIC, "<clinit>",
+                                      "()V");
+  init.new_object(reader);
+  init.new_object("java/io/InputStreamReader");
+  init.field(JVMOp::GETSTATIC, "java/lang/System", "in",
+             "Ljava/io/InputStream;");
+  init.invoke(JVMOp::INVOKESPECIAL, "java/io/InputStreamReader", "<init>",
+              "(Ljava/io/InputStream;)V");
+  init.invoke(JVMOp::INVOKESPECIAL, reader, "<init>", "(Ljava/io/Reader;)V");
+  init.field(JVMOp::PUTSTATIC, PROGRAM, READER, "L" + reader + ";");
+  init.op(JVMOp::RETURN);
+
+  JVMCode& f = program->add_method(JVMClassFile::ACC_PRIVATE |
+                                   JVMClassFile::ACC_STATIC, INPUT,
+                                   "()" + STRING);
+  JVMLabel done = f.new_label();
+  f.field(JVMOp::GETSTATIC, PROGRAM, READER, "L" + reader + ";");
+  f.invoke(JVMOp::INVOKEVIRTUAL, reader, "readLine", "()" + STRING);
+  f.op(JVMOp::DUP);
+  f.branch(JVMOp::IFNONNULL, done);
+  f.op(JVMOp::POP);
+  f.push_string("");
+  f.bind(done);
+  f.op(JVMOp::ARETURN);
+}
+
+
+void MyPLtoJVMCompiler::statement(const shared_ptr<Stmt>& stmt)
+{
+  // a call used as a statement is made directly (its result popped)
+  if (CallExpr* e = dynamic_cast<CallExpr*>(stmt.get())) {
+    call(*e);
+    if (!is_void_type(curr_type))
+      pop_value(curr_type);
+  } else
+    stmt->accept(*this);
+}
+
+
+void MyPLtoJVMCompiler::block(const vector<shared_ptr<Stmt>>& stmts)
+{
+  vars.push_back({});
+  int start = code->scope();
+  for (auto& stmt : stmts)
+    statement(stmt);
+  code->end_scope(start);
+  vars.pop_back();
+}
+
+
+void MyPLtoJVMCompiler::visit(Program& p)
+{
+  for (auto& struct_def : p.struct_defs)
+    struct_def.accept(*this);
+  for (auto& fun_def : p.fun_defs) {
+    string name = fun_def.fun_name.lexeme();
+    return_types[name] = fun_def.return_type;
+    for (const VarDef& param : fun_def.params)
+      param_types[name].push_back(param.data_type);
+  }
+  for (auto& fun_def : p.fun_defs)
+    fun_def.accept(*this);
+  if (formats_doubles)
+    write_format();
+  if (reads_input)
+    write_input();
+}
+
+
+void MyPLtoJVMCompiler::visit(FunDef& f)
+{
+  return_type = f.return_type;
+  code = &program->add_method(JVMClassFile::ACC_PUBLIC |
+                              JVMClassFile::ACC_STATIC,
+                              f.fun_name.lexeme(), descriptor(f));
+  // (main's first local is the JVM's String[] argument)
+  int local = f.fun_name.lexeme() == "main" ? 1 : 0;
+  vars.push_back({});
+  for (const VarDef& param : f.params) {
+    vars.back()[param.var_name.lexeme()] = Var {local, param.data_type};
+    local += is_double_type(param.data_type) ? 2 : 1;
+  }
+  for (auto& stmt : f.stmts)
+    statement(stmt);
+  // (a function that ends without returning returns null, or zero)
+  if (code->reachable()) {
+    if (!is_void_type(return_type))
+      push_default(return_type);
+    return_value(return_type);
+  }
+  vars.pop_back();
+  code = nullptr;
+}
+
+
+void MyPLtoJVMCompiler::visit(StructDef& s)
+{
+  string name = s.struct_name.lexeme();
+  struct_defs[name] = s;
+  auto c = make_unique<JVMClassFile>(class_name({false, name}),
+                                     JVMClassFile::ACC_PUBLIC |
+                                     JVMClassFile::ACC_SUPER);
+  for (const VarDef& field : s.fields)
+    c->add_field(JVMClassFile::ACC_PUBLIC, field.var_name.lexeme(),
+                 descriptor(field.data_type));
+  JVMCode& init = c->add_method(JVMClassFile::ACC_PUBLIC, "<init>", "()V");
+  init.load(0);
+  init.invoke(JVMOp::INVOKESPECIAL, "java/lang/Object", "<init>", "()V");
+  init.op(JVMOp::RETURN);
+  // (both classes record the nesting)
+  int access = JVMClassFile::ACC_PUBLIC | JVMClassFile::ACC_STATIC;
+  c->add_inner_class(c->name(), PROGRAM, name, access);
+  program->add_inner_class(c->name(), PROGRAM, name, access);
+  structs.push_back(move(c));
+}
+
+
+void MyPLtoJVMCompiler::visit(ReturnStmt& s)
+{
+  s.expr.accept(*this);
+  if (is_void_type(return_type))
+    pop_value(curr_type);
+  else
+    coerce(return_type);
+  return_value(return_type);
+}
+
+
+void MyPLtoJVMCompiler::visit(WhileStmt& s)
+{
+  JVMLabel top = code->new_label();
+  JVMLabel end = code->new_label();
+  code->bind(top);
+  s.condition.accept(*this);
+  code->branch(JVMOp::IFEQ, end);
+  block(s.stmts);
+  code->branch(JVMOp::GOTO, top);
+  code->bind(end);
+}
+
+
+void MyPLtoJVMCompiler::visit(ForStmt& s)
+{
+  vars.push_back({});
+  int start = code->scope();
+  s.var_decl.accept(*this);
+  JVMLabel top = code->new_label();
+  JVMLabel end = code->new_label();
+  code->bind(top);
+  s.condition.accept(*this);
+  code->branch(JVMOp::IFEQ, end);
+  // (the body's variables are out of scope in the update)
+  block(s.stmts);
+  s.assign_stmt.accept(*this);
+  code->branch(JVMOp::GOTO, top);
+  code->bind(end);
+  code->end_scope(start);
+  vars.pop_back();
+}
+
+
+void MyPLtoJVMCompiler::visit(IfStmt& s)
+{
+  JVMLabel end = code->new_label();
+  JVMLabel next = code->new_label();
+  s.if_part.condition.accept(*this);
+  code->branch(JVMOp::IFEQ, next);
+  block(s.if_part.stmts);
+  for (BasicIf& else_if : s.else_ifs) {
+    code->branch(JVMOp::GOTO, end);
+    code->bind(next);
+    next = code->new_label();
+    else_if.condition.accept(*this);
+    code->branch(JVMOp::IFEQ, next);
+    block(else_if.stmts);
+  }
+  if (s.else_stmts.size() > 0) {
+    code->branch(JVMOp::GOTO, end);
+    code->bind(next);
+    block(s.else_stmts);
+  } else
+    code->bind(next);
+  code->bind(end);
+}
+
+
+void MyPLtoJVMCompiler::visit(VarDeclStmt& s)
+{
+  s.expr.accept(*this);
+  coerce(s.var_def.data_type);
+  int local = code->add_local(JVMType::of(descriptor(s.var_def.data_type)));
+  vars.back()[s.var_def.var_name.lexeme()] = Var {local, s.var_def.data_type};
+  code->store(local);
+}
+
+
+void MyPLtoJVMCompiler::visit(AssignStmt& s)
+{
+  vector<VarRef>& path = s.lvalue;
+  Var v = var(path[0].var_name.lexeme());
+  if (path.size() == 1 and !path[0].array_expr.has_value()) {
+    s.expr.accept(*this);
+    coerce(v.type);
+    code->store(v.local);
+    return;
+  }
+  // the object or array holding the field or element assigned is
+  // pushed first (and the element's index)
+  DataType type = v.type;
+  DataType owner = type;
+  code->load(v.local);
+  for (int i = 0; i < path.size(); i++) {
+    bool last = i == path.size() - 1;
+    if (i > 0) {
+      DataType field = field_type(type, path[i].var_name);
+      if (!last or path[i].array_expr.has_value())
+        code->field(JVMOp::GETFIELD, class_name(type),
+                    path[i].var_name.lexeme(), descriptor(field));
+      owner = type;
+      type = field;
+    }
+    if (path[i].array_expr.has_value()) {
+      path[i].array_expr->accept(*this);
+      type.is_array = false;
+      if (!last)
+        load_element(type);
+    }
+  }
+  s.expr.accept(*this);
+  coerce(type);
+  if (path.back().array_expr.has_value())
+    store_element(type);
+  else
+    code->field(JVMOp::PUTFIELD, class_name(owner),
+                path.back().var_name.lexeme(), descriptor(type));
+}
+
+
+void MyPLtoJVMCompiler::call(CallExpr& e)
+{
+  string name = e.fun_name.lexeme();
+  if (!BUILT_INS.contains(name)) {
+    if (name == "main")
+      code->op(JVMOp::ACONST_NULL);
+    vector<DataType>& params = param_types[name];
+    for (int i = 0; i < e.args.size(); i++) {
+      e.args[i].accept(*this);
+      if (i < params.size())
+        coerce(params[i]);
+    }
+    string signature = "(";
+    for (const DataType& param : params)
+      signature += descriptor(param);
+    signature += ")" + descriptor(return_types[name]);
+    if (name == "main")
+      signature = "([" + STRING + ")V";
+    code->invoke(JVMOp::INVOKESTATIC, PROGRAM, name, signature);
+    curr_type = return_types[name];
+    return;
+  }
+
+  const string string_class = "java/lang/String";
+  if (name == "print") {
+    code->field(JVMOp::GETSTATIC, "java/lang/System", "out",
+                "Ljava/io/PrintStream;");
+    e.args[0].accept(*this);
+    string param = descriptor(curr_type);
+    if (is_double_type(curr_type)) {
+      formats_doubles = true;
+      code->invoke(JVMOp::INVOKESTATIC, PROGRAM, FORMAT, "(D)" + STRING);
+      param = STRING;
+    } else if (!is_primitive_type(curr_type) and param != STRING)
+      param = OBJECT;
+    code->invoke(JVMOp::INVOKEVIRTUAL, "java/io/PrintStream", "print",
+                 "(" + param + ")V");
+    curr_type = DataType {false, "void"};
+  } else if (name == "input") {
+    reads_input = true;
+    code->invoke(JVMOp::INVOKESTATIC, PROGRAM, INPUT, "()" + STRING);
+    curr_type = DataType {false, "string"};
+  } else if (name == "to_string") {
+    e.args[0].accept(*this);
+    if (is_double_type(curr_type)) {
+      formats_doubles = true;
+      code->invoke(JVMOp::INVOKESTATIC, PROGRAM, FORMAT, "(D)" + STRING);
+    } else if (is_primitive_type(curr_type))
+      code->invoke(JVMOp::INVOKESTATIC, string_class, "valueOf",
+                   "(" + descriptor(curr_type) + ")" + STRING);
+    curr_type = DataType {false, "string"};
+  } else if (name == "to_int" or name == "to_double") {
+    e.args[0].accept(*this);
+    string type = curr_type.type_name;
+    if (type == "char")
+      code->invoke(JVMOp::INVOKESTATIC, string_class, "valueOf",
+                   "(C)" + STRING);
+    if (name == "to_int") {
+      if (type == "double")
+        code->op(JVMOp::D2I);
+      else if (type == "string" or type == "char")
+        code->invoke(JVMOp::INVOKESTATIC, "java/lang/Integer", "parseInt",
+                     "(" + STRING + ")I");
+      curr_type = DataType {false, "int"};
+    } else {
+      if (type == "int")
+        code->op(JVMOp::I2D);
+      else if (type == "string" or type == "char")
+        code->invoke(JVMOp::INVOKESTATIC, "java/lang/Double", "parseDouble",
+                     "(" + STRING + ")D");
+      curr_type = DataType {false, "double"};
+    }
+  } else if (name == "length") {
+    e.args[0].accept(*this);
+    if (curr_type.is_array)
+      code->op(JVMOp::ARRAYLENGTH);
+    else
+      code->invoke(JVMOp::INVOKEVIRTUAL, string_class, "length", "()I");
+    curr_type = DataType {false, "int"};
+  } else if (name == "get") {
+    // (the index is computed first, as in the vm)
+    e.args[0].accept(*this);
+    e.args[1].accept(*this);
+    code->op(JVMOp::SWAP);
+    code->invoke(JVMOp::INVOKEVIRTUAL, string_class, "charAt", "(I)C");
+    curr_type = DataType {false, "char"};
+  } else if (name == "concat") {
+    e.args[0].accept(*this);
+    e.args[1].accept(*this);
+    code->invoke(JVMOp::INVOKEVIRTUAL, string_class, "concat",
+                 "(" + STRING + ")" + STRING);
+    curr_type = DataType {false, "string"};
+  }
+}
+
+
+void MyPLtoJVMCompiler::visit(CallExpr& e)
+{
+  call(e);
+  if (is_void_type(curr_type))
+    code->op(JVMOp::ACONST_NULL);
+}
+
+
+void MyPLtoJVMCompiler::compare(const string& op, const DataType& lhs,
+                                const DataType& rhs)
+{
+  DataType type = is_void_type(lhs) ? rhs : lhs;
+  JVMLabel yes = code->new_label();
+  JVMLabel done = code->new_label();
+  if (op == "==" or op == "!=") {
+    if (is_void_type(lhs) != is_void_type(rhs) and is_primitive_type(type)) {
+      // a primitive is never null
+      pop_value(rhs);
+      pop_value(lhs);
+      code->push_int(op == "!=");
+      return;
+    }
+    if (type.type_name == "string" and !type.is_array) {
+      code->invoke(JVMOp::INVOKESTATIC, "java/util/Objects", "equals",
+                   "(" + OBJECT + OBJECT + ")Z");
+      if (op == "!=") {
+        code->push_int(1);
+        code->op(JVMOp::IXOR);
+      }
+      return;
+    }
+    if (!is_primitive_type(type))
+      code->branch(op == "==" ? JVMOp::IF_ACMPEQ : JVMOp::IF_ACMPNE, yes);
+  }
+  if (is_primitive_type(type)) {
+    // ints, bools, and chars are compared directly, doubles and
+    // strings first compared to give -1, 0, or 1
+    unordered_map<string, JVMOp> int_ops {
+      {"==", JVMOp::IF_ICMPEQ}, {"!=", JVMOp::IF_ICMPNE},
+      {"<", JVMOp::IF_ICMPLT}, {"<=", JVMOp::IF_ICMPLE},
+      {">", JVMOp::IF_ICMPGT}, {">=", JVMOp::IF_ICMPGE}};
+    unordered_map<string, JVMOp> ops {
+      {"==", JVMOp::IFEQ}, {"!=", JVMOp::IFNE}, {"<", JVMOp::IFLT},
+      {"<=", JVMOp::IFLE}, {">", JVMOp::IFGT}, {">=", JVMOp::IFGE}};
+    if (is_double_type(type)) {
+      // (NaN compares false, other than with !=)
+      code->op(op == "<" or op == "<=" ? JVMOp::DCMPG : JVMOp::DCMPL);
+      code->branch(ops[op], yes);
+    } else
+      code->branch(int_ops[op], yes);
+  } else if (op != "==" and op != "!=") {
+    unordered_map<string, JVMOp> ops {
+      {"<", JVMOp::IFLT}, {"<=", JVMOp::IFLE}, {">", JVMOp::IFGT},
+      {">=", JVMOp::IFGE}};
+    code->invoke(JVMOp::INVOKEVIRTUAL, "java/lang/String", "compareTo",
+                 "(" + STRING + ")I");
+    code->branch(ops[op], yes);
+  }
+  code->push_int(0);
+  code->branch(JVMOp::GOTO, done);
+  code->bind(yes);
+  code->push_int(1);
+  code->bind(done);
+}
+
+
+void MyPLtoJVMCompiler::visit(Expr& e)
+{
+  e.first->accept(*this);
+  if (e.negated) {
+    code->push_int(1);
+    code->op(JVMOp::IXOR);
+    curr_type = DataType {false, "bool"};
+  }
+  if (!e.op.has_value())
+    return;
+  DataType lhs_type = curr_type;
+  e.rest->accept(*this);
+  DataType rhs_type = curr_type;
+  string op = e.op.value().lexeme();
+  bool dbl = is_double_type(lhs_type);
+  if (op == "+")
+    code->op(dbl ? JVMOp::DADD : JVMOp::IADD);
+  else if (op == "-")
+    code->op(dbl ? JVMOp::DSUB : JVMOp::ISUB);
+  else if (op == "*")
+    code->op(dbl ? JVMOp::DMUL : JVMOp::IMUL);
+  else if (op == "/")
+    code->op(dbl ? JVMOp::DDIV : JVMOp::IDIV);
+  else if (op == "and")
+    code->op(JVMOp::IAND);
+  else if (op == "or")
+    code->op(JVMOp::IOR);
+  else {
+    compare(op, lhs_type, rhs_type);
+    curr_type = DataType {false, "bool"};
+    return;
+  }
+  if (op == "and" or op == "or")
+    curr_type = DataType {false, "bool"};
+  else
+    curr_type = DataType {false, lhs_type.type_name};
+}
+
+
+void MyPLtoJVMCompiler::visit(SimpleTerm& t)
+{
+  t.rvalue->accept(*this);
+}
+
+
+void MyPLtoJVMCompiler::visit(ComplexTerm& t)
+{
+  t.expr.accept(*this);
+}
+
+
+void MyPLtoJVMCompiler::visit(SimpleRValue& v)
+{
+  string s = v.value.lexeme();
+  TokenType type = v.value.type();
+  if (type == TokenType::INT_VAL) {
+    code->push_int(stoi(s));
+    curr_type = DataType {false, "int"};
+  } else if (type == TokenType::DOUBLE_VAL) {
+    code->push_double(stod(s));
+    curr_type = DataType {false, "double"};
+  } else if (type == TokenType::BOOL_VAL) {
+    code->push_int(s == "true");
+    curr_type = DataType {false, "bool"};
+  } else if (type == TokenType::CHAR_VAL) {
+    char ch = s == "\\n" ? '\n' : s == "\\t" ? '\t' : s[0];
+    code->push_int(static_cast<unsigned char>(ch));
+    curr_type = DataType {false, "char"};
+  } else if (type == TokenType::STRING_VAL) {
+    // (the same escapes as the code generator)
+    for (auto [escape, ch] : {pair {"\\n", "\n"}, pair {"\\t", "\t"}})
+      for (size_t i = s.find(escape); i != string::npos; i = s.find(escape, i))
+        s.replace(i, 2, ch);
+    code->push_string(s);
+    curr_type = DataType {false, "string"};
+  } else {
+    code->op(JVMOp::ACONST_NULL);
+    curr_type = DataType {false, "void"};
+  }
+}
+
+
+void MyPLtoJVMCompiler::visit(NewRValue& v)
+{
+  DataType type {false, v.type.lexeme()};
+  if (v.array_expr.has_value()) {
+    v.array_expr->accept(*this);
+    code->new_array(descriptor(type));
+    type.is_array = true;
+  } else {
+    code->new_object(class_name(type));
+    code->invoke(JVMOp::INVOKESPECIAL, class_name(type), "<init>", "()V");
+  }
+  curr_type = type;
+}
+
+
+void MyPLtoJVMCompiler::visit(VarRValue& v)
+{
+  Var x = var(v.path[0].var_name.lexeme());
+  DataType type = x.type;
+  code->load(x.local);
+  for (int i = 0; i < v.path.size(); i++) {
+    if (i > 0) {
+      DataType field = field_type(type, v.path[i].var_name);
+      code->field(JVMOp::GETFIELD, class_name(type),
+                  v.path[i].var_name.lexeme(), descriptor(field));
+      type = field;
+    }
+    if (v.path[i].array_expr.has_value()) {
+      v.path[i].array_expr->accept(*this);
+      type.is_array = false;
+      load_element(type);
+    }
+  }
+  curr_type = type;
+}
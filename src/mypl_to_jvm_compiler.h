@@ -0,0 +1,121 @@
+//----------------------------------------------------------------------
+// FILE: mypl_to_jvm_compiler.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Interface for the MyPL to JVM class file compiler
+//----------------------------------------------------------------------
+
+
+#ifndef MYPL_TO_JVM_COMPILER_H
+#define MYPL_TO_JVM_COMPILER_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ast.h"
+#include "jvm_class_file.h"
+
+
+// Compiles a checked program straight to JVM class files (no Java
+// source, and so no javac): a Program class with a static method for
+// each function (main is the JVM's main), and a nested class
+// Program$<name> with public fields for each struct. Values use the
+// JVM's own types (ints, doubles, bools, and chars are primitives, so
+// unset fields and array elements are zero rather than null, as in the
+// Java transpiler's output), strings are java.lang.Strings, and the
+// built-in functions call the Java library.
+class MyPLtoJVMCompiler : public Visitor {
+public:
+  MyPLtoJVMCompiler();
+  void visit(Program& p);
+  void visit(FunDef& f);
+  void visit(StructDef& s);
+  void visit(ReturnStmt& s);
+  void visit(WhileStmt& s);
+  void visit(ForStmt& s);
+  void visit(IfStmt& s);
+  void visit(VarDeclStmt& s);
+  void visit(AssignStmt& s);
+  void visit(CallExpr& e);
+  void visit(Expr& e);
+  void visit(SimpleTerm& t);
+  void visit(ComplexTerm& t);
+  void visit(SimpleRValue& v);
+  void visit(NewRValue& v);
+  void visit(VarRValue& v);
+
+  // the compiled class files (Program.class first), each as its file
+  // name and contents
+  std::vector<std::pair<std::string, std::string>> class_files();
+
+private:
+  std::unique_ptr<JVMClassFile> program;
+  std::vector<std::unique_ptr<JVMClassFile>> structs;
+
+  // the code of the function being compiled
+  JVMCode* code = nullptr;
+
+  // the type of the expression last visited (its value is on the
+  // operand stack, and the null literal and void calls push null)
+  DataType curr_type;
+
+  std::unordered_map<std::string, StructDef> struct_defs;
+  std::unordered_map<std::string, DataType> return_types;
+  std::unordered_map<std::string, std::vector<DataType>> param_types;
+
+  // the local and declared type of each variable in scope (innermost
+  // last)
+  struct Var {
+    int local;
+    DataType type;
+  };
+  std::vector<std::unordered_map<std::string, Var>> vars;
+
+  // the return type of the function being compiled
+  DataType return_type;
+
+  // true if the program writes doubles, or reads input (each needs a
+  // run-time support method)
+  bool formats_doubles = false;
+  bool reads_input = false;
+
+  // helpers to compile a statement (calls used as statements discard
+  // their results), and a block of them in a new scope
+  void statement(const std::shared_ptr<Stmt>& stmt);
+  void block(const std::vector<std::shared_ptr<Stmt>>& stmts);
+
+  // helper to compile a call, leaving nothing on the stack if it is
+  // void
+  void call(CallExpr& e);
+
+  // helper to compare the two values on the stack
+  void compare(const std::string& op, const DataType& lhs,
+               const DataType& rhs);
+
+  // helper to convert the value last visited (which may be null) to
+  // the given type
+  void coerce(const DataType& type);
+
+  // helpers for the instructions that depend on a value's type
+  void push_default(const DataType& type);
+  void pop_value(const DataType& type);
+  void load_element(const DataType& type);
+  void store_element(const DataType& type);
+  void return_value(const DataType& type);
+
+  // helpers to write the run-time support methods
+  void write_format();
+  void write_input();
+
+  // helpers for types and declarations
+  std::string descriptor(const DataType& type) const;
+  std::string descriptor(const FunDef& f) const;
+  std::string class_name(const DataType& type) const;
+  Var var(const std::string& name) const;
+  DataType field_type(const DataType& type, const Token& field) const;
+
+};
+
+#endif
@@ -35,6 +35,36 @@ enum class OpCode {
   CMPEQ,        // pop x and y off stack, push (y == x)  
   CMPNE,        // pop x and y off stack, push (y != x)
 
+  // typed arithmetic ops (operands known to be ints or doubles)
+  ADDI,         // pop ints x and y, push (y + x)
+  ADDD,         // pop doubles x and y, push (y + x)
+  SUBI,         // pop ints x and y, push (y - x)
+  SUBD,         // pop doubles x and y, push (y - x)
+  MULI,         // pop ints x and y, push (y * x)
+  MULD,         // pop doubles x and y, push (y * x)
+  DIVI,         // pop ints x and y, push (y / x)
+  DIVD,         // pop doubles x and y, push (y / x)
+
+  // typed comparators (operands known to be ints, doubles, or strings)
+  CMPLTI,       // pop ints x and y, push (y < x)
+  CMPLTD,       // pop doubles x and y, push (y < x)
+  CMPLTS,       // pop strings x and y, push (y < x)
+  CMPLEI,       // pop ints x and y, push (y <= x)
+  CMPLED,       // pop doubles x and y, push (y <= x)
+  CMPLES,       // pop strings x and y, push (y <= x)
+  CMPGTI,       // pop ints x and y, push (y > x)
+  CMPGTD,       // pop doubles x and y, push (y > x)
+  CMPGTS,       // pop strings x and y, push (y > x)
+  CMPGEI,       // pop ints x and y, push (y >= x)
+  CMPGED,       // pop doubles x and y, push (y >= x)
+  CMPGES,       // pop strings x and y, push (y >= x)
+  CMPEQI,       // pop ints x and y, push (y == x) (x or y may be null)
+  CMPEQD,       // pop doubles x and y, push (y == x) (x or y may be null)
+  CMPEQS,       // pop strings x and y, push (y == x) (x or y may be null)
+  CMPNEI,       // pop ints x and y, push (y != x) (x or y may be null)
+  CMPNED,       // pop doubles x and y, push (y != x) (x or y may be null)
+  CMPNES,       // pop strings x and y, push (y != x) (x or y may be null)
+
   // jump
   JMP,          // [operand] jump to given instruction v
   JMPF,         // [operand] pop x, if x is false jump to instruction v
@@ -55,14 +85,38 @@ enum class OpCode {
   CONCAT,       // pop x, pop y, push y + x (string concat)
     
   // heap
-  ALLOCS,       // allocate struct obj, push oid x
+  ALLOCS,       // [operand] allocate struct obj of type v, push oid x
   ALLOCA,       // pop x, pop y, allocate array obj with y x values, push oid
-  ADDF,         // [operand] pop x, add field named v to obj(x)
+  ADDF,         // [operand] pop x (obj(x) already has a field v slot)
   SETF,         // [operand] pop x and y, set obj(y).v = x
   GETF,         // [operand] pop x, push value of obj(x).v 
   SETI,         // pop x, y, and z, set array obj(z)[y] = x
   GETI,         // pop x and y, push array obj(y)[x] value
-    
+
+  // typed arrays (elements of the array's static type, stored unboxed)
+  ALLOCAI,      // pop y, allocate int array obj with y null values, push oid
+  ALLOCAD,      // pop y, allocate double array obj with y null values, ...
+  ALLOCAB,      // pop y, allocate bool array obj with y null values, ...
+  ALLOCAC,      // pop y, allocate char array obj with y null values, ...
+  SETII,        // pop int x, y, and z, set int array obj(z)[y] = x
+  SETID,        // pop double x, y, and z, set double array obj(z)[y] = x
+  SETIB,        // pop bool x, y, and z, set bool array obj(z)[y] = x
+  SETIC,        // pop char x, y, and z, set char array obj(z)[y] = x
+  GETII,        // pop x and y, push int array obj(y)[x] value
+  GETID,        // pop x and y, push double array obj(y)[x] value
+  GETIB,        // pop x and y, push bool array obj(y)[x] value
+  GETIC,        // pop x and y, push char array obj(y)[x] value
+
+  // superinstructions (formed by VM::link from the instruction sequence
+  // starting at the instruction they replace, which they skip over)
+  INC_LOCAL,    // [operand] LOAD(v) PUSH(int c) ADD STORE(v)
+  CMP_LOCAL_CONST_JMPF,  // [operand] LOAD(v) PUSH(int c) CMPxx JMPF(t)
+  LOAD_GETI,    // [operand] LOAD(v) GETI (or a typed GETI)
+  LOAD_LOAD,    // [operand] LOAD(v) LOAD(w)
+  LOAD_PUSH,    // [operand] LOAD(v) PUSH(c)
+  LOAD_RET,     // [operand] LOAD(v) RET
+  RET_NULL,     // PUSH(null) RET
+
   // special
   DUP,          // pop x, push x, push x
   NOP           // has no effect (for jumping over code segments)
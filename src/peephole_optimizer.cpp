@@ -0,0 +1,323 @@
+//----------------------------------------------------------------------
+// FILE: peephole_optimizer.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Bytecode peephole optimizer implementation
+//----------------------------------------------------------------------
+
+#include <unordered_map>
+#include "peephole_optimizer.h"
+
+
+using namespace std;
+
+
+// true if the instruction's operand is an instruction index
+static bool is_jump(const VMInstr& instr)
+{
+  return instr.opcode() == OpCode::JMP or instr.opcode() == OpCode::JMPF;
+}
+
+
+static int jump_target(const VMInstr& instr)
+{
+  return instr.operand().value().as_int();
+}
+
+
+// true if the instruction only pushes a value (no other effects)
+static bool pushes_only(const VMInstr& instr)
+{
+  OpCode op = instr.opcode();
+  return op == OpCode::PUSH or op == OpCode::LOAD or op == OpCode::DUP;
+}
+
+
+// true if the value the instruction pushes can never be null
+static bool pushes_non_null(const VMInstr& instr)
+{
+  switch (instr.opcode()) {
+    case OpCode::PUSH:
+      return !instr.operand().value().is_null();
+    case OpCode::ADDI: case OpCode::ADDD: case OpCode::SUBI:
+    case OpCode::SUBD: case OpCode::MULI: case OpCode::MULD:
+    case OpCode::DIVI: case OpCode::DIVD:
+    case OpCode::CMPLT: case OpCode::CMPLE: case OpCode::CMPGT:
+    case OpCode::CMPGE: case OpCode::CMPEQ: case OpCode::CMPNE:
+    case OpCode::CMPLTI: case OpCode::CMPLTD: case OpCode::CMPLTS:
+    case OpCode::CMPLEI: case OpCode::CMPLED: case OpCode::CMPLES:
+    case OpCode::CMPGTI: case OpCode::CMPGTD: case OpCode::CMPGTS:
+    case OpCode::CMPGEI: case OpCode::CMPGED: case OpCode::CMPGES:
+    case OpCode::CMPEQI: case OpCode::CMPEQD: case OpCode::CMPEQS:
+    case OpCode::CMPNEI: case OpCode::CMPNED: case OpCode::CMPNES:
+    case OpCode::SLEN: case OpCode::ALEN: case OpCode::TOSTR:
+    case OpCode::CONCAT: case OpCode::ALLOCS: case OpCode::ALLOCA:
+    case OpCode::ALLOCAI: case OpCode::ALLOCAD: case OpCode::ALLOCAB:
+    case OpCode::ALLOCAC:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+PeepholeOptimizer::PeepholeOptimizer(const VM& vm)
+  : vm(vm)
+{
+}
+
+
+void PeepholeOptimizer::optimize(VMFrameInfo& frame)
+{
+  this->frame = &frame;
+  instrs = &frame.instructions;
+  while (pass())
+    ;
+  this->frame = nullptr;
+  instrs = nullptr;
+}
+
+
+bool PeepholeOptimizer::pass()
+{
+  removed.assign(instrs->size(), false);
+  bool changed = thread_jumps();
+  changed = remove_unreachable() or changed;
+  changed = remove_redundant() or changed;
+  compact();
+  changed = propagate_constants() or changed;
+  return changed;
+}
+
+
+int PeepholeOptimizer::next(int pc) const
+{
+  ++pc;
+  while (pc < instrs->size() and removed[pc])
+    ++pc;
+  return pc;
+}
+
+
+bool PeepholeOptimizer::thread_jumps()
+{
+  vector<VMInstr>& code = *instrs;
+  int size = code.size();
+  bool changed = false;
+  for (VMInstr& instr : code) {
+    if (!is_jump(instr))
+      continue;
+    int target = jump_target(instr);
+    // follow NOPs and unconditional jumps (the step limit stops at
+    // jumps that loop back to themselves)
+    for (int steps = 0; target < size and steps < size; ++steps) {
+      if (code[target].opcode() == OpCode::NOP)
+        target = target + 1;
+      else if (code[target].opcode() == OpCode::JMP)
+        target = jump_target(code[target]);
+      else
+        break;
+    }
+    if (target != jump_target(instr)) {
+      instr.set_operand(target);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+
+bool PeepholeOptimizer::remove_unreachable()
+{
+  vector<VMInstr>& code = *instrs;
+  int size = code.size();
+  vector<bool> reached(size, false);
+  vector<int> worklist = {0};
+  while (!worklist.empty()) {
+    int pc = worklist.back();
+    worklist.pop_back();
+    if (pc >= size or reached[pc])
+      continue;
+    reached[pc] = true;
+    OpCode op = code[pc].opcode();
+    if (is_jump(code[pc]))
+      worklist.push_back(jump_target(code[pc]));
+    if (op != OpCode::JMP and op != OpCode::RET)
+      worklist.push_back(pc + 1);
+  }
+  bool changed = false;
+  for (int pc = 0; pc < size; ++pc) {
+    if (!reached[pc]) {
+      removed[pc] = true;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+
+bool PeepholeOptimizer::remove_redundant()
+{
+  vector<VMInstr>& code = *instrs;
+  int size = code.size();
+  // instructions that are jumped to (a sequence can only be rewritten
+  // if control can't enter it part way through)
+  vector<bool> is_target(size + 1, false);
+  for (int pc = 0; pc < size; ++pc)
+    if (!removed[pc] and is_jump(code[pc]))
+      is_target[jump_target(code[pc])] = true;
+  // the number of reads of each variable
+  vector<int> loads;
+  for (int pc = 0; pc < size; ++pc) {
+    if (!removed[pc] and code[pc].opcode() == OpCode::LOAD) {
+      int index = code[pc].operand().value().as_int();
+      if (index >= loads.size())
+        loads.resize(index + 1, 0);
+      ++loads[index];
+    }
+  }
+  // true if a jump lands on the first kept instruction after pc
+  // (a jump to a removed instruction lands on the next one kept)
+  auto entered = [&](int pc) {
+    for (int i = pc + 1; i < size and i <= next(pc); ++i)
+      if (is_target[i])
+        return true;
+    return false;
+  };
+  auto is_read = [&](int index) {
+    return index < loads.size() and loads[index] > 0;
+  };
+  bool changed = false;
+  for (int pc = 0; pc < size; pc = next(pc)) {
+    if (removed[pc])
+      continue;
+    VMInstr& instr = code[pc];
+    OpCode op = instr.opcode();
+    int pc2 = next(pc);
+    int pc3 = pc2 < size ? next(pc2) : size;
+    OpCode op2 = pc2 < size ? code[pc2].opcode() : OpCode::NOP;
+    OpCode op3 = pc3 < size ? code[pc3].opcode() : OpCode::NOP;
+    bool pair = pc2 < size and !entered(pc);
+    optional<VMValue> folded;
+    if (op == OpCode::NOP) {
+      removed[pc] = true;
+      changed = true;
+    } else if (op == OpCode::JMP and jump_target(instr) > pc and
+               jump_target(instr) <= pc2) {
+      removed[pc] = true;
+      changed = true;
+    } else if (pair and pushes_only(instr) and op2 == OpCode::POP) {
+      removed[pc] = removed[pc2] = true;
+      changed = true;
+    } else if (pair and op == OpCode::PUSH and op2 == OpCode::PUSH and
+               pc3 < size and !entered(pc2) and
+               (folded = vm.fold(op3, instr.operand().value(),
+                                 code[pc2].operand().value()))) {
+      // an operator applied to two constants
+      instr = VMInstr::PUSH(folded.value());
+      removed[pc2] = removed[pc3] = true;
+      changed = true;
+    } else if (pair and op == OpCode::PUSH and op2 == OpCode::NOT and
+               instr.operand().value().is_bool()) {
+      instr = VMInstr::PUSH(!instr.operand().value().as_bool());
+      removed[pc2] = true;
+      changed = true;
+    } else if (pair and op == OpCode::PUSH and op2 == OpCode::STORE and
+               !instr.operand().value().is_null() and
+               !is_read(code[pc2].operand().value().as_int()) and
+               code[pc2].operand().value().as_int() >= frame->arg_count) {
+      // a (non-null) constant stored to a variable that is never read
+      removed[pc] = removed[pc2] = true;
+      changed = true;
+    } else if (pair and op == OpCode::PUSH and op2 == OpCode::JMPF and
+               instr.operand().value().is_bool()) {
+      // branch on a constant: never taken (true) or always taken (false)
+      if (!instr.operand().value().as_bool())
+        instr = VMInstr::JMP(jump_target(code[pc2]));
+      else
+        removed[pc] = true;
+      removed[pc2] = true;
+      changed = true;
+    } else if (pair and pushes_non_null(instr) and op2 == OpCode::STORE and
+               op3 == OpCode::LOAD and !entered(pc2)) {
+      // STORE(x) LOAD(x) where x is never read again: the stored value
+      // can't be null (so STORE can't fail), leave it on the stack
+      int index = code[pc2].operand().value().as_int();
+      if (code[pc3].operand().value().as_int() == index and
+          loads[index] == 1)
+      {
+        removed[pc2] = removed[pc3] = true;
+        loads[index] = 0;
+        changed = true;
+      }
+    }
+  }
+  return changed;
+}
+
+
+bool PeepholeOptimizer::propagate_constants()
+{
+  vector<VMInstr>& code = *instrs;
+  // the constant stored to each variable, for variables (other than
+  // parameters) stored to just once (a declaration), with a constant
+  unordered_map<int, int> stores;
+  vector<bool> is_target(code.size() + 1, false);
+  for (int pc = 0; pc < code.size(); ++pc) {
+    if (code[pc].opcode() == OpCode::STORE)
+      ++stores[code[pc].operand().value().as_int()];
+    else if (is_jump(code[pc]))
+      is_target[jump_target(code[pc])] = true;
+  }
+  unordered_map<int, VMValue> constants;
+  for (int pc = 1; pc < code.size(); ++pc) {
+    if (code[pc].opcode() != OpCode::STORE)
+      continue;
+    int index = code[pc].operand().value().as_int();
+    const VMInstr& prev = code[pc - 1];
+    if (stores[index] == 1 and index >= frame->arg_count and
+        !is_target[pc] and prev.opcode() == OpCode::PUSH and !prev.operand().value().is_null())
+      constants[index] = prev.operand().value();
+  }
+  // variables are always declared before they are read, so every read
+  // sees the constant (the store itself is left for the next pass)
+  bool changed = false;
+  for (VMInstr& instr : code) {
+    if (instr.opcode() != OpCode::LOAD)
+      continue;
+    auto constant = constants.find(instr.operand().value().as_int());
+    if (constant != constants.end()) {
+      instr = VMInstr::PUSH(constant->second);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+
+void PeepholeOptimizer::compact()
+{
+  vector<VMInstr>& code = *instrs;
+  int size = code.size();
+  // new_index[pc] is the position of the first kept instruction at or
+  // after pc, which is where a jump to pc now lands
+  vector<int> new_index(size + 1, 0);
+  int kept = 0;
+  for (int pc = 0; pc < size; ++pc) {
+    new_index[pc] = kept;
+    if (!removed[pc])
+      ++kept;
+  }
+  new_index[size] = kept;
+  vector<VMInstr> result;
+  result.reserve(kept);
+  for (int pc = 0; pc < size; ++pc) {
+    if (removed[pc])
+      continue;
+    VMInstr instr = code[pc];
+    if (is_jump(instr))
+      instr.set_operand(new_index[jump_target(instr)]);
+    result.push_back(instr);
+  }
+  code = result;
+}
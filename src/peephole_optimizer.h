@@ -0,0 +1,71 @@
+//----------------------------------------------------------------------
+// FILE: peephole_optimizer.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Interface for the bytecode peephole optimizer
+//----------------------------------------------------------------------
+
+#ifndef PEEPHOLE_OPTIMIZER_H
+#define PEEPHOLE_OPTIMIZER_H
+
+#include <vector>
+#include "vm.h"
+
+
+// Removes redundant instructions from a generated frame (before it is
+// added to the vm), rewriting jump targets to match:
+//   - NOPs, jumps to the next instruction, and unreachable code
+//   - jumps to jumps (retargeted to the final destination)
+//   - values pushed and then immediately popped
+//   - branches on constant conditions
+//   - a non-null value stored to a variable that is only read back by
+//     the next instruction (the value is just left on the stack)
+//   - operators applied to constants (evaluated by the vm that will run
+//     the code, so the results are the same as at run time)
+//   - variables only ever assigned a (non-null) constant, which is
+//     pushed in place of each read
+class PeepholeOptimizer
+{
+public:
+
+  // the vm evaluates constant expressions
+  PeepholeOptimizer(const VM& vm);
+
+  // optimize the frame's instructions (until no more rules apply)
+  void optimize(VMFrameInfo& frame);
+
+private:
+
+  const VM& vm;
+
+  // the frame being optimized, its instructions, and which are to be
+  // removed
+  VMFrameInfo* frame = nullptr;
+  std::vector<VMInstr>* instrs = nullptr;
+  std::vector<bool> removed;
+
+  // helper to apply each rule once (returns false if none applied)
+  bool pass();
+
+  // helper to retarget jumps that land on jumps or NOPs
+  bool thread_jumps();
+
+  // helper to mark instructions no path from the start reaches
+  bool remove_unreachable();
+
+  // helper to apply the rules over adjacent instructions
+  bool remove_redundant();
+
+  // helper to replace reads of constant variables with the constant
+  bool propagate_constants();
+
+  // helper to delete the removed instructions, adjusting jump targets
+  void compact();
+
+  // the next instruction after pc that is not removed (or size if none)
+  int next(int pc) const;
+
+};
+
+
+#endif
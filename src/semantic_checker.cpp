@@ -45,6 +45,12 @@ void SemanticChecker::error(const string& msg)
 }
 
 
+const OperandTypes& SemanticChecker::operand_types() const
+{
+  return expr_operand_types;
+}
+
+
 // visitor functions
 
 
@@ -241,7 +247,7 @@ void SemanticChecker::visit(IfStmt& s)
   }
 
   symbol_table.pop_environment();
-  for (BasicIf elseif:s.else_ifs)
+  for (BasicIf& elseif:s.else_ifs)
   {
     elseif.condition.accept(*this);
 
@@ -351,7 +357,7 @@ void SemanticChecker::visit(CallExpr& e)
   if (BUILT_INS.contains(e.fun_name.lexeme())) { 
     if (e.fun_name.lexeme() == "print")
     {
-      for (Expr arg:e.args)
+      for (Expr& arg:e.args)
       {
         arg.accept(*this);
       }
@@ -374,7 +380,7 @@ void SemanticChecker::visit(CallExpr& e)
       }
 
     } else if (e.fun_name.lexeme() == "concat") {
-      for (Expr arg:e.args)
+      for (Expr& arg:e.args)
       {
         arg.accept(*this);
       }
@@ -390,7 +396,7 @@ void SemanticChecker::visit(CallExpr& e)
       }
 
     } else if (e.fun_name.lexeme() == "to_string") {
-      for (Expr arg:e.args)
+      for (Expr& arg:e.args)
       {
         arg.accept(*this);
       }
@@ -407,7 +413,7 @@ void SemanticChecker::visit(CallExpr& e)
 
       curr_type = {false, "string"};
     } else if (e.fun_name.lexeme() == "to_int") {
-      for (Expr arg:e.args)
+      for (Expr& arg:e.args)
       {
         arg.accept(*this);
         if ((curr_type.type_name == "int") || (curr_type.type_name == "bool"))
@@ -423,7 +429,7 @@ void SemanticChecker::visit(CallExpr& e)
 
       curr_type = {false, "int"};
     } else if (e.fun_name.lexeme() == "to_double") {
-      for (Expr arg:e.args)
+      for (Expr& arg:e.args)
       {
         arg.accept(*this);
       }
@@ -440,7 +446,7 @@ void SemanticChecker::visit(CallExpr& e)
 
       curr_type = {false, "double"};
     } else if (e.fun_name.lexeme() == "input") {
-      for (Expr arg:e.args)
+      for (Expr& arg:e.args)
       {
         arg.accept(*this);
       }
@@ -467,7 +473,7 @@ void SemanticChecker::visit(CallExpr& e)
 
       curr_type = {false, "char"};
     } else if (e.fun_name.lexeme() == "length") {
-      for (Expr arg:e.args)
+      for (Expr& arg:e.args)
       {
         arg.accept(*this);
 
@@ -490,7 +496,7 @@ void SemanticChecker::visit(CallExpr& e)
   } else if (fun_defs.contains(e.fun_name.lexeme())) { 
   // checking for function use before definition
 
-    for (Expr arg:e.args)
+    for (Expr& arg:e.args)
     {
       arg.accept(*this);
     }
@@ -499,6 +505,8 @@ void SemanticChecker::visit(CallExpr& e)
       error("Wrong number of arguments in function call", e.first_token());
     }
 
+    curr_type = fun_defs[e.fun_name.lexeme()].return_type;
+
   } else {
     error("Function " + e.fun_name.lexeme() + " used before definition.", e.first_token());
   }
@@ -513,6 +521,11 @@ void SemanticChecker::visit(Expr& e)
   {
     e.rest->accept(*this);
     DataType rhs_type = curr_type;
+    // record the operand type for code generation
+    if (lhs_type.type_name == rhs_type.type_name && lhs_type.is_array == rhs_type.is_array)
+      expr_operand_types[&e] = lhs_type;
+    else
+      expr_operand_types[&e] = DataType {false, "void"};
     if ((e.op.value().lexeme() == "+") || (e.op.value().lexeme() == "*") ||
     (e.op.value().lexeme() == "-") || (e.op.value().lexeme() == "/"))
     //arithmetic operations mean type must be int or double
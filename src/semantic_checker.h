@@ -13,10 +13,18 @@
 #include "symbol_table.h"
 
 
+// the static type shared by the operands of each binary expression
+// (void when the operand types differ, e.g., a comparison with null)
+typedef std::unordered_map<const Expr*, DataType> OperandTypes;
+
+
 class SemanticChecker : public Visitor
 {
 public:
 
+  // the operand types of the binary expressions checked so far
+  const OperandTypes& operand_types() const;
+
   // visitor functions
   void visit(Program& p);
   void visit(FunDef& f);
@@ -49,6 +57,9 @@ private:
   // mapping from function names to corresponding ast objects
   std::unordered_map<std::string, FunDef> fun_defs;
 
+  // operand type of each checked binary expression
+  OperandTypes expr_operand_types;
+
   // helper function to get field in struct def
   std::optional<VarDef> get_field(const StructDef& struct_def,
                                   const std::string& field_name);
@@ -5,8 +5,12 @@
 // DESC: MyPL virtual machine implementation
 //----------------------------------------------------------------------
 
+#include <algorithm>
+#include <climits>
 #include <iostream>
 #include "vm.h"
+#include "vm_bytecode.h"
+#include "vm_verifier.h"
 #include "mypl_exception.h"
 
 
@@ -22,8 +26,8 @@ void VM::error(string msg) const
 void VM::error(string msg, const VMFrame& frame) const
 {
   int pc = frame.pc - 1;
-  VMInstr instr = frame.info.instructions[pc];
-  string name = frame.info.function_name;
+  VMInstr instr = frame.info->instructions[pc];
+  string name = frame.info->function_name;
   msg += " (in " + name + " at " + to_string(pc) + ": " +
     to_string(instr) + ")";
   throw MyPLException::VMError(msg);
@@ -37,8 +41,10 @@ string to_string(const VM& vm)
     const string& name = entry.first;
     s += "\nFrame '" + name + "'\n";
     const VMFrameInfo& frame = entry.second;
-    for (int i = 0; i < frame.instructions.size(); ++i) {
-      VMInstr instr = frame.instructions[i];
+    vector<VMInstr> instrs = frame.image_index < 0 ?
+      frame.instructions : vm.image->code(frame.image_index);
+    for (int i = 0; i < instrs.size(); ++i) {
+      VMInstr instr = instrs[i];
       s += "  " + to_string(i) + ": " + to_string(instr) + "\n"; 
     }
   }
@@ -49,263 +55,1206 @@ string to_string(const VM& vm)
 void VM::add(const VMFrameInfo& frame)
 {
   frame_info[frame.function_name] = frame;
+  linked = false;
 }
 
 
-void VM::run(bool DEBUG)
+void VM::add(const VMStructInfo& struct_type)
 {
-  // grab the "main" frame if it exists
-  if (!frame_info.contains("main"))
+  struct_info[struct_type.struct_name] = struct_type;
+  linked = false;
+}
+
+
+void VM::load(shared_ptr<const VMImage> image)
+{
+  for (const VMStructInfo& struct_type : image->struct_types())
+    add(struct_type);
+  for (const VMFrameInfo& frame : image->functions())
+    add(frame);
+  this->image = image;
+}
+
+
+void VM::link()
+{
+  // assign each function a dense index (dropping any code compiled for
+  // the previous functions)
+  compiler.clear();
+  function_index.clear();
+  functions.clear();
+  for (const auto& [name, frame] : frame_info) {
+    function_index[name] = functions.size();
+    functions.push_back(frame);
+  }
+  if (!function_index.contains("main"))
     error("No 'main' function");
-  shared_ptr<VMFrame> frame = make_shared<VMFrame>();
-  frame->info = frame_info["main"];
-  call_stack.push(frame);
-
-  // run loop (keep going until we run out of instructions)
-  while (!call_stack.empty() and frame->pc < frame->info.instructions.size()) {
-
-    // get the next instruction
-    VMInstr& instr = frame->info.instructions[frame->pc];
-
-    // increment the program counter
-    ++frame->pc;
-
-    // for debugging
-    if (DEBUG) {
-      // TODO
-      cerr << endl << endl;
-      cerr << "\t FRAME.........: " << frame->info.function_name << endl;
-      cerr << "\t PC............: " << (frame->pc - 1) << endl;
-      cerr << "\t INSTR.........: " << to_string(instr) << endl;
-      cerr << "\t NEXT OPERAND..: ";
-      if (!frame->operand_stack.empty())
-        cerr << to_string(frame->operand_stack.top()) << endl;
-      else
-        cerr << "empty" << endl;
-      cerr << "\t NEXT FUNCTION.: ";
-      if (!call_stack.empty())
-        cerr << call_stack.top()->info.function_name << endl;
-      else
-        cerr << "empty" << endl;
+  main_index = function_index["main"];
+  // and each struct type, with the slot of each of its fields
+  struct_index.clear();
+  field_slot.clear();
+  structs.clear();
+  for (const auto& [name, struct_type] : struct_info) {
+    struct_index[name] = structs.size();
+    structs.push_back(struct_type);
+    for (int i = 0; i < struct_type.field_names.size(); ++i)
+      field_slot[name + "." + struct_type.field_names[i]] = i;
+  }
+  literals.clear();
+  unverified.clear();
+  verified = verification;
+  // (functions loaded from an image are decoded when first called, but
+  // main is always called)
+  for (VMFrameInfo& frame : functions)
+    if (frame.image_index < 0)
+      prepare(frame);
+  if (functions[main_index].image_index >= 0)
+    decode(functions[main_index]);
+  linked = true;
+}
+
+
+void VM::prepare(VMFrameInfo& frame)
+{
+  // verify the function while it still refers to others by name
+  if (verification) {
+    VMVerifier verifier(frame_info, struct_info);
+    if (auto failure = verifier.verify(frame)) {
+      unverified.push_back(*failure);
+      verified = false;
+    }
+  }
+  // resolve each call to its callee's index, each allocation to its
+  // struct type's index, and each field access to the field's slot
+  // (keeping the names as comments for debugging output), and share
+  // string literals with the same characters
+  for (int pc = 0; pc < frame.instructions.size(); ++pc) {
+    VMInstr& instr = frame.instructions[pc];
+    OpCode op = instr.opcode();
+    unordered_map<string, int>* index = nullptr;
+    string kind;
+    if (op == OpCode::PUSH and instr.operand()->is_string()) {
+      const string& chars = instr.operand()->as_string();
+      instr.set_operand(literals.try_emplace(chars, chars).first->second);
+      continue;
+    } else if (op == OpCode::CALL) {
+      index = &function_index;
+      kind = "call to undefined function";
+    } else if (op == OpCode::ALLOCS) {
+      index = &struct_index;
+      kind = "undefined struct type";
+    } else if (op == OpCode::ADDF or op == OpCode::SETF or
+               op == OpCode::GETF) {
+      index = &field_slot;
+      kind = "undefined field";
+    } else
+      continue;
+    string name = instr.operand().value().as_string();
+    if (!index->contains(name))
+      error(kind + " '" + name + "' (in " + frame.function_name +
+            " at " + to_string(pc) + ": " + to_string(instr) + ")");
+    instr.set_operand(index->at(name));
+    instr.set_comment(name);
+  }
+  size_frame(frame);
+  if (superinstructions)
+    fuse(frame);
+}
+
+
+void VM::decode(VMFrameInfo& frame)
+{
+  frame.instructions = image->code(frame.image_index);
+  frame.image_index = -1;
+  prepare(frame);
+}
+
+
+// the number of values an instruction pops and then pushes
+static pair<int,int> stack_effect(const VMInstr& instr, int arg_count)
+{
+  switch (instr.opcode()) {
+    case OpCode::PUSH: case OpCode::LOAD: case OpCode::READ:
+    case OpCode::ALLOCS:
+      return {0, 1};
+    case OpCode::POP: case OpCode::STORE: case OpCode::JMPF:
+    case OpCode::RET: case OpCode::WRITE: case OpCode::ADDF:
+      return {1, 0};
+    case OpCode::NOT: case OpCode::SLEN: case OpCode::ALEN:
+    case OpCode::TOINT: case OpCode::TODBL: case OpCode::TOSTR:
+    case OpCode::GETF: case OpCode::ALLOCAI: case OpCode::ALLOCAD:
+    case OpCode::ALLOCAB: case OpCode::ALLOCAC:
+      return {1, 1};
+    case OpCode::SETF:
+      return {2, 0};
+    case OpCode::SETI: case OpCode::SETII: case OpCode::SETID:
+    case OpCode::SETIB: case OpCode::SETIC:
+      return {3, 0};
+    case OpCode::DUP:
+      return {1, 2};
+    case OpCode::CALL:
+      return {arg_count, 1};
+    case OpCode::JMP: case OpCode::NOP:
+      return {0, 0};
+    default:
+      // binary operators, comparators, GETC, CONCAT, ALLOCA, GETI (and
+      // the typed GETIs)
+      return {2, 1};
+  }
+}
+
+
+void VM::size_frame(VMFrameInfo& frame) const
+{
+  const vector<VMInstr>& instrs = frame.instructions;
+  frame.local_count = frame.arg_count;
+  frame.max_stack = 0;
+  // walk every path through the code tracking the operand stack depth
+  // on entry to each instruction
+  vector<int> depth(instrs.size() + 1, -1);
+  vector<int> worklist = {0};
+  depth[0] = 0;
+  while (!worklist.empty()) {
+    int pc = worklist.back();
+    worklist.pop_back();
+    if (pc == instrs.size())
+      continue;
+    const VMInstr& instr = instrs[pc];
+    auto fail = [&](const string& msg) {
+      error(msg + " (in " + frame.function_name + " at " + to_string(pc) +
+            ": " + to_string(instr) + ")");
+    };
+    OpCode op = instr.opcode();
+    if (op == OpCode::LOAD or op == OpCode::STORE) {
+      int index = instr.operand().value().as_int();
+      if (index < 0)
+        fail("variable index out of bounds");
+      frame.local_count = max(frame.local_count, index + 1);
+    }
+    int arg_count = 0;
+    if (op == OpCode::CALL)
+      arg_count = functions[instr.operand().value().as_int()].arg_count;
+    auto [pops, pushes] = stack_effect(instr, arg_count);
+    if (depth[pc] < pops)
+      fail("operand stack underflow");
+    int next_depth = depth[pc] - pops + pushes;
+    frame.max_stack = max(frame.max_stack, next_depth);
+    vector<int> successors;
+    if (op == OpCode::JMP or op == OpCode::JMPF) {
+      int target = instr.operand().value().as_int();
+      if (target < 0 or target > instrs.size())
+        fail("jump target out of bounds");
+      successors.push_back(target);
+    }
+    if (op != OpCode::JMP and op != OpCode::RET)
+      successors.push_back(pc + 1);
+    for (int next : successors) {
+      if (depth[next] == -1) {
+        depth[next] = next_depth;
+        worklist.push_back(next);
+      } else if (depth[next] != next_depth)
+        fail("inconsistent operand stack depth");
     }
+  }
+}
+
+
+// Superinstructions overwrite the first instruction of the sequence
+// they replace and leave the rest in place: a superinstruction skips
+// over the rest of its sequence, so no jump targets change (a jump into
+// the middle still runs the original instructions). Each one also falls
+// back to its first instruction's handler for anything but the common
+// case, which leaves errors exactly as they were.
+void VM::fuse(VMFrameInfo& frame) const
+{
+  vector<VMInstr>& instrs = frame.instructions;
+  auto op = [&](int pc) {
+    return pc < instrs.size() ? instrs[pc].opcode() : OpCode::NOP;
+  };
+  auto int_operand = [&](int pc) {
+    return instrs[pc].operand().has_value() and instrs[pc].operand()->is_int();
+  };
+  auto int_compare = [&](int pc) {
+    switch (op(pc)) {
+      case OpCode::CMPLT: case OpCode::CMPLE: case OpCode::CMPGT:
+      case OpCode::CMPGE: case OpCode::CMPEQ: case OpCode::CMPNE:
+      case OpCode::CMPLTI: case OpCode::CMPLEI: case OpCode::CMPGTI:
+      case OpCode::CMPGEI: case OpCode::CMPEQI: case OpCode::CMPNEI:
+        return true;
+      default:
+        return false;
+    }
+  };
+  auto is_array_get = [&](int pc) {
+    switch (op(pc)) {
+      case OpCode::GETI: case OpCode::GETII: case OpCode::GETID:
+      case OpCode::GETIB: case OpCode::GETIC:
+        return true;
+      default:
+        return false;
+    }
+  };
+  int pc = 0;
+  while (pc < instrs.size()) {
+    int length = 1;
+    if (op(pc) == OpCode::LOAD and int_operand(pc)) {
+      int index = instrs[pc].operand()->as_int();
+      bool push_int = op(pc + 1) == OpCode::PUSH and int_operand(pc + 1);
+      if (push_int and (op(pc + 2) == OpCode::ADD or
+                        op(pc + 2) == OpCode::ADDI) and
+          op(pc + 3) == OpCode::STORE and int_operand(pc + 3) and
+          instrs[pc + 3].operand()->as_int() == index) {
+        instrs[pc] = VMInstr::INC_LOCAL(index);
+        length = 4;
+      } else if (push_int and int_compare(pc + 2) and
+                 op(pc + 3) == OpCode::JMPF) {
+        instrs[pc] = VMInstr::CMP_LOCAL_CONST_JMPF(index);
+        length = 4;
+      } else if (is_array_get(pc + 1)) {
+        instrs[pc] = VMInstr::LOAD_GETI(index);
+        length = 2;
+      } else if (op(pc + 1) == OpCode::LOAD and int_operand(pc + 1)) {
+        instrs[pc] = VMInstr::LOAD_LOAD(index);
+        length = 2;
+      } else if (op(pc + 1) == OpCode::PUSH) {
+        instrs[pc] = VMInstr::LOAD_PUSH(index);
+        length = 2;
+      } else if (op(pc + 1) == OpCode::RET) {
+        instrs[pc] = VMInstr::LOAD_RET(index);
+        length = 2;
+      }
+    } else if (op(pc) == OpCode::PUSH and instrs[pc].operand()->is_null() and
+               op(pc + 1) == OpCode::RET) {
+      instrs[pc] = VMInstr::RET_NULL();
+      length = 2;
+    }
+    pc += length;
+  }
+}
+
+
+VMFrame* VM::push_frame(const VMFrameInfo& info, VMFrame* caller)
+{
+  VMFrame* frame = try_push_frame(info, caller);
+  if (!frame) {
+    if (caller)
+      error("stack overflow", *caller);
+    error("stack overflow");
+  }
+  return frame;
+}
+
+
+VMFrame* VM::try_push_frame(const VMFrameInfo& info, VMFrame* caller)
+{
+  // the frame's window starts at its arguments (the caller's top
+  // arg_count operands), which become its first variables
+  VMValue* base = value_stack.data();
+  if (caller)
+    base = caller->sp - info.arg_count;
+  VMValue* limit = value_stack.data() + value_stack.size();
+  if (call_depth == call_stack.size() or
+      base + info.local_count + info.max_stack > limit)
+    return nullptr;
+  if (caller)
+    caller->sp = base;
+  VMFrame* frame = &call_stack[call_depth++];
+  frame->info = &info;
+  frame->pc = 0;
+  frame->variables = base;
+  fill(base + info.arg_count, base + info.local_count, nullptr);
+  frame->operands = base + info.local_count;
+  frame->sp = frame->operands;
+  return frame;
+}
+
+
+bool VM::tier_up(const VMFrameInfo& info)
+{
+  if (info.native)
+    return true;
+  if (++info.hotness != JIT_THRESHOLD)
+    return false;
+  VMJit::Runtime runtime {this, &VM::jit_call, &VM::jit_return};
+  try {
+    info.native = compiler.compile(info, runtime);
+  } catch (std::bad_alloc&) {
+    // (the function just stays interpreted)
+  }
+  return info.native != nullptr;
+}
+
+
+// (called from compiled code, so neither helper may throw: anything
+// that could fail is left to the interpreter)
+
+int VM::jit_call(void* vm_ptr, VMFrame* caller, int index)
+{
+  VM& vm = *static_cast<VM*>(vm_ptr);
+  const VMFrameInfo& callee = vm.functions[index];
+  if (callee.image_index >= 0)
+    return VMJit::NOT_CALLED;
+  VMFrame* frame = vm.try_push_frame(callee, caller);
+  if (!frame)
+    return VMJit::NOT_CALLED;
+  if (!vm.tier_up(callee))
+    return VMJit::LEFT;
+  return callee.native(frame);
+}
+
+
+int VM::jit_return(void* vm_ptr, VMFrame* frame)
+{
+  VM& vm = *static_cast<VM*>(vm_ptr);
+  // (returning from main ends the run, which the interpreter does)
+  if (vm.call_depth == 1)
+    return VMJit::LEFT;
+  --vm.call_depth;
+  vm.call_stack[vm.call_depth - 1].push(frame->top());
+  return VMJit::RETURNED;
+}
+
+
+void VM::collect(const VMFrame& top)
+{
+  // the frames' windows are stacked one after another, so the values
+  // of every active frame lie below the top frame's stack pointer
+  heap.collect(value_stack.data(), top.sp);
+}
+
+
+//----------------------------------------------------------------------
+// Instruction dispatch
+//
+// Every opcode handler in run() is labelled L_<opcode> so it can be
+// reached both from the jump table and from the legacy compare chain.
+// With GCC/Clang the table is a computed goto repeated at the end of
+// each handler (threaded code); other compilers loop back to a switch.
+//----------------------------------------------------------------------
+
+#if defined(__GNUC__)
+#define MYPL_COMPUTED_GOTO 1
+#else
+#define MYPL_COMPUTED_GOTO 0
+#endif
+
+#define TARGET(op) case OpCode::op: L_##op:
+
+#define FETCH()                                                 \
+  instr = &frame->info->instructions[frame->pc++];              \
+  if (instrument) {                                             \
+    if (DEBUG)                                                  \
+      trace(*frame, *instr);                                    \
+    if (profile)                                                \
+      record(*instr);                                           \
+  }
+
+// verified code never runs off its end (see VMVerifier), so only
+// checked code tests for it
+#if MYPL_COMPUTED_GOTO
+#define NEXT()                                                  \
+  do {                                                          \
+    if (CHECKED and                                             \
+        frame->pc >= frame->info->instructions.size())          \
+      return nullptr;                                           \
+    FETCH();                                                    \
+    if (dispatch == Dispatch::LEGACY)                           \
+      goto legacy_decode;                                       \
+    goto *targets[static_cast<int>(instr->opcode())];           \
+  } while (false)
+#else
+#define NEXT() goto next_instr
+#endif
+
+
+void VM::set_dispatch(Dispatch strategy)
+{
+  dispatch = strategy;
+}
+
+
+void VM::set_max_call_depth(int depth)
+{
+  max_call_depth = depth;
+}
+
+
+void VM::set_value_stack_size(int slots)
+{
+  value_stack_size = slots;
+}
+
+
+void VM::set_gc_threshold(size_t bytes)
+{
+  heap.set_threshold(bytes);
+}
+
+
+void VM::set_gc_growth(double factor)
+{
+  heap.set_growth(factor);
+}
+
+
+void VM::set_gc_nursery_size(size_t bytes)
+{
+  heap.set_nursery_size(bytes);
+}
+
+
+void VM::set_gc_stress(bool enabled)
+{
+  heap.set_stress(enabled);
+}
+
+
+const VMHeapStats& VM::gc_statistics() const
+{
+  return heap.statistics();
+}
+
+
+void VM::set_superinstructions(bool enabled)
+{
+  superinstructions = enabled;
+  linked = false;
+}
+
+
+void VM::set_verification(bool enabled)
+{
+  verification = enabled;
+  linked = false;
+}
+
+
+const vector<string>& VM::verification_failures() const
+{
+  return unverified;
+}
+
+
+void VM::set_jit(bool enabled)
+{
+  jit = enabled;
+}
+
+
+int VM::jit_compiled_count() const
+{
+  return compiler.compiled_count();
+}
+
+
+void VM::set_profile(bool enabled)
+{
+  profile = enabled;
+}
+
+
+// number of distinct opcodes (NOP is declared last)
+static const int OPCODE_COUNT = static_cast<int>(OpCode::NOP) + 1;
+
+
+void VM::record(const VMInstr& instr)
+{
+  int opcode = static_cast<int>(instr.opcode());
+  ++dispatch_count;
+  if (prev_opcode != -1)
+    ++pair_counts[prev_opcode * OPCODE_COUNT + opcode];
+  prev_opcode = opcode;
+}
+
+
+string VM::profile_report(int pairs) const
+{
+  vector<int> order;
+  for (int i = 0; i < pair_counts.size(); ++i)
+    if (pair_counts[i] > 0)
+      order.push_back(i);
+  sort(order.begin(), order.end(), [&](int i, int j) {
+    return pair_counts[i] > pair_counts[j];
+  });
+  string s = "instructions executed: " + to_string(dispatch_count) + "\n";
+  for (int k = 0; k < order.size() and k < pairs; ++k) {
+    int i = order[k];
+    string pair = to_string(OpCode(i / OPCODE_COUNT)) + " " +
+      to_string(OpCode(i % OPCODE_COUNT));
+    long count = pair_counts[i];
+    s += "  " + pair + string(max(1, 32 - (int) pair.size()), ' ') +
+      to_string(count) + " (" + to_string(100 * count / dispatch_count) +
+      "%)\n";
+  }
+  return s;
+}
+
+
+void VM::trace(const VMFrame& frame, const VMInstr& instr) const
+{
+  cerr << endl << endl;
+  cerr << "\t FRAME.........: " << frame.info->function_name << endl;
+  cerr << "\t PC............: " << (frame.pc - 1) << endl;
+  cerr << "\t INSTR.........: " << to_string(instr) << endl;
+  cerr << "\t NEXT OPERAND..: ";
+  if (!frame.empty())
+    cerr << to_string(frame.top()) << endl;
+  else
+    cerr << "empty" << endl;
+  cerr << "\t NEXT FUNCTION.: ";
+  if (call_depth > 0)
+    cerr << call_stack[call_depth - 1].info->function_name << endl;
+  else
+    cerr << "empty" << endl;
+}
+
+
+void VM::run(bool DEBUG)
+{
+  // resolve function calls (and find "main") before running
+  if (!linked)
+    link();
+  // set up the call and value stacks, then call "main"
+  call_stack.assign(max_call_depth, VMFrame());
+  value_stack.assign(value_stack_size, nullptr);
+  call_depth = 0;
+  VMFrame* frame = push_frame(functions[main_index], nullptr);
+
+  // reset the profile (if profiling)
+  if (profile) {
+    pair_counts.assign(OPCODE_COUNT * OPCODE_COUNT, 0);
+    dispatch_count = 0;
+    prev_opcode = -1;
+  }
+
+  // only run without the checks verification proves while every
+  // function verified (unverified code could break what verified code
+  // relies on, e.g., by storing a value of the wrong type in a field),
+  // going on checked once a function that does not is decoded
+  if (verified)
+    frame = execute<false>(frame, DEBUG);
+  if (frame)
+    execute<true>(frame, DEBUG);
+}
+
+
+template <bool CHECKED>
+VMFrame* VM::execute(VMFrame* frame, bool DEBUG)
+{
+  const bool instrument = DEBUG or profile;
+  // (compiled code skips the instrumentation)
+  const bool tiering = jit and VMJit::available() and !instrument;
+
+  // the instruction currently being executed
+  const VMInstr* instr = nullptr;
+
+#if MYPL_COMPUTED_GOTO
+  // handler addresses, one per opcode in OpCode declaration order
+  static void* const targets[] = {
+    &&L_PUSH, &&L_POP, &&L_LOAD, &&L_STORE, &&L_ADD,
+    &&L_SUB, &&L_MUL, &&L_DIV, &&L_AND, &&L_OR,
+    &&L_NOT, &&L_CMPLT, &&L_CMPLE, &&L_CMPGT, &&L_CMPGE,
+    &&L_CMPEQ, &&L_CMPNE,
+    &&L_ADDI, &&L_ADDD, &&L_SUBI, &&L_SUBD, &&L_MULI,
+    &&L_MULD, &&L_DIVI, &&L_DIVD, &&L_CMPLTI, &&L_CMPLTD,
+    &&L_CMPLTS, &&L_CMPLEI, &&L_CMPLED, &&L_CMPLES, &&L_CMPGTI,
+    &&L_CMPGTD, &&L_CMPGTS, &&L_CMPGEI, &&L_CMPGED, &&L_CMPGES,
+    &&L_CMPEQI, &&L_CMPEQD, &&L_CMPEQS, &&L_CMPNEI, &&L_CMPNED,
+    &&L_CMPNES,
+    &&L_JMP, &&L_JMPF, &&L_CALL,
+    &&L_RET, &&L_WRITE, &&L_READ, &&L_SLEN, &&L_ALEN,
+    &&L_GETC, &&L_TOINT, &&L_TODBL, &&L_TOSTR, &&L_CONCAT,
+    &&L_ALLOCS, &&L_ALLOCA, &&L_ADDF, &&L_SETF, &&L_GETF,
+    &&L_SETI, &&L_GETI, &&L_ALLOCAI, &&L_ALLOCAD, &&L_ALLOCAB,
+    &&L_ALLOCAC, &&L_SETII, &&L_SETID, &&L_SETIB, &&L_SETIC, &&L_GETII,
+    &&L_GETID, &&L_GETIB, &&L_GETIC, &&L_INC_LOCAL, &&L_CMP_LOCAL_CONST_JMPF,
+    &&L_LOAD_GETI, &&L_LOAD_LOAD, &&L_LOAD_PUSH, &&L_LOAD_RET,
+    &&L_RET_NULL, &&L_DUP, &&L_NOP
+  };
+  static_assert(sizeof(targets) / sizeof(targets[0]) ==
+                static_cast<int>(OpCode::NOP) + 1);
+#endif
+
+  // run loop (keep going until we run out of instructions; with
+  // computed gotos each instruction dispatches the next itself)
+#if !MYPL_COMPUTED_GOTO
+ next_instr:
+#endif
+  if (CHECKED and frame->pc >= frame->info->instructions.size())
+    return nullptr;
+  FETCH();
+  if (dispatch == Dispatch::LEGACY)
+    goto legacy_decode;
+
+  switch (instr->opcode()) {
 
     //----------------------------------------------------------------------
     // Literals and Variables
     //----------------------------------------------------------------------
 
-    if (instr.opcode() == OpCode::PUSH) {
-      frame->operand_stack.push(instr.operand().value());
+    TARGET(PUSH) {
+      frame->push(instr->operand().value());
     }
+    NEXT();
 
 
-    else if (instr.opcode() == OpCode::POP) {
-      frame->operand_stack.pop();
+    TARGET(POP) {
+      frame->pop();
     }
+    NEXT();
 
 
-    else if (instr.opcode() == OpCode::LOAD)
-    {
-      VMValue val = instr.operand().value();
-      ensure_not_null(*frame, val);
-      if (holds_alternative<int>(val)){
-        int index = get<int>(val);
-
-        VMValue x = frame->variables.at(index); //grab from memory
-        frame->operand_stack.push(x);
-      } else {
-        error("LOAD only accepts integers for memory addresses");
-      }
+    // (link checks that variable and jump operands are in range)
+    TARGET(LOAD) {
+      //grab from memory
+      frame->push(frame->variables[instr->operand()->int_unchecked()]);
     }
+    NEXT();
 
-    else if (instr.opcode() == OpCode::STORE)
-    {
-      VMValue x = frame->operand_stack.top(); //grab from stack
+    TARGET(STORE) {
+      VMValue& x = frame->top(); //grab from stack
       ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      
-      if (holds_alternative<int>(instr.operand().value())) {
-        int index = get<int>(instr.operand().value());
-
-        if (index == frame->variables.size())
-        {
-          frame->variables.push_back(x);
-        } else {
-          frame->variables[index] = x; //add to memory
-        }
-
-      } else {
-        error("STORE only accepts integers for memory addresses");
-      }
+      //add to memory
+      frame->variables[instr->operand()->int_unchecked()] = move(x);
+      frame->pop();
     }
+    NEXT();
     
     //----------------------------------------------------------------------
     // Operations
     //----------------------------------------------------------------------
 
-    else if (instr.opcode() == OpCode::ADD) {
-      VMValue x = frame->operand_stack.top();
+    TARGET(ADD) {
+      VMValue x = frame->top();
       ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
+      frame->pop();
+      VMValue y = frame->top();
       ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(add(y, x));
+      frame->pop();
+      frame->push(add(y, x));
     }
+    NEXT();
 
     
-    else if (instr.opcode() == OpCode::SUB) {
-      VMValue x = frame->operand_stack.top();
+    TARGET(SUB) {
+      VMValue x = frame->top();
       ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
+      frame->pop();
+      VMValue y = frame->top();
       ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(sub(y, x));
+      frame->pop();
+      frame->push(sub(y, x));
     }
+    NEXT();
 
 
-    else if (instr.opcode() == OpCode::MUL) {
-      VMValue x = frame->operand_stack.top();
+    TARGET(MUL) {
+      VMValue x = frame->top();
       ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
+      frame->pop();
+      VMValue y = frame->top();
       ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(mul(y, x));
+      frame->pop();
+      frame->push(mul(y, x));
     }
+    NEXT();
 
 
-    else if (instr.opcode() == OpCode::DIV) {
-      VMValue x = frame->operand_stack.top();
+    TARGET(DIV) {
+      VMValue x = frame->top();
       ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
+      frame->pop();
+      VMValue y = frame->top();
       ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(div(y, x));
+      frame->pop();
+      frame->push(div(y, x));
     }
+    NEXT();
 
 
-    else if (instr.opcode() == OpCode::AND) {
-      VMValue x = frame->operand_stack.top();
+    TARGET(AND) {
+      VMValue x = frame->top();
       ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
+      frame->pop();
+      VMValue y = frame->top();
       ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      if (holds_alternative<bool>(x) && holds_alternative<bool>(y)) {
-        frame->operand_stack.push(get<bool>(y) && get<bool>(x));
+      frame->pop();
+      if (x.is_bool() && y.is_bool()) {
+        frame->push(y.as_bool() && x.as_bool());
       }
     }
+    NEXT();
 
 
-    else if (instr.opcode() == OpCode::OR) {
-      VMValue x = frame->operand_stack.top();
+    TARGET(OR) {
+      VMValue x = frame->top();
       ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
+      frame->pop();
+      VMValue y = frame->top();
       ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      if (holds_alternative<bool>(x) && holds_alternative<bool>(y)) {
-        frame->operand_stack.push(get<bool>(y) || get<bool>(x));
+      frame->pop();
+      if (x.is_bool() && y.is_bool()) {
+        frame->push(y.as_bool() || x.as_bool());
       }
     }
+    NEXT();
 
 
-    else if (instr.opcode() == OpCode::NOT) {
-      VMValue x = frame->operand_stack.top();
+    TARGET(NOT) {
+      VMValue x = frame->top();
       ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      if (holds_alternative<bool>(x)) {
-        frame->operand_stack.push(!get<bool>(x));
+      frame->pop();
+      if (x.is_bool()) {
+        frame->push(!x.as_bool());
       }
     }
+    NEXT();
 
 
-    else if (instr.opcode() == OpCode::CMPLT) {
-      VMValue x = frame->operand_stack.top();
+    TARGET(CMPLT) {
+      VMValue x = frame->top();
       ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
+      frame->pop();
+      VMValue y = frame->top();
       ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(lt(y, x));
+      frame->pop();
+      frame->push(lt(y, x));
     }
+    NEXT();
 
 
-    else if (instr.opcode() == OpCode::CMPLE) {
-      VMValue x = frame->operand_stack.top();
+    TARGET(CMPLE) {
+      VMValue x = frame->top();
       ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
+      frame->pop();
+      VMValue y = frame->top();
       ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(le(y, x));
+      frame->pop();
+      frame->push(le(y, x));
     }
+    NEXT();
 
 
-    else if (instr.opcode() == OpCode::CMPGT) {
-      VMValue x = frame->operand_stack.top();
+    TARGET(CMPGT) {
+      VMValue x = frame->top();
       ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
+      frame->pop();
+      VMValue y = frame->top();
       ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(gt(y, x));
+      frame->pop();
+      frame->push(gt(y, x));
     }
+    NEXT();
 
 
-    else if (instr.opcode() == OpCode::CMPGE) {
-      VMValue x = frame->operand_stack.top();
+    TARGET(CMPGE) {
+      VMValue x = frame->top();
       ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
+      frame->pop();
+      VMValue y = frame->top();
       ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
-      frame->operand_stack.push(ge(y, x));
+      frame->pop();
+      frame->push(ge(y, x));
     }
+    NEXT();
 
 
-    else if (instr.opcode() == OpCode::CMPEQ) {
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      frame->operand_stack.push(eq(y, x));
+    TARGET(CMPEQ) {
+      VMValue x = frame->top();
+      frame->pop();
+      VMValue y = frame->top();
+      frame->pop();
+      frame->push(eq(y, x));
     }
+    NEXT();
 
 
-    else if (instr.opcode() == OpCode::CMPNE) {
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      VMValue y = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      frame->operand_stack.push(!get<bool>(eq(y, x)));
+    TARGET(CMPNE) {
+      VMValue x = frame->top();
+      frame->pop();
+      VMValue y = frame->top();
+      frame->pop();
+      frame->push(!eq(y, x).as_bool());
     }
+    NEXT();
+
+
+    //----------------------------------------------------------------------
+    // Typed arithmetic and comparators: the code generator only emits
+    // these when the checker has determined both operand types, so the
+    // result is computed in place without dispatching on the operand
+    // tags (strings are still accessed through the checked accessor).
+    // Only verified code trusts the types; checked code runs the
+    // untyped instruction instead.
+    //----------------------------------------------------------------------
+
+
+    TARGET(ADDI) {
+      if constexpr (CHECKED)
+        goto L_ADD;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.int_unchecked() + x.int_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(ADDD) {
+      if constexpr (CHECKED)
+        goto L_ADD;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.double_unchecked() + x.double_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(SUBI) {
+      if constexpr (CHECKED)
+        goto L_SUB;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.int_unchecked() - x.int_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(SUBD) {
+      if constexpr (CHECKED)
+        goto L_SUB;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.double_unchecked() - x.double_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(MULI) {
+      if constexpr (CHECKED)
+        goto L_MUL;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.int_unchecked() * x.int_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(MULD) {
+      if constexpr (CHECKED)
+        goto L_MUL;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.double_unchecked() * x.double_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(DIVI) {
+      if constexpr (CHECKED)
+        goto L_DIV;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.int_unchecked() / x.int_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(DIVD) {
+      if constexpr (CHECKED)
+        goto L_DIV;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.double_unchecked() / x.double_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPLTI) {
+      if constexpr (CHECKED)
+        goto L_CMPLT;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.int_unchecked() < x.int_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPLTD) {
+      if constexpr (CHECKED)
+        goto L_CMPLT;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.double_unchecked() < x.double_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPLTS) {
+      if constexpr (CHECKED)
+        goto L_CMPLT;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.as_string() < x.as_string());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPLEI) {
+      if constexpr (CHECKED)
+        goto L_CMPLE;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.int_unchecked() <= x.int_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPLED) {
+      if constexpr (CHECKED)
+        goto L_CMPLE;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.double_unchecked() <= x.double_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPLES) {
+      if constexpr (CHECKED)
+        goto L_CMPLE;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.as_string() <= x.as_string());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPGTI) {
+      if constexpr (CHECKED)
+        goto L_CMPGT;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.int_unchecked() > x.int_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPGTD) {
+      if constexpr (CHECKED)
+        goto L_CMPGT;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.double_unchecked() > x.double_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPGTS) {
+      if constexpr (CHECKED)
+        goto L_CMPGT;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.as_string() > x.as_string());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPGEI) {
+      if constexpr (CHECKED)
+        goto L_CMPGE;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.int_unchecked() >= x.int_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPGED) {
+      if constexpr (CHECKED)
+        goto L_CMPGE;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.double_unchecked() >= x.double_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPGES) {
+      if constexpr (CHECKED)
+        goto L_CMPGE;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      ensure_not_null(*frame, x);
+      ensure_not_null(*frame, y);
+      y = (y.as_string() >= x.as_string());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPEQI) {
+      if constexpr (CHECKED)
+        goto L_CMPEQ;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      if (x.is_null() or y.is_null())
+        y = (x.is_null() == y.is_null());
+      else
+        y = (y.int_unchecked() == x.int_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPEQD) {
+      if constexpr (CHECKED)
+        goto L_CMPEQ;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      if (x.is_null() or y.is_null())
+        y = (x.is_null() == y.is_null());
+      else
+        y = (y.double_unchecked() == x.double_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPEQS) {
+      if constexpr (CHECKED)
+        goto L_CMPEQ;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      if (x.is_null() or y.is_null())
+        y = (x.is_null() == y.is_null());
+      else
+        y = y.string_equal(x);
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPNEI) {
+      if constexpr (CHECKED)
+        goto L_CMPNE;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      if (x.is_null() or y.is_null())
+        y = (x.is_null() != y.is_null());
+      else
+        y = (y.int_unchecked() != x.int_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPNED) {
+      if constexpr (CHECKED)
+        goto L_CMPNE;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      if (x.is_null() or y.is_null())
+        y = (x.is_null() != y.is_null());
+      else
+        y = (y.double_unchecked() != x.double_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+
+    TARGET(CMPNES) {
+      if constexpr (CHECKED)
+        goto L_CMPNE;
+      VMValue& x = frame->sp[-1];
+      VMValue& y = frame->sp[-2];
+      if (x.is_null() or y.is_null())
+        y = (x.is_null() != y.is_null());
+      else
+        y = !y.string_equal(x);
+      frame->pop();
+    }
+    NEXT();
     //----------------------------------------------------------------------
     // Branching
     //----------------------------------------------------------------------
 
     
-    else if (instr.opcode() == OpCode::JMP) {
-      if (holds_alternative<int>(instr.operand().value())) {
-        int instruction_number = get<int>(instr.operand().value());
-          frame->pc = instruction_number; //jump to next instruction
-      } else {
-        error("JMPF only accepts integers for instruction numbers to jump to");
-      }
+    TARGET(JMP) {
+      int target = instr->operand()->int_unchecked();
+      bool loop = target < frame->pc;
+      frame->pc = target; //jump to next instruction
+      if (loop and tiering and tier_up(*frame->info))
+        goto run_native;
     }
+    NEXT();
 
-    else if (instr.opcode() == OpCode::JMPF) {
-      VMValue x = frame->operand_stack.top();
+    TARGET(JMPF) {
+      VMValue x = frame->top();
       ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
+      frame->pop();
 
-      int instruction_number = get<int>(instr.operand().value());
+      int instruction_number = instr->operand()->int_unchecked();
       
-      if (holds_alternative<bool>(x))
+      if (x.is_bool())
       {
-        if (get<bool>(x) == false)
+        if (x.as_bool() == false)
         {
           frame->pc = instruction_number; //jump to next instruction
         }
@@ -313,402 +1262,901 @@ void VM::run(bool DEBUG)
         error("Last element on stack must be bool type when calling JMPF");
       }
     }
+    NEXT();
 
     //----------------------------------------------------------------------
     // Functions
     //----------------------------------------------------------------------
 
 
-    else if (instr.opcode() == OpCode::CALL) {
-      //get name
-      string name = get<string>(instr.operand().value());
-      //instantiate new frame and set frame info
-      shared_ptr<VMFrame> new_frame = make_shared<VMFrame>();
-      new_frame->info = frame_info[name];
-      //push new frame on to call stack
-      call_stack.push(new_frame);
-      //copy number of arguments into stack
-      for (int i = 0; i < new_frame->info.arg_count; i++)
-      {
-        VMValue x = frame->operand_stack.top();
-        new_frame->operand_stack.push(x);
-        frame->operand_stack.pop();
+    TARGET(CALL) {
+      //push new frame on to call stack (operand is the callee's
+      //index, resolved by link), taking the arguments on top of the
+      //caller's operand stack as its first variables
+      VMFrameInfo& callee = functions[instr->operand()->int_unchecked()];
+      if (callee.image_index >= 0) {
+        decode(callee);
+        if (!CHECKED and !verified)
+          return push_frame(callee, frame);
       }
-      //set new frame to the current frame
-      frame = new_frame;
+      frame = push_frame(callee, frame);
+      if (tiering and tier_up(callee))
+        goto run_native;
     }
-
-    else if (instr.opcode() == OpCode::RET) {
-      //grab return value
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      //pop frame
-      call_stack.pop();
-      if (!call_stack.empty())
-      {
-        frame = call_stack.top();
-        //if frame exists, push return value
-        frame->operand_stack.push(x);
-      }
+    NEXT();
+
+    TARGET(RET) {
+      //pop frame (returning from main ends the run)
+      --call_depth;
+      if (call_depth == 0)
+        return nullptr;
+      //the return value replaces the arguments (the caller's stack
+      //pointer is at the callee's variables)
+      VMFrame* caller = &call_stack[call_depth - 1];
+      caller->push(frame->top());
+      frame = caller;
+      if (tiering and frame->info->native)
+        goto run_native;
     }
+    NEXT();
 
     //----------------------------------------------------------------------
     // Built in functions
     //----------------------------------------------------------------------
 
 
-    else if (instr.opcode() == OpCode::WRITE) {
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      cout << to_string(x);
+    TARGET(WRITE) {
+      VMValue x = frame->top();
+      frame->pop();
+      if (x.is_string())
+        cout << x.as_string();
+      else
+        cout << to_string(x);
     }
+    NEXT();
 
-    else if (instr.opcode() == OpCode::READ) {
+    TARGET(READ) {
       string val = "";
       getline(cin, val);
-      frame->operand_stack.push(val);
+      frame->push(val);
     }
+    NEXT();
 
     
-    else if (instr.opcode() == OpCode::SLEN) {
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
+    TARGET(SLEN) {
+      VMValue x = frame->top();
+      frame->pop();
       ensure_not_null(*frame, x);
-      int size = get<string>(x).size();
-      frame->operand_stack.push(size);
+      int size = x.string_size();
+      frame->push(size);
     }
+    NEXT();
 
-    else if (instr.opcode() == OpCode::ALEN) {
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
+    TARGET(ALEN) {
+      VMValue x = frame->top();
+      frame->pop();
       ensure_not_null(*frame, x);
-      int size = array_heap[get<int>(x)].size();
-      frame->operand_stack.push(size);
+      int size = x.as_ref()->size;
+      frame->push(size);
     }
+    NEXT();
 
-    else if (instr.opcode() == OpCode::GETC) {
+    TARGET(GETC) {
       //pop x
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
+      VMValue x = frame->top();
+      frame->pop();
       ensure_not_null(*frame, x);
       //pop y
-      VMValue y = frame->operand_stack.top();
-      frame->operand_stack.pop();
+      VMValue y = frame->top();
+      frame->pop();
       ensure_not_null(*frame, y);
       //push x[y]
-      if (get<int>(y) >= get<string>(x).size())
+      if (y.as_int() >= x.string_size())
       {
         error("out-of-bounds string index", *frame);
-      } else if (get<int>(y) < 0)
+      } else if (y.as_int() < 0)
       {
         error("out-of-bounds string index", *frame);
       } else {
-        string s = "";
-        s += get<string>(x).at(get<int>(y));
-        frame->operand_stack.push(s);
+        frame->push(char_value(x.as_string()[y.as_int()]));
       }
     }
+    NEXT();
 
-    else if (instr.opcode() == OpCode::TOINT) {
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
+    TARGET(TOINT) {
+      VMValue x = frame->top();
+      frame->pop();
       ensure_not_null(*frame, x);
-      if (holds_alternative<double>(x))
+      if (x.is_double())
       {
-        frame->operand_stack.push(int(get<double>(x)));
+        frame->push(int(x.as_double()));
       }
-      if (holds_alternative<string>(x))
+      if (x.is_string())
       {
         try {
-          stoi(get<string>(x));
+          stoi(x.as_string());
         } catch (exception& err) {
           error("cannot convert string to int", *frame);
         }
-        static_cast<int>(stoi(get<string>(x)));
-        frame->operand_stack.push(stoi(get<string>(x)));
+        static_cast<int>(stoi(x.as_string()));
+        frame->push(stoi(x.as_string()));
       }
     }
+    NEXT();
 
-    else if (instr.opcode() == OpCode::TODBL) {
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
+    TARGET(TODBL) {
+      VMValue x = frame->top();
+      frame->pop();
       ensure_not_null(*frame, x);
-      if (holds_alternative<int>(x))
+      if (x.is_int())
       {
-        frame->operand_stack.push(double(get<int>(x)));
+        frame->push(double(x.as_int()));
       }
-      if (holds_alternative<string>(x))
+      if (x.is_string())
       {
         try {
-          stod(get<string>(x));
+          stod(x.as_string());
         } catch (exception& err) {
           error("cannot convert string to double", *frame);
         }
-        frame->operand_stack.push(stod(get<string>(x)));
+        frame->push(stod(x.as_string()));
       }
     }
+    NEXT();
 
-    else if (instr.opcode() == OpCode::TOSTR) {
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
+    TARGET(TOSTR) {
+      VMValue x = frame->top();
+      frame->pop();
       ensure_not_null(*frame, x);
-      frame->operand_stack.push(to_string(x));
+      if (x.is_string())
+        frame->push(x);
+      else
+        frame->push(to_string(x));
     }
+    NEXT();
 
-    else if (instr.opcode() == OpCode::CONCAT) {
+    TARGET(CONCAT) {
       //grab x
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
+      VMValue x = frame->top();
+      frame->pop();
       ensure_not_null(*frame, x);
       //grab y
-      VMValue y = frame->operand_stack.top();
-      frame->operand_stack.pop();
+      VMValue y = frame->top();
+      frame->pop();
       ensure_not_null(*frame, y);
-      frame->operand_stack.push(to_string(y) + to_string(x));
+      if (x.is_string() and y.is_string())
+        frame->push(y.concat(x));
+      else
+        frame->push(to_string(y) + to_string(x));
     }
+    NEXT();
 
     //----------------------------------------------------------------------
     // heap
     //----------------------------------------------------------------------
 
 
-    else if (instr.opcode() == OpCode::ALLOCS) {
-      struct_heap[next_obj_id] = {};
-      frame->operand_stack.push(next_obj_id);
-      ++next_obj_id;
+    TARGET(ALLOCS) {
+      if (heap.should_collect())
+        collect(*frame);
+      const VMStructInfo& type = structs[instr->operand()->as_int()];
+      frame->push(heap.allocate(VMObject::Kind::STRUCT,
+                                type.field_names.size()));
     }
-
-    else if (instr.opcode() == OpCode::ALLOCA) {
-     VMValue val = frame->operand_stack.top();
-     frame->operand_stack.pop();
-     int size = get<int>(frame->operand_stack.top());
-     frame->operand_stack.pop();
-     array_heap[next_obj_id] = vector<VMValue>(size, val);
-     frame->operand_stack.push(next_obj_id);
-     ++next_obj_id;
+    NEXT();
+
+    TARGET(ALLOCA) {
+     if (heap.should_collect())
+       collect(*frame);
+     VMValue val = frame->top();
+     frame->pop();
+     int size = frame->top().as_int();
+     frame->pop();
+     if (size < 0)
+       error("negative array size", *frame);
+     frame->push(heap.allocate(VMObject::Kind::ARRAY, size, val));
     }
+    NEXT();
     
-    else if (instr.opcode() == OpCode::ADDF) {
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
+    TARGET(ADDF) {
+      VMValue x = frame->top();
+      frame->pop();
       ensure_not_null(*frame, x);
-      struct_heap[get<int>(x)][get<string>(instr.operand().value())] = nullptr;
     }
+    NEXT();
 
-    else if (instr.opcode() == OpCode::SETF) {
+    TARGET(SETF) {
       //grab x
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
+      VMValue x = frame->top();
+      frame->pop();
       //ensure_not_null(*frame, x);
       //grab y
-      VMValue y = frame->operand_stack.top();
-      frame->operand_stack.pop();
+      VMValue y = frame->top();
+      frame->pop();
       ensure_not_null(*frame, y);
       //obj(y).f = x
-      struct_heap[get<int>(y)][get<string>(instr.operand().value())] = x;
+      VMObject* object = y.as_ref();
+      int slot = instr->operand()->int_unchecked();
+      if constexpr (CHECKED)
+        ensure_field(*frame, object, slot);
+      heap.write_barrier(object, x);
+      (*object)[slot] = x;
     }
+    NEXT();
 
-    else if (instr.opcode() == OpCode::GETF) {
+    TARGET(GETF) {
       //grab x
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
+      VMValue x = frame->top();
+      frame->pop();
       ensure_not_null(*frame, x);
       //push obj(y).f
-      frame->operand_stack.push(struct_heap[get<int>(x)][get<string>(instr.operand().value())]);
+      VMObject* object = x.as_ref();
+      int slot = instr->operand()->int_unchecked();
+      if constexpr (CHECKED)
+        ensure_field(*frame, object, slot);
+      frame->push((*object)[slot]);
     }
+    NEXT();
 
-    else if (instr.opcode() == OpCode::SETI) {
+    TARGET(SETI) {
       //grab x
-      VMValue x = frame->operand_stack.top();
+      VMValue x = frame->top();
       ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
+      frame->pop();
       //grab y
-      VMValue y = frame->operand_stack.top();
+      VMValue y = frame->top();
       ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
+      frame->pop();
       //grab z
-      VMValue z = frame->operand_stack.top();
+      VMValue z = frame->top();
       ensure_not_null(*frame, z);
-      frame->operand_stack.pop();
+      frame->pop();
       //obj(z)[y] = x
-      if (((get<int>(y)) >= array_heap[get<int>(z)].size()) || (get<int>(y) < 0))
+      VMObject* array = z.as_ref();
+      if ((y.as_int() >= array->size) || (y.as_int() < 0))
       {
         error("out-of-bounds array index", *frame);
+      } else if (array->kind == VMObject::Kind::ARRAY) {
+        heap.write_barrier(array, x);
+        (*array)[y.as_int()] = x;
       } else {
-        array_heap[get<int>(z)][get<int>(y)] = x;
+        array->set_element(y.as_int(), x);
       }
     }
+    NEXT();
 
-    else if (instr.opcode() == OpCode::GETI) {
+    TARGET(GETI) {
       //grab x
-      VMValue x = frame->operand_stack.top();
+      VMValue x = frame->top();
       ensure_not_null(*frame, x);
-      frame->operand_stack.pop();
+      frame->pop();
       //grab y
-      VMValue y = frame->operand_stack.top();
+      VMValue y = frame->top();
       ensure_not_null(*frame, y);
-      frame->operand_stack.pop();
+      frame->pop();
       //obj(y)[x]
-      if ((get<int>(x) >= array_heap[get<int>(y)].size()) || (get<int>(x) < 0))
+      VMObject* array = y.as_ref();
+      if ((x.as_int() >= array->size) || (x.as_int() < 0))
       {
         error("out-of-bounds array index", *frame);
+      } else if (array->kind == VMObject::Kind::ARRAY) {
+        frame->push((*array)[x.as_int()]);
       } else {
-        frame->operand_stack.push(array_heap[get<int>(y)][get<int>(x)]);
+        frame->push(array->element(x.as_int()));
+      }
+    }
+    NEXT();
+
+    //----------------------------------------------------------------------
+    // typed arrays (the code generator only emits these for arrays of the
+    // matching element type, so once verified only nulls and bounds are
+    // checked; checked code runs GETI and SETI instead)
+    //----------------------------------------------------------------------
+
+    TARGET(ALLOCAI) {
+      if (heap.should_collect())
+        collect(*frame);
+      frame->push(allocate_array(*frame, VMObject::Kind::INT_ARRAY));
+    }
+    NEXT();
+
+    TARGET(ALLOCAD) {
+      if (heap.should_collect())
+        collect(*frame);
+      frame->push(allocate_array(*frame, VMObject::Kind::DOUBLE_ARRAY));
+    }
+    NEXT();
+
+    TARGET(ALLOCAB) {
+      if (heap.should_collect())
+        collect(*frame);
+      frame->push(allocate_array(*frame, VMObject::Kind::BOOL_ARRAY));
+    }
+    NEXT();
+
+    TARGET(ALLOCAC) {
+      if (heap.should_collect())
+        collect(*frame);
+      frame->push(allocate_array(*frame, VMObject::Kind::CHAR_ARRAY));
+    }
+    NEXT();
+
+    TARGET(SETII) {
+      if constexpr (CHECKED)
+        goto L_SETI;
+      VMValue x = frame->top();
+      ensure_not_null(*frame, x);
+      frame->pop();
+      int i = array_index(*frame);
+      frame->top().as_ref()->set(i, x.int_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+    TARGET(SETID) {
+      if constexpr (CHECKED)
+        goto L_SETI;
+      VMValue x = frame->top();
+      ensure_not_null(*frame, x);
+      frame->pop();
+      int i = array_index(*frame);
+      frame->top().as_ref()->set(i, x.double_unchecked());
+      frame->pop();
+    }
+    NEXT();
+
+    TARGET(SETIB) {
+      if constexpr (CHECKED)
+        goto L_SETI;
+      VMValue x = frame->top();
+      ensure_not_null(*frame, x);
+      frame->pop();
+      int i = array_index(*frame);
+      frame->top().as_ref()->set(i, x.as_bool());
+      frame->pop();
+    }
+    NEXT();
+
+    TARGET(SETIC) {
+      if constexpr (CHECKED)
+        goto L_SETI;
+      VMValue x = frame->top();
+      ensure_not_null(*frame, x);
+      frame->pop();
+      int i = array_index(*frame);
+      frame->top().as_ref()->set(i, x.as_string()[0]);
+      frame->pop();
+    }
+    NEXT();
+
+    TARGET(GETII) {
+      if constexpr (CHECKED)
+        goto L_GETI;
+      int i = array_index(*frame);
+      VMObject* array = frame->top().as_ref();
+      if (array->is_set(i))
+        frame->top() = array->elements<int>()[i];
+      else
+        frame->top() = nullptr;
+    }
+    NEXT();
+
+    TARGET(GETID) {
+      if constexpr (CHECKED)
+        goto L_GETI;
+      int i = array_index(*frame);
+      VMObject* array = frame->top().as_ref();
+      if (array->is_set(i))
+        frame->top() = array->elements<double>()[i];
+      else
+        frame->top() = nullptr;
+    }
+    NEXT();
+
+    TARGET(GETIB) {
+      if constexpr (CHECKED)
+        goto L_GETI;
+      int i = array_index(*frame);
+      VMObject* array = frame->top().as_ref();
+      if (array->is_set(i))
+        frame->top() = array->elements<bool>()[i];
+      else
+        frame->top() = nullptr;
+    }
+    NEXT();
+
+    TARGET(GETIC) {
+      if constexpr (CHECKED)
+        goto L_GETI;
+      int i = array_index(*frame);
+      frame->top() = frame->top().as_ref()->element(i);
+    }
+    NEXT();
+    //----------------------------------------------------------------------
+    // Superinstructions (see VM::fuse): instr[k] is the k-th instruction
+    // of the replaced sequence, and the handler of the sequence's first
+    // instruction (always LOAD or PUSH) takes over outside the common case
+    //----------------------------------------------------------------------
+
+
+    TARGET(INC_LOCAL) {
+      VMValue& x = frame->variables[instr->operand()->int_unchecked()];
+      if (!x.is_int())
+        goto L_LOAD;
+      x = x.int_unchecked() + instr[1].operand()->int_unchecked();
+      frame->pc += 3;
+    }
+    NEXT();
+
+
+    TARGET(CMP_LOCAL_CONST_JMPF) {
+      const VMValue& x = frame->variables[instr->operand()->int_unchecked()];
+      if (!x.is_int())
+        goto L_LOAD;
+      int y = x.int_unchecked();
+      int c = instr[1].operand()->int_unchecked();
+      bool result;
+      switch (instr[2].opcode()) {
+        case OpCode::CMPLT: case OpCode::CMPLTI: result = y < c; break;
+        case OpCode::CMPLE: case OpCode::CMPLEI: result = y <= c; break;
+        case OpCode::CMPGT: case OpCode::CMPGTI: result = y > c; break;
+        case OpCode::CMPGE: case OpCode::CMPGEI: result = y >= c; break;
+        case OpCode::CMPEQ: case OpCode::CMPEQI: result = y == c; break;
+        default: result = y != c;
       }
+      if (result)
+        frame->pc += 3;
+      else
+        frame->pc = instr[3].operand()->int_unchecked();
     }
+    NEXT();
+
+
+    TARGET(LOAD_GETI) {
+      const VMValue& x = frame->variables[instr->operand()->int_unchecked()];
+      const VMValue& y = frame->top();
+      if (!x.is_int() or !y.is_ref())
+        goto L_LOAD;
+      VMObject* array = y.as_ref();
+      int index = x.int_unchecked();
+      if (index < 0 or index >= array->size)
+        goto L_LOAD;
+      frame->pop();
+      if (array->kind == VMObject::Kind::ARRAY)
+        frame->push((*array)[index]);
+      else
+        frame->push(array->element(index));
+      frame->pc += 1;
+    }
+    NEXT();
+
+
+    TARGET(LOAD_LOAD) {
+      frame->push(frame->variables[instr->operand()->int_unchecked()]);
+      frame->push(frame->variables[instr[1].operand()->int_unchecked()]);
+      frame->pc += 1;
+    }
+    NEXT();
+
+
+    TARGET(LOAD_PUSH) {
+      frame->push(frame->variables[instr->operand()->int_unchecked()]);
+      frame->push(instr[1].operand().value());
+      frame->pc += 1;
+    }
+    NEXT();
+
+
+    TARGET(LOAD_RET) {
+      frame->push(frame->variables[instr->operand()->int_unchecked()]);
+    }
+    goto L_RET;
+
+
+    TARGET(RET_NULL) {
+      frame->push(nullptr);
+    }
+    goto L_RET;
+
+
     //----------------------------------------------------------------------
     // special
     //----------------------------------------------------------------------
 
     
-    else if (instr.opcode() == OpCode::DUP) {
-      VMValue x = frame->operand_stack.top();
-      frame->operand_stack.pop();
-      frame->operand_stack.push(x);
-      frame->operand_stack.push(x);      
+    TARGET(DUP) {
+      VMValue x = frame->top();
+      frame->pop();
+      frame->push(x);
+      frame->push(x);      
     }
+    NEXT();
 
-    else if (instr.opcode() == OpCode::NOP) {
+    TARGET(NOP) {
       // do nothing
     }
-    
-    else {
-      error("unsupported operation " + to_string(instr));
-    }
+    NEXT();
+
+
+    default:
+      error("unsupported operation " + to_string(*instr));
+  }
+
+  // run the frame's compiled code until its function returns (going on
+  // with the caller's compiled code, if it has some) or leaves the rest
+  // to the interpreter (at the pc of the frame then on top)
+ run_native:
+  {
+    bool returned = frame->info->native(frame) == VMJit::RETURNED;
+    frame = &call_stack[call_depth - 1];
+    if (returned and frame->info->native)
+      goto run_native;
   }
+  NEXT();
+
+  // the original dispatch: compare the opcode against each case in
+  // turn, then jump to the same handler the table would have chosen
+ legacy_decode:
+  {
+    OpCode op = instr->opcode();
+    if (op == OpCode::PUSH) goto L_PUSH;
+    else if (op == OpCode::POP) goto L_POP;
+    else if (op == OpCode::LOAD) goto L_LOAD;
+    else if (op == OpCode::STORE) goto L_STORE;
+    else if (op == OpCode::ADD) goto L_ADD;
+    else if (op == OpCode::SUB) goto L_SUB;
+    else if (op == OpCode::MUL) goto L_MUL;
+    else if (op == OpCode::DIV) goto L_DIV;
+    else if (op == OpCode::AND) goto L_AND;
+    else if (op == OpCode::OR) goto L_OR;
+    else if (op == OpCode::NOT) goto L_NOT;
+    else if (op == OpCode::CMPLT) goto L_CMPLT;
+    else if (op == OpCode::CMPLE) goto L_CMPLE;
+    else if (op == OpCode::CMPGT) goto L_CMPGT;
+    else if (op == OpCode::CMPGE) goto L_CMPGE;
+    else if (op == OpCode::CMPEQ) goto L_CMPEQ;
+    else if (op == OpCode::CMPNE) goto L_CMPNE;
+    else if (op == OpCode::ADDI) goto L_ADDI;
+    else if (op == OpCode::ADDD) goto L_ADDD;
+    else if (op == OpCode::SUBI) goto L_SUBI;
+    else if (op == OpCode::SUBD) goto L_SUBD;
+    else if (op == OpCode::MULI) goto L_MULI;
+    else if (op == OpCode::MULD) goto L_MULD;
+    else if (op == OpCode::DIVI) goto L_DIVI;
+    else if (op == OpCode::DIVD) goto L_DIVD;
+    else if (op == OpCode::CMPLTI) goto L_CMPLTI;
+    else if (op == OpCode::CMPLTD) goto L_CMPLTD;
+    else if (op == OpCode::CMPLTS) goto L_CMPLTS;
+    else if (op == OpCode::CMPLEI) goto L_CMPLEI;
+    else if (op == OpCode::CMPLED) goto L_CMPLED;
+    else if (op == OpCode::CMPLES) goto L_CMPLES;
+    else if (op == OpCode::CMPGTI) goto L_CMPGTI;
+    else if (op == OpCode::CMPGTD) goto L_CMPGTD;
+    else if (op == OpCode::CMPGTS) goto L_CMPGTS;
+    else if (op == OpCode::CMPGEI) goto L_CMPGEI;
+    else if (op == OpCode::CMPGED) goto L_CMPGED;
+    else if (op == OpCode::CMPGES) goto L_CMPGES;
+    else if (op == OpCode::CMPEQI) goto L_CMPEQI;
+    else if (op == OpCode::CMPEQD) goto L_CMPEQD;
+    else if (op == OpCode::CMPEQS) goto L_CMPEQS;
+    else if (op == OpCode::CMPNEI) goto L_CMPNEI;
+    else if (op == OpCode::CMPNED) goto L_CMPNED;
+    else if (op == OpCode::CMPNES) goto L_CMPNES;
+    else if (op == OpCode::JMP) goto L_JMP;
+    else if (op == OpCode::JMPF) goto L_JMPF;
+    else if (op == OpCode::CALL) goto L_CALL;
+    else if (op == OpCode::RET) goto L_RET;
+    else if (op == OpCode::WRITE) goto L_WRITE;
+    else if (op == OpCode::READ) goto L_READ;
+    else if (op == OpCode::SLEN) goto L_SLEN;
+    else if (op == OpCode::ALEN) goto L_ALEN;
+    else if (op == OpCode::GETC) goto L_GETC;
+    else if (op == OpCode::TOINT) goto L_TOINT;
+    else if (op == OpCode::TODBL) goto L_TODBL;
+    else if (op == OpCode::TOSTR) goto L_TOSTR;
+    else if (op == OpCode::CONCAT) goto L_CONCAT;
+    else if (op == OpCode::ALLOCS) goto L_ALLOCS;
+    else if (op == OpCode::ALLOCA) goto L_ALLOCA;
+    else if (op == OpCode::ADDF) goto L_ADDF;
+    else if (op == OpCode::SETF) goto L_SETF;
+    else if (op == OpCode::GETF) goto L_GETF;
+    else if (op == OpCode::SETI) goto L_SETI;
+    else if (op == OpCode::GETI) goto L_GETI;
+    else if (op == OpCode::ALLOCAI) goto L_ALLOCAI;
+    else if (op == OpCode::ALLOCAD) goto L_ALLOCAD;
+    else if (op == OpCode::ALLOCAB) goto L_ALLOCAB;
+    else if (op == OpCode::ALLOCAC) goto L_ALLOCAC;
+    else if (op == OpCode::SETII) goto L_SETII;
+    else if (op == OpCode::SETID) goto L_SETID;
+    else if (op == OpCode::SETIB) goto L_SETIB;
+    else if (op == OpCode::SETIC) goto L_SETIC;
+    else if (op == OpCode::GETII) goto L_GETII;
+    else if (op == OpCode::GETID) goto L_GETID;
+    else if (op == OpCode::GETIB) goto L_GETIB;
+    else if (op == OpCode::GETIC) goto L_GETIC;
+    else if (op == OpCode::INC_LOCAL) goto L_INC_LOCAL;
+    else if (op == OpCode::CMP_LOCAL_CONST_JMPF) goto L_CMP_LOCAL_CONST_JMPF;
+    else if (op == OpCode::LOAD_GETI) goto L_LOAD_GETI;
+    else if (op == OpCode::LOAD_LOAD) goto L_LOAD_LOAD;
+    else if (op == OpCode::LOAD_PUSH) goto L_LOAD_PUSH;
+    else if (op == OpCode::LOAD_RET) goto L_LOAD_RET;
+    else if (op == OpCode::RET_NULL) goto L_RET_NULL;
+    else if (op == OpCode::DUP) goto L_DUP;
+    else if (op == OpCode::NOP) goto L_NOP;
+    else
+    error("unsupported operation " + to_string(*instr));
+  }
+  return nullptr;
 }
 
+#undef TARGET
+#undef FETCH
+#undef NEXT
+#undef MYPL_COMPUTED_GOTO
+
 
 void VM::ensure_not_null(const VMFrame& f, const VMValue& x) const
 {
-  if (holds_alternative<nullptr_t>(x))
+  if (x.is_null())
     error("null reference", f);
 }
 
 
+void VM::ensure_field(const VMFrame& f, const VMObject* object,
+                      int slot) const
+{
+  if (object->kind != VMObject::Kind::STRUCT or slot >= object->size)
+    error("no such field", f);
+}
+
+
+int VM::array_index(VMFrame& f) const
+{
+  VMValue x = f.top();
+  ensure_not_null(f, x);
+  f.pop();
+  const VMValue& y = f.top();
+  ensure_not_null(f, y);
+  int i = x.int_unchecked();
+  if (i < 0 or i >= y.as_ref()->size)
+    error("out-of-bounds array index", f);
+  return i;
+}
+
+
+VMObject* VM::allocate_array(VMFrame& f, VMObject::Kind kind)
+{
+  int size = f.top().as_int();
+  f.pop();
+  if (size < 0)
+    error("negative array size", f);
+  return heap.allocate(kind, size);
+}
+
+
+optional<VMValue> VM::fold(OpCode op, const VMValue& y,
+                           const VMValue& x) const
+{
+  // the operand type a typed instruction requires (checked by the code
+  // generator, but not by run())
+  auto typed = [&](bool (VMValue::*is_type)() const) {
+    return (x.*is_type)() and (y.*is_type)();
+  };
+  auto typed_eq = [&](bool (VMValue::*is_type)() const) {
+    return (x.is_null() or (x.*is_type)()) and (y.is_null() or (y.*is_type)());
+  };
+  bool nulls = x.is_null() or y.is_null();
+  try {
+    switch (op) {
+      case OpCode::ADDI: case OpCode::SUBI: case OpCode::MULI:
+      case OpCode::DIVI: case OpCode::CMPLTI: case OpCode::CMPLEI:
+      case OpCode::CMPGTI: case OpCode::CMPGEI:
+        if (!typed(&VMValue::is_int))
+          return nullopt;
+        break;
+      case OpCode::ADDD: case OpCode::SUBD: case OpCode::MULD:
+      case OpCode::DIVD: case OpCode::CMPLTD: case OpCode::CMPLED:
+      case OpCode::CMPGTD: case OpCode::CMPGED:
+        if (!typed(&VMValue::is_double))
+          return nullopt;
+        break;
+      case OpCode::CMPLTS: case OpCode::CMPLES: case OpCode::CMPGTS:
+      case OpCode::CMPGES:
+        if (!typed(&VMValue::is_string))
+          return nullopt;
+        break;
+      case OpCode::CMPEQI: case OpCode::CMPNEI:
+        if (!typed_eq(&VMValue::is_int))
+          return nullopt;
+        break;
+      case OpCode::CMPEQD: case OpCode::CMPNED:
+        if (!typed_eq(&VMValue::is_double))
+          return nullopt;
+        break;
+      case OpCode::CMPEQS: case OpCode::CMPNES:
+        if (!typed_eq(&VMValue::is_string))
+          return nullopt;
+        break;
+      default:
+        break;
+    }
+    switch (op) {
+      case OpCode::ADD: case OpCode::ADDI: case OpCode::ADDD:
+        return nulls ? nullopt : optional<VMValue>(add(y, x));
+      case OpCode::SUB: case OpCode::SUBI: case OpCode::SUBD:
+        return nulls ? nullopt : optional<VMValue>(sub(y, x));
+      case OpCode::MUL: case OpCode::MULI: case OpCode::MULD:
+        return nulls ? nullopt : optional<VMValue>(mul(y, x));
+      case OpCode::DIV: case OpCode::DIVI: case OpCode::DIVD:
+        // integer division by zero (or overflow) traps at run time
+        if (nulls or (y.is_int() and (x.as_int() == 0 or
+                                      (x.as_int() == -1 and
+                                       y.as_int() == INT_MIN))))
+          return nullopt;
+        return div(y, x);
+      case OpCode::CMPLT: case OpCode::CMPLTI: case OpCode::CMPLTD:
+      case OpCode::CMPLTS:
+        return nulls ? nullopt : optional<VMValue>(lt(y, x));
+      case OpCode::CMPLE: case OpCode::CMPLEI: case OpCode::CMPLED:
+      case OpCode::CMPLES:
+        return nulls ? nullopt : optional<VMValue>(le(y, x));
+      case OpCode::CMPGT: case OpCode::CMPGTI: case OpCode::CMPGTD:
+      case OpCode::CMPGTS:
+        return nulls ? nullopt : optional<VMValue>(gt(y, x));
+      case OpCode::CMPGE: case OpCode::CMPGEI: case OpCode::CMPGED:
+      case OpCode::CMPGES:
+        return nulls ? nullopt : optional<VMValue>(ge(y, x));
+      case OpCode::CMPEQ: case OpCode::CMPEQI: case OpCode::CMPEQD:
+      case OpCode::CMPEQS:
+        return eq(y, x);
+      case OpCode::CMPNE: case OpCode::CMPNEI: case OpCode::CMPNED:
+      case OpCode::CMPNES:
+        return !eq(y, x).as_bool();
+      case OpCode::AND:
+        if (nulls or !x.is_bool() or !y.is_bool())
+          return nullopt;
+        return y.as_bool() && x.as_bool();
+      case OpCode::OR:
+        if (nulls or !x.is_bool() or !y.is_bool())
+          return nullopt;
+        return y.as_bool() || x.as_bool();
+      case OpCode::CONCAT:
+        return nulls ? nullopt : optional<VMValue>(to_string(y) + to_string(x));
+      default:
+        return nullopt;
+    }
+  } catch (MyPLException& ex) {
+    // mismatched operand types
+    return nullopt;
+  }
+}
+
+
 VMValue VM::add(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<int>(x)) 
-    return get<int>(x) + get<int>(y);
+  if (x.is_int()) 
+    return x.as_int() + y.as_int();
   else
-    return get<double>(x) + get<double>(y);
+    return x.as_double() + y.as_double();
 }
 
 
 VMValue VM::sub(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<int>(x)) 
-    return get<int>(x) - get<int>(y);
+  if (x.is_int()) 
+    return x.as_int() - y.as_int();
   else
-    return get<double>(x) - get<double>(y);
+    return x.as_double() - y.as_double();
 }
 
 VMValue VM::mul(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<int>(x)) 
-    return get<int>(x) * get<int>(y);
+  if (x.is_int()) 
+    return x.as_int() * y.as_int();
   else
-    return get<double>(x) * get<double>(y);
+    return x.as_double() * y.as_double();
 }
 
 VMValue VM::div(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<int>(x)) 
-    return get<int>(x) / get<int>(y);
+  if (x.is_int()) 
+    return x.as_int() / y.as_int();
   else
-    return get<double>(x) / get<double>(y);
+    return x.as_double() / y.as_double();
 }
 
 
 VMValue VM::eq(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<nullptr_t>(x) and not holds_alternative<nullptr_t>(y)) 
+  if (x.is_null() and not y.is_null()) 
     return false;
-  else if (not holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (not x.is_null() and y.is_null())
     return false;
-  else if (holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (x.is_null() and y.is_null())
     return true;
-  else if (holds_alternative<int>(x)) 
-    return get<int>(x) == get<int>(y);
-  else if (holds_alternative<double>(x))
-    return get<double>(x) == get<double>(y);
-  else if (holds_alternative<string>(x))
-    return get<string>(x) == get<string>(y);
+  else if (x.is_int()) 
+    return x.as_int() == y.as_int();
+  else if (x.is_double())
+    return x.as_double() == y.as_double();
+  else if (x.is_string())
+    return x.string_equal(y);
+  else if (x.is_ref())
+    return x.as_ref() == y.as_ref();
   else
-    return get<bool>(x) == get<bool>(y);
+    return x.as_bool() == y.as_bool();
 }
 
 // TODO: Finish the rest of the comparison operators
 
 VMValue VM::lt(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<nullptr_t>(x) and not holds_alternative<nullptr_t>(y)) 
+  if (x.is_null() and not y.is_null()) 
     return false;
-  else if (not holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (not x.is_null() and y.is_null())
     return false;
-  else if (holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (x.is_null() and y.is_null())
     return true;
-  else if (holds_alternative<int>(x)) 
-    return get<int>(x) < get<int>(y);
-  else if (holds_alternative<double>(x))
-    return get<double>(x) < get<double>(y);
-  else if (holds_alternative<string>(x))
-    return get<string>(x) < get<string>(y);
+  else if (x.is_int()) 
+    return x.as_int() < y.as_int();
+  else if (x.is_double())
+    return x.as_double() < y.as_double();
+  else if (x.is_string())
+    return x.as_string() < y.as_string();
   else
-    return get<bool>(x) < get<bool>(y);
+    return x.as_bool() < y.as_bool();
 }
 
 VMValue VM::le(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<nullptr_t>(x) and not holds_alternative<nullptr_t>(y)) 
+  if (x.is_null() and not y.is_null()) 
     return false;
-  else if (not holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (not x.is_null() and y.is_null())
     return false;
-  else if (holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (x.is_null() and y.is_null())
     return true;
-  else if (holds_alternative<int>(x)) 
-    return get<int>(x) <= get<int>(y);
-  else if (holds_alternative<double>(x))
-    return get<double>(x) <= get<double>(y);
-  else if (holds_alternative<string>(x))
-    return get<string>(x) <= get<string>(y);
+  else if (x.is_int()) 
+    return x.as_int() <= y.as_int();
+  else if (x.is_double())
+    return x.as_double() <= y.as_double();
+  else if (x.is_string())
+    return x.as_string() <= y.as_string();
   else
-    return get<bool>(x) <= get<bool>(y);
+    return x.as_bool() <= y.as_bool();
 }
 
 VMValue VM::gt(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<nullptr_t>(x) and not holds_alternative<nullptr_t>(y)) 
+  if (x.is_null() and not y.is_null()) 
     return false;
-  else if (not holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (not x.is_null() and y.is_null())
     return false;
-  else if (holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (x.is_null() and y.is_null())
     return true;
-  else if (holds_alternative<int>(x)) 
-    return get<int>(x) > get<int>(y);
-  else if (holds_alternative<double>(x))
-    return get<double>(x) > get<double>(y);
-  else if (holds_alternative<string>(x))
-    return get<string>(x) > get<string>(y);
+  else if (x.is_int()) 
+    return x.as_int() > y.as_int();
+  else if (x.is_double())
+    return x.as_double() > y.as_double();
+  else if (x.is_string())
+    return x.as_string() > y.as_string();
   else
-    return get<bool>(x) > get<bool>(y);
+    return x.as_bool() > y.as_bool();
 }
 
 VMValue VM::ge(const VMValue& x, const VMValue& y) const
 {
-  if (holds_alternative<nullptr_t>(x) and not holds_alternative<nullptr_t>(y)) 
+  if (x.is_null() and not y.is_null()) 
     return false;
-  else if (not holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (not x.is_null() and y.is_null())
     return false;
-  else if (holds_alternative<nullptr_t>(x) and holds_alternative<nullptr_t>(y))
+  else if (x.is_null() and y.is_null())
     return true;
-  else if (holds_alternative<int>(x)) 
-    return get<int>(x) >= get<int>(y);
-  else if (holds_alternative<double>(x))
-    return get<double>(x) >= get<double>(y);
-  else if (holds_alternative<string>(x))
-    return get<string>(x) >= get<string>(y);
+  else if (x.is_int()) 
+    return x.as_int() >= y.as_int();
+  else if (x.is_double())
+    return x.as_double() >= y.as_double();
+  else if (x.is_string())
+    return x.as_string() >= y.as_string();
   else
-    return get<bool>(x) >= get<bool>(y);
+    return x.as_bool() >= y.as_bool();
 }
 
@@ -8,13 +8,24 @@
 #ifndef VM_H
 #define VM_H
 
+#include <iosfwd>
 #include <memory>
-#include <stack>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include "vm_instr.h"
 #include "vm_frame.h"
+#include "vm_heap.h"
+#include "vm_jit.h"
+
+
+// instruction dispatch strategies for VM::run: TABLE jumps straight to
+// each opcode's handler, LEGACY walks the original if/else opcode chain
+enum class Dispatch {TABLE, LEGACY};
+
+
+class VMImage;
 
 
 class VM
@@ -24,29 +35,209 @@ public:
   // add a new frame type to the vm
   void add(const VMFrameInfo& frame);
 
+  // add a new struct type to the vm
+  void add(const VMStructInfo& struct_type);
+
+  // add the functions and struct types of a bytecode image (see
+  // vm_bytecode.h), leaving each function's instructions in the image
+  // until its first call
+  void load(std::shared_ptr<const VMImage> image);
+
+  // resolve each CALL to its callee, each ALLOCS to its struct type,
+  // and each field access ("T.f") to its slot (run() links
+  // automatically, but linking first reports undefined names up front)
+  void link();
+
   // run the virtual machine
   void run(bool DEBUG = false);
 
+  // select how run() dispatches instructions (defaults to TABLE)
+  void set_dispatch(Dispatch strategy);
+
+  // limit the number of active calls (a deeper call is a stack overflow)
+  void set_max_call_depth(int depth);
+
+  // limit the number of value slots (locals and operands) shared by
+  // all active calls
+  void set_value_stack_size(int slots);
+
+  // count how often each opcode follows another during run() (used to
+  // choose superinstructions)
+  void set_profile(bool enabled);
+
+  // the instruction count and most frequent opcode pairs of the last
+  // profiled run
+  std::string profile_report(int pairs = 20) const;
+
+  // garbage collection triggers: fully collect once the old space
+  // reaches the threshold (in bytes), and then once it reaches growth
+  // times the bytes that survived the last full collection
+  void set_gc_threshold(std::size_t bytes);
+  void set_gc_growth(double factor);
+
+  // the size in bytes of the nursery new objects are allocated in
+  void set_gc_nursery_size(std::size_t bytes);
+
+  // collect garbage before every allocation (for testing)
+  void set_gc_stress(bool enabled);
+
+  // garbage collection statistics for the runs so far
+  const VMHeapStats& gc_statistics() const;
+
+  // replace common instruction sequences with superinstructions when
+  // linking (defaults to true)
+  void set_superinstructions(bool enabled);
+
+  // verify each function when linking (see VMVerifier), so run() can
+  // skip the checks verification proves if every function verifies
+  // (defaults to true)
+  void set_verification(bool enabled);
+
+  // compile hot functions to machine code (see VMJit) when running
+  // without debugging output or profiling (defaults to true where the
+  // compiler is available)
+  void set_jit(bool enabled);
+
+  // the number of functions compiled to machine code so far
+  int jit_compiled_count() const;
+
+  // why each function that did not verify failed (functions loaded
+  // from an image are only verified once they are first called)
+  const std::vector<std::string>& verification_failures() const;
+
+  // apply a binary operator (arithmetic, comparison, and, or, concat)
+  // to the constant operands y and x exactly as run() would, for
+  // constant folding (no value if run() would report an error)
+  std::optional<VMValue> fold(OpCode op, const VMValue& y,
+                              const VMValue& x) const;
+
   // to print the instructions for each VM frame
   friend std::string to_string(const VM& vm);
 
+  // to save the frames and struct types (see vm_bytecode.h)
+  friend void write_bytecode(const VM& vm, std::ostream& out);
+
   
 private:
 
-  // heap for struct objects mapping oid's to field values
-  std::unordered_map<int, std::unordered_map<std::string, VMValue>> struct_heap;
-
-  // heap for array objects
-  std::unordered_map<int, std::vector<VMValue>> array_heap;
-
-  // next available object id 
-  int next_obj_id = 2023;
+  // struct and array objects (struct fields are stored in the order of
+  // the struct type's field names)
+  VMHeap heap;
 
   // collection of frame "templates" identified by function name
   std::unordered_map<std::string, VMFrameInfo> frame_info;
 
-  // VM function call stack
-  std::stack<std::shared_ptr<VMFrame>> call_stack;
+  // the linked frame templates, indexed by the CALL operands
+  std::vector<VMFrameInfo> functions;
+
+  // struct types identified by name
+  std::unordered_map<std::string, VMStructInfo> struct_info;
+
+  // the linked struct types, indexed by the ALLOCS operands
+  std::vector<VMStructInfo> structs;
+
+  // index of the "main" function in functions
+  int main_index = 0;
+
+  // true if functions is up to date with frame_info
+  bool linked = false;
+
+  // the image that loaded functions are decoded from
+  std::shared_ptr<const VMImage> image;
+
+  // the names link() resolves, and the string literals it shares
+  // (kept for functions decoded after linking)
+  std::unordered_map<std::string, int> function_index;
+  std::unordered_map<std::string, int> struct_index;
+  std::unordered_map<std::string, int> field_slot;
+  std::unordered_map<std::string, VMValue> literals;
+
+  // VM function call stack (frames are reused, not allocated per call)
+  std::vector<VMFrame> call_stack;
+
+  // number of active frames in the call stack
+  int call_depth = 0;
+
+  // VM value stack, holding each active frame's variables followed by
+  // its operands
+  std::vector<VMValue> value_stack;
+
+  // call and value stack limits
+  int max_call_depth = 10000;
+  int value_stack_size = 1 << 18;
+
+  // instruction dispatch strategy used by run()
+  Dispatch dispatch = Dispatch::TABLE;
+
+  // true if link() forms superinstructions
+  bool superinstructions = true;
+
+  // true if link() verifies functions, whether every function verified
+  // so far, and why those that did not failed
+  bool verification = true;
+  bool verified = false;
+  std::vector<std::string> unverified;
+
+  // true if run() compiles hot functions, and the compiler (functions
+  // are compiled once they are called or loop back JIT_THRESHOLD times)
+  bool jit = true;
+  VMJit compiler;
+  static const int JIT_THRESHOLD = 1000;
+
+  // opcode pair profile: counts indexed by (previous, current) opcode
+  bool profile = false;
+  std::vector<long> pair_counts;
+  long dispatch_count = 0;
+  int prev_opcode = -1;
+
+  // helper function to record an instruction in the profile
+  void record(const VMInstr& instr);
+
+  // helper function to print the current state for debugging
+  void trace(const VMFrame& frame, const VMInstr& instr) const;
+
+  // helper function to verify a function, resolve its names, size it,
+  // and form its superinstructions
+  void prepare(VMFrameInfo& frame);
+
+  // helper function to decode a loaded function's instructions from the
+  // image and prepare them
+  void decode(VMFrameInfo& frame);
+
+  // helper function to compute a linked frame's variable and operand
+  // stack sizes (reports inconsistent stack use)
+  void size_frame(VMFrameInfo& frame) const;
+
+  // helper function to replace a linked frame's common instruction
+  // sequences with superinstructions
+  void fuse(VMFrameInfo& frame) const;
+
+  // helper function to run from the given frame until main returns,
+  // checking what verification would prove only if CHECKED (returns
+  // the frame to go on running checked from if unverified code is
+  // called while running unchecked, otherwise null)
+  template <bool CHECKED>
+  VMFrame* execute(VMFrame* frame, bool DEBUG);
+
+  // helper function to push a new frame for the given function on top
+  // of the caller (reports a stack overflow)
+  VMFrame* push_frame(const VMFrameInfo& info, VMFrame* caller);
+
+  // helper function to push a new frame if there is room for it
+  // (otherwise returning null)
+  VMFrame* try_push_frame(const VMFrameInfo& info, VMFrame* caller);
+
+  // helper function to count a call of, or loop in, a function,
+  // returning true if it has compiled code (compiling it once hot)
+  bool tier_up(const VMFrameInfo& info);
+
+  // the run-time helpers called by compiled code (see VMJit::Runtime)
+  static int jit_call(void* vm, VMFrame* caller, int index);
+  static int jit_return(void* vm, VMFrame* frame);
+
+  // helper function to collect garbage, given the top frame (the roots
+  // are the variables and operands of each active frame)
+  void collect(const VMFrame& top);
 
   // helper functions to report VM errors
   void error(std::string msg) const;
@@ -55,6 +246,18 @@ private:
   // helper function to check for null values (throws mypl exception)
   void ensure_not_null(const VMFrame& f, const VMValue& x) const;
 
+  // helper function to check that an object is a struct with the
+  // field slot (throws mypl exception)
+  void ensure_field(const VMFrame& f, const VMObject* object,
+                    int slot) const;
+
+  // helper function to pop the (checked) index of a typed array access,
+  // leaving the array on top of the stack
+  int array_index(VMFrame& f) const;
+
+  // helper function to pop the size and allocate a typed array
+  VMObject* allocate_array(VMFrame& f, VMObject::Kind kind);
+
   // operation support helper functions
   VMValue add(const VMValue& x, const VMValue& y) const;
   VMValue sub(const VMValue& x, const VMValue& y) const;  
@@ -0,0 +1,419 @@
+//----------------------------------------------------------------------
+// FILE: vm_bytecode.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Saving and loading compiled MyPL VM programs (.myplc files)
+//----------------------------------------------------------------------
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include "vm_bytecode.h"
+#include "mypl_exception.h"
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MYPL_MMAP 1
+#else
+#define MYPL_MMAP 0
+#endif
+
+
+using namespace std;
+
+
+static const string MAGIC = "MYPLC";
+
+// the sizes of the header and of string and constant table entries
+static const size_t HEADER_SIZE = 33;
+static const size_t STRING_SIZE = 8;
+static const size_t CONSTANT_SIZE = 9;
+
+
+static void put_u8(string& out, uint8_t x)
+{
+  out.push_back(char(x));
+}
+
+
+static void put_u32(string& out, uint32_t x)
+{
+  for (int i = 0; i < 4; ++i)
+    out.push_back(char(x >> (8 * i)));
+}
+
+
+// true if instructions with the opcode have an operand
+static bool has_operand(OpCode op)
+{
+  switch (op) {
+    case OpCode::PUSH: case OpCode::LOAD: case OpCode::STORE:
+    case OpCode::JMP: case OpCode::JMPF: case OpCode::CALL:
+    case OpCode::ALLOCS: case OpCode::ADDF: case OpCode::SETF:
+    case OpCode::GETF:
+      return true;
+    default:
+      return false;
+  }
+}
+
+
+[[noreturn]] static void malformed()
+{
+  throw MyPLException::VMError("malformed bytecode");
+}
+
+
+namespace {
+
+  // reads bytecode in order from a position, reporting reads past its
+  // end
+  class Reader
+  {
+  public:
+
+    Reader(const char* data, size_t size, size_t pos)
+      : data(data), size(size), pos(pos)
+    {
+      if (pos > size)
+        malformed();
+    }
+
+    uint8_t u8()
+    {
+      need(1);
+      return data[pos++];
+    }
+
+    uint32_t u32()
+    {
+      need(4);
+      uint32_t x = 0;
+      for (int i = 0; i < 4; ++i)
+        x |= uint32_t(uint8_t(data[pos + i])) << (8 * i);
+      pos += 4;
+      return x;
+    }
+
+    // a count of items each taking at least item_size bytes (so a
+    // corrupt count is caught before anything is allocated for it)
+    uint32_t count(size_t item_size)
+    {
+      uint32_t n = u32();
+      if (n > (size - pos) / item_size)
+        malformed();
+      return n;
+    }
+
+    size_t position() const {return pos;}
+
+  private:
+
+    const char* data;
+    size_t size;
+    size_t pos;
+
+    void need(size_t n) const {if (size - pos < n) malformed();}
+
+  };
+
+}
+
+
+void write_bytecode(const VM& vm, ostream& out)
+{
+  // the string and constant tables, each entry stored once
+  vector<string> strings;
+  unordered_map<string, uint32_t> string_index;
+  auto string_id = [&](const string& s) {
+    auto [entry, added] = string_index.try_emplace(s, strings.size());
+    if (added)
+      strings.push_back(s);
+    return entry->second;
+  };
+  string constants;
+  unordered_map<string, uint32_t> constant_index;
+  auto constant_id = [&](const VMValue& x) {
+    string bytes;
+    put_u8(bytes, uint8_t(x.type()));
+    if (x.is_int())
+      put_u32(bytes, uint32_t(x.as_int()));
+    else if (x.is_double()) {
+      double d = x.as_double();
+      uint64_t bits;
+      memcpy(&bits, &d, sizeof(bits));
+      put_u32(bytes, uint32_t(bits));
+      put_u32(bytes, uint32_t(bits >> 32));
+    } else if (x.is_bool())
+      put_u8(bytes, x.as_bool());
+    else if (x.is_string())
+      put_u32(bytes, string_id(x.as_string()));
+    else if (x.is_ref())
+      throw MyPLException::VMError("object references cannot be saved");
+    bytes.resize(CONSTANT_SIZE);
+    auto [entry, added] = constant_index.try_emplace(bytes,
+                                                     constant_index.size());
+    if (added)
+      constants += bytes;
+    return entry->second;
+  };
+  auto put_strings = [&](string& out, const vector<string>& xs) {
+    put_u32(out, xs.size());
+    for (const string& x : xs)
+      put_u32(out, string_id(x));
+  };
+
+  // the struct types and functions, in name order (so a program always
+  // saves to the same bytes)
+  auto by_name = [](const auto& table) {
+    vector<const string*> names;
+    for (const auto& entry : table)
+      names.push_back(&entry.first);
+    sort(names.begin(), names.end(),
+         [](const string* x, const string* y) {return *x < *y;});
+    return names;
+  };
+  string types;
+  for (const string* name : by_name(vm.struct_info)) {
+    const VMStructInfo& type = vm.struct_info.at(*name);
+    put_u32(types, string_id(type.struct_name));
+    put_strings(types, type.field_names);
+    put_strings(types, type.field_types);
+  }
+  string signatures;
+  string code;
+  for (const string* name : by_name(vm.frame_info)) {
+    const VMFrameInfo& frame = vm.frame_info.at(*name);
+    // (functions loaded from an image may not be decoded yet)
+    vector<VMInstr> instrs = frame.image_index < 0 ?
+      frame.instructions : vm.image->code(frame.image_index);
+    put_u32(signatures, string_id(frame.function_name));
+    put_u32(signatures, frame.arg_count);
+    put_strings(signatures, frame.arg_types);
+    put_u32(signatures, string_id(frame.return_type));
+    put_u32(signatures, instrs.size());
+    put_u32(signatures, code.size());
+    for (const VMInstr& instr : instrs) {
+      put_u8(code, uint8_t(instr.opcode()));
+      put_u32(code, instr.operand() ? constant_id(*instr.operand()) + 1 : 0);
+    }
+  }
+
+  string table;
+  string chars;
+  for (const string& s : strings) {
+    put_u32(table, chars.size());
+    put_u32(table, s.size());
+    chars += s;
+  }
+  string header = MAGIC;
+  put_u32(header, BYTECODE_VERSION);
+  put_u32(header, strings.size());
+  put_u32(header, constant_index.size());
+  put_u32(header, vm.struct_info.size());
+  put_u32(header, vm.frame_info.size());
+  size_t chars_at = HEADER_SIZE + table.size() + constants.size() +
+    types.size() + signatures.size();
+  put_u32(header, chars_at);
+  put_u32(header, chars_at + chars.size());
+  out << header << table << constants << types << signatures << chars
+      << code;
+}
+
+
+void read_bytecode(istream& in, VM& vm)
+{
+  shared_ptr<const VMImage> image = VMImage::read(in);
+  for (const VMStructInfo& type : image->struct_types())
+    vm.add(type);
+  for (int i = 0; i < image->functions().size(); ++i) {
+    VMFrameInfo frame = image->functions()[i];
+    frame.instructions = image->code(i);
+    frame.image_index = -1;
+    vm.add(frame);
+  }
+}
+
+
+shared_ptr<const VMImage> VMImage::open(const string& path)
+{
+#if MYPL_MMAP
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw MyPLException::VMError("unable to open '" + path + "'");
+  struct stat info;
+  void* pages = MAP_FAILED;
+  if (fstat(fd, &info) == 0 and info.st_size > 0)
+    pages = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (pages != MAP_FAILED) {
+    shared_ptr<VMImage> image(new VMImage());
+    image->data = static_cast<const char*>(pages);
+    image->size = info.st_size;
+    image->mapped = true;
+    image->parse();
+    return image;
+  }
+  // (files that cannot be mapped are read instead)
+#endif
+  ifstream in(path, ios::binary);
+  if (in.fail())
+    throw MyPLException::VMError("unable to open '" + path + "'");
+  return read(in);
+}
+
+
+shared_ptr<const VMImage> VMImage::read(istream& in)
+{
+  shared_ptr<VMImage> image(new VMImage());
+  image->owned.assign(istreambuf_iterator<char>(in),
+                      istreambuf_iterator<char>());
+  image->data = image->owned.data();
+  image->size = image->owned.size();
+  image->parse();
+  return image;
+}
+
+
+VMImage::~VMImage()
+{
+#if MYPL_MMAP
+  if (mapped)
+    munmap(const_cast<char*>(data), size);
+#endif
+}
+
+
+void VMImage::parse()
+{
+  if (size < MAGIC.size() or memcmp(data, MAGIC.data(), MAGIC.size()) != 0)
+    throw MyPLException::VMError("not a MyPL bytecode file");
+  Reader reader(data, size, MAGIC.size());
+  if (reader.u32() != BYTECODE_VERSION)
+    throw MyPLException::VMError("bytecode is from another version of "
+                                 "MyPL (recompile it)");
+  string_count = reader.u32();
+  constant_count = reader.u32();
+  uint32_t struct_count = reader.u32();
+  uint32_t function_count = reader.u32();
+  chars_at = reader.u32();
+  code_at = reader.u32();
+  // (64-bit arithmetic, so corrupt counts cannot wrap around)
+  strings_at = HEADER_SIZE;
+  constants_at = strings_at + uint64_t(string_count) * STRING_SIZE;
+  uint64_t types_at = constants_at + uint64_t(constant_count) * CONSTANT_SIZE;
+  if (types_at > chars_at or chars_at > code_at or code_at > size)
+    malformed();
+
+  reader = Reader(data, chars_at, types_at);
+  auto read_string = [&]() {
+    return string(string_at(reader.u32()));
+  };
+  auto read_strings = [&](vector<string>& xs) {
+    xs.resize(reader.count(4));
+    for (string& x : xs)
+      x = read_string();
+  };
+  if (struct_count > (chars_at - types_at) / 12)
+    malformed();
+  structs.resize(struct_count);
+  for (VMStructInfo& type : structs) {
+    type.struct_name = read_string();
+    read_strings(type.field_names);
+    read_strings(type.field_types);
+  }
+  if (function_count > (chars_at - reader.position()) / 24)
+    malformed();
+  signatures.resize(function_count);
+  uint64_t code_size = 0;
+  for (uint32_t i = 0; i < function_count; ++i) {
+    VMFrameInfo& frame = signatures[i];
+    frame.function_name = read_string();
+    uint32_t arg_count = reader.u32();
+    if (arg_count > INT_MAX)
+      malformed();
+    frame.arg_count = arg_count;
+    read_strings(frame.arg_types);
+    frame.return_type = read_string();
+    frame.image_index = i;
+    uint32_t instruction_count = reader.u32();
+    uint32_t offset = reader.u32();
+    if (offset > size - code_at or
+        instruction_count > (size - code_at - offset) / 5)
+      malformed();
+    code_ranges.emplace_back(instruction_count, offset);
+    code_size += uint64_t(instruction_count) * 5;
+  }
+  // (so truncated or padded bytecode is caught up front)
+  if (reader.position() != chars_at or code_size != size - code_at)
+    malformed();
+}
+
+
+string_view VMImage::string_at(uint32_t index) const
+{
+  if (index >= string_count)
+    malformed();
+  Reader reader(data, size, strings_at + index * STRING_SIZE);
+  uint32_t offset = reader.u32();
+  uint32_t length = reader.u32();
+  if (offset > code_at - chars_at or length > code_at - chars_at - offset)
+    malformed();
+  return string_view(data + chars_at + offset, length);
+}
+
+
+VMValue VMImage::constant(uint32_t index) const
+{
+  if (index >= constant_count)
+    malformed();
+  Reader reader(data, size, constants_at + index * CONSTANT_SIZE);
+  switch (VMValue::Tag(reader.u8())) {
+    case VMValue::Tag::NULL_VAL:
+      return nullptr;
+    case VMValue::Tag::INT:
+      return int(reader.u32());
+    case VMValue::Tag::DOUBLE: {
+      uint64_t bits = reader.u32();
+      bits |= uint64_t(reader.u32()) << 32;
+      double d;
+      memcpy(&d, &bits, sizeof(d));
+      return d;
+    }
+    case VMValue::Tag::BOOL:
+      return reader.u8() != 0;
+    case VMValue::Tag::STRING:
+      return string(string_at(reader.u32()));
+    default:
+      malformed();
+  }
+}
+
+
+vector<VMInstr> VMImage::code(int index) const
+{
+  auto [instruction_count, offset] = code_ranges.at(index);
+  Reader reader(data, size, code_at + offset);
+  vector<VMInstr> instrs;
+  instrs.reserve(instruction_count);
+  for (uint32_t i = 0; i < instruction_count; ++i) {
+    // (superinstructions are only formed by linking, so never saved)
+    OpCode op = OpCode(reader.u8());
+    uint32_t operand = reader.u32();
+    if (op > OpCode::NOP or
+        (op >= OpCode::INC_LOCAL and op <= OpCode::RET_NULL) or
+        operand > constant_count or has_operand(op) != (operand > 0))
+      malformed();
+    if (operand == 0)
+      instrs.push_back(VMInstr::make(op, nullopt));
+    else
+      instrs.push_back(VMInstr::make(op, constant(operand - 1)));
+  }
+  return instrs;
+}
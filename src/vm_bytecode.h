@@ -0,0 +1,120 @@
+//----------------------------------------------------------------------
+// FILE: vm_bytecode.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Saving and loading compiled MyPL VM programs (.myplc files)
+//----------------------------------------------------------------------
+
+#ifndef VM_BYTECODE_H
+#define VM_BYTECODE_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string_view>
+#include "vm.h"
+
+
+// A .myplc file holds a program's unlinked functions and struct types
+// (as the code generator added them to the vm), so running it skips
+// the lexer, parser, checker, and code generator. Each string and
+// constant is stored once and referred to by its index. The string and
+// constant tables have fixed-size entries and each function's code is
+// found by its offset, so a file can be used in place (see VMImage)
+// without reading all of it. Integers are 4 byte little-endian unless
+// noted, and offsets are from the start of the file:
+//   header:     "MYPLC", the format version, the string, constant,
+//               struct, and function counts, and the offsets of the
+//               characters and the code
+//   strings:    each string's offset in the characters and length
+//   constants:  each constant's type tag (1 byte) and its int, double
+//               (8 bytes), bool, or string index, padded to 8 bytes
+//   structs:    each struct type's name, its field count and field
+//               names, and its field type count and types
+//   functions:  each function's name, parameter count, parameter type
+//               count and types, return type, and instruction count and
+//               offset in the code
+//   characters: the strings' characters
+//   code:       each instruction's opcode (1 byte) and operand
+//               (constant index + 1, or 0)
+// (names and types are string indexes)
+
+
+// the .myplc format version (changes whenever the format or the opcode
+// numbering does)
+const int BYTECODE_VERSION = 2;
+
+// write the vm's functions and struct types as bytecode
+void write_bytecode(const VM& vm, std::ostream& out);
+
+// add the functions and struct types saved as bytecode to the vm
+// (reports malformed or out-of-date bytecode as a VM error)
+void read_bytecode(std::istream& in, VM& vm);
+
+
+// Bytecode used in place: a mapped file's pages are shared by every
+// process running it, and only the header, struct types, and function
+// signatures are read up front. A function's instructions (and the
+// constants and strings they use) are only decoded when it is asked
+// for, which VM::load leaves to the function's first call.
+// Malformed bytecode is reported as a VM error when the part of it at
+// fault is read.
+class VMImage
+{
+public:
+
+  // map a .myplc file
+  static std::shared_ptr<const VMImage> open(const std::string& path);
+
+  // read bytecode into memory (e.g., from standard input)
+  static std::shared_ptr<const VMImage> read(std::istream& in);
+
+  ~VMImage();
+
+  VMImage(const VMImage&) = delete;
+  VMImage& operator=(const VMImage&) = delete;
+
+  // the struct types
+  const std::vector<VMStructInfo>& struct_types() const {return structs;}
+
+  // the functions without their instructions (with image_index set)
+  const std::vector<VMFrameInfo>& functions() const {return signatures;}
+
+  // decode the (unlinked) instructions of the function at an index
+  std::vector<VMInstr> code(int index) const;
+
+private:
+
+  // the bytecode, either mapped or owned
+  const char* data = nullptr;
+  std::size_t size = 0;
+  bool mapped = false;
+  std::string owned;
+
+  // the table counts and section offsets from the header
+  std::uint32_t string_count = 0;
+  std::uint32_t constant_count = 0;
+  std::size_t strings_at = 0;
+  std::size_t constants_at = 0;
+  std::size_t chars_at = 0;
+  std::size_t code_at = 0;
+
+  std::vector<VMStructInfo> structs;
+  std::vector<VMFrameInfo> signatures;
+
+  // each function's instruction count and code offset
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> code_ranges;
+
+  VMImage() = default;
+
+  // helper to read the header, struct types, and signatures
+  void parse();
+
+  // helpers to decode an entry of the string or constant table
+  std::string_view string_at(std::uint32_t index) const;
+  VMValue constant(std::uint32_t index) const;
+
+};
+
+
+#endif
@@ -9,7 +9,6 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 
-#include <stack>
 #include <string>
 #include <vector>
 #include "vm_instr.h"
@@ -18,6 +17,12 @@
 // The following are plain-old-data classes
 
 
+class VMFrame;
+
+// a function's compiled code, run on its frame (see vm_jit.h)
+using VMNativeCode = int (*)(VMFrame* frame);
+
+
 class VMFrameInfo
 {
 public:
@@ -28,9 +33,47 @@ public:
   // the number of parameters of the assocated function
   int arg_count; 
 
+  // the declared parameter and return types (MyPL type names such as
+  // "int" or "array Node", checked by the verifier; empty if unknown)
+  std::vector<std::string> arg_types;
+  std::string return_type;
+
   // the program instructions
   std::vector<VMInstr> instructions;  
 
+  // the number of local variable slots (computed by VM::link)
+  int local_count = 0;
+
+  // the maximum operand stack depth (computed by VM::link)
+  int max_stack = 0;
+
+  // the function's index in the bytecode image its instructions are
+  // still to be decoded from (see VM::load), or -1 once they are here
+  int image_index = -1;
+
+  // how often the linked function was called or looped back (counted
+  // by VM::run to find the functions worth compiling), and its
+  // compiled code if it has been
+  mutable int hotness = 0;
+  mutable VMNativeCode native = nullptr;
+
+};
+
+
+class VMStructInfo
+{
+public:
+
+  // the name of the struct type
+  std::string struct_name;
+
+  // the field names, in slot order (objects of the type store their
+  // field values in a fixed array of slots)
+  std::vector<std::string> field_names;
+
+  // the declared field types, in slot order (empty if unknown)
+  std::vector<std::string> field_types;
+
 };
 
 
@@ -38,17 +81,28 @@ class VMFrame
 {
 public:
 
-  // the type of the current frame
-  VMFrameInfo info;
+  // the type of the current frame (owned by the VM and shared by
+  // every call to the function, so it is never copied per call)
+  const VMFrameInfo* info = nullptr;
   
   // the program counter
   int pc = 0;
 
-  // the internal memory of the function
-  std::vector<VMValue> variables;
-
-  // the operand stack
-  std::stack<VMValue> operand_stack;
+  // the internal memory of the function (its local_count slots of the
+  // VM value stack, starting with the arguments)
+  VMValue* variables = nullptr;
+
+  // the operand stack (the slots above the variables, with sp one
+  // past the top operand)
+  VMValue* operands = nullptr;
+  VMValue* sp = nullptr;
+
+  // operand stack helpers
+  const VMValue& top() const {return sp[-1];}
+  VMValue& top() {return sp[-1];}
+  void pop() {--sp;}
+  void push(const VMValue& x) {*sp++ = x;}
+  bool empty() const {return sp == operands;}
 
 };
 
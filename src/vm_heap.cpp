@@ -0,0 +1,450 @@
+//----------------------------------------------------------------------
+// FILE: vm_heap.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Object heap for MyPL VM structs and arrays
+//----------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <new>
+#include "vm_heap.h"
+
+
+using namespace std;
+
+
+// the next free block after a free block
+static VMObject*& next_free(VMObject* block)
+{
+  return *reinterpret_cast<VMObject**>(block->slots());
+}
+
+
+// the old space copy of a forwarded nursery object
+static VMObject*& forwarding(VMObject* object)
+{
+  return *reinterpret_cast<VMObject**>(object->slots());
+}
+
+
+int VMObject::cells(Kind kind, int size)
+{
+  if (kind == Kind::STRUCT or kind == Kind::ARRAY)
+    return size;
+  int bytes = size * element_size(kind) + (size + 7) / 8;
+  return (bytes + sizeof(VMValue) - 1) / sizeof(VMValue);
+}
+
+
+int VMObject::cells() const
+{
+  return cells(kind, size);
+}
+
+
+VMValue VMObject::element(int i)
+{
+  if (kind == Kind::ARRAY)
+    return slots()[i];
+  if (!is_set(i))
+    return nullptr;
+  switch (kind) {
+    case Kind::INT_ARRAY: return elements<int>()[i];
+    case Kind::DOUBLE_ARRAY: return elements<double>()[i];
+    case Kind::BOOL_ARRAY: return elements<bool>()[i];
+    default: return char_value(elements<char>()[i]);
+  }
+}
+
+
+void VMObject::set_element(int i, const VMValue& value)
+{
+  if (kind == Kind::ARRAY)
+    (*this)[i] = value;
+  else if (value.is_null())
+    clear(i);
+  else if (kind == Kind::INT_ARRAY)
+    set(i, value.as_int());
+  else if (kind == Kind::DOUBLE_ARRAY)
+    set(i, value.as_double());
+  else if (kind == Kind::BOOL_ARRAY)
+    set(i, value.as_bool());
+  else
+    set(i, value.as_string()[0]);
+}
+
+
+VMHeap::VMHeap()
+{
+  reset_nursery();
+}
+
+
+VMHeap::~VMHeap()
+{
+  clear();
+  ::operator delete(nursery);
+}
+
+
+int VMHeap::block_size(int size_class)
+{
+  return sizeof(VMObject) + (1 << size_class) * sizeof(VMValue);
+}
+
+
+void VMHeap::add_page(int size_class)
+{
+  char* page = static_cast<char*>(::operator new(PAGE_SIZE));
+  pages.push_back({page, size_class});
+  int size = block_size(size_class);
+  for (int offset = 0; offset + size <= PAGE_SIZE; offset += size) {
+    VMObject* block = reinterpret_cast<VMObject*>(page + offset);
+    block->kind = VMObject::Kind::FREE;
+    block->size_class = size_class;
+    next_free(block) = free_lists[size_class];
+    free_lists[size_class] = block;
+  }
+}
+
+
+VMObject* VMHeap::allocate(VMObject::Kind kind, int size, const VMValue& init)
+{
+  VMObject* object;
+  int cells = VMObject::cells(kind, size);
+  size_t bytes = young_bytes(cells);
+  if (cells <= MAX_YOUNG_CELLS and nursery_top + bytes <= nursery_end) {
+    object = reinterpret_cast<VMObject*>(nursery_top);
+    nursery_top += bytes;
+    object->young = true;
+    int size_class = 0;
+    while ((1 << size_class) < cells)
+      ++size_class;
+    object->size_class = size_class;
+  } else {
+    object = allocate_old(cells);
+    bytes = object_bytes(object, cells);
+    old_bytes += bytes;
+  }
+  object->id = next_id++;
+  object->size = size;
+  object->kind = kind;
+  object->marked = false;
+  object->remembered = false;
+  if (object->slot_count() > 0) {
+    uninitialized_fill_n(object->slots(), size, init);
+    write_barrier(object, init);
+  } else {
+    // typed arrays start with every element null
+    memset(static_cast<void*>(object->slots()), 0, cells * sizeof(VMValue));
+    if (!init.is_null())
+      for (int i = 0; i < size; ++i)
+        object->set_element(i, init);
+  }
+  stats.bytes_in_use += bytes;
+  stats.peak_bytes_in_use = max(stats.peak_bytes_in_use, stats.bytes_in_use);
+  return object;
+}
+
+
+VMObject* VMHeap::allocate_old(int cells)
+{
+  int size_class = 0;
+  while (size_class < SIZE_CLASSES and (1 << size_class) < cells)
+    ++size_class;
+  VMObject* object;
+  if (size_class == LARGE) {
+    object = static_cast<VMObject*>(
+      ::operator new(sizeof(VMObject) + cells * sizeof(VMValue)));
+    large_objects.push_back(object);
+  } else {
+    if (!free_lists[size_class])
+      add_page(size_class);
+    object = free_lists[size_class];
+    free_lists[size_class] = next_free(object);
+  }
+  object->size_class = size_class;
+  object->young = false;
+  return object;
+}
+
+
+size_t VMHeap::object_bytes(const VMObject* object, int cells)
+{
+  if (object->size_class == LARGE)
+    return sizeof(VMObject) + cells * sizeof(VMValue);
+  return block_size(object->size_class);
+}
+
+
+size_t VMHeap::object_bytes(const VMObject* object)
+{
+  return object_bytes(object, object->cells());
+}
+
+
+size_t VMHeap::young_bytes(int cells)
+{
+  // nursery objects have at least one cell, to hold a forwarding pointer
+  return sizeof(VMObject) + max(cells, 1) * sizeof(VMValue);
+}
+
+
+void VMHeap::remember(VMObject* object)
+{
+  object->remembered = true;
+  remembered.push_back(object);
+}
+
+
+void VMHeap::set_threshold(size_t bytes)
+{
+  threshold = bytes;
+  next_collection = max(threshold, size_t(stats.bytes_in_use * growth));
+}
+
+
+void VMHeap::set_growth(double factor)
+{
+  growth = factor;
+  next_collection = max(threshold, size_t(stats.bytes_in_use * growth));
+}
+
+
+void VMHeap::set_nursery_size(size_t bytes)
+{
+  // a nursery holding objects is resized after the next minor collection
+  nursery_size = max(bytes, size_t(MAX_YOUNG_BYTES));
+  if (nursery_top == nursery)
+    reset_nursery();
+}
+
+
+void VMHeap::reset_nursery()
+{
+  if (size_t(nursery_end - nursery) != nursery_size) {
+    ::operator delete(nursery);
+    nursery = static_cast<char*>(::operator new(nursery_size));
+    nursery_end = nursery + nursery_size;
+  }
+  nursery_top = nursery;
+}
+
+
+void VMHeap::set_stress(bool enabled)
+{
+  stress = enabled;
+}
+
+
+const VMHeapStats& VMHeap::statistics() const
+{
+  return stats;
+}
+
+
+void VMHeap::collect(VMValue* roots_begin, VMValue* roots_end, bool full)
+{
+  auto start = chrono::steady_clock::now();
+  minor_collect(roots_begin, roots_end);
+  chrono::duration<double, milli> pause = chrono::steady_clock::now() - start;
+  ++stats.minor_collections;
+  stats.max_minor_pause_ms = max(stats.max_minor_pause_ms, pause.count());
+  if (full or stress or old_bytes >= next_collection) {
+    mark(roots_begin, roots_end);
+    sweep();
+    pause = chrono::steady_clock::now() - start;
+    ++stats.collections;
+    next_collection = max(threshold, size_t(old_bytes * growth));
+  }
+  stats.total_pause_ms += pause.count();
+  stats.max_pause_ms = max(stats.max_pause_ms, pause.count());
+}
+
+
+void VMHeap::minor_collect(VMValue* roots_begin, VMValue* roots_end)
+{
+  for (VMValue* root = roots_begin; root != roots_end; ++root)
+    forward(*root);
+  for (VMObject* object : remembered) {
+    object->remembered = false;
+    for (int i = 0; i < object->slot_count(); ++i)
+      forward((*object)[i]);
+  }
+  remembered.clear();
+  // promoted objects may in turn refer to nursery objects
+  while (!promoted.empty()) {
+    VMObject* object = promoted.back();
+    promoted.pop_back();
+    for (int i = 0; i < object->slot_count(); ++i)
+      forward((*object)[i]);
+  }
+  // the rest of the nursery is garbage (the promoted objects' slots
+  // were moved, so only the unreachable objects need destroying)
+  for (char* p = nursery; p < nursery_top; ) {
+    VMObject* object = reinterpret_cast<VMObject*>(p);
+    bool moved = object->kind == VMObject::Kind::FORWARDED;
+    size_t bytes = young_bytes(moved ? forwarding(object)->cells()
+                                     : object->cells());
+    if (!moved) {
+      destroy(object);
+      ++stats.objects_freed;
+      stats.bytes_freed += bytes;
+    }
+    stats.bytes_in_use -= bytes;
+    p += bytes;
+  }
+  reset_nursery();
+}
+
+
+void VMHeap::forward(VMValue& value)
+{
+  if (!value.is_ref() or !value.as_ref()->young)
+    return;
+  VMObject* object = value.as_ref();
+  if (object->kind != VMObject::Kind::FORWARDED) {
+    int cells = object->cells();
+    VMObject* copy = allocate_old(cells);
+    copy->id = object->id;
+    copy->size = object->size;
+    copy->kind = object->kind;
+    copy->marked = false;
+    copy->remembered = false;
+    // move the slots (the copy takes over their string references)
+    memcpy(static_cast<void*>(copy->slots()), object->slots(),
+           cells * sizeof(VMValue));
+    size_t bytes = object_bytes(copy);
+    old_bytes += bytes;
+    stats.bytes_in_use += bytes;
+    ++stats.objects_promoted;
+    object->kind = VMObject::Kind::FORWARDED;
+    forwarding(object) = copy;
+    promoted.push_back(copy);
+  }
+  value = forwarding(object);
+}
+
+
+void VMHeap::mark(const VMValue* roots_begin, const VMValue* roots_end)
+{
+  // objects that are marked but whose slots haven't been scanned yet
+  vector<VMObject*> worklist;
+  auto visit = [&](const VMValue& value) {
+    if (value.is_ref() and !value.as_ref()->marked) {
+      value.as_ref()->marked = true;
+      worklist.push_back(value.as_ref());
+    }
+  };
+  for (const VMValue* root = roots_begin; root != roots_end; ++root)
+    visit(*root);
+  while (!worklist.empty()) {
+    VMObject* object = worklist.back();
+    worklist.pop_back();
+    for (int i = 0; i < object->slot_count(); ++i)
+      visit((*object)[i]);
+  }
+}
+
+
+void VMHeap::sweep()
+{
+  for (auto [page, size_class] : pages) {
+    int size = block_size(size_class);
+    for (int offset = 0; offset + size <= PAGE_SIZE; offset += size) {
+      VMObject* block = reinterpret_cast<VMObject*>(page + offset);
+      if (block->kind == VMObject::Kind::FREE)
+        continue;
+      if (block->marked)
+        block->marked = false;
+      else
+        free_block(block);
+    }
+  }
+  auto survivor = large_objects.begin();
+  for (VMObject* object : large_objects) {
+    if (object->marked) {
+      object->marked = false;
+      *survivor++ = object;
+    } else
+      free_block(object);
+  }
+  large_objects.erase(survivor, large_objects.end());
+}
+
+
+void VMHeap::free_block(VMObject* object)
+{
+  size_t bytes = object_bytes(object);
+  ++stats.objects_freed;
+  stats.bytes_freed += bytes;
+  stats.bytes_in_use -= bytes;
+  old_bytes -= bytes;
+  destroy(object);
+  if (object->size_class == LARGE)
+    ::operator delete(object);
+  else {
+    next_free(object) = free_lists[object->size_class];
+    free_lists[object->size_class] = object;
+  }
+}
+
+
+void VMHeap::destroy(VMObject* object)
+{
+  for (int i = 0; i < object->slot_count(); ++i)
+    object->slots()[i].~VMValue();
+  object->kind = VMObject::Kind::FREE;
+}
+
+
+void VMHeap::clear()
+{
+  for (char* p = nursery; p < nursery_top; ) {
+    VMObject* object = reinterpret_cast<VMObject*>(p);
+    p += young_bytes(object->cells());
+    destroy(object);
+  }
+  nursery_top = nursery;
+  remembered.clear();
+  for (auto [page, size_class] : pages) {
+    int size = block_size(size_class);
+    for (int offset = 0; offset + size <= PAGE_SIZE; offset += size) {
+      VMObject* block = reinterpret_cast<VMObject*>(page + offset);
+      if (block->kind != VMObject::Kind::FREE)
+        destroy(block);
+    }
+    ::operator delete(page);
+  }
+  for (VMObject* object : large_objects) {
+    destroy(object);
+    ::operator delete(object);
+  }
+  pages.clear();
+  large_objects.clear();
+  for (VMObject*& free_list : free_lists)
+    free_list = nullptr;
+  stats.bytes_in_use = 0;
+  old_bytes = 0;
+  next_collection = threshold;
+}
+
+
+string to_string(const VMHeapStats& stats)
+{
+  auto kb = [](size_t bytes) {return to_string(bytes / 1024) + " KB";};
+  string s = "gc collections: " + to_string(stats.collections) + "\n";
+  s += "gc minor collections: " + to_string(stats.minor_collections) + "\n";
+  s += "gc pause total: " + to_string(stats.total_pause_ms) + " ms\n";
+  s += "gc pause max: " + to_string(stats.max_pause_ms) + " ms\n";
+  s += "gc minor pause max: " + to_string(stats.max_minor_pause_ms) + " ms\n";
+  s += "gc objects promoted: " + to_string(stats.objects_promoted) + "\n";
+  s += "gc objects freed: " + to_string(stats.objects_freed) + "\n";
+  s += "gc bytes freed: " + kb(stats.bytes_freed) + "\n";
+  s += "heap in use: " + kb(stats.bytes_in_use) + "\n";
+  s += "heap peak: " + kb(stats.peak_bytes_in_use) + "\n";
+  return s;
+}
@@ -0,0 +1,264 @@
+//----------------------------------------------------------------------
+// FILE: vm_heap.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Object heap for MyPL VM structs and arrays
+//----------------------------------------------------------------------
+
+#ifndef VM_HEAP_H
+#define VM_HEAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "vm_value.h"
+
+
+// a struct or array object: a header followed directly by its value
+// slots (struct fields in field order, or array elements). Typed arrays
+// instead hold their unboxed elements, followed by a bitmap of which
+// elements are set (the rest are null).
+class alignas(8) VMObject
+{
+public:
+
+  // the kinds of objects (FREE marks an unused heap block, FORWARDED a
+  // nursery object that was moved to the old space)
+  enum class Kind : std::uint8_t {STRUCT, ARRAY, INT_ARRAY, DOUBLE_ARRAY,
+                                  BOOL_ARRAY, CHAR_ARRAY, FREE, FORWARDED};
+
+  // the object's id (printed in place of references to it)
+  int id;
+
+  // the number of value slots (or typed array elements)
+  int size;
+
+  Kind kind;
+
+  // the heap size class of the object's block
+  std::uint8_t size_class;
+
+  // true if the collector found the object reachable
+  bool marked;
+
+  // true if the object is in the nursery
+  bool young;
+
+  // true if the (old) object is in the remembered set
+  bool remembered;
+
+  // the object's value slots
+  VMValue* slots() {return reinterpret_cast<VMValue*>(this + 1);}
+  VMValue& operator[](int i) {return slots()[i];}
+
+  // the number of value slots (zero for typed arrays)
+  int slot_count() const
+    {return kind == Kind::STRUCT or kind == Kind::ARRAY ? size : 0;}
+
+  // the number of value sized cells the slots or elements take up
+  int cells() const;
+
+  // a typed array's elements
+  template<typename T> T* elements()
+    {return reinterpret_cast<T*>(this + 1);}
+
+  // true if a typed array's element is not null
+  bool is_set(int i) const {return set_bits()[i >> 3] & (1 << (i & 7));}
+
+  // get or set an array's element (as a value)
+  VMValue element(int i);
+  void set_element(int i, const VMValue& value);
+
+  // set a typed array's element to the (non-null) value
+  template<typename T> void set(int i, T value)
+    {elements<T>()[i] = value; set_bits()[i >> 3] |= 1 << (i & 7);}
+
+  // set a typed array's element to null
+  void clear(int i) {set_bits()[i >> 3] &= ~(1 << (i & 7));}
+
+  // the size in bytes of a typed array element
+  static int element_size(Kind kind)
+    {return kind == Kind::DOUBLE_ARRAY ? 8 : kind == Kind::INT_ARRAY ? 4 : 1;}
+
+  // the number of cells a new object of the kind and size takes up
+  static int cells(Kind kind, int size);
+
+
+private:
+
+  // a typed array's set bitmap (following its elements)
+  std::uint8_t* set_bits() const
+    {return reinterpret_cast<std::uint8_t*>(const_cast<VMObject*>(this) + 1)
+        + size * element_size(kind);}
+
+};
+
+static_assert(sizeof(VMObject) == 16);
+
+
+// garbage collection statistics
+class VMHeapStats
+{
+public:
+  int collections = 0;
+  int minor_collections = 0;
+  double total_pause_ms = 0;
+  double max_pause_ms = 0;
+  double max_minor_pause_ms = 0;
+  std::size_t objects_promoted = 0;
+  std::size_t objects_freed = 0;
+  std::size_t bytes_freed = 0;
+  std::size_t bytes_in_use = 0;
+  std::size_t peak_bytes_in_use = 0;
+};
+
+// pretty print the statistics
+std::string to_string(const VMHeapStats& stats);
+
+
+// New objects of up to 128 cells are bump allocated in a nursery. A
+// minor collection copies the nursery objects reachable from the roots
+// (or from old objects in the remembered set) to the old space and
+// empties the nursery. The old space is made of pages of equal sized
+// blocks, one set of pages per size class (blocks hold 1, 2, 4, ...,
+// 128 slots), with a free list of unused blocks per class. Larger
+// objects get their own allocation in the old space. Unreachable old
+// objects are reclaimed by a mark-sweep (major) collection. The vm
+// runs a collection when should_collect() says the nursery is full or
+// the old space has grown enough since the last major collection.
+class VMHeap
+{
+public:
+
+  VMHeap();
+  VMHeap(const VMHeap&) = delete;
+  VMHeap& operator=(const VMHeap&) = delete;
+  ~VMHeap();
+
+  // create an object with the given number of slots, each set to init
+  VMObject* allocate(VMObject::Kind kind, int size,
+                     const VMValue& init = nullptr);
+
+  // release all objects
+  void clear();
+
+  // run a major collection once the old space reaches the threshold,
+  // and afterwards once it reaches growth times the bytes that survived
+  // (the default is a 4MB threshold, with a growth of 2)
+  void set_threshold(std::size_t bytes);
+  void set_growth(double factor);
+
+  // the nursery size in bytes (the default is 256KB)
+  void set_nursery_size(std::size_t bytes);
+
+  // collect (fully) before every allocation (to find missing roots in
+  // testing)
+  void set_stress(bool enabled);
+
+  // true if the next allocation should be preceded by a collection
+  bool should_collect() const
+    {return stress or nursery_end - nursery_top < MAX_YOUNG_BYTES or
+        old_bytes >= next_collection;}
+
+  // record a store of the value into the object (call before storing)
+  void write_barrier(VMObject* object, const VMValue& value)
+    {if (value.is_ref() and !object->young and value.as_ref()->young and
+         !object->remembered) remember(object);}
+
+  // run a minor collection, followed by a major one if the old space
+  // has grown enough (or if full), updating references in the roots to
+  // objects that moved
+  void collect(VMValue* roots_begin, VMValue* roots_end, bool full = false);
+
+  // the collection statistics so far
+  const VMHeapStats& statistics() const;
+
+private:
+
+  static const int SIZE_CLASSES = 8;
+  static const int LARGE = SIZE_CLASSES;
+  static const int PAGE_SIZE = 64 * 1024;
+  static const int MAX_YOUNG_CELLS = 1 << (SIZE_CLASSES - 1);
+  static const int MAX_YOUNG_BYTES =
+    sizeof(VMObject) + MAX_YOUNG_CELLS * sizeof(VMValue);
+
+  // the nursery, its allocation pointer, and the size it should have
+  char* nursery = nullptr;
+  char* nursery_top = nullptr;
+  char* nursery_end = nullptr;
+  std::size_t nursery_size = 256 * 1024;
+
+  // old objects that may refer to nursery objects
+  std::vector<VMObject*> remembered;
+
+  // objects promoted by the current minor collection (not yet scanned)
+  std::vector<VMObject*> promoted;
+
+  // bytes used by old objects
+  std::size_t old_bytes = 0;
+
+  // unused blocks of each size class (linked through their first slot)
+  VMObject* free_lists[SIZE_CLASSES] = {};
+
+  // pages of blocks, with the size class of each page's blocks
+  std::vector<std::pair<char*, int>> pages;
+
+  // objects too large for a size class
+  std::vector<VMObject*> large_objects;
+
+  // the id of the next object
+  int next_id = 2023;
+
+  // collection triggers
+  std::size_t threshold = 4 * 1024 * 1024;
+  double growth = 2;
+  bool stress = false;
+  std::size_t next_collection = threshold;
+
+  VMHeapStats stats;
+
+  // helper to get the number of bytes used by an (old) object
+  static std::size_t object_bytes(const VMObject* object);
+  static std::size_t object_bytes(const VMObject* object, int cells);
+
+  // helper to get the number of bytes used by a nursery object
+  static std::size_t young_bytes(int cells);
+
+  // helper to allocate an old object's block
+  VMObject* allocate_old(int cells);
+
+  // helper to add an old object to the remembered set
+  void remember(VMObject* object);
+
+  // helper to copy the reachable nursery objects to the old space
+  void minor_collect(VMValue* roots_begin, VMValue* roots_end);
+
+  // helper to update a reference to a nursery object (promoting it)
+  void forward(VMValue& value);
+
+  // helper to (re)allocate the empty nursery at its requested size
+  void reset_nursery();
+
+  // helper to mark each object reachable from the root values
+  void mark(const VMValue* roots_begin, const VMValue* roots_end);
+
+  // helper to free each unmarked object (and unmark the rest)
+  void sweep();
+
+  // helper to return an object's block to its free list
+  void free_block(VMObject* object);
+
+  // helper to get the number of bytes in a block of a size class
+  static int block_size(int size_class);
+
+  // helper to add a page of free blocks to a size class's free list
+  void add_page(int size_class);
+
+  // helper to release an object's slots (the block is not freed)
+  static void destroy(VMObject* object);
+
+};
+
+
+#endif
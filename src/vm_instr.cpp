@@ -40,7 +40,7 @@ OpCode VMInstr::opcode() const
 }
 
 
-std::optional<VMValue> VMInstr::operand() const
+const std::optional<VMValue>& VMInstr::operand() const
 {
   return instr_operand;
 }
@@ -154,6 +154,162 @@ VMInstr VMInstr::CMPNE()
 }
 
 
+VMInstr VMInstr::ADDI()
+{
+  return VMInstr(OpCode::ADDI);
+}
+
+
+VMInstr VMInstr::ADDD()
+{
+  return VMInstr(OpCode::ADDD);
+}
+
+
+VMInstr VMInstr::SUBI()
+{
+  return VMInstr(OpCode::SUBI);
+}
+
+
+VMInstr VMInstr::SUBD()
+{
+  return VMInstr(OpCode::SUBD);
+}
+
+
+VMInstr VMInstr::MULI()
+{
+  return VMInstr(OpCode::MULI);
+}
+
+
+VMInstr VMInstr::MULD()
+{
+  return VMInstr(OpCode::MULD);
+}
+
+
+VMInstr VMInstr::DIVI()
+{
+  return VMInstr(OpCode::DIVI);
+}
+
+
+VMInstr VMInstr::DIVD()
+{
+  return VMInstr(OpCode::DIVD);
+}
+
+
+VMInstr VMInstr::CMPLTI()
+{
+  return VMInstr(OpCode::CMPLTI);
+}
+
+
+VMInstr VMInstr::CMPLTD()
+{
+  return VMInstr(OpCode::CMPLTD);
+}
+
+
+VMInstr VMInstr::CMPLTS()
+{
+  return VMInstr(OpCode::CMPLTS);
+}
+
+
+VMInstr VMInstr::CMPLEI()
+{
+  return VMInstr(OpCode::CMPLEI);
+}
+
+
+VMInstr VMInstr::CMPLED()
+{
+  return VMInstr(OpCode::CMPLED);
+}
+
+
+VMInstr VMInstr::CMPLES()
+{
+  return VMInstr(OpCode::CMPLES);
+}
+
+
+VMInstr VMInstr::CMPGTI()
+{
+  return VMInstr(OpCode::CMPGTI);
+}
+
+
+VMInstr VMInstr::CMPGTD()
+{
+  return VMInstr(OpCode::CMPGTD);
+}
+
+
+VMInstr VMInstr::CMPGTS()
+{
+  return VMInstr(OpCode::CMPGTS);
+}
+
+
+VMInstr VMInstr::CMPGEI()
+{
+  return VMInstr(OpCode::CMPGEI);
+}
+
+
+VMInstr VMInstr::CMPGED()
+{
+  return VMInstr(OpCode::CMPGED);
+}
+
+
+VMInstr VMInstr::CMPGES()
+{
+  return VMInstr(OpCode::CMPGES);
+}
+
+
+VMInstr VMInstr::CMPEQI()
+{
+  return VMInstr(OpCode::CMPEQI);
+}
+
+
+VMInstr VMInstr::CMPEQD()
+{
+  return VMInstr(OpCode::CMPEQD);
+}
+
+
+VMInstr VMInstr::CMPEQS()
+{
+  return VMInstr(OpCode::CMPEQS);
+}
+
+
+VMInstr VMInstr::CMPNEI()
+{
+  return VMInstr(OpCode::CMPNEI);
+}
+
+
+VMInstr VMInstr::CMPNED()
+{
+  return VMInstr(OpCode::CMPNED);
+}
+
+
+VMInstr VMInstr::CMPNES()
+{
+  return VMInstr(OpCode::CMPNES);
+}
+
+
 VMInstr VMInstr::JMP(int instruction_index)
 {
   return VMInstr(OpCode::JMP, instruction_index);
@@ -232,9 +388,9 @@ VMInstr VMInstr::CONCAT()
 }
 
 
-VMInstr VMInstr::ALLOCS()
+VMInstr VMInstr::ALLOCS(const std::string& struct_name)
 {
-  return VMInstr(OpCode::ALLOCS);  
+  return VMInstr(OpCode::ALLOCS, struct_name);  
 }
 
 
@@ -274,6 +430,120 @@ VMInstr VMInstr::GETI()
 }  
 
 
+VMInstr VMInstr::ALLOCAI()
+{
+  return VMInstr(OpCode::ALLOCAI);
+}
+
+
+VMInstr VMInstr::ALLOCAD()
+{
+  return VMInstr(OpCode::ALLOCAD);
+}
+
+
+VMInstr VMInstr::ALLOCAB()
+{
+  return VMInstr(OpCode::ALLOCAB);
+}
+
+
+VMInstr VMInstr::ALLOCAC()
+{
+  return VMInstr(OpCode::ALLOCAC);
+}
+
+
+VMInstr VMInstr::SETII()
+{
+  return VMInstr(OpCode::SETII);
+}
+
+
+VMInstr VMInstr::SETID()
+{
+  return VMInstr(OpCode::SETID);
+}
+
+
+VMInstr VMInstr::SETIB()
+{
+  return VMInstr(OpCode::SETIB);
+}
+
+
+VMInstr VMInstr::SETIC()
+{
+  return VMInstr(OpCode::SETIC);
+}
+
+
+VMInstr VMInstr::GETII()
+{
+  return VMInstr(OpCode::GETII);
+}
+
+
+VMInstr VMInstr::GETID()
+{
+  return VMInstr(OpCode::GETID);
+}
+
+
+VMInstr VMInstr::GETIB()
+{
+  return VMInstr(OpCode::GETIB);
+}
+
+
+VMInstr VMInstr::GETIC()
+{
+  return VMInstr(OpCode::GETIC);
+}
+
+
+VMInstr VMInstr::INC_LOCAL(int mem_addr)
+{
+  return VMInstr(OpCode::INC_LOCAL, mem_addr);
+}
+
+
+VMInstr VMInstr::CMP_LOCAL_CONST_JMPF(int mem_addr)
+{
+  return VMInstr(OpCode::CMP_LOCAL_CONST_JMPF, mem_addr);
+}
+
+
+VMInstr VMInstr::LOAD_GETI(int mem_addr)
+{
+  return VMInstr(OpCode::LOAD_GETI, mem_addr);
+}
+
+
+VMInstr VMInstr::LOAD_LOAD(int mem_addr)
+{
+  return VMInstr(OpCode::LOAD_LOAD, mem_addr);
+}
+
+
+VMInstr VMInstr::LOAD_PUSH(int mem_addr)
+{
+  return VMInstr(OpCode::LOAD_PUSH, mem_addr);
+}
+
+
+VMInstr VMInstr::LOAD_RET(int mem_addr)
+{
+  return VMInstr(OpCode::LOAD_RET, mem_addr);
+}
+
+
+VMInstr VMInstr::RET_NULL()
+{
+  return VMInstr(OpCode::RET_NULL);
+}
+
+
 VMInstr VMInstr::DUP()
 {
   return VMInstr(OpCode::DUP);      
@@ -286,25 +556,17 @@ VMInstr VMInstr::NOP()
 }
 
 
-string to_string(const VMValue& val) {
-  if (holds_alternative<int>(val))
-    return to_string(get<int>(val));
-  else if (holds_alternative<double>(val))
-    return to_string(get<double>(val));
-  else if (holds_alternative<bool>(val) and get<bool>(val))
-    return "true";
-  else if (holds_alternative<bool>(val) and !get<bool>(val))
-    return "false";
-  else if (holds_alternative<string>(val))
-    return get<string>(val);
-  else
-    return "null";
+VMInstr VMInstr::make(OpCode opcode, const std::optional<VMValue>& operand)
+{
+  if (operand)
+    return VMInstr(opcode, *operand);
+  return VMInstr(opcode);
 }
 
 
-std::string to_string(const VMInstr& instr)
+std::string to_string(OpCode opcode)
 {
-  std::unordered_map<OpCode, string> os = {
+  static const unordered_map<OpCode, string> names = {
     {OpCode::PUSH, "PUSH"}, {OpCode::POP, "POP"},
     {OpCode::LOAD, "LOAD"}, {OpCode::STORE, "STORE"},
     {OpCode::ADD, "ADD"}, {OpCode::SUB, "SUB"},
@@ -314,6 +576,19 @@ std::string to_string(const VMInstr& instr)
     {OpCode::CMPLE, "CMPLE"}, {OpCode::CMPGT, "CMPGT"},
     {OpCode::CMPGE, "CMPGE"}, {OpCode::CMPEQ, "CMPEQ"}, 
     {OpCode::CMPNE, "CMPNE"}, {OpCode::JMP, "JMP"},
+    {OpCode::ADDI, "ADDI"}, {OpCode::ADDD, "ADDD"},
+    {OpCode::SUBI, "SUBI"}, {OpCode::SUBD, "SUBD"},
+    {OpCode::MULI, "MULI"}, {OpCode::MULD, "MULD"},
+    {OpCode::DIVI, "DIVI"}, {OpCode::DIVD, "DIVD"},
+    {OpCode::CMPLTI, "CMPLTI"}, {OpCode::CMPLTD, "CMPLTD"},
+    {OpCode::CMPLTS, "CMPLTS"}, {OpCode::CMPLEI, "CMPLEI"},
+    {OpCode::CMPLED, "CMPLED"}, {OpCode::CMPLES, "CMPLES"},
+    {OpCode::CMPGTI, "CMPGTI"}, {OpCode::CMPGTD, "CMPGTD"},
+    {OpCode::CMPGTS, "CMPGTS"}, {OpCode::CMPGEI, "CMPGEI"},
+    {OpCode::CMPGED, "CMPGED"}, {OpCode::CMPGES, "CMPGES"},
+    {OpCode::CMPEQI, "CMPEQI"}, {OpCode::CMPEQD, "CMPEQD"},
+    {OpCode::CMPEQS, "CMPEQS"}, {OpCode::CMPNEI, "CMPNEI"},
+    {OpCode::CMPNED, "CMPNED"}, {OpCode::CMPNES, "CMPNES"},
     {OpCode::JMPF, "JMPF"}, {OpCode::CALL, "CALL"},
     {OpCode::RET, "RET"}, {OpCode::WRITE, "WRITE"},
     {OpCode::READ, "READ"}, {OpCode::SLEN, "SLEN"},
@@ -323,14 +598,30 @@ std::string to_string(const VMInstr& instr)
     {OpCode::ALLOCS, "ALLOCS"}, {OpCode::ALLOCA, "ALLOCA"},
     {OpCode::ADDF, "ADDF"}, {OpCode::GETF, "GETF"},
     {OpCode::SETF, "SETF"}, {OpCode::GETI, "GETI"},
-    {OpCode::SETI, "SETI"}, {OpCode::DUP, "DUP"},
+    {OpCode::SETI, "SETI"}, {OpCode::ALLOCAI, "ALLOCAI"},
+    {OpCode::ALLOCAD, "ALLOCAD"}, {OpCode::ALLOCAB, "ALLOCAB"},
+    {OpCode::ALLOCAC, "ALLOCAC"}, {OpCode::SETII, "SETII"},
+    {OpCode::SETID, "SETID"}, {OpCode::SETIB, "SETIB"},
+    {OpCode::SETIC, "SETIC"}, {OpCode::GETII, "GETII"},
+    {OpCode::GETID, "GETID"}, {OpCode::GETIB, "GETIB"},
+    {OpCode::GETIC, "GETIC"}, {OpCode::INC_LOCAL, "INC_LOCAL"},
+    {OpCode::CMP_LOCAL_CONST_JMPF, "CMP_LOCAL_CONST_JMPF"},
+    {OpCode::LOAD_GETI, "LOAD_GETI"}, {OpCode::LOAD_LOAD, "LOAD_LOAD"},
+    {OpCode::LOAD_PUSH, "LOAD_PUSH"}, {OpCode::LOAD_RET, "LOAD_RET"},
+    {OpCode::RET_NULL, "RET_NULL"}, {OpCode::DUP, "DUP"},
     {OpCode::NOP, "NOP"}
   };
+  return names.at(opcode);
+}
+
+
+std::string to_string(const VMInstr& instr)
+{
   string vstr = "";
   if (instr.operand().has_value()) {
     vstr = to_string(instr.operand().value());
   }
-  string s = os[instr.opcode()] + "(" + vstr + ")";
+  string s = to_string(instr.opcode()) + "(" + vstr + ")";
   if (instr.instr_comment != "")
     s += "  // " + instr.instr_comment;
   return s;
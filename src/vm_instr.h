@@ -9,17 +9,10 @@
 #ifndef VM_INSTR_H
 #define VM_INSTR_H
 
-#include <variant>
 #include <optional>
 #include <string>
 #include "op_code.h"
-
-
-// vm values are one of int, double, bool, string, or nullptr_t
-typedef std::variant<int, double, bool, std::string, std::nullptr_t> VMValue;
-
-// function to get a string representation of a vm_value
-std::string to_string(const VMValue& val);
+#include "vm_value.h"
 
 
 class VMInstr
@@ -44,6 +37,32 @@ public:
   static VMInstr CMPGE();
   static VMInstr CMPEQ();
   static VMInstr CMPNE();
+  static VMInstr ADDI();
+  static VMInstr ADDD();
+  static VMInstr SUBI();
+  static VMInstr SUBD();
+  static VMInstr MULI();
+  static VMInstr MULD();
+  static VMInstr DIVI();
+  static VMInstr DIVD();
+  static VMInstr CMPLTI();
+  static VMInstr CMPLTD();
+  static VMInstr CMPLTS();
+  static VMInstr CMPLEI();
+  static VMInstr CMPLED();
+  static VMInstr CMPLES();
+  static VMInstr CMPGTI();
+  static VMInstr CMPGTD();
+  static VMInstr CMPGTS();
+  static VMInstr CMPGEI();
+  static VMInstr CMPGED();
+  static VMInstr CMPGES();
+  static VMInstr CMPEQI();
+  static VMInstr CMPEQD();
+  static VMInstr CMPEQS();
+  static VMInstr CMPNEI();
+  static VMInstr CMPNED();
+  static VMInstr CMPNES();
   static VMInstr JMP(int instruction_index);
   static VMInstr JMPF(int instruction_index);
   static VMInstr CALL(const std::string& function);
@@ -57,16 +76,39 @@ public:
   static VMInstr TODBL();  
   static VMInstr TOSTR();
   static VMInstr CONCAT();
-  static VMInstr ALLOCS();
+  static VMInstr ALLOCS(const std::string& struct_name);
   static VMInstr ALLOCA();
   static VMInstr ADDF(const std::string& field);
   static VMInstr SETF(const std::string& field);
   static VMInstr GETF(const std::string& field);
   static VMInstr SETI();
   static VMInstr GETI();  
+  static VMInstr ALLOCAI();
+  static VMInstr ALLOCAD();
+  static VMInstr ALLOCAB();
+  static VMInstr ALLOCAC();
+  static VMInstr SETII();
+  static VMInstr SETID();
+  static VMInstr SETIB();
+  static VMInstr SETIC();
+  static VMInstr GETII();
+  static VMInstr GETID();
+  static VMInstr GETIB();
+  static VMInstr GETIC();
+  static VMInstr INC_LOCAL(int mem_addr);
+  static VMInstr CMP_LOCAL_CONST_JMPF(int mem_addr);
+  static VMInstr LOAD_GETI(int mem_addr);
+  static VMInstr LOAD_LOAD(int mem_addr);
+  static VMInstr LOAD_PUSH(int mem_addr);
+  static VMInstr LOAD_RET(int mem_addr);
+  static VMInstr RET_NULL();
   static VMInstr DUP();
   static VMInstr NOP();
 
+  // an instruction with any opcode and (optional) operand, e.g., one
+  // read back from saved bytecode
+  static VMInstr make(OpCode opcode, const std::optional<VMValue>& operand);
+
   // set the instruction's comment (optional)
   void set_comment(const std::string& comment);
 
@@ -77,7 +119,7 @@ public:
   OpCode opcode() const;
 
   // returns the operand for those instructions with operands
-  std::optional<VMValue> operand() const;
+  const std::optional<VMValue>& operand() const;
 
   // set the operand value
   void set_operand(VMValue value);
@@ -105,4 +147,8 @@ private:
 };
 
 
+// the name of an opcode
+std::string to_string(OpCode opcode);
+
+
 #endif
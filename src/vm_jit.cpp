@@ -0,0 +1,882 @@
+//----------------------------------------------------------------------
+// FILE: vm_jit.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Baseline template compiler from MyPL VM code to x86-64
+//----------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <map>
+#include "vm_jit.h"
+#include "vm_heap.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define MYPL_JIT 1
+#else
+#define MYPL_JIT 0
+#endif
+
+
+using namespace std;
+
+
+bool VMJit::available()
+{
+  return MYPL_JIT;
+}
+
+
+VMJit::~VMJit()
+{
+  clear();
+}
+
+
+void VMJit::clear()
+{
+#if MYPL_JIT
+  for (auto [code, size] : regions)
+    munmap(code, size);
+#endif
+  regions.clear();
+}
+
+
+size_t VMJit::code_size() const
+{
+  size_t size = 0;
+  for (auto [code, region_size] : regions)
+    size += region_size;
+  return size;
+}
+
+
+#if !MYPL_JIT
+
+VMNativeCode VMJit::compile(const VMFrameInfo& frame, const Runtime& runtime)
+{
+  return nullptr;
+}
+
+#else
+
+namespace {
+
+  //--------------------------------------------------------------------
+  // x86-64 encoding
+  //--------------------------------------------------------------------
+
+  enum Reg {RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+            R8, R9, R10, R11, R12, R13, R14, R15};
+
+  // condition codes (for jcc and setcc)
+  enum Cond {O = 0x0, B = 0x2, AE = 0x3, E = 0x4, NE = 0x5, BE = 0x6,
+             A = 0x7, P = 0xA, NP = 0xB, L = 0xC, GE = 0xD, LE = 0xE,
+             G = 0xF};
+
+  // a memory operand: [base + index * scale + disp]
+  struct Mem {
+    Reg base;
+    int32_t disp = 0;
+    int index = -1;
+    int scale = 1;
+    Mem operator+(int32_t offset) const
+      {Mem m = *this; m.disp += offset; return m;}
+  };
+
+  // a code position jumps can target before it is known
+  struct Label {
+    long pos = -1;
+    vector<size_t> fixups;
+  };
+
+  class Assembler
+  {
+  public:
+
+    vector<uint8_t> code;
+
+    size_t size() const {return code.size();}
+
+    void u8(uint8_t x) {code.push_back(x);}
+
+    void u32(uint32_t x)
+    {
+      for (int i = 0; i < 4; ++i)
+        u8(x >> (8 * i));
+    }
+
+    void u64(uint64_t x)
+    {
+      for (int i = 0; i < 8; ++i)
+        u8(x >> (8 * i));
+    }
+
+    // an instruction with a memory operand (and a register, or an
+    // opcode extension, in the reg field): [prefix] [REX] opcode ModRM
+    // [SIB] disp32
+    void op(initializer_list<uint8_t> opcode, int reg, Mem m,
+            bool wide = false, uint8_t prefix = 0)
+    {
+      if (prefix)
+        u8(prefix);
+      int index = m.index < 0 ? 0 : m.index;
+      uint8_t rex = 0x40 | (wide << 3) | ((reg >> 3) << 2) |
+        ((index >> 3) << 1) | (m.base >> 3);
+      if (rex != 0x40)
+        u8(rex);
+      for (uint8_t byte : opcode)
+        u8(byte);
+      // (always a 32-bit displacement, which also covers rbp and r13)
+      if (m.index >= 0 or (m.base & 7) == RSP) {
+        u8(0x80 | ((reg & 7) << 3) | 4);
+        int scale_bits = m.scale == 8 ? 3 : m.scale == 4 ? 2 :
+          m.scale == 2 ? 1 : 0;
+        int index_bits = m.index >= 0 ? (m.index & 7) : 4;
+        u8((scale_bits << 6) | (index_bits << 3) | (m.base & 7));
+      } else
+        u8(0x80 | ((reg & 7) << 3) | (m.base & 7));
+      u32(m.disp);
+    }
+
+    // an instruction with two register operands (reg and rm)
+    void op_rr(initializer_list<uint8_t> opcode, int reg, int rm,
+               bool wide = false, uint8_t prefix = 0)
+    {
+      if (prefix)
+        u8(prefix);
+      uint8_t rex = 0x40 | (wide << 3) | ((reg >> 3) << 2) | (rm >> 3);
+      if (rex != 0x40)
+        u8(rex);
+      for (uint8_t byte : opcode)
+        u8(byte);
+      u8(0xC0 | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    // moves
+    void mov(Reg r, Mem m) {op({0x8B}, r, m, true);}           // r64 <- m
+    void mov(Mem m, Reg r) {op({0x89}, r, m, true);}           // m <- r64
+    void mov32(Reg r, Mem m) {op({0x8B}, r, m);}
+    void mov32(Mem m, Reg r) {op({0x89}, r, m);}
+    void mov8(Mem m, Reg r) {op({0x88}, r, m);}                 // al..bl
+    void mov8(Reg r, Mem m) {op({0x8A}, r, m);}
+    void movzx8(Reg r, Mem m) {op({0x0F, 0xB6}, r, m);}
+    void mov8(Mem m, uint8_t x) {op({0xC6}, 0, m); u8(x);}
+    void mov32(Mem m, uint32_t x) {op({0xC7}, 0, m); u32(x);}
+    void movsxd(Reg r, Mem m) {op({0x63}, r, m, true);}
+    void lea(Reg r, Mem m) {op({0x8D}, r, m, true);}
+    void mov(Reg r, Reg from) {op_rr({0x89}, from, r, true);}
+
+    void mov_imm(Reg r, uint64_t x)
+    {
+      u8(0x48 | (r >> 3));
+      u8(0xB8 | (r & 7));
+      u64(x);
+    }
+
+    void mov32_imm(Reg r, uint32_t x)
+    {
+      if (r >> 3)
+        u8(0x41);
+      u8(0xB8 | (r & 7));
+      u32(x);
+    }
+
+    // 16 byte (value) copies through xmm0
+    void movups(int xmm, Mem m) {op({0x0F, 0x10}, xmm, m);}
+    void movups(Mem m, int xmm) {op({0x0F, 0x11}, xmm, m);}
+    void movsd(int xmm, Mem m) {op({0x0F, 0x10}, xmm, m, false, 0xF2);}
+    void movsd(Mem m, int xmm) {op({0x0F, 0x11}, xmm, m, false, 0xF2);}
+
+    // arithmetic and comparisons
+    void add64(Reg r, int32_t x) {op_rr({0x81}, 0, r, true); u32(x);}
+    void sub64(Reg r, int32_t x) {op_rr({0x81}, 5, r, true); u32(x);}
+    void cmp8(Mem m, uint8_t x) {op({0x80}, 7, m); u8(x);}
+    void cmp8(Reg r, Mem m) {op({0x3A}, r, m);}
+    void cmp32(Reg r, Mem m) {op({0x3B}, r, m);}
+    void cmp32(Reg r, int32_t x) {op_rr({0x81}, 7, r); u32(x);}
+    void cmp32(Reg r, Reg other) {op_rr({0x39}, other, r);}
+    void cmp64(Reg r, Mem m) {op({0x3B}, r, m, true);}
+    void test32(Reg r, Reg other) {op_rr({0x85}, other, r);}
+    void test64(Reg r, Reg other) {op_rr({0x85}, other, r, true);}
+    void setcc(Cond c, Reg r) {op_rr({0x0F, uint8_t(0x90 | c)}, 0, r);}
+    void and8(Reg r, Reg other) {op_rr({0x20}, other, r);}
+    void or8(Reg r, Reg other) {op_rr({0x08}, other, r);}
+    void and8(Mem m, Reg r) {op({0x20}, r, m);}
+    void or8(Mem m, Reg r) {op({0x08}, r, m);}
+    void xor8(Reg r, uint8_t x) {op_rr({0x80}, 6, r); u8(x);}
+    void xor8(Mem m, uint8_t x) {op({0x80}, 6, m); u8(x);}
+    void inc32(Mem m) {op({0xFF}, 0, m);}
+    void dec32(Mem m) {op({0xFF}, 1, m);}
+    void cdq() {u8(0x99);}
+    void idiv32(Reg r) {op_rr({0xF7}, 7, r);}
+    void bt(Mem m, Reg bit) {op({0x0F, 0xA3}, bit, m);}
+    void bts(Mem m, Reg bit) {op({0x0F, 0xAB}, bit, m);}
+
+    // binary int (add, sub, imul) and double (addsd, ...) operations
+    // with a memory source
+    void int_op(OpCode op_code, Reg r, Mem m)
+    {
+      if (op_code == OpCode::MULI or op_code == OpCode::MUL)
+        op({0x0F, 0xAF}, r, m);
+      else if (op_code == OpCode::SUBI or op_code == OpCode::SUB)
+        op({0x2B}, r, m);
+      else
+        op({0x03}, r, m);
+    }
+
+    void double_op(uint8_t opcode, int xmm, Mem m)
+    {
+      op({0x0F, opcode}, xmm, m, false, 0xF2);
+    }
+
+    void ucomisd(int xmm, int other) {op_rr({0x0F, 0x2E}, xmm, other, false, 0x66);}
+
+    // control flow
+    void push(Reg r) {if (r >> 3) u8(0x41); u8(0x50 | (r & 7));}
+    void pop(Reg r) {if (r >> 3) u8(0x41); u8(0x58 | (r & 7));}
+    void ret() {u8(0xC3);}
+    void call(Reg r) {op_rr({0xFF}, 2, r);}
+
+    void call(const void* target)
+    {
+      mov_imm(RAX, reinterpret_cast<uint64_t>(target));
+      call(RAX);
+    }
+
+    void jmp(Label& label) {u8(0xE9); rel32(label);}
+    void jcc(Cond c, Label& label) {u8(0x0F); u8(0x80 | c); rel32(label);}
+
+    void bind(Label& label)
+    {
+      label.pos = size();
+      for (size_t at : label.fixups)
+        patch(at, label.pos);
+      label.fixups.clear();
+    }
+
+    // patch a rel32 at the offset to reach the position
+    void patch(size_t at, long pos)
+    {
+      int32_t rel = pos - long(at + 4);
+      memcpy(&code[at], &rel, 4);
+    }
+
+  private:
+
+    void rel32(Label& label)
+    {
+      if (label.pos >= 0) {
+        u32(0);
+        patch(size() - 4, label.pos);
+      } else {
+        label.fixups.push_back(size());
+        u32(0);
+      }
+    }
+
+  };
+
+
+  //--------------------------------------------------------------------
+  // Templates
+  //--------------------------------------------------------------------
+
+  // value layout: the tag byte, then the 8 byte payload
+  const int TAG = 0;
+  const int PAYLOAD = 8;
+  const int VALUE = sizeof(VMValue);
+
+  uint8_t tag(VMValue::Tag t) {return static_cast<uint8_t>(t);}
+
+  const uint8_t NULL_TAG = tag(VMValue::Tag::NULL_VAL);
+  const uint8_t INT_TAG = tag(VMValue::Tag::INT);
+  const uint8_t DOUBLE_TAG = tag(VMValue::Tag::DOUBLE);
+  const uint8_t BOOL_TAG = tag(VMValue::Tag::BOOL);
+  const uint8_t STRING_TAG = tag(VMValue::Tag::STRING);
+  const uint8_t REF_TAG = tag(VMValue::Tag::REF);
+
+  // the offset of a string's reference count
+  int refs_offset()
+  {
+    static VMString probe("");
+    return reinterpret_cast<char*>(&probe.refs) -
+      reinterpret_cast<char*>(&probe);
+  }
+
+  // the string data held by a string value
+  VMString* string_of(const VMValue& x)
+  {
+    VMString* s;
+    memcpy(&s, reinterpret_cast<const char*>(&x) + PAYLOAD, sizeof(s));
+    return s;
+  }
+
+  void destroy_string(VMString* s) noexcept
+  {
+    VMString::destroy(s);
+  }
+
+  // compiles one function: rbx holds the frame's variables, r12 its
+  // stack pointer, and r13 the frame
+  class Compiler
+  {
+  public:
+
+    Compiler(const VMFrameInfo& frame, const VMJit::Runtime& runtime)
+      : frame(frame), runtime(runtime), labels(frame.instructions.size() + 1) {}
+
+    // generate the code, returning the offset of the jump table
+    size_t generate();
+
+    vector<uint8_t>& code() {return a.code;}
+
+    // each instruction's offset in the code (and the end's)
+    vector<long> entries() const
+    {
+      vector<long> offsets;
+      for (const Label& label : labels)
+        offsets.push_back(label.pos);
+      return offsets;
+    }
+
+  private:
+
+    const VMFrameInfo& frame;
+    const VMJit::Runtime& runtime;
+    Assembler a;
+    vector<Label> labels;
+    // the exits to the interpreter, by pc
+    map<int, Label> exits;
+    Label leave;
+    Label returned;
+
+    const Mem top {R12, -VALUE};
+    const Mem second {R12, -2 * VALUE};
+    const Mem third {R12, -3 * VALUE};
+    const Mem next {R12, 0};
+
+    Mem variable(int index) const {return Mem {RBX, index * VALUE};}
+
+    // a jump to leave the function to the interpreter at the pc
+    Label& exit(int pc) {return exits[pc];}
+
+    // helper to leave the function unless the value has the tag
+    void guard(Mem value, uint8_t t, int pc)
+    {
+      a.cmp8(value + TAG, t);
+      a.jcc(NE, exit(pc));
+    }
+
+    // helper to release the string a slot about to be overwritten holds
+    void release(Mem slot)
+    {
+      Label done;
+      a.cmp8(slot + TAG, STRING_TAG);
+      a.jcc(NE, done);
+      a.mov(RDI, slot + PAYLOAD);
+      a.dec32(Mem {RDI, refs_offset()});
+      a.jcc(NE, done);
+      a.call(reinterpret_cast<const void*>(&destroy_string));
+      a.bind(done);
+    }
+
+    // helper to take a reference to the string a slot was copied into
+    void retain(Mem slot)
+    {
+      Label done;
+      a.cmp8(slot + TAG, STRING_TAG);
+      a.jcc(NE, done);
+      a.mov(RAX, slot + PAYLOAD);
+      a.inc32(Mem {RAX, refs_offset()});
+      a.bind(done);
+    }
+
+    void copy(Mem to, Mem from)
+    {
+      a.movups(0, from);
+      a.movups(to, 0);
+    }
+
+    void load(int index)
+    {
+      release(next);
+      copy(next, variable(index));
+      retain(next);
+      a.add64(R12, VALUE);
+    }
+
+    void push(const VMValue& x);
+    void int_arithmetic(OpCode op, int pc);
+    void double_arithmetic(OpCode op, int pc);
+    void int_compare(Cond c, int pc);
+    void double_compare(OpCode op, int pc);
+    void equality(bool equal, int pc);
+    void array_get(bool doubles, int pc);
+    void array_set(bool doubles, int pc);
+    void instruction(const VMInstr& instr, int pc);
+
+  };
+
+
+  void Compiler::push(const VMValue& x)
+  {
+    release(next);
+    if (x.is_int())
+      a.mov32(next + PAYLOAD, uint32_t(x.int_unchecked()));
+    else if (x.is_double()) {
+      double d = x.double_unchecked();
+      uint64_t bits;
+      memcpy(&bits, &d, sizeof(bits));
+      a.mov_imm(RAX, bits);
+      a.mov(next + PAYLOAD, RAX);
+    } else if (x.is_bool())
+      a.mov8(next + PAYLOAD, uint8_t(x.as_bool()));
+    else if (x.is_string()) {
+      // (the instruction's operand keeps the literal alive)
+      a.mov_imm(RAX, reinterpret_cast<uint64_t>(string_of(x)));
+      a.inc32(Mem {RAX, refs_offset()});
+      a.mov(next + PAYLOAD, RAX);
+    }
+    a.mov8(next + TAG, tag(x.type()));
+    a.add64(R12, VALUE);
+  }
+
+
+  void Compiler::int_arithmetic(OpCode op, int pc)
+  {
+    guard(top, INT_TAG, pc);
+    guard(second, INT_TAG, pc);
+    if (op == OpCode::DIVI or op == OpCode::DIV) {
+      // (division by zero, and INT_MIN / -1, are left to the
+      // interpreter)
+      a.mov32(RCX, top + PAYLOAD);
+      a.cmp32(RCX, 0);
+      a.jcc(E, exit(pc));
+      a.cmp32(RCX, -1);
+      a.jcc(E, exit(pc));
+      a.mov32(RAX, second + PAYLOAD);
+      a.cdq();
+      a.idiv32(RCX);
+    } else {
+      a.mov32(RAX, second + PAYLOAD);
+      a.int_op(op, RAX, top + PAYLOAD);
+    }
+    a.mov32(second + PAYLOAD, RAX);
+    a.sub64(R12, VALUE);
+  }
+
+
+  void Compiler::double_arithmetic(OpCode op, int pc)
+  {
+    guard(top, DOUBLE_TAG, pc);
+    guard(second, DOUBLE_TAG, pc);
+    uint8_t opcode = op == OpCode::ADDD ? 0x58 : op == OpCode::SUBD ? 0x5C :
+      op == OpCode::MULD ? 0x59 : 0x5E;
+    a.movsd(0, second + PAYLOAD);
+    a.double_op(opcode, 0, top + PAYLOAD);
+    a.movsd(second + PAYLOAD, 0);
+    a.sub64(R12, VALUE);
+  }
+
+
+  void Compiler::int_compare(Cond c, int pc)
+  {
+    guard(top, INT_TAG, pc);
+    guard(second, INT_TAG, pc);
+    a.mov32(RAX, second + PAYLOAD);
+    a.cmp32(RAX, top + PAYLOAD);
+    a.setcc(c, RAX);
+    a.mov8(second + PAYLOAD, RAX);
+    a.mov8(second + TAG, BOOL_TAG);
+    a.sub64(R12, VALUE);
+  }
+
+
+  void Compiler::double_compare(OpCode op, int pc)
+  {
+    guard(top, DOUBLE_TAG, pc);
+    guard(second, DOUBLE_TAG, pc);
+    a.movsd(0, second + PAYLOAD);
+    a.movsd(1, top + PAYLOAD);
+    // (unordered comparisons set CF, so A and AE are false for NaNs,
+    // as in C++)
+    bool less = op == OpCode::CMPLTD or op == OpCode::CMPLED;
+    bool strict = op == OpCode::CMPLTD or op == OpCode::CMPGTD;
+    if (less)
+      a.ucomisd(1, 0);
+    else
+      a.ucomisd(0, 1);
+    a.setcc(strict ? A : AE, RAX);
+    a.mov8(second + PAYLOAD, RAX);
+    a.mov8(second + TAG, BOOL_TAG);
+    a.sub64(R12, VALUE);
+  }
+
+
+  void Compiler::equality(bool equal, int pc)
+  {
+    // nulls are only equal to nulls, and otherwise ints, bools, object
+    // references, and doubles of the same type are compared (anything
+    // else is left to the interpreter)
+    Label not_int, not_bool, not_ref, nulls, done;
+    a.movzx8(RAX, second + TAG);
+    a.movzx8(RCX, top + TAG);
+    a.test32(RAX, RAX);
+    a.jcc(E, nulls);
+    a.test32(RCX, RCX);
+    a.jcc(E, nulls);
+    a.cmp32(RAX, RCX);
+    a.jcc(NE, exit(pc));
+    a.cmp32(RAX, INT_TAG);
+    a.jcc(NE, not_int);
+    a.mov32(RDX, second + PAYLOAD);
+    a.cmp32(RDX, top + PAYLOAD);
+    a.setcc(E, RDX);
+    a.jmp(done);
+    a.bind(not_int);
+    a.cmp32(RAX, BOOL_TAG);
+    a.jcc(NE, not_bool);
+    a.mov8(RDX, second + PAYLOAD);
+    a.cmp8(RDX, top + PAYLOAD);
+    a.setcc(E, RDX);
+    a.jmp(done);
+    a.bind(not_bool);
+    a.cmp32(RAX, REF_TAG);
+    a.jcc(NE, not_ref);
+    a.mov(RDX, second + PAYLOAD);
+    a.cmp64(RDX, top + PAYLOAD);
+    a.setcc(E, RDX);
+    a.jmp(done);
+    a.bind(not_ref);
+    a.cmp32(RAX, DOUBLE_TAG);
+    a.jcc(NE, exit(pc));
+    a.movsd(0, second + PAYLOAD);
+    a.movsd(1, top + PAYLOAD);
+    a.ucomisd(0, 1);
+    a.setcc(E, RDX);
+    a.setcc(NP, RCX);
+    a.and8(RDX, RCX);
+    a.jmp(done);
+    a.bind(nulls);
+    a.cmp32(RAX, RCX);
+    a.setcc(E, RDX);
+    a.bind(done);
+    if (!equal)
+      a.xor8(RDX, 1);
+    a.mov8(second + PAYLOAD, RDX);
+    a.mov8(second + TAG, BOOL_TAG);
+    a.sub64(R12, VALUE);
+  }
+
+
+  void Compiler::array_get(bool doubles, int pc)
+  {
+    // the array (second) and index (top) are checked as the interpreter
+    // would, then the element (or null, if it is not set) replaces the
+    // array
+    Label unset, done;
+    guard(top, INT_TAG, pc);
+    guard(second, REF_TAG, pc);
+    a.mov(RDX, second + PAYLOAD);
+    a.cmp8(Mem {RDX, int32_t(offsetof(VMObject, kind))},
+           uint8_t(doubles ? VMObject::Kind::DOUBLE_ARRAY
+                           : VMObject::Kind::INT_ARRAY));
+    a.jcc(NE, exit(pc));
+    a.mov32(RCX, top + PAYLOAD);
+    a.cmp32(RCX, Mem {RDX, int32_t(offsetof(VMObject, size))});
+    a.jcc(AE, exit(pc));
+    // (the set bitmap follows the elements)
+    a.movsxd(RAX, Mem {RDX, int32_t(offsetof(VMObject, size))});
+    int scale = doubles ? 8 : 4;
+    a.lea(RSI, Mem {RDX, int32_t(sizeof(VMObject)), RAX, scale});
+    a.bt(Mem {RSI}, RCX);
+    a.jcc(AE, unset);
+    Mem element {RDX, int32_t(sizeof(VMObject)), RCX, scale};
+    if (doubles) {
+      a.movsd(0, element);
+      a.movsd(second + PAYLOAD, 0);
+      a.mov8(second + TAG, DOUBLE_TAG);
+    } else {
+      a.mov32(RAX, element);
+      a.mov32(second + PAYLOAD, RAX);
+      a.mov8(second + TAG, INT_TAG);
+    }
+    a.jmp(done);
+    a.bind(unset);
+    a.mov8(second + TAG, NULL_TAG);
+    a.bind(done);
+    a.sub64(R12, VALUE);
+  }
+
+
+  void Compiler::array_set(bool doubles, int pc)
+  {
+    // the array (third), index (second), and value (top)
+    guard(top, doubles ? DOUBLE_TAG : INT_TAG, pc);
+    guard(second, INT_TAG, pc);
+    guard(third, REF_TAG, pc);
+    a.mov(RDX, third + PAYLOAD);
+    a.cmp8(Mem {RDX, int32_t(offsetof(VMObject, kind))},
+           uint8_t(doubles ? VMObject::Kind::DOUBLE_ARRAY
+                           : VMObject::Kind::INT_ARRAY));
+    a.jcc(NE, exit(pc));
+    a.mov32(RCX, second + PAYLOAD);
+    a.cmp32(RCX, Mem {RDX, int32_t(offsetof(VMObject, size))});
+    a.jcc(AE, exit(pc));
+    int scale = doubles ? 8 : 4;
+    Mem element {RDX, int32_t(sizeof(VMObject)), RCX, scale};
+    // (typed arrays hold no references, so need no write barrier)
+    if (doubles) {
+      a.movsd(0, top + PAYLOAD);
+      a.movsd(element, 0);
+    } else {
+      a.mov32(RAX, top + PAYLOAD);
+      a.mov32(element, RAX);
+    }
+    a.movsxd(RAX, Mem {RDX, int32_t(offsetof(VMObject, size))});
+    a.lea(RSI, Mem {RDX, int32_t(sizeof(VMObject)), RAX, scale});
+    a.bts(Mem {RSI}, RCX);
+    a.sub64(R12, 3 * VALUE);
+  }
+
+
+  void Compiler::instruction(const VMInstr& instr, int pc)
+  {
+    auto operand = [&]() {return instr.operand()->int_unchecked();};
+    switch (instr.opcode()) {
+      case OpCode::PUSH:
+        push(*instr.operand());
+        break;
+      case OpCode::RET_NULL:
+        // (PUSH(null) followed by the RET at pc + 1)
+        push(nullptr);
+        break;
+      case OpCode::POP:
+        a.sub64(R12, VALUE);
+        break;
+      case OpCode::LOAD:
+      // (each superinstruction starts with its LOAD, followed by the
+      // rest of the instructions it replaces)
+      case OpCode::INC_LOCAL: case OpCode::CMP_LOCAL_CONST_JMPF:
+      case OpCode::LOAD_GETI: case OpCode::LOAD_LOAD:
+      case OpCode::LOAD_PUSH: case OpCode::LOAD_RET:
+        load(operand());
+        break;
+      case OpCode::STORE: {
+        // (storing null is an error)
+        a.cmp8(top + TAG, NULL_TAG);
+        a.jcc(E, exit(pc));
+        Mem to = variable(operand());
+        release(to);
+        copy(to, top);
+        // (the value is moved, leaving null behind)
+        a.mov8(top + TAG, NULL_TAG);
+        a.sub64(R12, VALUE);
+        break;
+      }
+      case OpCode::DUP:
+        release(next);
+        copy(next, top);
+        retain(next);
+        a.add64(R12, VALUE);
+        break;
+      case OpCode::ADD: case OpCode::SUB: case OpCode::MUL:
+      case OpCode::DIV: case OpCode::ADDI: case OpCode::SUBI:
+      case OpCode::MULI: case OpCode::DIVI:
+        int_arithmetic(instr.opcode(), pc);
+        break;
+      case OpCode::ADDD: case OpCode::SUBD: case OpCode::MULD:
+      case OpCode::DIVD:
+        double_arithmetic(instr.opcode(), pc);
+        break;
+      case OpCode::CMPLT: case OpCode::CMPLTI:
+        int_compare(L, pc);
+        break;
+      case OpCode::CMPLE: case OpCode::CMPLEI:
+        int_compare(LE, pc);
+        break;
+      case OpCode::CMPGT: case OpCode::CMPGTI:
+        int_compare(G, pc);
+        break;
+      case OpCode::CMPGE: case OpCode::CMPGEI:
+        int_compare(GE, pc);
+        break;
+      case OpCode::CMPLTD: case OpCode::CMPLED: case OpCode::CMPGTD:
+      case OpCode::CMPGED:
+        double_compare(instr.opcode(), pc);
+        break;
+      case OpCode::CMPEQ: case OpCode::CMPEQI: case OpCode::CMPEQD:
+        equality(true, pc);
+        break;
+      case OpCode::CMPNE: case OpCode::CMPNEI: case OpCode::CMPNED:
+        equality(false, pc);
+        break;
+      case OpCode::NOT:
+        guard(top, BOOL_TAG, pc);
+        a.xor8(top + PAYLOAD, 1);
+        break;
+      case OpCode::AND: case OpCode::OR:
+        guard(top, BOOL_TAG, pc);
+        guard(second, BOOL_TAG, pc);
+        a.mov8(RAX, top + PAYLOAD);
+        if (instr.opcode() == OpCode::AND)
+          a.and8(second + PAYLOAD, RAX);
+        else
+          a.or8(second + PAYLOAD, RAX);
+        a.sub64(R12, VALUE);
+        break;
+      case OpCode::JMP:
+        a.jmp(operand() < labels.size() ? labels[operand()] : exit(operand()));
+        break;
+      case OpCode::JMPF: {
+        guard(top, BOOL_TAG, pc);
+        a.sub64(R12, VALUE);
+        a.cmp8(next + PAYLOAD, 0);
+        a.jcc(E, operand() < labels.size() ? labels[operand()]
+                                           : exit(operand()));
+        break;
+      }
+      case OpCode::CALL: {
+        // the callee runs (compiled or not) before the code goes on
+        // after the call, unless it leaves the rest to the interpreter
+        Label called;
+        a.mov(Mem {R13, int32_t(offsetof(VMFrame, sp))}, R12);
+        a.mov_imm(RDI, reinterpret_cast<uint64_t>(runtime.vm));
+        a.mov(RSI, R13);
+        a.mov32_imm(RDX, operand());
+        a.call(reinterpret_cast<const void*>(runtime.call));
+        a.mov(R12, Mem {R13, int32_t(offsetof(VMFrame, sp))});
+        a.cmp32(RAX, VMJit::RETURNED);
+        a.jcc(E, called);
+        a.cmp32(RAX, VMJit::NOT_CALLED);
+        a.jcc(E, exit(pc));
+        a.jmp(exit(pc + 1));
+        a.bind(called);
+        break;
+      }
+      case OpCode::RET:
+        a.mov(Mem {R13, int32_t(offsetof(VMFrame, sp))}, R12);
+        a.mov_imm(RDI, reinterpret_cast<uint64_t>(runtime.vm));
+        a.mov(RSI, R13);
+        a.call(reinterpret_cast<const void*>(runtime.ret));
+        a.cmp32(RAX, VMJit::RETURNED);
+        a.jcc(NE, exit(pc));
+        a.jmp(returned);
+        break;
+      case OpCode::GETII: case OpCode::GETID:
+        array_get(instr.opcode() == OpCode::GETID, pc);
+        break;
+      case OpCode::SETII: case OpCode::SETID:
+        array_set(instr.opcode() == OpCode::SETID, pc);
+        break;
+      case OpCode::NOP:
+        break;
+      default:
+        // everything else is left to the interpreter
+        a.jmp(exit(pc));
+    }
+  }
+
+
+  size_t Compiler::generate()
+  {
+    const vector<VMInstr>& instrs = frame.instructions;
+    // prologue: save the registers the code uses (leaving the stack
+    // 16 byte aligned for calls), load the frame, and jump to the
+    // instruction at its pc
+    a.push(RBX);
+    a.push(R12);
+    a.push(R13);
+    a.mov(R13, RDI);
+    a.mov(RBX, Mem {RDI, int32_t(offsetof(VMFrame, variables))});
+    a.mov(R12, Mem {RDI, int32_t(offsetof(VMFrame, sp))});
+    a.movsxd(RAX, Mem {RDI, int32_t(offsetof(VMFrame, pc))});
+    // lea rcx, [rip + table]
+    a.u8(0x48);
+    a.u8(0x8D);
+    a.u8(0x0D);
+    size_t table_fixup = a.size();
+    a.u32(0);
+    // jmp [rcx + rax * 8]
+    a.u8(0xFF);
+    a.u8(0x24);
+    a.u8(0xC1);
+
+    for (int pc = 0; pc < instrs.size(); ++pc) {
+      a.bind(labels[pc]);
+      instruction(instrs[pc], pc);
+    }
+    // just past the last instruction (where checked code that runs off
+    // the end, or that ends with a call and is returned to, goes on),
+    // leaving the rest to the interpreter
+    a.bind(labels[instrs.size()]);
+    a.jmp(exit(instrs.size()));
+
+    // leaving the function to the interpreter at a pc
+    for (auto& [pc, label] : exits) {
+      a.bind(label);
+      a.mov32_imm(RAX, pc);
+      a.jmp(leave);
+    }
+    a.bind(leave);
+    a.mov32(Mem {R13, int32_t(offsetof(VMFrame, pc))}, RAX);
+    a.mov(Mem {R13, int32_t(offsetof(VMFrame, sp))}, R12);
+    a.mov32_imm(RAX, VMJit::LEFT);
+    a.pop(R13);
+    a.pop(R12);
+    a.pop(RBX);
+    a.ret();
+    a.bind(returned);
+    a.mov32_imm(RAX, VMJit::RETURNED);
+    a.pop(R13);
+    a.pop(R12);
+    a.pop(RBX);
+    a.ret();
+
+    // the jump table (filled with absolute addresses once the code is
+    // in place)
+    while (a.size() % 8)
+      a.u8(0xCC);
+    size_t table = a.size();
+    a.patch(table_fixup, table);
+    for (int pc = 0; pc <= instrs.size(); ++pc)
+      a.u64(0);
+    return table;
+  }
+
+}
+
+
+VMNativeCode VMJit::compile(const VMFrameInfo& frame, const Runtime& runtime)
+{
+  if (frame.instructions.empty())
+    return nullptr;
+  Compiler compiler(frame, runtime);
+  size_t table = compiler.generate();
+  vector<uint8_t>& code = compiler.code();
+  size_t size = code.size();
+  void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED)
+    return nullptr;
+  uint8_t* base = static_cast<uint8_t*>(memory);
+  vector<long> entries = compiler.entries();
+  for (int pc = 0; pc < entries.size(); ++pc) {
+    uint64_t address = reinterpret_cast<uint64_t>(base + entries[pc]);
+    memcpy(&code[table + 8 * pc], &address, 8);
+  }
+  memcpy(base, code.data(), size);
+  // (never writable and executable at once)
+  if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory, size);
+    return nullptr;
+  }
+  regions.emplace_back(memory, size);
+  return reinterpret_cast<VMNativeCode>(memory);
+}
+
+#endif
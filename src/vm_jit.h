@@ -0,0 +1,78 @@
+//----------------------------------------------------------------------
+// FILE: vm_jit.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Baseline template compiler from MyPL VM code to x86-64
+//----------------------------------------------------------------------
+
+#ifndef VM_JIT_H
+#define VM_JIT_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "vm_frame.h"
+
+
+// Compiles a linked function one instruction at a time into x86-64
+// machine code (in mapped executable memory) that works on the same
+// frame and value stack as VM::run, so the vm can move between the
+// two at any instruction. The code checks every assumption it makes
+// (operand types, nulls, array bounds, division by zero or -1), and
+// leaves the function to the interpreter at the instruction where one
+// fails, or at an instruction it does not compile (e.g., WRITE or
+// CONCAT), by storing the frame's pc and sp and returning
+// VMJit::LEFT. Calls and returns go through the vm's (non-throwing)
+// run-time helpers, so errors are only ever reported by the
+// interpreter. Only available on x86-64 Linux.
+class VMJit
+{
+public:
+
+  // what compiled code returns: RETURNED if the function returned
+  // (its frame was popped and its result pushed on its caller's
+  // operand stack), LEFT if the interpreter is to go on from the
+  // frame's pc
+  static const int RETURNED = 0;
+  static const int LEFT = 1;
+
+  // the vm's run-time helpers called by compiled code
+  struct Runtime {
+    void* vm;
+    // push a frame for the function at the index and run it (returns
+    // RETURNED, LEFT, or NOT_CALLED if the interpreter is to make the
+    // call instead)
+    int (*call)(void* vm, VMFrame* caller, int index);
+    // pop the returning frame and push its result on its caller's
+    // operand stack (returns LEFT if the interpreter is to do it)
+    int (*ret)(void* vm, VMFrame* frame);
+  };
+  static const int NOT_CALLED = 2;
+
+  VMJit() = default;
+  VMJit(const VMJit&) = delete;
+  VMJit& operator=(const VMJit&) = delete;
+  ~VMJit();
+
+  // true if this build can generate machine code
+  static bool available();
+
+  // compile a linked function (null if it cannot be compiled)
+  VMNativeCode compile(const VMFrameInfo& frame, const Runtime& runtime);
+
+  // free all the compiled code
+  void clear();
+
+  // the number of functions compiled and the bytes of code generated
+  int compiled_count() const {return regions.size();}
+  std::size_t code_size() const;
+
+private:
+
+  // the mapped memory holding each compiled function
+  std::vector<std::pair<void*, std::size_t>> regions;
+
+};
+
+
+#endif
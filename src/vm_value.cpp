@@ -0,0 +1,121 @@
+//----------------------------------------------------------------------
+// FILE: vm_value.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Compact (16 byte) tagged representation of MyPL VM values
+//----------------------------------------------------------------------
+
+#include <vector>
+#include "vm_value.h"
+#include "vm_heap.h"
+#include "mypl_exception.h"
+
+using namespace std;
+
+
+// concatenations shorter than this are copied rather than shared
+static const size_t SHORT_CONCAT = 64;
+
+
+void VMString::flatten()
+{
+  string result;
+  result.reserve(length);
+  // the parts still to copy, the next one last (concatenations are
+  // usually built up on the left, so walk them without recursing)
+  vector<VMString*> parts = {this};
+  while (!parts.empty()) {
+    VMString* part = parts.back();
+    parts.pop_back();
+    if (part->left) {
+      parts.push_back(part->right);
+      parts.push_back(part->left);
+    } else
+      result += part->chars;
+  }
+  chars = move(result);
+  for (VMString* part : {left, right})
+    if (--part->refs == 0)
+      destroy(part);
+  left = right = nullptr;
+}
+
+
+void VMString::destroy(VMString* s)
+{
+  if (!s->left) {
+    delete s;
+    return;
+  }
+  vector<VMString*> unreferenced = {s};
+  while (!unreferenced.empty()) {
+    VMString* part = unreferenced.back();
+    unreferenced.pop_back();
+    for (VMString* child : {part->left, part->right})
+      if (child and --child->refs == 0)
+        unreferenced.push_back(child);
+    delete part;
+  }
+}
+
+
+bool VMValue::string_equal(const VMValue& other) const
+{
+  check(Tag::STRING);
+  other.check(Tag::STRING);
+  return s == other.s or (s->size() == other.s->size() and
+                          s->str() == other.s->str());
+}
+
+
+VMValue VMValue::concat(const VMValue& other) const
+{
+  check(Tag::STRING);
+  other.check(Tag::STRING);
+  if (other.s->size() == 0)
+    return *this;
+  if (s->size() == 0)
+    return other;
+  if (s->size() + other.s->size() < SHORT_CONCAT)
+    return s->str() + other.s->str();
+  ++s->refs;
+  ++other.s->refs;
+  return VMValue(new VMString(s, other.s));
+}
+
+
+const VMValue& char_value(char c)
+{
+  static VMValue values[256];
+  VMValue& value = values[static_cast<unsigned char>(c)];
+  if (value.is_null())
+    value = string(1, c);
+  return value;
+}
+
+
+void VMValue::type_error(Tag expected) const
+{
+  const string names[] = {"null", "int", "double", "bool", "string",
+                          "object"};
+  throw MyPLException::VMError("expecting " + names[int(expected)] +
+                               " value, found " + names[int(tag)]);
+}
+
+
+string to_string(const VMValue& val) {
+  if (val.is_int())
+    return to_string(val.as_int());
+  else if (val.is_double())
+    return to_string(val.as_double());
+  else if (val.is_bool() and val.as_bool())
+    return "true";
+  else if (val.is_bool() and !val.as_bool())
+    return "false";
+  else if (val.is_string())
+    return val.as_string();
+  else if (val.is_ref())
+    return to_string(val.as_ref()->id);
+  else
+    return "null";
+}
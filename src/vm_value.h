@@ -0,0 +1,162 @@
+//----------------------------------------------------------------------
+// FILE: vm_value.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Compact (16 byte) tagged representation of MyPL VM values
+//----------------------------------------------------------------------
+
+#ifndef VM_VALUE_H
+#define VM_VALUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+class VMObject;
+
+
+// immutable, reference-counted string data shared by string values. A
+// concatenation only refers to its two parts until its characters are
+// needed, when it is flattened into a single string.
+class VMString
+{
+public:
+
+  // the number of values (or concatenations) referring to the string
+  int refs = 1;
+
+  VMString(const std::string& s) : length(s.size()), chars(s) {}
+
+  // the concatenation of left and right (taking over a reference to each)
+  VMString(VMString* left, VMString* right)
+    : length(left->length + right->length), left(left), right(right) {}
+
+  // the number of characters
+  std::size_t size() const {return length;}
+
+  // the string's characters
+  const std::string& str() {if (left) flatten(); return chars;}
+
+  // free an unreferenced string (and the unreferenced parts of it)
+  static void destroy(VMString* s);
+
+private:
+
+  std::size_t length;
+
+  // the characters (once flattened)
+  std::string chars;
+
+  // the parts of an unflattened concatenation
+  VMString* left = nullptr;
+  VMString* right = nullptr;
+
+  // helper to copy the parts' characters and release the parts
+  void flatten();
+
+};
+
+
+// vm values are one of int, double, bool, string, object reference, or
+// null, stored as a type tag plus an 8 byte payload (strings are held
+// by handle, so copying a value never copies characters)
+class VMValue
+{
+public:
+
+  // the possible value types
+  enum class Tag : std::uint8_t {NULL_VAL, INT, DOUBLE, BOOL, STRING, REF};
+
+  // construct values of each type (the default value is null)
+  VMValue() : tag(Tag::NULL_VAL), bits(0) {}
+  VMValue(std::nullptr_t) : tag(Tag::NULL_VAL), bits(0) {}
+  VMValue(int x) : tag(Tag::INT), i(x) {}
+  VMValue(double x) : tag(Tag::DOUBLE), d(x) {}
+  VMValue(bool x) : tag(Tag::BOOL), b(x) {}
+  VMValue(const std::string& x) : tag(Tag::STRING), s(new VMString(x)) {}
+  VMValue(const char* x) : VMValue(std::string(x)) {}
+  VMValue(VMObject* x) : tag(Tag::REF), o(x) {}
+
+  // copying and assigning share the string data
+  VMValue(const VMValue& other) : tag(other.tag), bits(other.bits)
+    {retain();}
+  VMValue(VMValue&& other) noexcept : tag(other.tag), bits(other.bits)
+    {other.tag = Tag::NULL_VAL;}
+  VMValue& operator=(const VMValue& other)
+    {other.retain(); release(); tag = other.tag; bits = other.bits;
+     return *this;}
+  VMValue& operator=(VMValue&& other) noexcept
+    {if (this != &other) {release(); tag = other.tag; bits = other.bits;
+                          other.tag = Tag::NULL_VAL;}
+     return *this;}
+  ~VMValue() {release();}
+
+  // type tests
+  Tag type() const {return tag;}
+  bool is_null() const {return tag == Tag::NULL_VAL;}
+  bool is_int() const {return tag == Tag::INT;}
+  bool is_double() const {return tag == Tag::DOUBLE;}
+  bool is_bool() const {return tag == Tag::BOOL;}
+  bool is_string() const {return tag == Tag::STRING;}
+  bool is_ref() const {return tag == Tag::REF;}
+
+  // accessors (report a VM error if the value has a different type)
+  int as_int() const {check(Tag::INT); return i;}
+  double as_double() const {check(Tag::DOUBLE); return d;}
+  bool as_bool() const {check(Tag::BOOL); return b;}
+  const std::string& as_string() const {check(Tag::STRING); return s->str();}
+  VMObject* as_ref() const {check(Tag::REF); return o;}
+
+  // accessors for values already known to have the type (no tag check)
+  int int_unchecked() const {return i;}
+  double double_unchecked() const {return d;}
+
+  // the length of a string value (without flattening it)
+  std::size_t string_size() const {check(Tag::STRING); return s->size();}
+
+  // true if two string values have the same characters
+  bool string_equal(const VMValue& other) const;
+
+  // the concatenation of two string values (short results are copied,
+  // longer ones share the two strings' data)
+  VMValue concat(const VMValue& other) const;
+
+private:
+
+  Tag tag;
+
+  // a string value holding the string data (taking over a reference)
+  explicit VMValue(VMString* x) : tag(Tag::STRING), s(x) {}
+
+  union {
+    int i;
+    double d;
+    bool b;
+    VMString* s;
+    VMObject* o;
+    std::uint64_t bits;         // the whole payload, for copying
+  };
+
+  // string reference counting helpers
+  void retain() const {if (tag == Tag::STRING) ++s->refs;}
+  void release()
+    {if (tag == Tag::STRING and --s->refs == 0) VMString::destroy(s);}
+
+  // helper to report an access with the wrong type
+  void check(Tag expected) const {if (tag != expected) type_error(expected);}
+  [[noreturn]] void type_error(Tag expected) const;
+
+};
+
+static_assert(sizeof(VMValue) == 16);
+
+
+// function to get a string representation of a vm_value
+std::string to_string(const VMValue& val);
+
+// the (shared) one character string value of a char
+const VMValue& char_value(char c);
+
+
+#endif
@@ -0,0 +1,418 @@
+//----------------------------------------------------------------------
+// FILE: vm_verifier.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Load-time bytecode verifier for the MyPL VM
+//----------------------------------------------------------------------
+
+#include <algorithm>
+#include "vm_verifier.h"
+
+
+using namespace std;
+
+
+// the type of values nothing is known about
+static const string UNKNOWN = "";
+
+// the types of typed arrays, in the order of their ALLOCAx, SETIx, and
+// GETIx instructions
+static const string TYPED_ARRAYS[] = {"array int", "array double",
+                                      "array bool", "array char"};
+
+
+namespace {
+
+  // thrown with the reason an instruction does not verify
+  struct Unverifiable {
+    string reason;
+  };
+
+}
+
+
+// the type of a value that is either of type x or of type y
+static string join(const string& x, const string& y)
+{
+  if (x == y or y == "null")
+    return x;
+  if (x == "null")
+    return y;
+  return UNKNOWN;
+}
+
+
+// true if a value of the type can be used where a value of the expected
+// type is required (null can be used anywhere, and anything can be
+// used where nothing is expected)
+static bool fits(const string& type, const string& expected)
+{
+  return expected == UNKNOWN or type == expected or type == "null";
+}
+
+
+static string constant_type(const VMValue& x)
+{
+  switch (x.type()) {
+    case VMValue::Tag::NULL_VAL: return "null";
+    case VMValue::Tag::INT: return "int";
+    case VMValue::Tag::DOUBLE: return "double";
+    case VMValue::Tag::BOOL: return "bool";
+    case VMValue::Tag::STRING: return "string";
+    default: return UNKNOWN;
+  }
+}
+
+
+// the type of the elements of an array type (unknown unless typed)
+static string element_type(const string& array_type)
+{
+  if (array_type == "array int" or array_type == "array double" or
+      array_type == "array bool")
+    return array_type.substr(6);
+  if (array_type == "array char")
+    return "string";
+  return UNKNOWN;
+}
+
+
+VMVerifier::VMVerifier(const unordered_map<string, VMFrameInfo>& functions,
+                       const unordered_map<string, VMStructInfo>& structs)
+  : functions(functions), structs(structs)
+{
+}
+
+
+string VMVerifier::value_type(const string& type_name)
+{
+  // chars are one character strings, and void functions return null
+  if (type_name == "char")
+    return "string";
+  if (type_name == "void")
+    return "null";
+  if (type_name.starts_with("array ") and
+      element_type(type_name) == UNKNOWN)
+    return "array";
+  return type_name;
+}
+
+
+optional<string> VMVerifier::verify(const VMFrameInfo& frame) const
+{
+  const vector<VMInstr>& instrs = frame.instructions;
+  // the variables are the parameters and every slot a LOAD or STORE
+  // names, with the parameters of their declared types and the rest
+  // starting out null
+  int variable_count = frame.arg_count;
+  for (const VMInstr& instr : instrs)
+    if ((instr.opcode() == OpCode::LOAD or instr.opcode() == OpCode::STORE)
+        and instr.operand().has_value() and instr.operand()->is_int())
+      variable_count = max(variable_count, instr.operand()->int_unchecked() + 1);
+  State entry;
+  entry.variables.assign(variable_count, "null");
+  for (int i = 0; i < frame.arg_count; ++i)
+    entry.variables[i] = i < frame.arg_types.size() ?
+      value_type(frame.arg_types[i]) : UNKNOWN;
+  // walk every path through the code, revisiting an instruction when
+  // the types reaching it change
+  vector<optional<State>> states(instrs.size());
+  vector<int> worklist;
+  int pc = 0;
+  try {
+    if (instrs.empty())
+      throw Unverifiable {"code runs off its end"};
+    states[0] = entry;
+    worklist.push_back(0);
+    while (!worklist.empty()) {
+      pc = worklist.back();
+      worklist.pop_back();
+      const VMInstr& instr = instrs[pc];
+      State state = *states[pc];
+      step(frame, instr, state);
+      OpCode op = instr.opcode();
+      vector<int> successors;
+      if (op == OpCode::JMP or op == OpCode::JMPF) {
+        if (!instr.operand().has_value() or !instr.operand()->is_int() or
+            instr.operand()->int_unchecked() < 0 or
+            instr.operand()->int_unchecked() >= instrs.size())
+          throw Unverifiable {"jump target out of bounds"};
+        successors.push_back(instr.operand()->int_unchecked());
+      }
+      if (op != OpCode::JMP and op != OpCode::RET) {
+        if (pc + 1 == instrs.size())
+          throw Unverifiable {"code runs off its end"};
+        successors.push_back(pc + 1);
+      }
+      for (int next : successors) {
+        if (!states[next]) {
+          states[next] = state;
+          worklist.push_back(next);
+        } else if (merge(*states[next], state))
+          worklist.push_back(next);
+      }
+    }
+  } catch (const Unverifiable& e) {
+    string at = instrs.empty() ? "" :
+      " at " + to_string(pc) + ": " + to_string(instrs[pc]);
+    return e.reason + " (in " + frame.function_name + at + ")";
+  }
+  return nullopt;
+}
+
+
+bool VMVerifier::merge(State& into, const State& from)
+{
+  if (into.operands.size() != from.operands.size())
+    throw Unverifiable {"inconsistent operand stack depth"};
+  bool changed = false;
+  auto merge_types = [&](vector<string>& x, const vector<string>& y) {
+    for (int i = 0; i < x.size(); ++i) {
+      string type = join(x[i], y[i]);
+      if (type != x[i]) {
+        x[i] = type;
+        changed = true;
+      }
+    }
+  };
+  merge_types(into.variables, from.variables);
+  merge_types(into.operands, from.operands);
+  return changed;
+}
+
+
+void VMVerifier::step(const VMFrameInfo& frame, const VMInstr& instr,
+                      State& state) const
+{
+  vector<string>& stack = state.operands;
+  auto push = [&](const string& type) {
+    stack.push_back(type);
+  };
+  auto pop = [&]() {
+    if (stack.empty())
+      throw Unverifiable {"operand stack underflow"};
+    string type = stack.back();
+    stack.pop_back();
+    return type;
+  };
+  // pop a value that must have the type (or be null)
+  auto pop_typed = [&](const string& expected) {
+    string type = pop();
+    if (!fits(type, expected))
+      throw Unverifiable {"expecting " + expected + " value, found " +
+                          (type == UNKNOWN ? "unknown" : type)};
+    return type;
+  };
+  auto name_operand = [&]() {
+    if (!instr.operand().has_value() or !instr.operand()->is_string())
+      throw Unverifiable {"expecting a name operand"};
+    return instr.operand()->as_string();
+  };
+  auto variable = [&]() {
+    if (!instr.operand().has_value() or !instr.operand()->is_int() or
+        instr.operand()->int_unchecked() < 0)
+      throw Unverifiable {"expecting a variable operand"};
+    return instr.operand()->int_unchecked();
+  };
+  // the struct type and slot of a field operand ("T.f")
+  auto field = [&]() {
+    string name = name_operand();
+    size_t dot = name.find('.');
+    auto type = structs.find(name.substr(0, dot));
+    if (dot != string::npos and type != structs.end()) {
+      const vector<string>& fields = type->second.field_names;
+      auto slot = find(fields.begin(), fields.end(), name.substr(dot + 1));
+      if (slot != fields.end())
+        return make_pair(&type->second, int(slot - fields.begin()));
+    }
+    throw Unverifiable {"undefined field '" + name + "'"};
+  };
+  auto field_type = [&](const VMStructInfo& type, int slot) {
+    if (type.field_types.size() != type.field_names.size())
+      return UNKNOWN;
+    return value_type(type.field_types[slot]);
+  };
+
+  switch (instr.opcode()) {
+    case OpCode::PUSH:
+      if (!instr.operand().has_value())
+        throw Unverifiable {"expecting a value operand"};
+      push(constant_type(*instr.operand()));
+      break;
+    case OpCode::POP: case OpCode::WRITE: case OpCode::ADDF:
+    case OpCode::JMPF:
+      pop();
+      break;
+    case OpCode::LOAD:
+      push(state.variables[variable()]);
+      break;
+    case OpCode::STORE: {
+      int index = variable();
+      state.variables[index] = pop();
+      break;
+    }
+    case OpCode::ADD: case OpCode::SUB: case OpCode::MUL:
+    case OpCode::DIV: {
+      string x = pop();
+      string y = pop();
+      push(x == y and (x == "int" or x == "double") ? x : UNKNOWN);
+      break;
+    }
+    case OpCode::AND: case OpCode::OR:
+      pop_typed("bool");
+      pop_typed("bool");
+      push("bool");
+      break;
+    case OpCode::NOT:
+      pop_typed("bool");
+      push("bool");
+      break;
+    case OpCode::CMPLT: case OpCode::CMPLE: case OpCode::CMPGT:
+    case OpCode::CMPGE: case OpCode::CMPEQ: case OpCode::CMPNE:
+      pop();
+      pop();
+      push("bool");
+      break;
+    case OpCode::ADDI: case OpCode::SUBI: case OpCode::MULI:
+    case OpCode::DIVI:
+      pop_typed("int");
+      pop_typed("int");
+      push("int");
+      break;
+    case OpCode::ADDD: case OpCode::SUBD: case OpCode::MULD:
+    case OpCode::DIVD:
+      pop_typed("double");
+      pop_typed("double");
+      push("double");
+      break;
+    case OpCode::CMPLTI: case OpCode::CMPLEI: case OpCode::CMPGTI:
+    case OpCode::CMPGEI: case OpCode::CMPEQI: case OpCode::CMPNEI:
+      pop_typed("int");
+      pop_typed("int");
+      push("bool");
+      break;
+    case OpCode::CMPLTD: case OpCode::CMPLED: case OpCode::CMPGTD:
+    case OpCode::CMPGED: case OpCode::CMPEQD: case OpCode::CMPNED:
+      pop_typed("double");
+      pop_typed("double");
+      push("bool");
+      break;
+    case OpCode::CMPLTS: case OpCode::CMPLES: case OpCode::CMPGTS:
+    case OpCode::CMPGES: case OpCode::CMPEQS: case OpCode::CMPNES:
+      pop_typed("string");
+      pop_typed("string");
+      push("bool");
+      break;
+    case OpCode::JMP: case OpCode::NOP:
+      break;
+    case OpCode::CALL: {
+      string name = name_operand();
+      auto callee = functions.find(name);
+      if (callee == functions.end())
+        throw Unverifiable {"call to undefined function '" + name + "'"};
+      const VMFrameInfo& f = callee->second;
+      for (int i = f.arg_count - 1; i >= 0; --i) {
+        string type = pop();
+        string expected = i < f.arg_types.size() ?
+          value_type(f.arg_types[i]) : UNKNOWN;
+        if (!fits(type, expected))
+          throw Unverifiable {"argument " + to_string(i + 1) + " of '" +
+                              name + "' is not of type " + expected};
+      }
+      push(value_type(f.return_type));
+      break;
+    }
+    case OpCode::RET: {
+      string expected = value_type(frame.return_type);
+      if (!fits(pop(), expected))
+        throw Unverifiable {"expecting " + expected + " return value"};
+      break;
+    }
+    case OpCode::READ:
+      push("string");
+      break;
+    case OpCode::SLEN: case OpCode::ALEN: case OpCode::TOINT:
+      pop();
+      push("int");
+      break;
+    case OpCode::TODBL:
+      pop();
+      push("double");
+      break;
+    case OpCode::TOSTR:
+      pop();
+      push("string");
+      break;
+    case OpCode::GETC: case OpCode::CONCAT:
+      pop();
+      pop();
+      push("string");
+      break;
+    case OpCode::ALLOCS: {
+      string name = name_operand();
+      if (!structs.contains(name))
+        throw Unverifiable {"undefined struct type '" + name + "'"};
+      push(name);
+      break;
+    }
+    case OpCode::ALLOCA:
+      pop();
+      pop();
+      push("array");
+      break;
+    case OpCode::ALLOCAI: case OpCode::ALLOCAD: case OpCode::ALLOCAB:
+    case OpCode::ALLOCAC: {
+      pop();
+      push(TYPED_ARRAYS[int(instr.opcode()) - int(OpCode::ALLOCAI)]);
+      break;
+    }
+    case OpCode::SETF: {
+      auto [type, slot] = field();
+      string x = pop();
+      pop_typed(type->struct_name);
+      string expected = field_type(*type, slot);
+      if (!fits(x, expected))
+        throw Unverifiable {"expecting " + expected + " field value"};
+      break;
+    }
+    case OpCode::GETF: {
+      auto [type, slot] = field();
+      pop_typed(type->struct_name);
+      push(field_type(*type, slot));
+      break;
+    }
+    case OpCode::SETI:
+      pop();
+      pop();
+      pop();
+      break;
+    case OpCode::GETI:
+      pop();
+      push(element_type(pop()));
+      break;
+    case OpCode::SETII: case OpCode::SETID: case OpCode::SETIB:
+    case OpCode::SETIC: {
+      string array = TYPED_ARRAYS[int(instr.opcode()) - int(OpCode::SETII)];
+      pop_typed(element_type(array));
+      pop_typed("int");
+      pop_typed(array);
+      break;
+    }
+    case OpCode::GETII: case OpCode::GETID: case OpCode::GETIB:
+    case OpCode::GETIC: {
+      string array = TYPED_ARRAYS[int(instr.opcode()) - int(OpCode::GETII)];
+      pop_typed("int");
+      pop_typed(array);
+      push(element_type(array));
+      break;
+    }
+    case OpCode::DUP: {
+      string x = pop();
+      push(x);
+      push(x);
+      break;
+    }
+    default:
+      // superinstructions are only formed when linking
+      throw Unverifiable {"unexpected instruction"};
+  }
+}
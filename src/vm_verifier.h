@@ -0,0 +1,71 @@
+//----------------------------------------------------------------------
+// FILE: vm_verifier.h
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Load-time bytecode verifier for the MyPL VM
+//----------------------------------------------------------------------
+
+#ifndef VM_VERIFIER_H
+#define VM_VERIFIER_H
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "vm_frame.h"
+
+
+// Proves before a function runs what VM::run would otherwise have to
+// check as it goes. A function verifies if on every path through it:
+//   - the operand stack never underflows, and has the same depth (and
+//     compatible types) wherever paths meet
+//   - jumps land on instructions and the code never runs off its end
+//   - typed instructions (ADDI, CMPLTS, GETID, ...) are only applied to
+//     values of their type or null (nulls are still reported at run
+//     time), and field accesses only to structs of the field's type
+//   - calls, returns, and field stores respect the declared parameter,
+//     return, and field types
+// Values are typed by MyPL type name ("int", "Node", "array double"),
+// where arrays of anything but ints, doubles, bools, and chars are just
+// "array" (their elements are not followed). Anything the verifier
+// cannot follow (e.g., undeclared types) fails verification.
+class VMVerifier
+{
+public:
+
+  // the (unlinked) functions and struct types calls and fields refer to
+  VMVerifier(const std::unordered_map<std::string, VMFrameInfo>& functions,
+             const std::unordered_map<std::string, VMStructInfo>& structs);
+
+  // check an unlinked function, returning why it does not verify (no
+  // value if it does)
+  std::optional<std::string> verify(const VMFrameInfo& frame) const;
+
+  // the verifier's name for values of a declared MyPL type
+  static std::string value_type(const std::string& type_name);
+
+private:
+
+  const std::unordered_map<std::string, VMFrameInfo>& functions;
+  const std::unordered_map<std::string, VMStructInfo>& structs;
+
+  // the types of a function's variables and operands before an
+  // instruction
+  struct State {
+    std::vector<std::string> variables;
+    std::vector<std::string> operands;
+  };
+
+  // helper to apply an instruction to the state (throws the reason the
+  // instruction does not verify)
+  void step(const VMFrameInfo& frame, const VMInstr& instr,
+            State& state) const;
+
+  // helper to merge a state into the state already reaching an
+  // instruction (returns true if the latter changed)
+  static bool merge(State& into, const State& from);
+
+};
+
+
+#endif
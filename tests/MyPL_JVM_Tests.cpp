@@ -0,0 +1,321 @@
+//----------------------------------------------------------------------
+// FILE: MyPL_JVM_Tests.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Basic tests for the MyPL to JVM class file compiler
+//----------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "mypl_exception.h"
+#include "lexer.h"
+#include "ast_parser.h"
+#include "semantic_checker.h"
+#include "jvm_class_file.h"
+#include "mypl_to_jvm_compiler.h"
+
+using namespace std;
+
+
+//------------------------------------------------------------
+// Helper Functions
+//------------------------------------------------------------
+
+// the class files compiled from the (checked) program, by file name
+map<string, string> compile(const string& program)
+{
+  stringstream in(program);
+  Lexer lexer(in);
+  ASTParser parser(lexer);
+  Program p = parser.parse();
+  SemanticChecker checker;
+  p.accept(checker);
+  MyPLtoJVMCompiler compiler;
+  p.accept(compiler);
+  map<string, string> files;
+  for (auto& [name, bytes] : compiler.class_files())
+    files[name] = bytes;
+  return files;
+}
+
+// the parts of a class file the tests look at (read with no JVM, so
+// reading it checks its layout)
+struct Method {
+  string name;
+  string descriptor;
+  int max_stack = 0;
+  int max_locals = 0;
+  string code;
+  int frames = 0;
+};
+
+struct ClassFile {
+  int major = 0;
+  string name;
+  string super_name;
+  vector<pair<string, string>> fields;
+  vector<Method> methods;
+  vector<string> attributes;
+  vector<string> inner_classes;
+};
+
+class Reader {
+public:
+  Reader(const string& bytes) : bytes(bytes) {}
+  int u1() {return static_cast<unsigned char>(bytes.at(pos++));}
+  int u2() {int hi = u1(); return (hi << 8) | u1();}
+  long u4() {long hi = u2(); return (hi << 16) | u2();}
+  string take(long n) {string s = bytes.substr(pos, n); pos += n; return s;}
+  bool done() const {return pos == bytes.size();}
+private:
+  const string& bytes;
+  size_t pos = 0;
+};
+
+ClassFile read_class(const string& bytes)
+{
+  Reader r(bytes);
+  ClassFile c;
+  EXPECT_EQ(0xcafebabe, r.u4());
+  r.u2();
+  c.major = r.u2();
+  // (utf8 constants, and the utf8 index of each class constant)
+  int count = r.u2();
+  map<int, string> utf8;
+  map<int, int> classes;
+  for (int i = 1; i < count; ++i) {
+    int tag = r.u1();
+    if (tag == 1)
+      utf8[i] = r.take(r.u2());
+    else if (tag == 7 or tag == 8)
+      classes[i] = r.u2();
+    else if (tag == 3)
+      r.u4();
+    else if (tag == 6) {
+      r.take(8);
+      ++i;
+    }
+    else if (tag == 9 or tag == 10 or tag == 12)
+      r.u4();
+    else
+      ADD_FAILURE() << "unexpected constant tag " << tag;
+  }
+  auto class_name = [&](int i) {return utf8[classes.at(i)];};
+  r.u2();
+  c.name = class_name(r.u2());
+  c.super_name = class_name(r.u2());
+  EXPECT_EQ(0, r.u2());
+  for (int n = r.u2(); n > 0; --n) {
+    r.u2();
+    string name = utf8[r.u2()];
+    c.fields.push_back({name, utf8[r.u2()]});
+    EXPECT_EQ(0, r.u2());
+  }
+  for (int n = r.u2(); n > 0; --n) {
+    Method m;
+    r.u2();
+    m.name = utf8[r.u2()];
+    m.descriptor = utf8[r.u2()];
+    EXPECT_EQ(1, r.u2());
+    EXPECT_EQ("Code", utf8[r.u2()]);
+    string attr = r.take(r.u4());
+    Reader code(attr);
+    m.max_stack = code.u2();
+    m.max_locals = code.u2();
+    m.code = code.take(code.u4());
+    EXPECT_EQ(0, code.u2());
+    for (int a = code.u2(); a > 0; --a) {
+      EXPECT_EQ("StackMapTable", utf8[code.u2()]);
+      string table = code.take(code.u4());
+      m.frames = Reader(table).u2();
+    }
+    EXPECT_TRUE(code.done());
+    c.methods.push_back(m);
+  }
+  for (int n = r.u2(); n > 0; --n) {
+    string name = utf8[r.u2()];
+    c.attributes.push_back(name);
+    string attr = r.take(r.u4());
+    if (name == "InnerClasses") {
+      Reader inner(attr);
+      for (int k = inner.u2(); k > 0; --k) {
+        c.inner_classes.push_back(class_name(inner.u2()));
+        inner.take(6);
+      }
+    }
+  }
+  EXPECT_TRUE(r.done());
+  return c;
+}
+
+const Method* method(const ClassFile& c, const string& name)
+{
+  for (const Method& m : c.methods)
+    if (m.name == name)
+      return &m;
+  return nullptr;
+}
+
+//------------------------------------------------------------
+// Class files
+//------------------------------------------------------------
+
+TEST (MyPLJVMTests, ProgramIsOneClass) {
+  auto files = compile("void main() {print(\"hi\")}");
+  ASSERT_EQ(1, files.size());
+  ClassFile c = read_class(files.at("Program.class"));
+  EXPECT_EQ(52, c.major);
+  EXPECT_EQ("Program", c.name);
+  EXPECT_EQ("java/lang/Object", c.super_name);
+  ASSERT_NE(nullptr, method(c, "main"));
+  EXPECT_EQ("([Ljava/lang/String;)V", method(c, "main")->descriptor);
+}
+
+TEST (MyPLJVMTests, FunctionsAreStaticMethods) {
+  ClassFile c = read_class(compile(
+    "double half(int x, double y) {return to_double(x) / y}"
+    "string name(array int xs, bool b) {return \"\"}"
+    "void main() {}").at("Program.class"));
+  ASSERT_NE(nullptr, method(c, "half"));
+  EXPECT_EQ("(ID)D", method(c, "half")->descriptor);
+  // (a double takes two locals)
+  EXPECT_EQ(3, method(c, "half")->max_locals);
+  ASSERT_NE(nullptr, method(c, "name"));
+  EXPECT_EQ("([IZ)Ljava/lang/String;", method(c, "name")->descriptor);
+}
+
+TEST (MyPLJVMTests, StructsAreNestedClasses) {
+  auto files = compile(
+    "struct Node {int val, double weight, Node next, array string tags}"
+    "void main() {Node n = new Node}");
+  ASSERT_EQ(2, files.size());
+  ClassFile node = read_class(files.at("Program$Node.class"));
+  EXPECT_EQ("Program$Node", node.name);
+  vector<pair<string, string>> fields {{"val", "I"}, {"weight", "D"},
+    {"next", "LProgram$Node;"}, {"tags", "[Ljava/lang/String;"}};
+  EXPECT_EQ(fields, node.fields);
+  ASSERT_NE(nullptr, method(node, "<init>"));
+  EXPECT_EQ(vector<string> {"Program$Node"}, node.inner_classes);
+  ClassFile program = read_class(files.at("Program.class"));
+  EXPECT_EQ(vector<string> {"Program$Node"}, program.inner_classes);
+}
+
+TEST (MyPLJVMTests, BranchTargetsHaveFrames) {
+  ClassFile c = read_class(compile(
+    "int count(int n) {"
+    "  int total = 0"
+    "  for (int i = 0; i < n; i = i + 1) {"
+    "    if (i > 2) {total = total + 1}"
+    "  }"
+    "  return total"
+    "}"
+    "void main() {}").at("Program.class"));
+  const Method* m = method(c, "count");
+  ASSERT_NE(nullptr, m);
+  // the loop's top and end, the if's end, and each comparison's true
+  // and end
+  EXPECT_EQ(7, m->frames);
+}
+
+TEST (MyPLJVMTests, UnreachableCodeIsNotWritten) {
+  ClassFile c = read_class(compile(
+    "int id(int x) {return x}"
+    "int sign(int x) {if (x < 0) {return 0 - 1} else {return 1}}"
+    "void main() {}").at("Program.class"));
+  // iload_0, ireturn (with no return of the default value after it)
+  EXPECT_EQ(string("\x1a\xac"), method(c, "id")->code);
+  EXPECT_EQ(0, method(c, "id")->frames);
+  // (sign's code ends with its else's return)
+  EXPECT_EQ('\xac', method(c, "sign")->code.back());
+}
+
+TEST (MyPLJVMTests, SupportMethodsOnlyWhenUsed) {
+  ClassFile plain = read_class(compile("void main() {print(1)}")
+                               .at("Program.class"));
+  EXPECT_EQ(1, plain.methods.size());
+  ClassFile c = read_class(compile(
+    "void main() {print(2.5) string s = input()}").at("Program.class"));
+  EXPECT_NE(nullptr, method(c, "mypl$format"));
+  EXPECT_NE(nullptr, method(c, "mypl$input"));
+  EXPECT_NE(nullptr, method(c, "<clinit>"));
+}
+
+//------------------------------------------------------------
+// Class file writer
+//------------------------------------------------------------
+
+TEST (MyPLJVMTests, ConstantsAreAddedOnce) {
+  JVMConstantPool pool;
+  int s = pool.string("abc");
+  EXPECT_EQ(s, pool.string("abc"));
+  int d = pool.number(2.5);
+  // (a double takes two entries)
+  EXPECT_EQ(d + 2, pool.integer(7));
+  EXPECT_EQ(pool.utf8("java/lang/Object"), pool.utf8("java/lang/Object"));
+  EXPECT_EQ(pool.method_ref("A", "f", "()V"), pool.method_ref("A", "f", "()V"));
+  EXPECT_NE(pool.method_ref("A", "f", "()V"), pool.method_ref("A", "f", "(I)V"));
+}
+
+TEST (MyPLJVMTests, StringsAreModifiedUTF8) {
+  JVMConstantPool pool;
+  pool.utf8(string("a\0b", 3));
+  string bytes = pool.bytes();
+  // count, tag, length, then NUL as two bytes
+  EXPECT_EQ(string("\x00\x02\x01\x00\x04" "a\xc0\x80" "b", 9), bytes);
+}
+
+TEST (MyPLJVMTests, CodeTracksStackAndLocals) {
+  JVMConstantPool pool;
+  JVMCode code(pool, {JVMType::of("D")});
+  int x = code.add_local(JVMType::of("I"));
+  EXPECT_EQ(2, x);
+  code.load(0);
+  code.load(0);
+  code.op(JVMOp::DADD);
+  code.op(JVMOp::D2I);
+  code.store(x);
+  code.load(x);
+  code.op(JVMOp::IRETURN);
+  EXPECT_FALSE(code.reachable());
+  string attr = code.attribute();
+  Reader r(attr);
+  r.u2();
+  r.u4();
+  EXPECT_EQ(4, r.u2());   // two doubles
+  EXPECT_EQ(3, r.u2());
+}
+
+TEST (MyPLJVMTests, FramesDescribeJumpTargets) {
+  JVMConstantPool pool;
+  JVMCode code(pool, {JVMType::of("I")});
+  JVMLabel yes = code.new_label();
+  JVMLabel done = code.new_label();
+  code.push_string("s");
+  code.load(0);
+  code.branch(JVMOp::IFNE, yes);
+  code.push_int(0);
+  code.branch(JVMOp::GOTO, done);
+  code.bind(yes);
+  code.push_int(1);
+  code.bind(done);
+  code.op(JVMOp::POP);
+  code.op(JVMOp::ARETURN);
+  string attr = code.attribute();
+  // the frame at done (just after yes's) has a string and an int on
+  // the stack
+  string frame = string("\xff\x00\x00\x00\x01\x01\x00\x02\x07", 9);
+  EXPECT_NE(string::npos, attr.find(frame));
+}
+
+//----------------------------------------------------------------------
+// main
+//----------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,180 @@
+//----------------------------------------------------------------------
+// FILE: MyPL_Native_Tests.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Basic tests for the MyPL to C++ (native code) transpiler
+//----------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <sstream>
+#include <string>
+#include "mypl_exception.h"
+#include "lexer.h"
+#include "ast_parser.h"
+#include "semantic_checker.h"
+#include "mypl_to_cpp_transpiler.h"
+
+using namespace std;
+
+
+//------------------------------------------------------------
+// Helper Functions
+//------------------------------------------------------------
+
+// the C++ translation of the (checked) program
+string translate(const string& program)
+{
+  stringstream in(program);
+  Lexer lexer(in);
+  ASTParser parser(lexer);
+  Program p = parser.parse();
+  SemanticChecker checker;
+  p.accept(checker);
+  stringstream out;
+  MyPLtoCppTranspiler transpiler(out);
+  p.accept(transpiler);
+  return out.str();
+}
+
+// true if there is a C++ compiler to build programs with
+bool have_compiler()
+{
+  const char* compiler = getenv("CXX");
+  string command = string(compiler ? compiler : "c++") +
+    " --version > /dev/null 2>&1";
+  return system(command.c_str()) == 0;
+}
+
+// build and run the program, returning what it wrote (to stdout and
+// stderr) and its exit status
+string run_native(const string& program, int& status)
+{
+  filesystem::path exe = filesystem::temp_directory_path() /
+    ("mypl-native-test-" + to_string(random_device()()));
+  MyPLtoCppTranspiler::build(translate(program), exe.string());
+  string output;
+  FILE* pipe = popen((exe.string() + " 2>&1").c_str(), "r");
+  char buffer[256];
+  for (size_t n; (n = fread(buffer, 1, sizeof(buffer), pipe)) > 0; )
+    output.append(buffer, n);
+  status = WEXITSTATUS(pclose(pipe));
+  filesystem::remove(exe);
+  return output;
+}
+
+//------------------------------------------------------------
+// Generated code
+//------------------------------------------------------------
+
+TEST (MyPLNativeTests, ProgramIsSelfContained) {
+  string code = translate(
+    "struct Node {int val, Node next}"
+    "void main() {"
+    "  Node n = new Node"
+    "  print(\"hi\")"
+    "}");
+  EXPECT_NE(string::npos, code.find("namespace mypl {"));
+  EXPECT_NE(string::npos, code.find("struct s_Node : mypl::Obj {\n"
+                                    "  mypl::Int m_val;\n"
+                                    "  mypl::Ref<s_Node> m_next;\n"
+                                    "};"));
+  EXPECT_NE(string::npos, code.find("static const mypl::Str lit_0 = "
+                                    "mypl::str(\"hi\");"));
+  EXPECT_NE(string::npos, code.find("static void f_main();"));
+  EXPECT_NE(string::npos, code.find("int main()\n{\n  f_main();"));
+}
+
+TEST (MyPLNativeTests, CallsAreMadeInOrder) {
+  string code = translate(
+    "int f(int x) {return x}"
+    "void main() {"
+    "  int y = f(1) + f(2) * f(3)"
+    "}");
+  EXPECT_NE(string::npos, code.find(
+    "  auto t0 = f_f(mypl::Int(1));\n"
+    "  auto t1 = f_f(mypl::Int(2));\n"
+    "  auto t2 = f_f(mypl::Int(3));\n"
+    "  mypl::Int v_y = mypl::nonnull(mypl::add(t0, mypl::mul(t1, t2)));\n"));
+}
+
+TEST (MyPLNativeTests, LoopConditionCallsAreMadeEachTime) {
+  string code = translate(
+    "bool more(int x) {return x < 3}"
+    "void main() {"
+    "  int i = 0"
+    "  while (more(i)) {i = i + 1}"
+    "}");
+  EXPECT_NE(string::npos, code.find(
+    "  while (true) {\n"
+    "    auto t0 = f_more(v_i);\n"
+    "    if (!mypl::test(t0))\n"
+    "      break;\n"));
+}
+
+//------------------------------------------------------------
+// Native executables
+//------------------------------------------------------------
+
+TEST (MyPLNativeTests, BuiltProgramsRunLikeTheVM) {
+  if (!have_compiler())
+    GTEST_SKIP();
+  string program =
+    "struct Point {int x, double y}"
+    "int fib(int n) {"
+    "  if (n <= 1) {return n}"
+    "  return fib(n - 1) + fib(n - 2)"
+    "}"
+    "void main() {"
+    "  print(fib(20)) print(\" \")"
+    "  array Point ps = new Point[3]"
+    "  for (int i = 0; i < 3; i = i + 1) {"
+    "    ps[i] = new Point"
+    "    ps[i].x = i * i"
+    "    ps[i].y = to_double(i) / 2.0"
+    "  }"
+    "  print(ps[2].x) print(\" \") print(ps[1].y) print(\" \")"
+    "  string s = \"\""
+    "  for (int i = 0; i < 3; i = i + 1) {"
+    "    s = concat(s, to_string(i))"
+    "  }"
+    "  print(s) print(get(0, s) == '0') print(ps[0] != null)"
+    "}";
+  int status = 0;
+  EXPECT_EQ("6765 4 0.500000 012truetrue", run_native(program, status));
+  EXPECT_EQ(0, status);
+}
+
+TEST (MyPLNativeTests, RuntimeErrorsEndThePrograms) {
+  if (!have_compiler())
+    GTEST_SKIP();
+  string program =
+    "void main() {"
+    "  array int xs = new int[2]"
+    "  print(\"before \")"
+    "  xs[0] = xs[1]"
+    "  print(\"after\")"
+    "}";
+  int status = 0;
+  EXPECT_EQ("before Runtime Error: null reference\n",
+            run_native(program, status));
+  EXPECT_EQ(1, status);
+}
+
+TEST (MyPLNativeTests, FailedBuildsAreNativeErrors) {
+  EXPECT_THROW(MyPLtoCppTranspiler::build("not C++", "/nonexistent/dir/prog"),
+               MyPLException);
+}
+
+//----------------------------------------------------------------------
+// main
+//----------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,1293 @@
+//----------------------------------------------------------------------
+// FILE: MyPL_VM_Tests.cpp
+// DATE: CPSC 326, Spring 2023
+// AUTH: Evan Shoemaker
+// DESC: Non-comprehensive set of basic tests for the MyPL VM
+//----------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include "mypl_exception.h"
+#include "lexer.h"
+#include "ast_parser.h"
+#include "semantic_checker.h"
+#include "code_generator.h"
+#include "vm.h"
+#include "vm_bytecode.h"
+#include "compile_cache.h"
+
+using namespace std;
+
+//------------------------------------------------------------
+// Helper Functions
+//------------------------------------------------------------
+
+// compile the given program into the vm (at the optimization level)
+void compile(const string& program, VM& vm, int level = 0)
+{
+  stringstream in(program);
+  Program p = ASTParser(Lexer(in)).parse();
+  SemanticChecker checker;
+  p.accept(checker);
+  CodeGenerator generator(vm, checker.operand_types());
+  generator.set_optimization_level(level);
+  p.accept(generator);
+}
+
+// compile and run the program, returning what it wrote to cout
+string run(const string& program, Dispatch dispatch = Dispatch::TABLE,
+           int level = 0)
+{
+  VM vm;
+  compile(program, vm, level);
+  vm.set_dispatch(dispatch);
+  stringstream out;
+  streambuf* saved = cout.rdbuf(out.rdbuf());
+  try {
+    vm.run();
+  } catch (...) {
+    cout.rdbuf(saved);
+    throw;
+  }
+  cout.rdbuf(saved);
+  return out.str();
+}
+
+const string FIB_PROGRAM =
+  "int fib(int n) {"
+  "  if (n <= 1) {"
+  "    return n"
+  "  }"
+  "  return fib(n - 1) + fib(n - 2)"
+  "}"
+  "void main() {"
+  "  print(fib(15))"
+  "}";
+
+const string LOOP_PROGRAM =
+  "void main() {"
+  "  array int xs = new int[10]"
+  "  for (int i = 0; i < 10; i = i + 1) {"
+  "    xs[i] = i * 2"
+  "  }"
+  "  int total = 0"
+  "  int j = 0"
+  "  while (j < 10) {"
+  "    total = total + xs[j]"
+  "    j = j + 1"
+  "  }"
+  "  print(total)"
+  "}";
+
+//------------------------------------------------------------
+// Instruction dispatch
+//------------------------------------------------------------
+
+TEST (MyPLVMTests, TableDispatchRecursion) {
+  EXPECT_EQ("610", run(FIB_PROGRAM));
+}
+
+TEST (MyPLVMTests, LegacyDispatchRecursion) {
+  EXPECT_EQ("610", run(FIB_PROGRAM, Dispatch::LEGACY));
+}
+
+TEST (MyPLVMTests, DispatchStrategiesAgree) {
+  EXPECT_EQ(run(LOOP_PROGRAM, Dispatch::LEGACY), run(LOOP_PROGRAM));
+  EXPECT_EQ("90", run(LOOP_PROGRAM));
+}
+
+TEST (MyPLVMTests, VMErrorsAreReported) {
+  string program =
+    "void main() {"
+    "  array int xs = new int[3]"
+    "  xs[5] = 1"
+    "}";
+  EXPECT_THROW(run(program), MyPLException);
+  EXPECT_THROW(run(program, Dispatch::LEGACY), MyPLException);
+}
+
+//------------------------------------------------------------
+// Linking
+//------------------------------------------------------------
+
+TEST (MyPLVMTests, LinkReportsUndefinedFunction) {
+  VMFrameInfo main {"main", 0};
+  main.instructions.push_back(VMInstr::CALL("missing"));
+  main.instructions.push_back(VMInstr::POP());
+  main.instructions.push_back(VMInstr::PUSH(nullptr));
+  main.instructions.push_back(VMInstr::RET());
+  VM vm;
+  vm.add(main);
+  EXPECT_THROW(vm.link(), MyPLException);
+}
+
+TEST (MyPLVMTests, LinkReportsMissingMain) {
+  VMFrameInfo f {"f", 0};
+  f.instructions.push_back(VMInstr::PUSH(nullptr));
+  f.instructions.push_back(VMInstr::RET());
+  VM vm;
+  vm.add(f);
+  EXPECT_THROW(vm.link(), MyPLException);
+}
+
+TEST (MyPLVMTests, LinkedCallsKeepNamesForPrinting) {
+  VM vm;
+  compile(FIB_PROGRAM, vm);
+  vm.link();
+  EXPECT_NE(string::npos, to_string(vm).find("CALL(fib)"));
+}
+
+//------------------------------------------------------------
+// Call stack
+//------------------------------------------------------------
+
+const string DEPTH_PROGRAM =
+  "int down(int n) {"
+  "  if (n == 0) {"
+  "    return 0"
+  "  }"
+  "  return down(n - 1) + 1"
+  "}"
+  "void main() {"
+  "  print(down(500))"
+  "}";
+
+TEST (MyPLVMTests, DeepRecursionWithinLimit) {
+  EXPECT_EQ("500", run(DEPTH_PROGRAM));
+}
+
+TEST (MyPLVMTests, StackOverflowIsReported) {
+  VM vm;
+  compile(DEPTH_PROGRAM, vm);
+  vm.set_max_call_depth(100);
+  try {
+    vm.run();
+    FAIL();
+  } catch (MyPLException& ex) {
+    EXPECT_TRUE(string(ex.what()).starts_with("VM Error: stack overflow"));
+  }
+}
+
+TEST (MyPLVMTests, CallStatementsDoNotGrowTheStack) {
+  string program =
+    "void noop() {}"
+    "void main() {"
+    "  for (int i = 0; i < 100000; i = i + 1) {"
+    "    noop()"
+    "  }"
+    "  print(\"done\")"
+    "}";
+  VM vm;
+  compile(program, vm);
+  vm.set_value_stack_size(64);
+  stringstream out;
+  streambuf* saved = cout.rdbuf(out.rdbuf());
+  vm.run();
+  cout.rdbuf(saved);
+  EXPECT_EQ("done", out.str());
+}
+
+TEST (MyPLVMTests, ArgumentsArriveInOrder) {
+  string program =
+    "string join(string a, string b, string c) {"
+    "  return concat(a, concat(b, c))"
+    "}"
+    "void main() {"
+    "  print(join(\"x\", \"y\", \"z\"))"
+    "}";
+  EXPECT_EQ("xyz", run(program));
+}
+
+TEST (MyPLVMTests, VoidFunctionsReturnToCaller) {
+  string program =
+    "void say(string s) {"
+    "  print(s)"
+    "}"
+    "void main() {"
+    "  say(\"a\")"
+    "  say(\"b\")"
+    "}";
+  EXPECT_EQ("ab", run(program));
+}
+
+TEST (MyPLVMTests, LinkReportsInconsistentStackDepth) {
+  // loop body pushes a value on each iteration
+  VMFrameInfo main {"main", 0};
+  main.instructions.push_back(VMInstr::PUSH(1));
+  main.instructions.push_back(VMInstr::JMP(0));
+  VM vm;
+  vm.add(main);
+  EXPECT_THROW(vm.link(), MyPLException);
+}
+
+TEST (MyPLVMTests, ElseIfBodiesSkipTheRest) {
+  // (each else-if body leaves nothing behind for the next condition)
+  string program =
+    "void main() {"
+    "  for (int x = 1; x <= 4; x = x + 1) {"
+    "    if (x == 1) {print(\"one \")}"
+    "    elseif (x == 2) {print(\"two \")}"
+    "    elseif (x == 3) {print(\"three \")}"
+    "    else {print(\"other \")}"
+    "  }"
+    "  if (false) {print(\"yes \")} else {print(\"no \")}"
+    "  print(\"done\")"
+    "}";
+  EXPECT_EQ("one two three other no done", run(program));
+}
+
+//------------------------------------------------------------
+// Values
+//------------------------------------------------------------
+
+TEST (MyPLVMTests, ValuesAreCompact) {
+  EXPECT_EQ(16, sizeof(VMValue));
+  EXPECT_TRUE(VMValue().is_null());
+  EXPECT_EQ(3, VMValue(3).as_int());
+  EXPECT_EQ(2.5, VMValue(2.5).as_double());
+  EXPECT_TRUE(VMValue(true).as_bool());
+  EXPECT_EQ("ab", VMValue("ab").as_string());
+}
+
+TEST (MyPLVMTests, CopiedStringsShareCharacters) {
+  VMValue x = string("shared");
+  VMValue y = x;
+  EXPECT_EQ(&x.as_string(), &y.as_string());
+  x = 1;
+  EXPECT_EQ("shared", y.as_string());
+  EXPECT_EQ("1", to_string(x));
+}
+
+TEST (MyPLVMTests, ConcatenationsShareTheirParts) {
+  VMValue x = string(40, 'x');
+  VMValue y = string(40, 'y');
+  VMValue xy = x.concat(y);
+  EXPECT_EQ(80, xy.string_size());
+  EXPECT_EQ(string(40, 'x') + string(40, 'y'), xy.as_string());
+  EXPECT_TRUE(xy.string_equal(x.concat(y)));
+  EXPECT_FALSE(xy.string_equal(y.concat(x)));
+  EXPECT_EQ("ab", VMValue("a").concat("b").as_string());
+  EXPECT_EQ(&x.as_string(), &x.concat("").as_string());
+}
+
+TEST (MyPLVMTests, LongConcatenationChainsDoNotRecurse) {
+  VMValue s = string(100, 'a');
+  for (int i = 0; i < 200000; ++i)
+    s = s.concat("b");
+  VMValue t = s.concat("c");
+  EXPECT_EQ(200101, t.string_size());
+  s = nullptr;
+  EXPECT_EQ('c', t.as_string().back());
+  EXPECT_EQ('b', t.as_string()[200099]);
+  VMValue u = string(100, 'a');
+  for (int i = 0; i < 200000; ++i)
+    u = u.concat("b");
+  u = nullptr;
+}
+
+TEST (MyPLVMTests, ConcatenatedStringsBehaveAsStrings) {
+  string program =
+    "void main() {"
+    "  string s = \"\""
+    "  for (int i = 0; i < 2000; i = i + 1) {"
+    "    s = concat(s, \"ab\")"
+    "  }"
+    "  print(length(s))"
+    "  print(get(3999, s))"
+    "  string t = concat(s, \"\")"
+    "  print(s == t)"
+    "  print(s < concat(s, \"a\"))"
+    "}";
+  EXPECT_EQ("4000btruetrue", run(program));
+}
+
+TEST (MyPLVMTests, WrongTypeAccessIsAVMError) {
+  EXPECT_THROW(VMValue(1).as_string(), MyPLException);
+  EXPECT_THROW(VMValue(nullptr).as_int(), MyPLException);
+}
+
+//------------------------------------------------------------
+// Typed instructions
+//------------------------------------------------------------
+
+TEST (MyPLVMTests, CheckedTypesSelectTypedInstructions) {
+  string program =
+    "void main() {"
+    "  int x = 3"
+    "  double d = 1.5"
+    "  string s = \"a\""
+    "  print((x * 2) < 7)"
+    "  print((d / 2.0) >= 0.5)"
+    "  print(s != \"b\")"
+    "  print(x == null)"
+    "}";
+  VM vm;
+  compile(program, vm);
+  string ir = to_string(vm);
+  EXPECT_NE(string::npos, ir.find("MULI()"));
+  EXPECT_NE(string::npos, ir.find("CMPLTI()"));
+  EXPECT_NE(string::npos, ir.find("DIVD()"));
+  EXPECT_NE(string::npos, ir.find("CMPGED()"));
+  EXPECT_NE(string::npos, ir.find("CMPNES()"));
+  EXPECT_NE(string::npos, ir.find("CMPEQ()"));
+  EXPECT_EQ("truetruetruefalse", run(program));
+  EXPECT_EQ("truetruetruefalse", run(program, Dispatch::LEGACY));
+}
+
+TEST (MyPLVMTests, TypedInstructionsReportNullOperands) {
+  string program =
+    "struct T {int v}"
+    "void main() {"
+    "  T t = new T"
+    "  print(t.v + 1)"
+    "}";
+  EXPECT_THROW(run(program), MyPLException);
+}
+
+//------------------------------------------------------------
+// Superinstructions
+//------------------------------------------------------------
+
+// run the program with or without superinstructions, returning what
+// it wrote to cout or its error message
+string run_fused(const string& program, bool fused)
+{
+  VM vm;
+  compile(program, vm);
+  vm.set_superinstructions(fused);
+  stringstream out;
+  streambuf* saved = cout.rdbuf(out.rdbuf());
+  try {
+    vm.run();
+  } catch (MyPLException& ex) {
+    out << ex.what();
+  }
+  cout.rdbuf(saved);
+  return out.str();
+}
+
+// the number of instructions executed by the program
+long dispatches(const string& program, bool fused)
+{
+  VM vm;
+  compile(program, vm);
+  vm.set_superinstructions(fused);
+  vm.set_profile(true);
+  stringstream out;
+  streambuf* saved = cout.rdbuf(out.rdbuf());
+  vm.run();
+  cout.rdbuf(saved);
+  string report = vm.profile_report();
+  return stol(report.substr(report.find(':') + 1));
+}
+
+TEST (MyPLVMTests, SuperinstructionsAgreeWithPlainInstructions) {
+  EXPECT_EQ(run_fused(LOOP_PROGRAM, false), run_fused(LOOP_PROGRAM, true));
+  EXPECT_EQ(run_fused(FIB_PROGRAM, false), run_fused(FIB_PROGRAM, true));
+}
+
+TEST (MyPLVMTests, SuperinstructionsKeepErrorLocations) {
+  string program =
+    "void main() {"
+    "  array int xs = new int[3]"
+    "  int i = 4"
+    "  print(xs[i])"
+    "}";
+  string msg = run_fused(program, true);
+  EXPECT_TRUE(msg.starts_with("VM Error: out-of-bounds array index"));
+  EXPECT_EQ(run_fused(program, false), msg);
+}
+
+TEST (MyPLVMTests, SuperinstructionsHalveLoopDispatches) {
+  EXPECT_LE(2 * dispatches(LOOP_PROGRAM, true),
+            dispatches(LOOP_PROGRAM, false));
+}
+
+//------------------------------------------------------------
+// Peephole optimization
+//------------------------------------------------------------
+
+// the generated instructions for the program
+string ir(const string& program, int level)
+{
+  VM vm;
+  compile(program, vm, level);
+  return to_string(vm);
+}
+
+TEST (MyPLVMTests, PeepholeRemovesNopsAndRetargetsJumps) {
+  EXPECT_NE(string::npos, ir(LOOP_PROGRAM, 0).find("NOP()"));
+  EXPECT_EQ(string::npos, ir(LOOP_PROGRAM, 1).find("NOP()"));
+  EXPECT_EQ("90", run(LOOP_PROGRAM, Dispatch::TABLE, 1));
+  EXPECT_EQ("610", run(FIB_PROGRAM, Dispatch::TABLE, 1));
+}
+
+TEST (MyPLVMTests, PeepholeRemovesConstantBranchesAndDeadStores) {
+  string program =
+    "void main() {"
+    "  int x = 3"
+    "  int y = x + 1"
+    "  if (false) {"
+    "    print(x)"
+    "  }"
+    "  while (true) {"
+    "    print(y)"
+    "    return null"
+    "  }"
+    "}";
+  string code = ir(program, 1);
+  EXPECT_EQ(string::npos, code.find("JMP"));
+  EXPECT_EQ(string::npos, code.find("STORE"));
+  EXPECT_EQ("4", run(program, Dispatch::TABLE, 1));
+}
+
+TEST (MyPLVMTests, PeepholeKeepsStoresThatMayFail) {
+  string program =
+    "struct T {int v}"
+    "void main() {"
+    "  T t = new T"
+    "  int v = t.v"
+    "  print(v)"
+    "}";
+  EXPECT_THROW(run(program, Dispatch::TABLE, 1), MyPLException);
+}
+
+TEST (MyPLVMTests, FoldingMatchesRunTimeSemantics) {
+  VM vm;
+  EXPECT_EQ(3, vm.fold(OpCode::DIV, 7, 2).value().as_int());
+  EXPECT_EQ(3.5, vm.fold(OpCode::DIVD, 7.0, 2.0).value().as_double());
+  EXPECT_EQ("ab", vm.fold(OpCode::CONCAT, "a", "b").value().as_string());
+  EXPECT_TRUE(vm.fold(OpCode::CMPEQI, nullptr, nullptr).value().as_bool());
+  EXPECT_FALSE(vm.fold(OpCode::CMPLTS, "b", "a").value().as_bool());
+  // left for run() to report (or trap on)
+  EXPECT_FALSE(vm.fold(OpCode::DIVI, 7, 0).has_value());
+  EXPECT_FALSE(vm.fold(OpCode::ADD, 1, 2.0).has_value());
+  EXPECT_FALSE(vm.fold(OpCode::MUL, nullptr, 2).has_value());
+  EXPECT_FALSE(vm.fold(OpCode::ADDI, 1.0, 2.0).has_value());
+}
+
+TEST (MyPLVMTests, ConstantExpressionsAreFolded) {
+  string program =
+    "void main() {"
+    "  print(3 * 60 * 1000)"
+    "  print(10 - 3 - 2)"
+    "  print(7 / 2)"
+    "  print(7.0 / 2.0)"
+    "  print(concat(\"a\", \"b\"))"
+    "  print((1 < 2) and not (\"a\" == \"b\"))"
+    "}";
+  string code = ir(program, 1);
+  for (string op : {"MUL", "SUB", "DIV", "CONCAT", "CMP", "AND", "NOT"})
+    EXPECT_EQ(string::npos, code.find(op));
+  EXPECT_EQ(run(program), run(program, Dispatch::TABLE, 1));
+  EXPECT_EQ("180000933.500000abtrue", run(program, Dispatch::TABLE, 1));
+}
+
+TEST (MyPLVMTests, ConstantVariablesArePropagated) {
+  string program =
+    "void main() {"
+    "  int limit = 2 * 3"
+    "  int total = 0"
+    "  for (int i = 0; i < limit; i = i + 1) {"
+    "    total = total + limit"
+    "  }"
+    "  print(total)"
+    "}";
+  string code = ir(program, 1);
+  EXPECT_EQ(string::npos, code.find("STORE(0)"));
+  EXPECT_EQ(string::npos, code.find("LOAD(0)"));
+  EXPECT_EQ("36", run(program, Dispatch::TABLE, 1));
+}
+
+//------------------------------------------------------------
+// Structs
+//------------------------------------------------------------
+
+TEST (MyPLVMTests, StructFieldsResolveToSlots) {
+  string program =
+    "struct Node {int val, Node next}"
+    "struct Pair {string val, Node first}"
+    "void main() {"
+    "  Pair p = new Pair"
+    "  p.val = \"list:\""
+    "  p.first = new Node"
+    "  p.first.val = 1"
+    "  p.first.next = new Node"
+    "  p.first.next.val = 2"
+    "  print(p.val)"
+    "  print(p.first.val + p.first.next.val)"
+    "  print(p.first.next.next == null)"
+    "}";
+  EXPECT_EQ("list:3true", run(program));
+  VM vm;
+  compile(program, vm);
+  vm.link();
+  string code = to_string(vm);
+  EXPECT_NE(string::npos, code.find("ALLOCS(Node)"));
+  EXPECT_NE(string::npos, code.find("SETF(Node.val)"));
+  EXPECT_NE(string::npos, code.find("GETF(Pair.first)"));
+  EXPECT_EQ(string::npos, code.find("ADDF"));
+}
+
+TEST (MyPLVMTests, LinkReportsUndefinedField) {
+  VMFrameInfo main {"main", 0};
+  main.instructions.push_back(VMInstr::ALLOCS("T"));
+  main.instructions.push_back(VMInstr::GETF("T.missing"));
+  main.instructions.push_back(VMInstr::RET());
+  VM vm;
+  vm.add(VMStructInfo {"T", {"x"}});
+  vm.add(main);
+  EXPECT_THROW(vm.link(), MyPLException);
+}
+
+//------------------------------------------------------------
+// Object heap
+//------------------------------------------------------------
+
+TEST (MyPLVMTests, HeapObjectsHoldTheirSlots) {
+  VMHeap heap;
+  VMObject* small = heap.allocate(VMObject::Kind::STRUCT, 3);
+  VMObject* large = heap.allocate(VMObject::Kind::ARRAY, 1000, 7);
+  EXPECT_EQ(3, small->size);
+  EXPECT_TRUE((*small)[2].is_null());
+  EXPECT_EQ(1000, large->size);
+  EXPECT_EQ(7, (*large)[999].as_int());
+  (*small)[0] = string("field");
+  EXPECT_EQ("field", (*small)[0].as_string());
+  EXPECT_NE(small->id, large->id);
+}
+
+TEST (MyPLVMTests, ReferencesCompareByIdentity) {
+  VMHeap heap;
+  VMObject* a = heap.allocate(VMObject::Kind::STRUCT, 1);
+  VMValue x = a;
+  VMValue y = heap.allocate(VMObject::Kind::STRUCT, 1);
+  EXPECT_EQ(a, x.as_ref());
+  EXPECT_TRUE(VM().fold(OpCode::CMPEQ, x, VMValue(a)).value().as_bool());
+  EXPECT_FALSE(VM().fold(OpCode::CMPEQ, x, y).value().as_bool());
+  EXPECT_EQ(to_string(a->id), to_string(x));
+}
+
+TEST (MyPLVMTests, NegativeArraySizeIsAVMError) {
+  string program =
+    "void main() {"
+    "  int n = 0 - 1"
+    "  array int xs = new int[n]"
+    "}";
+  EXPECT_THROW(run(program), MyPLException);
+}
+
+//------------------------------------------------------------
+// Garbage collection
+//------------------------------------------------------------
+
+const string LIST_PROGRAM =
+  "struct Node {"
+  "  int val,"
+  "  Node next"
+  "}"
+  "Node build(int n) {"
+  "  Node head = new Node"
+  "  head.val = 0"
+  "  for (int i = 1; i < n; i = i + 1) {"
+  "    Node t = new Node"
+  "    t.val = i"
+  "    t.next = head"
+  "    head = t"
+  "    array int garbage = new int[10]"
+  "  }"
+  "  return head"
+  "}"
+  "void main() {"
+  "  Node head = build(50)"
+  "  int total = 0"
+  "  while (head.next != null) {"
+  "    total = total + head.val"
+  "    head = head.next"
+  "  }"
+  "  print(total)"
+  "}";
+
+TEST (MyPLVMTests, CollectionKeepsReachableObjects) {
+  VMHeap heap;
+  VMValue roots[2] = {heap.allocate(VMObject::Kind::STRUCT, 1),
+                      heap.allocate(VMObject::Kind::ARRAY, 500, 1)};
+  (*roots[0].as_ref())[0] = heap.allocate(VMObject::Kind::STRUCT, 2, 3);
+  heap.allocate(VMObject::Kind::STRUCT, 4);
+  heap.allocate(VMObject::Kind::ARRAY, 500);
+  heap.collect(roots, roots + 2, true);
+  EXPECT_EQ(1, heap.statistics().collections);
+  EXPECT_EQ(2, heap.statistics().objects_freed);
+  VMObject* child = (*roots[0].as_ref())[0].as_ref();
+  EXPECT_EQ(3, (*child)[1].as_int());
+  EXPECT_EQ(1, (*roots[1].as_ref())[499].as_int());
+}
+
+TEST (MyPLVMTests, StressCollectionPreservesResults) {
+  VM vm;
+  compile(LIST_PROGRAM, vm);
+  vm.set_gc_stress(true);
+  stringstream out;
+  streambuf* saved = cout.rdbuf(out.rdbuf());
+  vm.run();
+  cout.rdbuf(saved);
+  EXPECT_EQ("1225", out.str());
+  EXPECT_EQ(99, vm.gc_statistics().collections);
+  EXPECT_EQ(47, vm.gc_statistics().objects_freed);
+}
+
+TEST (MyPLVMTests, CollectionBoundsHeapGrowth) {
+  string program =
+    "void main() {"
+    "  for (int i = 0; i < 2000; i = i + 1) {"
+    "    array int xs = new int[100]"
+    "  }"
+    "}";
+  VM vm;
+  compile(program, vm);
+  vm.set_gc_threshold(16 * 1024);
+  vm.set_gc_nursery_size(8 * 1024);
+  vm.run();
+  const VMHeapStats& stats = vm.gc_statistics();
+  EXPECT_LT(0, stats.minor_collections);
+  EXPECT_GT(32 * 1024u, stats.peak_bytes_in_use);
+}
+
+TEST (MyPLVMTests, MinorCollectionPromotesSurvivors) {
+  VMHeap heap;
+  VMValue root = heap.allocate(VMObject::Kind::STRUCT, 2, 5);
+  int id = root.as_ref()->id;
+  heap.allocate(VMObject::Kind::STRUCT, 2);
+  heap.collect(&root, &root + 1);
+  const VMHeapStats& stats = heap.statistics();
+  EXPECT_EQ(1, stats.minor_collections);
+  EXPECT_EQ(0, stats.collections);
+  EXPECT_EQ(1, stats.objects_promoted);
+  EXPECT_EQ(1, stats.objects_freed);
+  EXPECT_EQ(id, root.as_ref()->id);
+  EXPECT_EQ(5, (*root.as_ref())[1].as_int());
+}
+
+TEST (MyPLVMTests, WriteBarrierRemembersOldToYoungReferences) {
+  VMHeap heap;
+  VMValue root = heap.allocate(VMObject::Kind::ARRAY, 200);
+  VMObject* old = root.as_ref();
+  VMValue young = heap.allocate(VMObject::Kind::STRUCT, 1, 7);
+  heap.write_barrier(old, young);
+  (*old)[3] = young;
+  young = nullptr;
+  heap.collect(&root, &root + 1);
+  EXPECT_EQ(0, heap.statistics().objects_freed);
+  EXPECT_EQ(7, (*(*old)[3].as_ref())[0].as_int());
+}
+
+TEST (MyPLVMTests, StoresIntoOldObjectsSurviveMinorCollections) {
+  string program =
+    "struct Node {"
+    "  int val,"
+    "  Node next"
+    "}"
+    "void main() {"
+    "  array Node nodes = new Node[200]"
+    "  Node head = new Node"
+    "  head.val = 0"
+    "  Node tail = head"
+    "  for (int i = 0; i < 200; i = i + 1) {"
+    "    Node t = new Node"
+    "    t.val = i"
+    "    nodes[i] = t"
+    "    tail.next = t"
+    "    tail = t"
+    "    array int garbage = new int[50]"
+    "  }"
+    "  int total = 0"
+    "  for (int i = 0; i < 200; i = i + 1) {"
+    "    total = total + nodes[i].val"
+    "  }"
+    "  while (head.next != null) {"
+    "    head = head.next"
+    "    total = total + head.val"
+    "  }"
+    "  print(total)"
+    "}";
+  VM vm;
+  compile(program, vm);
+  vm.set_gc_nursery_size(4 * 1024);
+  stringstream out;
+  streambuf* saved = cout.rdbuf(out.rdbuf());
+  vm.run();
+  cout.rdbuf(saved);
+  EXPECT_EQ("39800", out.str());
+  EXPECT_LT(10, vm.gc_statistics().minor_collections);
+}
+
+//------------------------------------------------------------
+// Typed arrays
+//------------------------------------------------------------
+
+const string TYPED_ARRAY_PROGRAM =
+  "void main() {"
+  "  array int xs = new int[3]"
+  "  array double ds = new double[2]"
+  "  array bool bs = new bool[2]"
+  "  array char cs = new char[2]"
+  "  xs[1] = 7"
+  "  ds[0] = 2.5"
+  "  bs[1] = true"
+  "  cs[0] = 'a'"
+  "  print(xs[0]) print(xs[1]) print(ds[0]) print(ds[1])"
+  "  print(bs[0]) print(bs[1]) print(cs[0]) print(cs[1])"
+  "}";
+
+TEST (MyPLVMTests, ArrayElementTypesSelectTypedInstructions) {
+  VM vm;
+  compile(TYPED_ARRAY_PROGRAM, vm);
+  string ir = to_string(vm);
+  for (string op : {"ALLOCAI()", "ALLOCAD()", "ALLOCAB()", "ALLOCAC()",
+                    "SETII()", "SETID()", "SETIB()", "SETIC()",
+                    "GETII()", "GETID()", "GETIB()", "GETIC()"})
+    EXPECT_NE(string::npos, ir.find(op)) << op;
+  EXPECT_EQ(string::npos, ir.find("ALLOCA()"));
+}
+
+TEST (MyPLVMTests, TypedArrayElementsStartNull) {
+  string expected = "null72.500000nullnulltrueanull";
+  EXPECT_EQ(expected, run(TYPED_ARRAY_PROGRAM));
+  EXPECT_EQ(expected, run(TYPED_ARRAY_PROGRAM, Dispatch::LEGACY));
+}
+
+TEST (MyPLVMTests, TypedArraysStoreElementsUnboxed) {
+  VMHeap heap;
+  VMObject* ints = heap.allocate(VMObject::Kind::INT_ARRAY, 1000);
+  EXPECT_GT(16 + 1000 * 4 + 1000 / 8 + 16,
+            heap.statistics().bytes_in_use);
+  ints->set(999, 5);
+  EXPECT_TRUE(ints->is_set(999));
+  EXPECT_FALSE(ints->is_set(998));
+  EXPECT_EQ(5, ints->element(999).as_int());
+  EXPECT_TRUE(ints->element(0).is_null());
+  VMObject* chars = heap.allocate(VMObject::Kind::CHAR_ARRAY, 3, "x");
+  EXPECT_EQ("x", chars->element(2).as_string());
+}
+
+TEST (MyPLVMTests, TypedArraysSurviveCollections) {
+  string program =
+    "void main() {"
+    "  array double ds = new double[20]"
+    "  for (int i = 0; i < 20; i = i + 1) {"
+    "    array int garbage = new int[100]"
+    "    ds[i] = to_double(i) / 2.0"
+    "  }"
+    "  double total = 0.0"
+    "  for (int i = 0; i < 20; i = i + 1) {"
+    "    total = total + ds[i]"
+    "  }"
+    "  print(total)"
+    "}";
+  VM vm;
+  compile(program, vm);
+  vm.set_gc_stress(true);
+  stringstream out;
+  streambuf* saved = cout.rdbuf(out.rdbuf());
+  vm.run();
+  cout.rdbuf(saved);
+  EXPECT_EQ("95.000000", out.str());
+}
+
+TEST (MyPLVMTests, StoringNullInATypedArrayIsAVMError) {
+  string program =
+    "void main() {"
+    "  array int xs = new int[2]"
+    "  xs[0] = xs[1]"
+    "}";
+  EXPECT_THROW(run(program), MyPLException);
+}
+
+//------------------------------------------------------------
+// Verification
+//------------------------------------------------------------
+
+// run the vm's code, returning what it wrote to cout or its error
+// message
+string run_vm(VM& vm)
+{
+  stringstream out;
+  streambuf* saved = cout.rdbuf(out.rdbuf());
+  try {
+    vm.run();
+  } catch (MyPLException& ex) {
+    out << ex.what();
+  }
+  cout.rdbuf(saved);
+  return out.str();
+}
+
+TEST (MyPLVMTests, GeneratedCodeVerifies) {
+  string program =
+    "struct Node {int val, Node next}"
+    "Node push(Node list, int val) {"
+    "  Node n = new Node"
+    "  n.val = val"
+    "  n.next = list"
+    "  return n"
+    "}"
+    "void main() {"
+    "  Node list = new Node"
+    "  for (int i = 1; i <= 3; i = i + 1) {"
+    "    list = push(list, i * i)"
+    "  }"
+    "  array char cs = new char[1]"
+    "  cs[0] = 'x'"
+    "  print(list.val + list.next.val)"
+    "  print(cs[0])"
+    "}";
+  for (string p : {FIB_PROGRAM, LOOP_PROGRAM, TYPED_ARRAY_PROGRAM, program}) {
+    for (int level : {0, 1}) {
+      VM vm;
+      compile(p, vm, level);
+      vm.link();
+      EXPECT_TRUE(vm.verification_failures().empty())
+        << vm.verification_failures()[0];
+    }
+  }
+  EXPECT_EQ("13x", run(program));
+}
+
+TEST (MyPLVMTests, VerifierReportsMistypedOperands) {
+  VMFrameInfo main {"main", 0};
+  main.instructions.push_back(VMInstr::PUSH("a"));
+  main.instructions.push_back(VMInstr::PUSH(1));
+  main.instructions.push_back(VMInstr::ADDI());
+  main.instructions.push_back(VMInstr::WRITE());
+  main.instructions.push_back(VMInstr::PUSH(nullptr));
+  main.instructions.push_back(VMInstr::RET());
+  VM vm;
+  vm.add(main);
+  vm.link();
+  ASSERT_EQ(1, vm.verification_failures().size());
+  EXPECT_EQ("expecting int value, found string (in main at 2: ADDI())",
+            vm.verification_failures()[0]);
+  // the checked interpreter reports what verification would have
+  EXPECT_NE(string::npos, run_vm(vm).find("VM Error"));
+}
+
+TEST (MyPLVMTests, VerifierFollowsDeclaredTypes) {
+  VMFrameInfo f {"f", 1};
+  f.arg_types = {"int"};
+  f.return_type = "int";
+  f.instructions.push_back(VMInstr::LOAD(0));
+  f.instructions.push_back(VMInstr::PUSH(1));
+  f.instructions.push_back(VMInstr::ADDI());
+  f.instructions.push_back(VMInstr::RET());
+  VMFrameInfo main {"main", 0};
+  main.instructions.push_back(VMInstr::PUSH("2"));
+  main.instructions.push_back(VMInstr::CALL("f"));
+  main.instructions.push_back(VMInstr::WRITE());
+  main.instructions.push_back(VMInstr::PUSH(nullptr));
+  main.instructions.push_back(VMInstr::RET());
+  VM vm;
+  vm.add(f);
+  vm.add(main);
+  vm.link();
+  ASSERT_EQ(1, vm.verification_failures().size());
+  EXPECT_NE(string::npos, vm.verification_failures()[0].find(
+              "argument 1 of 'f' is not of type int (in main at 1"));
+  // without a declared parameter type f itself cannot verify
+  f.arg_types.clear();
+  vm.add(f);
+  vm.link();
+  ASSERT_EQ(1, vm.verification_failures().size());
+  EXPECT_NE(string::npos, vm.verification_failures()[0].find(
+              "expecting int value, found unknown (in f at 2"));
+}
+
+TEST (MyPLVMTests, VerifierReportsRunningOffTheEnd) {
+  VMFrameInfo main {"main", 0};
+  main.instructions.push_back(VMInstr::PUSH(1));
+  main.instructions.push_back(VMInstr::WRITE());
+  VM vm;
+  vm.add(main);
+  vm.link();
+  ASSERT_EQ(1, vm.verification_failures().size());
+  EXPECT_EQ("code runs off its end (in main at 1: WRITE())",
+            vm.verification_failures()[0]);
+  EXPECT_EQ("1", run_vm(vm));
+}
+
+TEST (MyPLVMTests, UnverifiedCodeChecksObjectKinds) {
+  // a double read from a bool array and a field of another struct type
+  VMFrameInfo main {"main", 0};
+  main.instructions.push_back(VMInstr::PUSH(2));
+  main.instructions.push_back(VMInstr::ALLOCAB());
+  main.instructions.push_back(VMInstr::PUSH(1));
+  main.instructions.push_back(VMInstr::GETID());
+  main.instructions.push_back(VMInstr::WRITE());
+  main.instructions.push_back(VMInstr::ALLOCS("T"));
+  main.instructions.push_back(VMInstr::GETF("U.c"));
+  main.instructions.push_back(VMInstr::RET());
+  VM vm;
+  vm.add(VMStructInfo {"T", {"x"}});
+  vm.add(VMStructInfo {"U", {"a", "b", "c"}});
+  vm.add(main);
+  string output = run_vm(vm);
+  EXPECT_EQ(0, output.find("null"));
+  EXPECT_NE(string::npos, output.find("no such field (in main at 6"));
+  EXPECT_EQ(1, vm.verification_failures().size());
+}
+
+TEST (MyPLVMTests, VerificationCanBeTurnedOff) {
+  VM vm;
+  compile(FIB_PROGRAM, vm);
+  vm.set_verification(false);
+  EXPECT_EQ("610", run_vm(vm));
+  EXPECT_TRUE(vm.verification_failures().empty());
+  vm.set_dispatch(Dispatch::LEGACY);
+  EXPECT_EQ("610", run_vm(vm));
+}
+
+//------------------------------------------------------------
+// Bytecode files
+//------------------------------------------------------------
+
+const string BYTECODE_PROGRAM =
+  "struct Point {double x, double y, string name}"
+  "Point point(double x, double y) {"
+  "  Point p = new Point"
+  "  p.x = x"
+  "  p.y = y"
+  "  p.name = \"p\""
+  "  return p"
+  "}"
+  "void main() {"
+  "  Point p = point(1.5, 0.0 - 2.0)"
+  "  array bool bs = new bool[2]"
+  "  bs[1] = p.x > p.y"
+  "  print(concat(p.name, to_string(p.x + p.y)))"
+  "  print(bs[1])"
+  "  print((0 - 2147483647) - 1)"
+  "}";
+
+// the bytecode of the vm's program
+string bytecode(const VM& vm)
+{
+  stringstream out;
+  write_bytecode(vm, out);
+  return out.str();
+}
+
+TEST (MyPLVMTests, BytecodeRoundTripsTheProgram) {
+  for (int level : {0, 1}) {
+    VM vm;
+    compile(BYTECODE_PROGRAM, vm, level);
+    stringstream in(bytecode(vm));
+    VM loaded;
+    read_bytecode(in, loaded);
+    EXPECT_EQ(bytecode(vm), bytecode(loaded));
+    EXPECT_EQ("p-0.500000true-2147483648", run_vm(loaded));
+    loaded.link();
+    EXPECT_TRUE(loaded.verification_failures().empty());
+  }
+}
+
+TEST (MyPLVMTests, BytecodeIsTheSameForTheSameProgram) {
+  VM vm1, vm2;
+  compile(BYTECODE_PROGRAM, vm1);
+  compile(BYTECODE_PROGRAM, vm2);
+  string code = bytecode(vm1);
+  EXPECT_EQ(code, bytecode(vm2));
+  EXPECT_EQ(0, code.find("MYPLC"));
+  // each name is stored once
+  EXPECT_EQ(code.find("Point.x"), code.rfind("Point.x"));
+}
+
+TEST (MyPLVMTests, MalformedBytecodeIsAVMError) {
+  VM vm;
+  compile(FIB_PROGRAM, vm);
+  string code = bytecode(vm);
+  for (string bad : {string("#!/usr/bin/env mypl"), code.substr(0, 5),
+                     code.substr(0, code.size() - 1), code + "x"}) {
+    stringstream in(bad);
+    VM loaded;
+    EXPECT_THROW(read_bytecode(in, loaded), MyPLException);
+  }
+  // a different format version
+  string old_version = code;
+  old_version[5] = char(BYTECODE_VERSION + 1);
+  stringstream in(old_version);
+  VM loaded;
+  EXPECT_THROW(read_bytecode(in, loaded), MyPLException);
+}
+
+TEST (MyPLVMTests, ImageFunctionsAreDecodedWhenFirstCalled) {
+  VM vm;
+  compile("void main() {print(\"ok\")} void unused() {print(1)}", vm);
+  // (unused's code is saved last, so this corrupts its first opcode)
+  string code = bytecode(vm);
+  code[code.size() - 5 * 4] = char(255);
+  stringstream in(code);
+  VM loaded;
+  loaded.load(VMImage::read(in));
+  EXPECT_EQ("ok", run_vm(loaded));
+  stringstream eager(code);
+  VM read;
+  EXPECT_THROW(read_bytecode(eager, read), MyPLException);
+}
+
+TEST (MyPLVMTests, ImageCodeThatDoesNotVerifyRunsChecked) {
+  VMFrameInfo main {"main", 0};
+  main.instructions.push_back(VMInstr::CALL("f"));
+  main.instructions.push_back(VMInstr::RET());
+  VMFrameInfo f {"f", 0};
+  f.instructions.push_back(VMInstr::ALLOCS("T"));
+  f.instructions.push_back(VMInstr::GETF("U.c"));
+  f.instructions.push_back(VMInstr::RET());
+  VM vm;
+  vm.add(VMStructInfo {"T", {"x"}});
+  vm.add(VMStructInfo {"U", {"a", "b", "c"}});
+  vm.add(main);
+  vm.add(f);
+  stringstream in(bytecode(vm));
+  VM loaded;
+  loaded.load(VMImage::read(in));
+  loaded.link();
+  EXPECT_TRUE(loaded.verification_failures().empty());
+  EXPECT_NE(string::npos, run_vm(loaded).find("no such field (in f at 1"));
+  EXPECT_EQ(1, loaded.verification_failures().size());
+}
+
+//------------------------------------------------------------
+// Compile cache
+//------------------------------------------------------------
+
+// an empty cache directory, removed when the test ends
+class CacheDirectory
+{
+public:
+  CacheDirectory()
+    : path(filesystem::temp_directory_path() /
+           ("mypl-cache-test-" + to_string(random_device()()))) {}
+  ~CacheDirectory() {filesystem::remove_all(path);}
+  const filesystem::path path;
+};
+
+TEST (MyPLVMTests, CacheFindsStoredBytecode) {
+  CacheDirectory dir;
+  CompileCache cache(dir.path.string());
+  string key = CompileCache::key(FIB_PROGRAM, 0);
+  EXPECT_EQ(nullptr, cache.find(key));
+  VM vm;
+  compile(FIB_PROGRAM, vm);
+  cache.store(key, vm);
+  shared_ptr<const VMImage> image = cache.find(key);
+  ASSERT_NE(nullptr, image);
+  VM cached;
+  cached.load(image);
+  EXPECT_EQ("610", run_vm(cached));
+  CompileCacheStats stats = cache.statistics();
+  EXPECT_EQ(1, stats.hits);
+  EXPECT_EQ(1, stats.misses);
+  EXPECT_EQ(1, stats.entries);
+  EXPECT_EQ(bytecode(vm).size(), stats.bytes);
+}
+
+TEST (MyPLVMTests, CacheKeysDependOnSourceAndOptimization) {
+  string key = CompileCache::key(FIB_PROGRAM, 0);
+  EXPECT_EQ(key, CompileCache::key(FIB_PROGRAM, 0));
+  EXPECT_NE(key, CompileCache::key(FIB_PROGRAM, 1));
+  EXPECT_NE(key, CompileCache::key(FIB_PROGRAM + " ", 0));
+}
+
+TEST (MyPLVMTests, CacheEvictsLeastRecentlyUsed) {
+  CacheDirectory dir;
+  vector<string> programs;
+  size_t bytes = 0;
+  for (int i = 0; i < 3; ++i) {
+    programs.push_back("void main() {print(" + to_string(i) + ")}");
+    VM vm;
+    compile(programs[i], vm);
+    bytes += bytecode(vm).size();
+  }
+  // room for all but one entry
+  CompileCache cache(dir.path.string(), bytes - 1);
+  auto store = [&](int i) {
+    VM vm;
+    compile(programs[i], vm);
+    cache.store(CompileCache::key(programs[i], 0), vm);
+    // (each entry stored a minute after the last)
+    filesystem::path entry = dir.path / (CompileCache::key(programs[i], 0) +
+                                         ".myplc");
+    filesystem::last_write_time(entry, filesystem::file_time_type::clock::now()
+                                - chrono::minutes(10 - i));
+  };
+  store(0);
+  store(1);
+  // using the first makes the second the least recently used
+  EXPECT_NE(nullptr, cache.find(CompileCache::key(programs[0], 0)));
+  store(2);
+  EXPECT_EQ(2, cache.statistics().entries);
+  EXPECT_NE(nullptr, cache.find(CompileCache::key(programs[0], 0)));
+  EXPECT_EQ(nullptr, cache.find(CompileCache::key(programs[1], 0)));
+  EXPECT_NE(nullptr, cache.find(CompileCache::key(programs[2], 0)));
+}
+
+//------------------------------------------------------------
+// Baseline compiler
+//------------------------------------------------------------
+
+// run the program with and without compiling hot functions, expecting
+// the same output (or error) from both
+string run_both(const string& program, int& compiled)
+{
+  VM interpreted;
+  compile(program, interpreted);
+  interpreted.set_jit(false);
+  string expected = run_vm(interpreted);
+  EXPECT_EQ(0, interpreted.jit_compiled_count());
+  VM vm;
+  compile(program, vm);
+  string actual = run_vm(vm);
+  EXPECT_EQ(expected, actual);
+  compiled = vm.jit_compiled_count();
+  return actual;
+}
+
+TEST (MyPLVMTests, HotFunctionsAreCompiled) {
+  if (!VMJit::available())
+    GTEST_SKIP();
+  int compiled = 0;
+  EXPECT_EQ("610", run_both(FIB_PROGRAM, compiled));
+  EXPECT_EQ(1, compiled);
+  string program =
+    "void main() {"
+    "  array int xs = new int[5000]"
+    "  array double ds = new double[5000]"
+    "  for (int i = 0; i < 5000; i = i + 1) {"
+    "    xs[i] = i - (i / 7) * 7"
+    "    ds[i] = to_double(i) / 4.0"
+    "  }"
+    "  int total = 0"
+    "  double sum = 0.0"
+    "  for (int i = 0; i < 5000; i = i + 1) {"
+    "    if ((xs[i] != 3) and not (ds[i] >= 1000.0)) {"
+    "      total = total + xs[i]"
+    "      sum = sum + ds[i]"
+    "    }"
+    "  }"
+    "  print(total) print(\" \") print(sum)"
+    "}";
+  EXPECT_EQ("10281 1714285.500000", run_both(program, compiled));
+  EXPECT_EQ(1, compiled);
+}
+
+TEST (MyPLVMTests, CompiledCodeLeavesFailedChecksToTheInterpreter) {
+  if (!VMJit::available())
+    GTEST_SKIP();
+  int compiled = 0;
+  // out of bounds and a null element, each well after the loop is
+  // compiled
+  for (string statement : {"xs[i] = i", "total = total + xs[i]"}) {
+    string program =
+      "void main() {"
+      "  array int xs = new int[2000]"
+      "  xs[0] = 0"
+      "  int total = 0"
+      "  for (int i = 0; i < 3000; i = i + 1) {"
+      "    if ((i < 1) or (i > 1500)) {" + statement + "}"
+      "  }"
+      "  print(total)"
+      "}";
+    string output = run_both(program, compiled);
+    EXPECT_NE(string::npos, output.find("VM Error")) << output;
+    EXPECT_EQ(1, compiled) << statement;
+  }
+  // dividing by -1 is left to the interpreter, which then goes on
+  string program =
+    "void main() {"
+    "  int total = 0"
+    "  for (int i = 0; i < 3000; i = i + 1) {"
+    "    if (i != 1500) {total = total + 3000 / (1500 - i)}"
+    "  }"
+    "  print(total)"
+    "}";
+  EXPECT_EQ("2", run_both(program, compiled));
+  EXPECT_EQ(1, compiled);
+}
+
+TEST (MyPLVMTests, CompiledCodeKeepsStringsAlive) {
+  if (!VMJit::available())
+    GTEST_SKIP();
+  string program =
+    "string pick(array string names, int i) {"
+    "  string name = names[i - (i / 3) * 3]"
+    "  return name"
+    "}"
+    "void main() {"
+    "  array string names = new string[3]"
+    "  names[0] = \"a\" names[1] = \"bb\" names[2] = \"ccc\""
+    "  string last = \"\""
+    "  int total = 0"
+    "  for (int i = 0; i < 3000; i = i + 1) {"
+    "    string s = pick(names, i)"
+    "    last = s"
+    "    total = total + length(last)"
+    "  }"
+    "  print(total) print(last)"
+    "}";
+  int compiled = 0;
+  EXPECT_EQ("6000ccc", run_both(program, compiled));
+  EXPECT_LE(1, compiled);
+}
+
+TEST (MyPLVMTests, CompiledCodeReenteredPastItsEnd) {
+  if (!VMJit::available())
+    GTEST_SKIP();
+  // g (which does not verify) ends with a call, so returning to it
+  // resumes just past its last instruction
+  VMFrameInfo h {"h", 0};
+  h.instructions.push_back(VMInstr::PUSH(nullptr));
+  h.instructions.push_back(VMInstr::RET());
+  VMFrameInfo g {"g", 1};
+  g.instructions.push_back(VMInstr::LOAD(0));
+  g.instructions.push_back(VMInstr::JMPF(4));
+  g.instructions.push_back(VMInstr::PUSH("t"));
+  g.instructions.push_back(VMInstr::RET());
+  g.instructions.push_back(VMInstr::CALL("h"));
+  VMFrameInfo main {"main", 0};
+  for (int i = 0; i < 2000; ++i) {
+    main.instructions.push_back(VMInstr::PUSH(true));
+    main.instructions.push_back(VMInstr::CALL("g"));
+    main.instructions.push_back(VMInstr::POP());
+  }
+  main.instructions.push_back(VMInstr::PUSH(false));
+  main.instructions.push_back(VMInstr::CALL("g"));
+  main.instructions.push_back(VMInstr::POP());
+  main.instructions.push_back(VMInstr::PUSH("done"));
+  main.instructions.push_back(VMInstr::WRITE());
+  main.instructions.push_back(VMInstr::PUSH(nullptr));
+  main.instructions.push_back(VMInstr::RET());
+  string outputs[2];
+  for (bool jit : {false, true}) {
+    VM vm;
+    vm.add(h);
+    vm.add(g);
+    vm.add(main);
+    vm.set_jit(jit);
+    outputs[jit] = run_vm(vm);
+    EXPECT_EQ(jit ? 1 : 0, vm.jit_compiled_count());
+  }
+  EXPECT_EQ(outputs[0], outputs[1]);
+}
+
+//----------------------------------------------------------------------
+// main
+//----------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
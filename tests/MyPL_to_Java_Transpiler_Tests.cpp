@@ -6,12 +6,16 @@
 //----------------------------------------------------------------------
 
 #include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <random>
 #include <string>
 #include <vector>
 #include "mypl_exception.h"
 #include "java_lexer.h"
 #include "java_ast_parser.h"
 #include "mypl_to_java_transpiler.h"
+#include "java_batch_transpiler.h"
 #include <iostream>
 
 using namespace std;
@@ -541,6 +545,114 @@ TEST (MyPLtoJavaTranspilerTests, not) {
     restore_cout();
 }
 
+//------------------------------------------------------------
+// Output
+//------------------------------------------------------------
+
+TEST (MyPLtoJavaTranspilerTests, WritesOnlyToItsStream) {
+    stringstream in("void main() {int a = 10}");
+    stringstream out;
+    stringstream console;
+    // (anything written to cout goes to console)
+    change_cout(console);
+    MyPLtoJavaTranspiler transpiler(out);
+    JavaASTParser(JavaLexer(in)).parse().accept(transpiler);
+    restore_cout();
+    EXPECT_EQ("", console.str());
+    EXPECT_EQ(build_string({
+        "import java.util.*;",
+        "\nimport java.util.Scanner;\n",
+        "\nclass Program {",
+        "\nScanner input = new Scanner(System.in);",
+        "\n\npublic static void main(String[] args) {",
+        "\nProgram p = new Program();",
+        "\n  int a = 10;;",
+        "\n}",
+        "\n}"
+    }),out.str());
+}
+
+TEST (MyPLtoJavaTranspilerTests, EachProgramWrittenOnce) {
+    stringstream out;
+    MyPLtoJavaTranspiler transpiler(out);
+    stringstream first("void main() {int a = 10}");
+    JavaASTParser(JavaLexer(first)).parse().accept(transpiler);
+    string program = out.str();
+    stringstream second("void main() {int a = 10}");
+    JavaASTParser(JavaLexer(second)).parse().accept(transpiler);
+    EXPECT_EQ(program + program, out.str());
+}
+
+//------------------------------------------------------------
+// Batches
+//------------------------------------------------------------
+
+// a directory of MyPL files (one that does not parse, and one nested),
+// removed when the test ends
+class BatchDirectory
+{
+public:
+  BatchDirectory()
+    : path(filesystem::temp_directory_path() /
+           ("mypl-batch-test-" + to_string(random_device()()))) {
+    filesystem::create_directories(path / "in" / "sub");
+    ofstream(path / "in" / "good.mypl") << GOOD;
+    ofstream(path / "in" / "bad.mypl") << "void main() { int x = }";
+    ofstream(path / "in" / "sub" / "nested.mypl") << NESTED;
+    ofstream(path / "in" / "notes.txt") << "not MyPL";
+  }
+  ~BatchDirectory() {filesystem::remove_all(path);}
+  const filesystem::path path;
+  static constexpr const char* GOOD = "void main() {int a = 10}";
+  static constexpr const char* NESTED = "void main() {bool b = true and false}";
+};
+
+string transpile(const string& program)
+{
+  stringstream in(program);
+  stringstream out;
+  MyPLtoJavaTranspiler transpiler(out);
+  JavaASTParser(JavaLexer(in)).parse().accept(transpiler);
+  return out.str();
+}
+
+string contents(const filesystem::path& file)
+{
+  ifstream in(file);
+  return string {istreambuf_iterator<char>(in), istreambuf_iterator<char>()};
+}
+
+TEST (MyPLtoJavaTranspilerTests, BatchTranspilesEachFile) {
+  BatchDirectory dir;
+  JavaBatchStats stats = JavaBatchTranspiler((dir.path / "in").string(),
+                                             (dir.path / "out").string(), 2).run();
+  EXPECT_EQ(3, stats.files);
+  EXPECT_EQ(1, stats.failed);
+  EXPECT_EQ(2, stats.threads);
+  // the same relative path (each as transpiled alone, plus a newline)
+  EXPECT_EQ(transpile(BatchDirectory::GOOD) + "\n",
+            contents(dir.path / "out" / "good.java"));
+  EXPECT_EQ(transpile(BatchDirectory::NESTED) + "\n",
+            contents(dir.path / "out" / "sub" / "nested.java"));
+  EXPECT_FALSE(filesystem::exists(dir.path / "out" / "notes.java"));
+  EXPECT_EQ(0, to_string(stats).find("Transpiled 2 of 3 files"));
+}
+
+TEST (MyPLtoJavaTranspilerTests, BatchReportsEachFailedFile) {
+  BatchDirectory dir;
+  JavaBatchStats stats = JavaBatchTranspiler((dir.path / "in").string(),
+                                             (dir.path / "out").string(), 8).run();
+  // (no more threads than files)
+  EXPECT_EQ(3, stats.threads);
+  ASSERT_EQ(1, stats.errors.size());
+  EXPECT_EQ((dir.path / "in" / "bad.mypl").string(), stats.errors[0].first);
+  EXPECT_EQ(0, stats.errors[0].second.find("Parser Error"));
+  EXPECT_FALSE(filesystem::exists(dir.path / "out" / "bad.java"));
+  EXPECT_THROW(JavaBatchTranspiler((dir.path / "missing").string(),
+                                   (dir.path / "out").string()).run(),
+               MyPLException);
+}
+
 //----------------------------------------------------------------------
 // main
 //----------------------------------------------------------------------